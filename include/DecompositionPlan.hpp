@@ -0,0 +1,87 @@
+#ifndef DECOMPOSITIONPLAN_HPP
+#define DECOMPOSITIONPLAN_HPP
+//!\file
+//!\brief Reusable precomputed state for multilevel decomposition and
+//! recomposition.
+
+#include <cstddef>
+
+#include <memory>
+#include <vector>
+
+#include "TensorMeshHierarchy.hpp"
+#include "TensorProjection.hpp"
+#include "TensorProlongation.hpp"
+#include "TensorSpearLayout.hpp"
+
+namespace mgard {
+
+//! Operators and workspace needed to decompose and recompose functions
+//! defined on a mesh hierarchy.
+//!
+//! Constructing the per-level operators (in particular, the spear layouts and
+//! the mass matrix inverse divisors) and allocating the workspace is done once,
+//! in the constructor. The plan can then be used to decompose and recompose any
+//! number of datasets defined on the hierarchy.
+//!
+//! The decomposition can be stopped short of the coarsest mesh. In that case
+//! the coefficients of the nodes of the `l_target`th mesh are the nodal values
+//! of the projection onto that mesh, and the other coefficients are the usual
+//! multilevel coefficients.
+//!
+//! IMPORTANT: The plan keeps a reference to the hierarchy, which must outlive
+//! it. Because the workspace is shared, a plan must not be used to decompose or
+//! recompose more than one dataset at a time.
+template <std::size_t N, typename Real> class DecompositionPlan {
+public:
+  //! Constructor.
+  //!
+  //!\param hierarchy Mesh hierarchy on which the functions are defined.
+  //!\param ordering Order of the arrays to be decomposed and recomposed.
+  //!\param l_target Index of the coarsest mesh to decompose onto.
+  explicit DecompositionPlan(
+      const TensorMeshHierarchy<N, Real> &hierarchy,
+      const NodeOrdering ordering = NodeOrdering::Shuffled,
+      const std::size_t l_target = 0);
+
+  //! Transform nodal coefficients into multilevel coefficients.
+  //!
+  //!\param[in, out] v Nodal coefficients of the input function on the finest
+  //! mesh in the hierarchy, in the plan's ordering.
+  void decompose(Real *const v);
+
+  //! Transform multilevel coefficients into nodal coefficients.
+  //!
+  //!\param[in, out] v Multilevel coefficients of the output function on the
+  //! finest mesh in the hierarchy, in the plan's ordering.
+  void recompose(Real *const v);
+
+  //! Mesh hierarchy on which the functions are defined.
+  const TensorMeshHierarchy<N, Real> &hierarchy;
+
+  //! Order of the arrays to be decomposed and recomposed.
+  const NodeOrdering ordering;
+
+  //! Index of the coarsest mesh onto which functions are decomposed.
+  const std::size_t l_target;
+
+private:
+  // The operators for the `l`th level (`l_target < l ≤ L`) are stored at index
+  // `l - l_target - 1`. The tensor operators hold pointers to their own
+  // members, so they are allocated individually and never copied.
+
+  //! Projections from the fine mesh to the coarse mesh of each level.
+  std::vector<std::unique_ptr<const TensorProjection<N, Real>>> projections;
+
+  //! Prolongations from the coarse mesh to the fine mesh of each level.
+  std::vector<std::unique_ptr<const TensorProlongationAddition<N, Real>>>
+      prolongation_additions;
+
+  //! Workspace the size of the finest mesh.
+  std::vector<Real> buffer;
+};
+
+} // namespace mgard
+
+#include "DecompositionPlan.tpp"
+#endif
@@ -0,0 +1,207 @@
+#include <array>
+#include <stdexcept>
+#include <vector>
+
+namespace mgard {
+
+namespace {
+
+//! Visit the nodes of a mesh.
+//!
+//! `f` is called as `f(i, is_new)` for each node of the `l`th mesh, where `i`
+//! is the position of the node in arrays of the given ordering and `is_new`
+//! indicates whether the node is new to the `l`th mesh.
+template <std::size_t N, typename Real, typename F>
+void for_each_node(const TensorMeshHierarchy<N, Real> &hierarchy,
+                   const NodeOrdering ordering, const std::size_t l, F &&f) {
+  if (ordering == NodeOrdering::Shuffled) {
+    // The nodes of the `l`th mesh come first, with the new nodes last.
+    const std::size_t old_ndof = l ? hierarchy.ndof(l - 1) : 0;
+    const std::size_t ndof = hierarchy.ndof(l);
+#pragma omp parallel for
+    for (std::size_t i = 0; i < old_ndof; ++i) {
+      f(i, false);
+    }
+#pragma omp parallel for
+    for (std::size_t i = old_ndof; i < ndof; ++i) {
+      f(i, true);
+    }
+    return;
+  }
+
+  // Walk the rows (the 'spears' along the last dimension) of the mesh.
+  const std::array<std::size_t, N> &SHAPE = hierarchy.shapes.back();
+  const std::array<std::size_t, N> &shape = hierarchy.shapes.at(l);
+  std::array<std::vector<std::size_t>, N> indices;
+  std::array<std::size_t, N> strides;
+  std::size_t stride = 1;
+  for (std::size_t k = 0; k < N; ++k) {
+    const std::size_t i = N - 1 - k;
+    const TensorIndexRange range = hierarchy.indices(l, i);
+    indices.at(i).assign(range.begin(), range.end());
+    strides.at(i) = stride;
+    stride *= SHAPE.at(i);
+  }
+  const std::vector<std::size_t> &last_indices = indices.back();
+  const std::vector<std::size_t> &last_dates_of_birth =
+      hierarchy.dates_of_birth.back();
+  const std::size_t n = shape.back();
+  const std::size_t nrows = hierarchy.ndof(l) / n;
+
+#pragma omp parallel for
+  for (std::size_t r = 0; r < nrows; ++r) {
+    std::size_t base = 0;
+    bool row_is_new = false;
+    std::size_t remainder = r;
+    for (std::size_t k = 1; k < N; ++k) {
+      const std::size_t i = N - 1 - k;
+      const std::size_t index = indices[i][remainder % shape[i]];
+      remainder /= shape[i];
+      base += index * strides[i];
+      row_is_new = row_is_new || hierarchy.dates_of_birth[i][index] == l;
+    }
+    for (std::size_t k = 0; k < n; ++k) {
+      const std::size_t index = last_indices[k];
+      f(base + index, row_is_new || last_dates_of_birth[index] == l);
+    }
+  }
+}
+
+// Not documenting the parameters here. I think it'll be easiest to understand
+// by reading the code.
+
+template <std::size_t N, typename Real>
+void add_on_old_add_on_new(const TensorMeshHierarchy<N, Real> &hierarchy,
+                           const NodeOrdering ordering, Real const *const src,
+                           Real *const dst, const std::size_t l) {
+  for_each_node(hierarchy, ordering, l,
+                [&](const std::size_t i, const bool) { dst[i] += src[i]; });
+}
+
+template <std::size_t N, typename Real>
+void subtract_on_old_zero_on_new(const TensorMeshHierarchy<N, Real> &hierarchy,
+                                 const NodeOrdering ordering,
+                                 Real const *const src, Real *const dst,
+                                 const std::size_t l) {
+  for_each_node(hierarchy, ordering, l,
+                [&](const std::size_t i, const bool is_new) {
+                  if (is_new) {
+                    dst[i] = 0;
+                  } else {
+                    dst[i] -= src[i];
+                  }
+                });
+}
+
+template <std::size_t N, typename Real>
+void copy_negation_on_old_subtract_on_new(
+    const TensorMeshHierarchy<N, Real> &hierarchy, const NodeOrdering ordering,
+    Real const *const src, Real *const dst, const std::size_t l) {
+  for_each_node(hierarchy, ordering, l,
+                [&](const std::size_t i, const bool is_new) {
+                  if (is_new) {
+                    dst[i] -= src[i];
+                  } else {
+                    dst[i] = -src[i];
+                  }
+                });
+}
+
+template <std::size_t N, typename Real>
+void copy_on_old_zero_on_new(const TensorMeshHierarchy<N, Real> &hierarchy,
+                             const NodeOrdering ordering, Real const *const src,
+                             Real *const dst, const std::size_t l) {
+  for_each_node(hierarchy, ordering, l,
+                [&](const std::size_t i, const bool is_new) {
+                  dst[i] = is_new ? 0 : src[i];
+                });
+}
+
+template <std::size_t N, typename Real>
+void subtract_on_new(const TensorMeshHierarchy<N, Real> &hierarchy,
+                     const NodeOrdering ordering, Real const *const src,
+                     Real *const dst, const std::size_t l) {
+  for_each_node(hierarchy, ordering, l,
+                [&](const std::size_t i, const bool is_new) {
+                  if (is_new) {
+                    dst[i] -= src[i];
+                  }
+                });
+}
+
+} // namespace
+
+template <std::size_t N, typename Real>
+DecompositionPlan<N, Real>::DecompositionPlan(
+    const TensorMeshHierarchy<N, Real> &hierarchy, const NodeOrdering ordering,
+    const std::size_t l_target)
+    : hierarchy(hierarchy), ordering(ordering), l_target(l_target),
+      buffer(hierarchy.ndof()) {
+  const std::size_t L = hierarchy.L;
+  if (l_target > L) {
+    throw std::out_of_range("mesh index out of range encountered");
+  }
+  projections.reserve(L - l_target);
+  prolongation_additions.reserve(L - l_target);
+  for (std::size_t l = l_target + 1; l <= L; ++l) {
+    projections.emplace_back(
+        new TensorProjection<N, Real>(hierarchy, l, ordering));
+    prolongation_additions.emplace_back(
+        new TensorProlongationAddition<N, Real>(hierarchy, l, ordering));
+  }
+}
+
+template <std::size_t N, typename Real>
+void DecompositionPlan<N, Real>::decompose(Real *const v) {
+  Real *const buffer = this->buffer.data();
+  for (std::size_t l = hierarchy.L; l > l_target; --l) {
+    // We start with `Q_{l}u` on `nodes(l)` of `v`. First we copy the values on
+    // `old_nodes(l)` to `buffer`. At the same time, we zero the values on
+    // `new_nodes(l)` of `buffer` in preparation for the interpolation routine.
+    copy_on_old_zero_on_new(hierarchy, ordering, v, buffer, l);
+    // Now we have `Π_{l - 1}Q_{l}u` on `old_nodes(l)` of `buffer` and zeros on
+    // `new_nodes(l)` of `buffer`. Time to interpolate.
+    prolongation_additions[l - l_target - 1]->operator()(buffer);
+    // Now we have `Π_{l - 1}Q_{l}u` on `nodes(l)` (that is, on both
+    // `old_nodes(l)` and `new_nodes(l)`) of `buffer`. `Q_{l}u` is still on
+    // `nodes(l)` of `v`. We subtract the values on `new_nodes(l)` of `buffer`
+    // from the values on `new_nodes(l)` of `v`.
+    subtract_on_new(hierarchy, ordering, buffer, v, l);
+    // Now we have `(I - Π_{l - 1})Q_{l}u` on `new_nodes(l)` of `v`. This
+    // function vanishes on `old_nodes(l)`, which is how the projection treats
+    // `old_nodes(l)` of `v`, so there is no need to zero them in a copy. Time
+    // to project.
+    projections[l - l_target - 1]->operator()(v, buffer);
+    // Now we have `Q_{l - 1}u - Π_{l - 1}Q_{l}u` on `old_nodes(l)` of `buffer`.
+    // Time to correct `Π_{l - 1}Q_{l}u` on `old_nodes(l)` of `v`.
+    add_on_old_add_on_new(hierarchy, ordering, buffer, v, l - 1);
+    // Now we have `(I - Π_{l - 1})Q_{l}u` on `new_nodes(l)` of `v` and
+    // `Q_{l - 1}u` on `old_nodes(l)` of `v`.
+  }
+}
+
+template <std::size_t N, typename Real>
+void DecompositionPlan<N, Real>::recompose(Real *const v) {
+  Real *const buffer = this->buffer.data();
+  for (std::size_t l = l_target + 1; l <= hierarchy.L; ++l) {
+    // We start with `Q_{l - 1}u` on `old_nodes(l)` of `v` and
+    // `(I - Π_{l - 1})Q_{l}u` on `new_nodes(l)` of `v`. We begin by projecting
+    // `(I - Π_{l - 1})Q_{l}u`, which vanishes on `old_nodes(l)`. The
+    // projection reads only `new_nodes(l)` of `v`, so no copy is needed.
+    projections[l - l_target - 1]->operator()(v, buffer);
+    // Now we have `Q_{l - 1}u - Π_{l - 1}Q_{l}u` on `old_nodes(l)` of `buffer`.
+    // We can subtract `Q_{l - 1}u` (on `old_nodes(l)` of `v`) to obtain
+    // `-Π_{l - 1}Q_{l}u`.
+    subtract_on_old_zero_on_new(hierarchy, ordering, v, buffer, l);
+    // Now we have `-Π_{l - 1}Q_{l}u` on `old_nodes(l)` of buffer. In addition,
+    // we have zeros on `new_nodes(l)` of buffer, so we're ready to use
+    // `TensorProlongationAddition`.
+    prolongation_additions[l - l_target - 1]->operator()(buffer);
+    // Now we have `-Π_{l - 1}Q_{l}u` on `nodes(l)` of `buffer`. Subtracting
+    // from `(I - Π_{l - 1})Q_{l}u`, we'll recover the projection.
+    copy_negation_on_old_subtract_on_new(hierarchy, ordering, buffer, v, l);
+    // Now we have `Q_{l}u` on `nodes(l)` of `v`.
+  }
+}
+
+} // namespace mgard
@@ -0,0 +1,155 @@
+#ifndef REGIONRECOMPOSITIONPLAN_HPP
+#define REGIONRECOMPOSITIONPLAN_HPP
+//!\file
+//!\brief Recomposition of a function on a box in the finest mesh.
+
+#include <cstddef>
+
+#include <array>
+#include <vector>
+
+#include "TensorMeshHierarchy.hpp"
+
+namespace mgard {
+
+//! Number of coarse nodes by which the windows of a `RegionRecompositionPlan`
+//! extend past the nodes whose values are needed.
+//!
+//! The entries of the inverse of a (one-dimensional) mass matrix decay at
+//! least as fast as `(2 - sqrt(3))^k`, where `k` is the distance from the
+//! diagonal, whatever the node spacing. Over this many nodes they decay by a
+//! factor of about `5e-19`.
+constexpr std::size_t region_halo = 32;
+
+//! Operators and windows needed to recompose a function on a box in the
+//! finest mesh of a hierarchy.
+//!
+//! The value of the function at a node depends on the multilevel coefficients
+//! near it, and on the values on the next coarser mesh near it. Those values
+//! in turn depend on the projections of the coefficients, which aren't local:
+//! the inverse of the coarse mass matrix couples every node of a 'spear.' The
+//! entries of the inverse decay exponentially away from the diagonal, though,
+//! so each level is recomposed on a window extending `region_halo` coarse nodes
+//! past the nodes needed by the next level, as though the window were the
+//! whole domain. The values near the edges of the window are spoiled by the
+//! truncation, but the error has decayed below rounding error by the time it
+//! reaches the nodes which are kept. Where a window reaches the boundary of the
+//! domain nothing is truncated.
+//!
+//! If the function was decomposed only down to the `l_target`th mesh (see
+//! `DecompositionPlan`), recomposition starts from the values of the function
+//! on that mesh.
+//!
+//! Window arrays are stored in row-major order on the window.
+template <std::size_t N, typename Real> class RegionRecompositionPlan {
+public:
+  //! Constructor.
+  //!
+  //!\param hierarchy Mesh hierarchy on which the function is defined.
+  //!\param lower Multiindex of the lower corner of the box.
+  //!\param upper Multiindex of the upper corner of the box. The box includes
+  //! this node.
+  //!\param l_target Index of the coarsest mesh onto which the function was
+  //! decomposed.
+  RegionRecompositionPlan(const TensorMeshHierarchy<N, Real> &hierarchy,
+                          const std::array<std::size_t, N> &lower,
+                          const std::array<std::size_t, N> &upper,
+                          const std::size_t l_target = 0);
+
+  //! Report the number of nodes in the box.
+  std::size_t ndof() const;
+
+  //! Report the number of nodes in the window of a level.
+  //!
+  //!\param l Index of the level.
+  std::size_t ndof(const std::size_t l) const;
+
+  //! Visit the nodes of the window of a level which are new to that level.
+  //!
+  //! `f` is called as `f(multiindex, k)`, where `multiindex` is the multiindex
+  //! of the node in the finest mesh and `k` is its position in window arrays.
+  //! The nodes are visited in order. All the nodes of the window of the
+  //! `l_target`th level are treated as new to it.
+  //!
+  //!\param l Index of the level. Must be at least `l_target`.
+  //!\param f Function to call on each node.
+  template <typename F>
+  void for_each_new_node(const std::size_t l, F &&f) const;
+
+  //! Recompose the function on the box.
+  //!
+  //! `coefficients` is called as `coefficients(l, w)` for each level from the
+  //! `l_target`th up in increasing order, where `w` is a window array of the
+  //! level filled with zeros. It must write the multilevel coefficients of the
+  //! nodes new to the level (see `for_each_new_node`) to `w`, leaving the other
+  //! entries alone.
+  //!
+  //!\param coefficients Function supplying the multilevel coefficients.
+  //!\param v Buffer of size `ndof()` in which to store the values of the
+  //! function on the box, in row-major order.
+  template <typename F> void recompose(F &&coefficients, Real *const v) const;
+
+  //! Associated mesh hierarchy.
+  const TensorMeshHierarchy<N, Real> &hierarchy;
+
+  //! Shape of the box.
+  std::array<std::size_t, N> shape;
+
+  //! Index of the coarsest mesh onto which the function was decomposed.
+  const std::size_t l_target;
+
+private:
+  //! Operators of a level along one dimension of its window.
+  struct Spear {
+    //! Whether the level introduces any nodes along the spear. If not, the
+    //! projection and the interpolation are both the identity.
+    bool refined = false;
+
+    //! Number of nodes of the spear.
+    std::size_t n = 0;
+
+    //! Number of coarse nodes of the spear.
+    std::size_t m = 0;
+
+    //! Mass matrix entries. See `ConstituentProjection`.
+    std::vector<Real> mass_subdiagonal;
+    std::vector<Real> mass_diagonal;
+    std::vector<Real> mass_superdiagonal;
+
+    //! For each node, the position among the coarse nodes of the coarse node
+    //! to its left (or of the node itself, if it is coarse).
+    std::vector<std::size_t> left_coarse_positions;
+
+    //! Restriction and interpolation weights. See `ConstituentProjection`.
+    std::vector<Real> left_weights;
+    std::vector<Real> right_weights;
+
+    //! Factorization of the coarse mass matrix used by the Thomas algorithm.
+    std::vector<Real> solve_subdiagonal;
+    std::vector<Real> solve_reciprocals;
+    std::vector<Real> solve_superdiagonal;
+  };
+
+  //! For each level, for each dimension, the indices in the finest mesh of the
+  //! nodes of the level's window.
+  std::vector<std::array<std::vector<std::size_t>, N>> windows;
+
+  //! For each level, the position in the window of the first node kept for
+  //! the next level (or of the first node of the box, for the finest level).
+  std::vector<std::array<std::size_t, N>> kept_offsets;
+
+  //! For each level, the shape of the nodes kept for the next level.
+  std::vector<std::array<std::size_t, N>> kept_shapes;
+
+  //! For each level after the `l_target`th, the operators of the level along
+  //! each dimension.
+  std::vector<std::array<Spear, N>> spears;
+
+  //! Compute the shape of the window of a level.
+  std::array<std::size_t, N> window_shape(const std::size_t l) const;
+};
+
+} // namespace mgard
+
+#include "RegionRecompositionPlan.tpp"
+#endif
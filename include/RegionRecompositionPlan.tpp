@@ -0,0 +1,489 @@
+#include <algorithm>
+#include <stdexcept>
+
+namespace mgard {
+
+namespace {
+
+//! Count the spears along a dimension of an array, split into the number
+//! preceding and following the dimension in row-major order.
+template <std::size_t N>
+void spear_counts(const std::array<std::size_t, N> &shape,
+                  const std::size_t dimension, std::size_t &outer,
+                  std::size_t &inner) {
+  outer = 1;
+  inner = 1;
+  for (std::size_t i = 0; i < N; ++i) {
+    if (i < dimension) {
+      outer *= shape.at(i);
+    } else if (i > dimension) {
+      inner *= shape.at(i);
+    }
+  }
+}
+
+//! Increment a multiindex in row-major order.
+template <std::size_t N>
+void increment(const std::array<std::size_t, N> &shape,
+               std::array<std::size_t, N> &multiindex) {
+  for (std::size_t k = 0; k < N; ++k) {
+    const std::size_t i = N - 1 - k;
+    if (++multiindex[i] < shape[i]) {
+      return;
+    }
+    multiindex[i] = 0;
+  }
+}
+
+} // namespace
+
+template <std::size_t N, typename Real>
+RegionRecompositionPlan<N, Real>::RegionRecompositionPlan(
+    const TensorMeshHierarchy<N, Real> &hierarchy,
+    const std::array<std::size_t, N> &lower,
+    const std::array<std::size_t, N> &upper, const std::size_t l_target)
+    : hierarchy(hierarchy), l_target(l_target), windows(hierarchy.L + 1),
+      kept_offsets(hierarchy.L + 1), kept_shapes(hierarchy.L + 1),
+      spears(hierarchy.L + 1) {
+  const std::array<std::size_t, N> &SHAPE = hierarchy.shapes.back();
+  // Indices in the finest mesh of the nodes needed from the level currently
+  // being processed.
+  std::array<std::vector<std::size_t>, N> needed;
+  if (l_target > hierarchy.L) {
+    throw std::out_of_range("mesh index out of range encountered");
+  }
+  for (std::size_t i = 0; i < N; ++i) {
+    if (upper.at(i) >= SHAPE.at(i)) {
+      throw std::out_of_range("region extends past the finest mesh");
+    }
+    if (lower.at(i) > upper.at(i)) {
+      throw std::invalid_argument("region corners are out of order");
+    }
+    shape.at(i) = upper.at(i) - lower.at(i) + 1;
+    for (std::size_t index = lower.at(i); index <= upper.at(i); ++index) {
+      needed.at(i).push_back(index);
+    }
+  }
+
+  for (std::size_t l = hierarchy.L; l > l_target; --l) {
+    for (std::size_t i = 0; i < N; ++i) {
+      const std::vector<std::size_t> &dates_of_birth =
+          hierarchy.dates_of_birth.at(i);
+      const TensorIndexRange range = hierarchy.indices(l, i);
+      const std::vector<std::size_t> indices(range.begin(), range.end());
+      const auto is_new = [&](const std::size_t j) {
+        return dates_of_birth.at(indices.at(j)) == l;
+      };
+      // Positions in the level's mesh of the ends of the window.
+      const std::vector<std::size_t> &needed_ = needed.at(i);
+      std::size_t a =
+          std::lower_bound(indices.begin(), indices.end(), needed_.front()) -
+          indices.begin();
+      std::size_t b =
+          std::lower_bound(indices.begin(), indices.end(), needed_.back()) -
+          indices.begin();
+      const bool refined =
+          hierarchy.shapes.at(l).at(i) != hierarchy.shapes.at(l - 1).at(i);
+      if (refined) {
+        // The ends of the mesh are always coarse nodes.
+        while (is_new(a)) {
+          --a;
+        }
+        while (is_new(b)) {
+          ++b;
+        }
+        for (std::size_t k = 0; k < region_halo && a; ++k) {
+          while (is_new(--a)) {
+          }
+        }
+        for (std::size_t k = 0; k < region_halo && b + 1 < indices.size();
+             ++k) {
+          while (is_new(++b)) {
+          }
+        }
+      }
+      std::vector<std::size_t> &window = windows.at(l).at(i);
+      window.assign(indices.begin() + a, indices.begin() + b + 1);
+      kept_offsets.at(l).at(i) =
+          std::lower_bound(window.begin(), window.end(), needed_.front()) -
+          window.begin();
+      kept_shapes.at(l).at(i) = needed.at(i).size();
+
+      // The next level is needed on the coarse nodes of the window.
+      needed.at(i).clear();
+      for (const std::size_t index : window) {
+        if (dates_of_birth.at(index) < l) {
+          needed.at(i).push_back(index);
+        }
+      }
+
+      Spear &spear = spears.at(l).at(i);
+      spear.refined = refined;
+      spear.n = window.size();
+      spear.m = needed.at(i).size();
+      if (!refined) {
+        continue;
+      }
+      const std::size_t n = spear.n;
+      const std::size_t m = spear.m;
+      const std::vector<Real> &xs = hierarchy.coordinates.at(i);
+
+      // Mass matrix entries. See `ConstituentMassMatrix`. The window is treated
+      // as though it were the whole domain.
+      spear.mass_subdiagonal.resize(n);
+      spear.mass_diagonal.resize(n);
+      spear.mass_superdiagonal.resize(n);
+      for (std::size_t j = 0; j < n; ++j) {
+        const Real h_left =
+            j ? xs.at(window.at(j)) - xs.at(window.at(j - 1)) : 0;
+        const Real h_right =
+            j + 1 < n ? xs.at(window.at(j + 1)) - xs.at(window.at(j)) : 0;
+        spear.mass_subdiagonal.at(j) = h_left / 6;
+        spear.mass_diagonal.at(j) = (h_left + h_right) / 3;
+        spear.mass_superdiagonal.at(j) = h_right / 6;
+      }
+
+      // Restriction and interpolation weights. See `ConstituentRestriction`.
+      spear.left_coarse_positions.resize(n);
+      spear.left_weights.resize(n);
+      spear.right_weights.resize(n);
+      std::size_t p = 0;
+      for (std::size_t j = 0; j < n; ++j) {
+        if (dates_of_birth.at(window.at(j)) < l) {
+          p = std::lower_bound(needed.at(i).begin(), needed.at(i).end(),
+                               window.at(j)) -
+              needed.at(i).begin();
+          spear.left_coarse_positions.at(j) = p;
+          spear.left_weights.at(j) = 1;
+          spear.right_weights.at(j) = 0;
+        } else {
+          const Real x_left = xs.at(needed.at(i).at(p));
+          const Real x_right = xs.at(needed.at(i).at(p + 1));
+          const Real x_middle = xs.at(window.at(j));
+          const Real width_reciprocal = 1 / (x_right - x_left);
+          spear.left_coarse_positions.at(j) = p;
+          spear.left_weights.at(j) = (x_right - x_middle) * width_reciprocal;
+          spear.right_weights.at(j) = (x_middle - x_left) * width_reciprocal;
+        }
+      }
+
+      // Thomas factorization of the coarse mass matrix.
+      spear.solve_subdiagonal.resize(m);
+      spear.solve_reciprocals.resize(m);
+      spear.solve_superdiagonal.resize(m);
+      for (std::size_t q = 0; q < m; ++q) {
+        const std::vector<std::size_t> &coarse = needed.at(i);
+        const Real h_left =
+            q ? xs.at(coarse.at(q)) - xs.at(coarse.at(q - 1)) : 0;
+        const Real h_right =
+            q + 1 < m ? xs.at(coarse.at(q + 1)) - xs.at(coarse.at(q)) : 0;
+        const Real subdiagonal = h_left / 6;
+        const Real diagonal = (h_left + h_right) / 3;
+        const Real superdiagonal = h_right / 6;
+        const Real pivot =
+            q ? diagonal - subdiagonal * spear.solve_superdiagonal.at(q - 1)
+              : diagonal;
+        spear.solve_subdiagonal.at(q) = subdiagonal;
+        spear.solve_reciprocals.at(q) = 1 / pivot;
+        spear.solve_superdiagonal.at(q) = superdiagonal / pivot;
+      }
+    }
+  }
+  windows.at(l_target) = needed;
+  for (std::size_t i = 0; i < N; ++i) {
+    kept_offsets.at(l_target).at(i) = 0;
+    kept_shapes.at(l_target).at(i) = needed.at(i).size();
+  }
+}
+
+template <std::size_t N, typename Real>
+std::size_t RegionRecompositionPlan<N, Real>::ndof() const {
+  std::size_t product = 1;
+  for (const std::size_t n : shape) {
+    product *= n;
+  }
+  return product;
+}
+
+template <std::size_t N, typename Real>
+std::size_t RegionRecompositionPlan<N, Real>::ndof(const std::size_t l) const {
+  std::size_t product = 1;
+  for (const std::vector<std::size_t> &window : windows.at(l)) {
+    product *= window.size();
+  }
+  return product;
+}
+
+template <std::size_t N, typename Real>
+std::array<std::size_t, N>
+RegionRecompositionPlan<N, Real>::window_shape(const std::size_t l) const {
+  std::array<std::size_t, N> window;
+  for (std::size_t i = 0; i < N; ++i) {
+    window.at(i) = windows.at(l).at(i).size();
+  }
+  return window;
+}
+
+template <std::size_t N, typename Real>
+template <typename F>
+void RegionRecompositionPlan<N, Real>::for_each_new_node(const std::size_t l,
+                                                         F &&f) const {
+  const std::array<std::vector<std::size_t>, N> &window = windows.at(l);
+  const std::array<std::size_t, N> window_shape_ = window_shape(l);
+  const std::size_t n = ndof(l);
+  std::array<std::size_t, N> position;
+  position.fill(0);
+  std::array<std::size_t, N> multiindex;
+  for (std::size_t k = 0; k < n; ++k, increment(window_shape_, position)) {
+    std::size_t date_of_birth = 0;
+    for (std::size_t i = 0; i < N; ++i) {
+      const std::size_t index = window[i][position[i]];
+      multiindex[i] = index;
+      date_of_birth =
+          std::max(date_of_birth, hierarchy.dates_of_birth[i][index]);
+    }
+    if (date_of_birth == l || l == l_target) {
+      f(multiindex, k);
+    }
+  }
+}
+
+namespace {
+
+//! Project a window array onto the coarse nodes along one dimension.
+//!
+//! The mass matrix is applied, the product restricted, and the coarse mass
+//! matrix inverted, as in `ConstituentProjection`, but on a window array.
+template <std::size_t N, typename Real, typename Spear>
+void project_window(const Spear &spear, const std::array<std::size_t, N> &shape,
+                    const std::size_t dimension, Real const *const u,
+                    Real *const v) {
+  const std::size_t n = spear.n;
+  const std::size_t m = spear.m;
+  std::size_t outer;
+  std::size_t inner;
+  spear_counts(shape, dimension, outer, inner);
+#pragma omp parallel
+  {
+    std::vector<Real> product(inner);
+    Real *const y = product.data();
+#pragma omp for
+    for (std::size_t o = 0; o < outer; ++o) {
+      Real const *const w = u + o * n * inner;
+      Real *const d = v + o * m * inner;
+      std::fill(d, d + m * inner, 0);
+      for (std::size_t j = 0; j < n; ++j) {
+        Real const *const w_middle = w + j * inner;
+        const Real b = spear.mass_diagonal[j];
+#pragma omp simd
+        for (std::size_t k = 0; k < inner; ++k) {
+          y[k] = b * w_middle[k];
+        }
+        if (j) {
+          Real const *const w_left = w_middle - inner;
+          const Real a = spear.mass_subdiagonal[j];
+#pragma omp simd
+          for (std::size_t k = 0; k < inner; ++k) {
+            y[k] += a * w_left[k];
+          }
+        }
+        if (j + 1 < n) {
+          Real const *const w_right = w_middle + inner;
+          const Real c = spear.mass_superdiagonal[j];
+#pragma omp simd
+          for (std::size_t k = 0; k < inner; ++k) {
+            y[k] += c * w_right[k];
+          }
+        }
+        Real *const d_left = d + spear.left_coarse_positions[j] * inner;
+        const Real weight_left = spear.left_weights[j];
+        const Real weight_right = spear.right_weights[j];
+#pragma omp simd
+        for (std::size_t k = 0; k < inner; ++k) {
+          d_left[k] += weight_left * y[k];
+        }
+        if (weight_right) {
+          Real *const d_right = d_left + inner;
+#pragma omp simd
+          for (std::size_t k = 0; k < inner; ++k) {
+            d_right[k] += weight_right * y[k];
+          }
+        }
+      }
+
+      // Forward elimination and back substitution.
+      for (std::size_t p = 0; p < m; ++p) {
+        Real *const d_p = d + p * inner;
+        const Real reciprocal = spear.solve_reciprocals[p];
+        if (p) {
+          Real const *const d_previous = d_p - inner;
+          const Real a = spear.solve_subdiagonal[p];
+#pragma omp simd
+          for (std::size_t k = 0; k < inner; ++k) {
+            d_p[k] = (d_p[k] - a * d_previous[k]) * reciprocal;
+          }
+        } else {
+#pragma omp simd
+          for (std::size_t k = 0; k < inner; ++k) {
+            d_p[k] *= reciprocal;
+          }
+        }
+      }
+      for (std::size_t p = m - 1; p > 0; --p) {
+        Real *const d_p = d + p * inner;
+        Real *const d_previous = d_p - inner;
+        const Real c = spear.solve_superdiagonal[p - 1];
+#pragma omp simd
+        for (std::size_t k = 0; k < inner; ++k) {
+          d_previous[k] -= c * d_p[k];
+        }
+      }
+    }
+  }
+}
+
+//! Interpolate a window array from the coarse nodes along one dimension.
+template <std::size_t N, typename Real, typename Spear>
+void interpolate_window(const Spear &spear,
+                        const std::array<std::size_t, N> &shape,
+                        const std::size_t dimension, Real const *const u,
+                        Real *const v) {
+  const std::size_t n = spear.n;
+  const std::size_t m = spear.m;
+  std::size_t outer;
+  std::size_t inner;
+  spear_counts(shape, dimension, outer, inner);
+#pragma omp parallel for
+  for (std::size_t o = 0; o < outer; ++o) {
+    for (std::size_t j = 0; j < n; ++j) {
+      Real const *const z =
+          u + (o * m + spear.left_coarse_positions[j]) * inner;
+      Real *const y = v + (o * n + j) * inner;
+      const Real weight_left = spear.left_weights[j];
+      const Real weight_right = spear.right_weights[j];
+      if (weight_right) {
+#pragma omp simd
+        for (std::size_t k = 0; k < inner; ++k) {
+          y[k] = weight_left * z[k] + weight_right * z[k + inner];
+        }
+      } else {
+        std::copy(z, z + inner, y);
+      }
+    }
+  }
+}
+
+//! Copy a box out of a window array.
+template <std::size_t N, typename Real>
+void crop_window(const std::array<std::size_t, N> &shape, Real const *const u,
+                 const std::array<std::size_t, N> &offsets,
+                 const std::array<std::size_t, N> &cropped_shape,
+                 Real *const v) {
+  std::array<std::size_t, N> strides;
+  std::size_t stride = 1;
+  for (std::size_t k = 0; k < N; ++k) {
+    const std::size_t i = N - 1 - k;
+    strides.at(i) = stride;
+    stride *= shape.at(i);
+  }
+  const std::size_t n = cropped_shape.back();
+  std::size_t nrows = 1;
+  for (std::size_t i = 0; i + 1 < N; ++i) {
+    nrows *= cropped_shape.at(i);
+  }
+  std::array<std::size_t, N> row;
+  row.fill(0);
+  for (std::size_t r = 0; r < nrows; ++r) {
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < N; ++i) {
+      offset += (offsets[i] + row[i]) * strides[i];
+    }
+    std::copy(u + offset, u + offset + n, v + r * n);
+    // Move to the next row by incrementing the leading indices.
+    for (std::size_t k = 1; k < N; ++k) {
+      const std::size_t i = N - 1 - k;
+      if (++row[i] < cropped_shape[i]) {
+        break;
+      }
+      row[i] = 0;
+    }
+  }
+}
+
+} // namespace
+
+template <std::size_t N, typename Real>
+template <typename F>
+void RegionRecompositionPlan<N, Real>::recompose(F &&coefficients,
+                                                 Real *const v) const {
+  const std::size_t L = hierarchy.L;
+  // Every node of the `l_target`th mesh is treated as new to it, so the
+  // 'coefficients' there are the values of the function.
+  std::vector<Real> values(ndof(l_target), 0);
+  coefficients(static_cast<std::size_t>(l_target), values.data());
+  std::vector<Real> w;
+  std::vector<Real> projection;
+  std::vector<Real> buffer;
+  for (std::size_t l = l_target + 1; l <= L; ++l) {
+    const std::array<std::size_t, N> window = window_shape(l);
+    w.assign(ndof(l), 0);
+    coefficients(l, w.data());
+
+    // We start with `Q_{l - 1}u` on the coarse nodes of the window in `values`
+    // and `(I - Π_{l - 1})Q_{l}u` on the new nodes of the window in `w`. See
+    // `DecompositionPlan::recompose`.
+    std::array<std::size_t, N> shape_ = window;
+    projection = w;
+    for (std::size_t i = 0; i < N; ++i) {
+      const Spear &spear = spears[l][i];
+      if (!spear.refined) {
+        continue;
+      }
+      buffer.resize(projection.size() / spear.n * spear.m);
+      project_window(spear, shape_, i, projection.data(), buffer.data());
+      shape_[i] = spear.m;
+      projection.swap(buffer);
+    }
+    // Now we have `Q_{l - 1}u - Π_{l - 1}Q_{l}u` on the coarse nodes in
+    // `projection`. Subtracting from `values`, we get `Π_{l - 1}Q_{l}u`.
+    const std::size_t ncoarse = values.size();
+#pragma omp parallel for
+    for (std::size_t k = 0; k < ncoarse; ++k) {
+      values[k] -= projection[k];
+    }
+    for (std::size_t i = 0; i < N; ++i) {
+      const Spear &spear = spears[l][i];
+      if (!spear.refined) {
+        continue;
+      }
+      buffer.resize(values.size() / spear.m * spear.n);
+      interpolate_window(spear, shape_, i, values.data(), buffer.data());
+      shape_[i] = spear.n;
+      values.swap(buffer);
+    }
+    // Now we have `Π_{l - 1}Q_{l}u` on all the nodes of the window. Adding
+    // `(I - Π_{l - 1})Q_{l}u`, we recover `Q_{l}u`.
+    const std::size_t nfine = values.size();
+#pragma omp parallel for
+    for (std::size_t k = 0; k < nfine; ++k) {
+      values[k] += w[k];
+    }
+
+    // Only the nodes needed by the next level are accurate enough to keep.
+    if (l == L) {
+      crop_window(window, values.data(), kept_offsets[l], kept_shapes[l], v);
+      return;
+    }
+    std::size_t nkept = 1;
+    for (const std::size_t n : kept_shapes[l]) {
+      nkept *= n;
+    }
+    buffer.resize(nkept);
+    crop_window(window, values.data(), kept_offsets[l], kept_shapes[l],
+                buffer.data());
+    values.swap(buffer);
+  }
+  std::copy(values.begin(), values.end(), v);
+}
+
+} // namespace mgard
@@ -7,11 +7,24 @@
 #include <cstddef>
 
 #include <array>
+#include <vector>
 
 #include "TensorMeshHierarchy.hpp"
+#include "TensorSpearLayout.hpp"
 
 namespace mgard {
 
+// Forward declaration.
+template <std::size_t N, typename Real> class TensorLinearOperator;
+
+//! Number of 'spears' to which constituent operators are applied at once.
+//!
+//! One value from each spear in a batch fills a 64-byte cache line, which is
+//! also a whole number of SIMD registers on the usual targets (SSE, NEON, AVX2,
+//! AVX-512).
+template <typename Real>
+constexpr std::size_t spear_batch_size = 64 / sizeof(Real);
+
 //! Linear operator \f$R^{N} \to R^{N}\f$ with respect to some fixed bases.
 //!
 //! These operators are designed to be tensored together to form a
@@ -31,8 +44,12 @@ public:
   //!\param l Index of the mesh on which the operator is to be applied.
   //!\param dimension Index of the dimension in which the operator is to
   //! be applied.
-  ConstituentLinearOperator(const TensorMeshHierarchy<N, Real> &hierarchy,
-                            const std::size_t l, const std::size_t dimension);
+  //!\param ordering Order of the arrays to which the operator is to be
+  //! applied.
+  ConstituentLinearOperator(
+      const TensorMeshHierarchy<N, Real> &hierarchy, const std::size_t l,
+      const std::size_t dimension,
+      const NodeOrdering ordering = NodeOrdering::Shuffled);
 
   //! Return the dimension of the domain and range.
   //!
@@ -49,6 +66,20 @@ public:
   void operator()(const std::array<std::size_t, N> multiindex,
                   Real *const v) const;
 
+  //! Apply the operator to several elements in place.
+  //!
+  //! The result is the same as applying the operator to each 'spear' in turn.
+  //! Derived classes may override `do_batched_operator_parentheses` to process
+  //! the spears together.
+  //!
+  //!\param [in] multiindices Starting multiindices of the 'spears' along which
+  //! the operator is to be applied.
+  //!\param [in] n Number of 'spears.'
+  //!\param [in, out] v Element in the domain, to be transformed into an element
+  //! in the range.
+  void operator()(std::array<std::size_t, N> const *const multiindices,
+                  const std::size_t n, Real *const v) const;
+
 protected:
   //! Mesh hierarchy on which the domain and range are defined.
   TensorMeshHierarchy<N, Real> const *hierarchy;
@@ -59,10 +90,70 @@ protected:
   //! Indices of the 'spear' in the chosen dimension.
   TensorIndexRange indices;
 
+  //! Positions in arrays of the nodes of the 'spears'.
+  TensorSpearLayout<N, Real> layout;
+
 private:
+  // `TensorLinearOperator` only generates valid 'spears,' so it skips the
+  // checks in `operator()`.
+  friend class TensorLinearOperator<N, Real>;
+
   virtual void
   do_operator_parentheses(const std::array<std::size_t, N> multiindex,
                           Real *const v) const = 0;
+
+  virtual void do_batched_operator_parentheses(
+      std::array<std::size_t, N> const *const multiindices, const std::size_t n,
+      Real *const v) const;
+};
+
+//! Constituent linear operator whose 'spear' kernel is resolved at compile
+//! time.
+//!
+//! `Derived` must provide a member function template
+//! ```
+//! template <std::size_t D>
+//! void apply(std::array<std::size_t, N> const *const multiindices,
+//!            const std::size_t n, Real *const v) const;
+//! ```
+//! applying the operator along the `n` spears starting at `multiindices`, where
+//! `D` is the dimension in which the operator is applied. The kernel need not
+//! check its arguments. Tensor product operators formed from `Derived` call the
+//! kernel directly, so that it can be inlined and specialized for each
+//! dimension. The virtual interface of `ConstituentLinearOperator` forwards to
+//! the same kernel.
+template <std::size_t N, typename Real, typename Derived>
+class StaticConstituentLinearOperator
+    : public ConstituentLinearOperator<N, Real> {
+public:
+  //! Constructor.
+  //!
+  //! This constructor is provided so that arrays of derived classes may be
+  //! formed. A default-constructed operator must be assigned to before being
+  //! used.
+  StaticConstituentLinearOperator() = default;
+
+  //! Constructor.
+  //!
+  //!\param hierarchy Mesh hierarchy on which the domain and range are defined.
+  //!\param l Index of the mesh on which the operator is to be applied.
+  //!\param dimension Index of the dimension in which the operator is to
+  //! be applied.
+  //!\param ordering Order of the arrays to which the operator is to be
+  //! applied.
+  StaticConstituentLinearOperator(
+      const TensorMeshHierarchy<N, Real> &hierarchy, const std::size_t l,
+      const std::size_t dimension,
+      const NodeOrdering ordering = NodeOrdering::Shuffled);
+
+private:
+  virtual void
+  do_operator_parentheses(const std::array<std::size_t, N> multiindex,
+                          Real *const v) const override;
+
+  virtual void do_batched_operator_parentheses(
+      std::array<std::size_t, N> const *const multiindices, const std::size_t n,
+      Real *const v) const override;
 };
 
 //! Linear operator with respect to some fixed bases formed by tensoring
@@ -76,7 +167,8 @@ public:
   //! Constructor.
   //!
   //! The pointer to component operator corresponding to any dimension of size 1
-  //! should be null.
+  //! should be null. The other pointers must be nonnull, and the operators they
+  //! point to must have dimensions matching those of the mesh.
   //!
   //!\param hierarchy Mesh hierarchy on which the domain and range are defined.
   //!\param l Index of the mesh on which the operator is to be applied.
@@ -91,6 +183,12 @@ public:
   //! IMPORTANT: Component operators on dimensions of size 1 will not be
   //! applied.
   //!
+  //! The 'spears' in each dimension are divided into batches of
+  //! `spear_batch_size<Real>`, which are distributed among the OpenMP threads
+  //! according to the runtime schedule. The chunking can thus be configured
+  //! with the `OMP_SCHEDULE` environment variable or `omp_set_schedule`. No
+  //! memory is allocated to enumerate the 'spears.'
+  //!
   //!\param [in, out] v Element in the domain, to be transformed into an element
   //! in the range.
   void operator()(Real *const v) const;
@@ -102,13 +200,51 @@ protected:
   //! of `operators` will point to members of the derived class (so to
   //! `ConstituentLinearOperator`s which do not exist at the time that this
   //! constructor is called). Since `operators` is not provided, this
-  //! constructor does not check that the operators have the right sizes.
+  //! constructor does not check that the operators have the right sizes. The
+  //! derived class constructor is responsible for making every entry of
+  //! `operators` corresponding to a dimension of size greater than 1 point to
+  //! an operator of the right size.
   //!
   //!\param hierarchy Mesh hierarchy on which the domain and range are defined.
   //!\param l Index of the mesh on which the operator is to be applied.
   TensorLinearOperator(const TensorMeshHierarchy<N, Real> &hierarchy,
                        const std::size_t l);
 
+  //! Apply a tensor product of constituent operators of a type known at
+  //! compile time.
+  //!
+  //! Derived classes call this in place of `operator()` so that the constituent
+  //! operators' kernels are called directly rather than through the virtual
+  //! interface. The 'spears' are scheduled as in `operator()`.
+  //!
+  //!\param [in] constituents Constituent operators for each dimension. Entries
+  //! corresponding to dimensions of size 1 are not used.
+  //!\param [in, out] v Element in the domain, to be transformed into an element
+  //! in the range.
+  template <typename Derived>
+  void apply(const std::array<Derived, N> &constituents, Real *const v) const;
+
+  //! Visit the 'spears' in a dimension in batches.
+  //!
+  //! `f` is called as `f(D, multiindices, n)` for each batch, where `D` is
+  //! `std::integral_constant<std::size_t, dimension>()`, `multiindices` points
+  //! to the starting multiindices of the 'spears' in the batch, and `n` is the
+  //! number of 'spears' in the batch. The batches are scheduled as in
+  //! `operator()`.
+  //!
+  //! If `coarsened` is `true`, only the 'spears' whose indices in the earlier
+  //! dimensions are those of the next coarser mesh are visited. This is for
+  //! operators which, in each dimension, only produce values at the nodes of
+  //! the coarser mesh.
+  //!
+  //!\param dimension Index of the dimension along which the 'spears' point.
+  //!\param coarsened Whether to skip the 'spears' not needed by operators
+  //! mapping to the next coarser mesh.
+  //!\param f Function to call on each batch.
+  template <typename F>
+  void for_each_spear_batch(const std::size_t dimension, const bool coarsened,
+                            F &&f) const;
+
   //! Mesh hierarchy on which the domain and range are defined.
   const TensorMeshHierarchy<N, Real> &hierarchy;
 
@@ -121,6 +257,52 @@ protected:
   //! Indices of the nodes of the mesh on which the operator is to be applied,
   //! grouped by dimension.
   const std::array<TensorIndexRange, N> multiindex_components;
+
+private:
+  //! Indices of the nodes of the mesh, grouped by dimension.
+  //!
+  //! These are the elements of `multiindex_components`, stored so that the
+  //! starting multiindex of any 'spear' can be found without iterating.
+  std::array<std::vector<std::size_t>, N> component_indices;
+
+  //! Indices of the nodes of the next coarser mesh, grouped by dimension.
+  //!
+  //! These are empty if the mesh is the coarsest.
+  std::array<std::vector<std::size_t>, N> coarse_component_indices;
+
+  //! Indices of the starting nodes of the 'spears' to be visited, grouped by
+  //! dimension.
+  using SpearComponents = std::array<std::vector<std::size_t> const *, N>;
+
+  //! Return the indices of the starting nodes of the 'spears' in a dimension.
+  //!
+  //!\param dimension Index of the dimension along which the 'spears' point.
+  //!\param coarsened Whether to use the indices of the next coarser mesh in
+  //! the earlier dimensions.
+  SpearComponents spear_components(const std::size_t dimension,
+                                   const bool coarsened) const;
+
+  //! Return the number of 'spears' in a dimension.
+  //!
+  //!\param components Indices of the starting nodes of the 'spears.'
+  //!\param dimension Index of the dimension along which the 'spears' point.
+  std::size_t number_spears(const SpearComponents &components,
+                            const std::size_t dimension) const;
+
+  //! Compute the starting multiindices of consecutive 'spears' in a dimension.
+  //!
+  //! The 'spears' are ordered lexicographically by their starting multiindices.
+  //!
+  //!\param [in] components Indices of the starting nodes of the 'spears.'
+  //!\param [in] dimension Index of the dimension along which the 'spears'
+  //! point.
+  //!\param [in] first Index of the first 'spear.'
+  //!\param [in] n Number of 'spears.'
+  //!\param [out] multiindices Starting multiindices of the 'spears.'
+  void spear_multiindices(const SpearComponents &components,
+                          const std::size_t dimension, const std::size_t first,
+                          const std::size_t n,
+                          std::array<std::size_t, N> *const multiindices) const;
 };
 
 } // namespace mgard
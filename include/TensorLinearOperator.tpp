@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <stdexcept>
+#include <type_traits>
 #include <vector>
 
 #include <omp.h>
@@ -10,9 +12,10 @@ namespace mgard {
 template <std::size_t N, typename Real>
 ConstituentLinearOperator<N, Real>::ConstituentLinearOperator(
     const TensorMeshHierarchy<N, Real> &hierarchy, const std::size_t l,
-    const std::size_t dimension)
+    const std::size_t dimension, const NodeOrdering ordering)
     : hierarchy(&hierarchy), dimension_(dimension),
-      indices(hierarchy.indices(l, dimension)) {}
+      indices(hierarchy.indices(l, dimension)),
+      layout(hierarchy, l, dimension, ordering) {}
 
 template <std::size_t N, typename Real>
 std::size_t ConstituentLinearOperator<N, Real>::dimension() const {
@@ -31,6 +34,80 @@ operator()(const std::array<std::size_t, N> multiindex, Real *const v) const {
   return do_operator_parentheses(multiindex, v);
 }
 
+template <std::size_t N, typename Real>
+void ConstituentLinearOperator<N, Real>::
+operator()(std::array<std::size_t, N> const *const multiindices,
+           const std::size_t n, Real *const v) const {
+  for (std::size_t k = 0; k < n; ++k) {
+    if (multiindices[k].at(dimension_)) {
+      throw std::invalid_argument(
+          "'spear' must start at a lower boundary of the domain");
+    }
+  }
+  return do_batched_operator_parentheses(multiindices, n, v);
+}
+
+template <std::size_t N, typename Real>
+void ConstituentLinearOperator<N, Real>::do_batched_operator_parentheses(
+    std::array<std::size_t, N> const *const multiindices, const std::size_t n,
+    Real *const v) const {
+  for (std::size_t k = 0; k < n; ++k) {
+    do_operator_parentheses(multiindices[k], v);
+  }
+}
+
+namespace {
+
+//! Call a function object with the dimension index as a compile-time constant.
+//!
+//! `f` is called with `std::integral_constant<std::size_t, dimension>()`.
+template <std::size_t D, std::size_t N> struct DimensionDispatcher {
+  template <typename F> static void call(const std::size_t dimension, F &f) {
+    if (dimension == D) {
+      f(std::integral_constant<std::size_t, D>());
+    } else {
+      DimensionDispatcher<D + 1, N>::call(dimension, f);
+    }
+  }
+};
+
+template <std::size_t N> struct DimensionDispatcher<N, N> {
+  template <typename F> static void call(const std::size_t, F &) {
+    throw std::out_of_range("dimension index out of range");
+  }
+};
+
+template <std::size_t N, typename F>
+void dispatch_on_dimension(const std::size_t dimension, F &&f) {
+  DimensionDispatcher<0, N>::call(dimension, f);
+}
+
+} // namespace
+
+template <std::size_t N, typename Real, typename Derived>
+StaticConstituentLinearOperator<N, Real, Derived>::
+    StaticConstituentLinearOperator(
+        const TensorMeshHierarchy<N, Real> &hierarchy, const std::size_t l,
+        const std::size_t dimension, const NodeOrdering ordering)
+    : ConstituentLinearOperator<N, Real>(hierarchy, l, dimension, ordering) {}
+
+template <std::size_t N, typename Real, typename Derived>
+void StaticConstituentLinearOperator<N, Real, Derived>::do_operator_parentheses(
+    const std::array<std::size_t, N> multiindex, Real *const v) const {
+  do_batched_operator_parentheses(&multiindex, 1, v);
+}
+
+template <std::size_t N, typename Real, typename Derived>
+void StaticConstituentLinearOperator<N, Real, Derived>::
+    do_batched_operator_parentheses(
+        std::array<std::size_t, N> const *const multiindices,
+        const std::size_t n, Real *const v) const {
+  const Derived &derived = static_cast<const Derived &>(*this);
+  dispatch_on_dimension<N>(this->dimension_, [&](const auto D) {
+    derived.template apply<decltype(D)::value>(multiindices, n, v);
+  });
+}
+
 namespace {
 
 template <std::size_t N, typename Real>
@@ -50,13 +127,25 @@ template <std::size_t N, typename Real>
 TensorLinearOperator<N, Real>::TensorLinearOperator(
     const TensorMeshHierarchy<N, Real> &hierarchy, const std::size_t l,
     const std::array<ConstituentLinearOperator<N, Real> const *, N> operators)
-    : hierarchy(hierarchy), operators(operators),
-      multiindex_components(level_multiindex_components(hierarchy, l)) {
+    : TensorLinearOperator(hierarchy, l) {
+  this->operators = operators;
   const std::array<std::size_t, N> &SHAPE = hierarchy.shapes.back();
   for (std::size_t i = 0; i < N; ++i) {
-    if (SHAPE.at(i) == 1 && operators.at(i) != nullptr) {
-      throw std::invalid_argument("the component operator corresponding to any "
-                                  "dimension of size 1 must be the identity");
+    ConstituentLinearOperator<N, Real> const *const A = operators.at(i);
+    if (SHAPE.at(i) == 1) {
+      if (A != nullptr) {
+        throw std::invalid_argument(
+            "the component operator corresponding to any "
+            "dimension of size 1 must be the identity");
+      }
+      continue;
+    }
+    if (A == nullptr) {
+      throw std::invalid_argument("operator has not been initialized");
+    }
+    if (A->dimension() != multiindex_components.at(i).size()) {
+      throw std::invalid_argument(
+          "operator dimension does not match mesh dimension");
     }
   }
 }
@@ -64,46 +153,146 @@ TensorLinearOperator<N, Real>::TensorLinearOperator(
 template <std::size_t N, typename Real>
 TensorLinearOperator<N, Real>::TensorLinearOperator(
     const TensorMeshHierarchy<N, Real> &hierarchy, const std::size_t l)
-    : TensorLinearOperator(hierarchy, l, {}) {}
+    : hierarchy(hierarchy), operators(),
+      multiindex_components(level_multiindex_components(hierarchy, l)) {
+  for (std::size_t i = 0; i < N; ++i) {
+    const TensorIndexRange &range = multiindex_components.at(i);
+    component_indices.at(i).assign(range.begin(), range.end());
+    if (l) {
+      const TensorIndexRange coarse_range = hierarchy.indices(l - 1, i);
+      coarse_component_indices.at(i).assign(coarse_range.begin(),
+                                            coarse_range.end());
+    }
+  }
+}
+
+template <std::size_t N, typename Real>
+typename TensorLinearOperator<N, Real>::SpearComponents
+TensorLinearOperator<N, Real>::spear_components(const std::size_t dimension,
+                                                const bool coarsened) const {
+  SpearComponents components;
+  for (std::size_t i = 0; i < N; ++i) {
+    components[i] = coarsened && i < dimension ? &coarse_component_indices[i]
+                                               : &component_indices[i];
+  }
+  return components;
+}
+
+template <std::size_t N, typename Real>
+std::size_t TensorLinearOperator<N, Real>::number_spears(
+    const SpearComponents &components, const std::size_t dimension) const {
+  std::size_t count = 1;
+  for (std::size_t i = 0; i < N; ++i) {
+    if (i != dimension) {
+      count *= components[i]->size();
+    }
+  }
+  return count;
+}
+
+template <std::size_t N, typename Real>
+void TensorLinearOperator<N, Real>::spear_multiindices(
+    const SpearComponents &components, const std::size_t dimension,
+    const std::size_t first, const std::size_t n,
+    std::array<std::size_t, N> *const multiindices) const {
+  // Decode the position of the first 'spear' in each dimension, treating the
+  // 'spear' index as a mixed-radix number whose last digit varies fastest.
+  std::array<std::size_t, N> positions;
+  std::size_t remainder = first;
+  for (std::size_t k = 0; k < N; ++k) {
+    const std::size_t i = N - 1 - k;
+    if (i == dimension) {
+      positions[i] = 0;
+      continue;
+    }
+    const std::size_t size = components[i]->size();
+    positions[i] = remainder % size;
+    remainder /= size;
+  }
+  // Step from one 'spear' to the next like an odometer.
+  for (std::size_t j = 0; j < n; ++j) {
+    std::array<std::size_t, N> &multiindex = multiindices[j];
+    for (std::size_t i = 0; i < N; ++i) {
+      multiindex[i] = i == dimension ? 0 : (*components[i])[positions[i]];
+    }
+    for (std::size_t k = 0; k < N; ++k) {
+      const std::size_t i = N - 1 - k;
+      if (i == dimension) {
+        continue;
+      }
+      if (++positions[i] < components[i]->size()) {
+        break;
+      }
+      positions[i] = 0;
+    }
+  }
+}
 
 template <std::size_t N, typename Real>
 void TensorLinearOperator<N, Real>::operator()(Real *const v) const {
-  std::array<TensorIndexRange, N> multiindex_components_ =
-      multiindex_components;
   const std::array<std::size_t, N> &SHAPE = hierarchy.shapes.back();
+  // The spears are handed to the constituent operator in batches so that it
+  // can process them together.
+  constexpr std::size_t B = spear_batch_size<Real>;
   for (std::size_t i = 0; i < N; ++i) {
     if (SHAPE.at(i) == 1) {
       continue;
     }
-    ConstituentLinearOperator<N, Real> const *const A = operators.at(i);
-    // We can't check these preconditions in the constructor because the
-    // operators won't be valid at that point in derived class constructors. It
-    // shouldn't be very expensive to run the tests each time this operator is
-    // called. Possibly we could put them in some sort of setter method for
-    // `operators`.
-    if (A == nullptr) {
-      throw std::logic_error("operator has not been initialized");
+    // The operators were checked when they were set.
+    ConstituentLinearOperator<N, Real> const *const A = operators[i];
+    const SpearComponents components = spear_components(i, false);
+    const std::size_t M = number_spears(components, i);
+    const std::size_t nbatches = (M + B - 1) / B;
+
+#pragma omp parallel for schedule(runtime) if (nbatches > 1)
+    for (std::size_t j = 0; j < nbatches; ++j) {
+      const std::size_t first = j * B;
+      const std::size_t n = std::min(B, M - first);
+      std::array<std::array<std::size_t, N>, B> multiindices;
+      spear_multiindices(components, i, first, n, multiindices.data());
+      A->do_batched_operator_parentheses(multiindices.data(), n, v);
     }
-    if (A->dimension() != multiindex_components.at(i).size()) {
-      throw std::invalid_argument(
-          "operator dimension does not match mesh dimension");
+  }
+}
+
+template <std::size_t N, typename Real>
+template <typename Derived>
+void TensorLinearOperator<N, Real>::apply(
+    const std::array<Derived, N> &constituents, Real *const v) const {
+  const std::array<std::size_t, N> &SHAPE = hierarchy.shapes.back();
+  for (std::size_t i = 0; i < N; ++i) {
+    if (SHAPE.at(i) == 1) {
+      continue;
     }
-    // Range which will yield `0` once.
-    multiindex_components_.at(i) = TensorIndexRange::singleton();
+    for_each_spear_batch(
+        i, false,
+        [&](const auto D, std::array<std::size_t, N> const *const multiindices,
+            const std::size_t n) {
+          constituents[D].template apply<decltype(D)::value>(multiindices, n,
+                                                             v);
+        });
+  }
+}
 
-    const CartesianProduct<TensorIndexRange, N> product(multiindex_components_);
-    const std::vector<std::array<std::size_t, N>> multiindices(product.begin(),
-                                                               product.end());
-    const std::size_t M = multiindices.size();
+template <std::size_t N, typename Real>
+template <typename F>
+void TensorLinearOperator<N, Real>::for_each_spear_batch(
+    const std::size_t dimension, const bool coarsened, F &&f) const {
+  constexpr std::size_t B = spear_batch_size<Real>;
+  const SpearComponents components = spear_components(dimension, coarsened);
+  const std::size_t M = number_spears(components, dimension);
+  const std::size_t nbatches = (M + B - 1) / B;
 
-#pragma omp parallel for
-    for (std::size_t j = 0; j < M; ++j) {
-      A->operator()(multiindices.at(j), v);
+  dispatch_on_dimension<N>(dimension, [&](const auto D) {
+#pragma omp parallel for schedule(runtime) if (nbatches > 1)
+    for (std::size_t j = 0; j < nbatches; ++j) {
+      const std::size_t first = j * B;
+      const std::size_t n = std::min(B, M - first);
+      std::array<std::array<std::size_t, N>, B> multiindices;
+      spear_multiindices(components, dimension, first, n, multiindices.data());
+      f(D, multiindices.data(), n);
     }
-
-    // Reinstate this dimension's indices for the next iteration.
-    multiindex_components_.at(i) = multiindex_components.at(i);
-  }
+  });
 }
 
 } // namespace mgard
@@ -12,7 +12,9 @@ namespace mgard {
 //! Mass matrix for continuous piecewise linear functions defined on a
 //! mesh 'spear.'
 template <std::size_t N, typename Real>
-class ConstituentMassMatrix : public ConstituentLinearOperator<N, Real> {
+class ConstituentMassMatrix
+    : public StaticConstituentLinearOperator<N, Real,
+                                             ConstituentMassMatrix<N, Real>> {
 public:
   //! Constructor.
   //!
@@ -26,15 +28,48 @@ public:
   //!\param l Index of the mesh on which the mass matrix is to be applied.
   //!\param dimension Index of the dimension in which the mass matrix is to
   //! be applied.
+  //!\param ordering Order of the arrays to which the mass matrix is to be
+  //! applied.
   ConstituentMassMatrix(const TensorMeshHierarchy<N, Real> &hierarchy,
-                        const std::size_t l, const std::size_t dimension);
+                        const std::size_t l, const std::size_t dimension,
+                        const NodeOrdering ordering = NodeOrdering::Shuffled);
+
+  //! Apply the operator along several 'spears' in place.
+  //!
+  //! See `StaticConstituentLinearOperator`. No checks are made. The 'spears'
+  //! are processed together as a tile, so that the innermost loop runs across
+  //! the 'spears' rather than along them.
+  //!
+  //!\param [in] multiindices Starting multiindices of the 'spears.'
+  //!\param [in] n Number of 'spears.'
+  //!\param [in, out] v Element in the domain, to be transformed into an element
+  //! in the range.
+  template <std::size_t D>
+  void apply(std::array<std::size_t, N> const *const multiindices,
+             const std::size_t n, Real *const v) const;
 
 private:
   using CLO = ConstituentLinearOperator<N, Real>;
-
-  virtual void
-  do_operator_parentheses(const std::array<std::size_t, N> multiindex,
-                          Real *const v) const override;
+  using SCLO = StaticConstituentLinearOperator<N, Real, ConstituentMassMatrix>;
+
+  //! Spacing of the nodes of the 'spears' if they are equispaced, and zero
+  //! otherwise.
+  Real spacing = 0;
+
+  //! Apply the operator along a single 'spear' in place.
+  template <std::size_t D>
+  void apply_to_spear(const std::array<std::size_t, N> &multiindex,
+                      Real *const v) const;
+
+  //! Apply the operator along a single 'spear' with equispaced nodes in place.
+  template <std::size_t D>
+  void apply_to_uniform_spear(const std::array<std::size_t, N> &multiindex,
+                              Real *const v) const;
+
+  //! Apply the operator along a tile of 'spears' in place.
+  template <std::size_t D>
+  void apply_to_tile(std::array<std::size_t, N> const *const multiindices,
+                     const std::size_t m, Real *const v) const;
 };
 
 //! Mass matrix for tensor products of continuous piecewise linear functions
@@ -46,8 +81,20 @@ public:
   //!
   //!\param hierarchy Mesh hierarchy on which the functions are defined.
   //!\param l Index of the mesh on which the mass matrix is to be applied.
+  //!\param ordering Order of the arrays to which the mass matrix is to be
+  //! applied.
   TensorMassMatrix(const TensorMeshHierarchy<N, Real> &hierarchy,
-                   const std::size_t l);
+                   const std::size_t l,
+                   const NodeOrdering ordering = NodeOrdering::Shuffled);
+
+  //! Apply the operator to an element in place.
+  //!
+  //! The constituent operators' kernels are called directly. See
+  //! `TensorLinearOperator::operator()`.
+  //!
+  //!\param [in, out] v Element in the domain, to be transformed into an element
+  //! in the range.
+  void operator()(Real *const v) const;
 
 private:
   using TLO = TensorLinearOperator<N, Real>;
@@ -59,7 +106,9 @@ private:
 //! Inverse of mass matrix for continuous piecewise linear functions defined on
 //! a mesh 'spear.'
 template <std::size_t N, typename Real>
-class ConstituentMassMatrixInverse : public ConstituentLinearOperator<N, Real> {
+class ConstituentMassMatrixInverse
+    : public StaticConstituentLinearOperator<
+          N, Real, ConstituentMassMatrixInverse<N, Real>> {
 public:
   //! Constructor.
   //!
@@ -73,19 +122,55 @@ public:
   //!\param l Index of the mesh on which the mass matrix is to be inverted.
   //!\param dimension Index of the dimension in which the mass matrix is to
   //! be inverted.
-  ConstituentMassMatrixInverse(const TensorMeshHierarchy<N, Real> &hierarchy,
-                               const std::size_t l,
-                               const std::size_t dimension);
+  //!\param ordering Order of the arrays to which the inverse is to be
+  //! applied.
+  ConstituentMassMatrixInverse(
+      const TensorMeshHierarchy<N, Real> &hierarchy, const std::size_t l,
+      const std::size_t dimension,
+      const NodeOrdering ordering = NodeOrdering::Shuffled);
+
+  //! Apply the operator along several 'spears' in place.
+  //!
+  //! See `StaticConstituentLinearOperator`. No checks are made. The
+  //! righthand sides are gathered into a buffer in which the entries for the
+  //! different spears are interleaved, so that each step of the forward and
+  //! backward sweeps is a single vector operation across the spears.
+  //!
+  //!\param [in] multiindices Starting multiindices of the 'spears.'
+  //!\param [in] n Number of 'spears.'
+  //!\param [in, out] v Element in the domain, to be transformed into an element
+  //! in the range.
+  template <std::size_t D>
+  void apply(std::array<std::size_t, N> const *const multiindices,
+             const std::size_t n, Real *const v) const;
+
+  //! Solve the mass matrix systems for several 'spears' at once.
+  //!
+  //! The righthand sides are interleaved, so that the entries for the `j`th
+  //! nodes of the 'spears' are contiguous. No checks are made.
+  //!
+  //!\param [in, out] d Righthand sides, to be overwritten by the solutions.
+  //!\param [in] m Number of 'spears.'
+  void solve(Real *const d, const std::size_t m) const;
 
 private:
   using CLO = ConstituentLinearOperator<N, Real>;
+  using SCLO =
+      StaticConstituentLinearOperator<N, Real, ConstituentMassMatrixInverse>;
 
   //! Buffer to store divisors for the Thomas algorithm.
   std::vector<Real> divisors;
 
-  virtual void
-  do_operator_parentheses(const std::array<std::size_t, N> multiindex,
-                          Real *const v) const override;
+  //! Buffer to store the forward sweep multipliers for the Thomas algorithm.
+  std::vector<Real> multipliers;
+
+  //! Buffer to store the superdiagonal of the mass matrix.
+  std::vector<Real> superdiagonal;
+
+  //! Apply the operator along a single 'spear' in place.
+  template <std::size_t D>
+  void apply_to_spear(const std::array<std::size_t, N> &multiindex,
+                      Real *const v) const;
 };
 
 //! Inverse of mass matrix for tensor products of continuous piecewise linear
@@ -97,8 +182,20 @@ public:
   //!
   //!\param hierarchy Mesh hierarchy on which the functions are defined.
   //!\param l Index of the mesh on which the mass matrix is to be inverted.
+  //!\param ordering Order of the arrays to which the inverse is to be
+  //! applied.
   TensorMassMatrixInverse(const TensorMeshHierarchy<N, Real> &hierarchy,
-                          const std::size_t l);
+                          const std::size_t l,
+                          const NodeOrdering ordering = NodeOrdering::Shuffled);
+
+  //! Apply the operator to an element in place.
+  //!
+  //! The constituent operators' kernels are called directly. See
+  //! `TensorLinearOperator::operator()`.
+  //!
+  //!\param [in, out] v Element in the domain, to be transformed into an element
+  //! in the range.
+  void operator()(Real *const v) const;
 
 private:
   using TLO = TensorLinearOperator<N, Real>;
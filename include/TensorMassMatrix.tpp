@@ -3,8 +3,9 @@ namespace mgard {
 template <std::size_t N, typename Real>
 ConstituentMassMatrix<N, Real>::ConstituentMassMatrix(
     const TensorMeshHierarchy<N, Real> &hierarchy, const std::size_t l,
-    const std::size_t dimension)
-    : ConstituentLinearOperator<N, Real>(hierarchy, l, dimension) {
+    const std::size_t dimension, const NodeOrdering ordering)
+    : SCLO(hierarchy, l, dimension, ordering),
+      spacing(hierarchy.uniform_spacings.at(l).at(dimension)) {
   if (this->dimension() < 2) {
     throw std::invalid_argument("mass matrix implementation assumes that "
                                 "'spear' has at least two nodes");
@@ -12,11 +13,100 @@ ConstituentMassMatrix<N, Real>::ConstituentMassMatrix(
 }
 
 template <std::size_t N, typename Real>
-void ConstituentMassMatrix<N, Real>::do_operator_parentheses(
-    const std::array<std::size_t, N> multiindex, Real *const v) const {
-  std::array<std::size_t, N> alpha = multiindex;
-  std::size_t &variable_index = alpha.at(CLO::dimension_);
-  const std::vector<Real> &xs = CLO::hierarchy->coordinates.at(CLO::dimension_);
+template <std::size_t D>
+void ConstituentMassMatrix<N, Real>::apply(
+    std::array<std::size_t, N> const *const multiindices, const std::size_t n,
+    Real *const v) const {
+  if (n > 1) {
+    return apply_to_tile<D>(multiindices, n, v);
+  } else if (spacing) {
+    return apply_to_uniform_spear<D>(multiindices[0], v);
+  } else {
+    return apply_to_spear<D>(multiindices[0], v);
+  }
+}
+
+template <std::size_t N, typename Real>
+template <std::size_t D>
+void ConstituentMassMatrix<N, Real>::apply_to_tile(
+    std::array<std::size_t, N> const *const multiindices, const std::size_t m,
+    Real *const v) const {
+  const std::vector<std::size_t> &indices = CLO::layout.indices;
+  const std::vector<Real> &xs = CLO::hierarchy->coordinates[D];
+  const std::size_t n = CLO::dimension();
+
+  // Positions of the spears' nodes in `v` and the input values, both
+  // interleaved so that the entries for the `j`th nodes of the spears are
+  // contiguous. The results are written straight to `v`.
+  // The buffers are kept from call to call so that no memory is allocated
+  // once they are large enough.
+  thread_local std::vector<std::size_t> offsets;
+  thread_local std::vector<Real> values;
+  offsets.resize(n * m);
+  values.resize(n * m);
+  CLO::layout.interleaved_offsets(multiindices, m, offsets.data());
+  for (std::size_t i = 0; i < n * m; ++i) {
+    values[i] = v[offsets[i]];
+  }
+
+  // Spacing between the `j`th and `j + 1`th nodes.
+  const auto h = [&](const std::size_t j) -> Real {
+    return spacing ? spacing : xs[indices[j + 1]] - xs[indices[j]];
+  };
+
+  for (std::size_t j = 0; j < n; ++j) {
+    // Subdiagonal, diagonal, and superdiagonal entries of the `j`th row. The
+    // formulas for equispaced nodes match `apply_to_uniform_spear`.
+    const bool first = !j;
+    const bool last = j + 1 == n;
+    Real a;
+    Real b;
+    Real c;
+    if (spacing) {
+      a = first ? 0 : spacing / 6;
+      b = first || last ? spacing / 3 : 2 * spacing / 3;
+      c = last ? 0 : spacing / 6;
+    } else {
+      const Real h_left = first ? 0 : h(j - 1);
+      const Real h_right = last ? 0 : h(j);
+      a = h_left / 6;
+      b = (h_left + h_right) / 3;
+      c = h_right / 6;
+    }
+
+    Real const *const u_middle = values.data() + j * m;
+    std::size_t const *const out = offsets.data() + j * m;
+    if (first) {
+      Real const *const u_right = u_middle + m;
+#pragma omp simd
+      for (std::size_t k = 0; k < m; ++k) {
+        v[out[k]] = b * u_middle[k] + c * u_right[k];
+      }
+    } else if (last) {
+      Real const *const u_left = u_middle - m;
+#pragma omp simd
+      for (std::size_t k = 0; k < m; ++k) {
+        v[out[k]] = a * u_left[k] + b * u_middle[k];
+      }
+    } else {
+      Real const *const u_left = u_middle - m;
+      Real const *const u_right = u_middle + m;
+#pragma omp simd
+      for (std::size_t k = 0; k < m; ++k) {
+        v[out[k]] = a * u_left[k] + b * u_middle[k] + c * u_right[k];
+      }
+    }
+  }
+}
+
+template <std::size_t N, typename Real>
+template <std::size_t D>
+void ConstituentMassMatrix<N, Real>::apply_to_spear(
+    const std::array<std::size_t, N> &multiindex, Real *const v) const {
+  const typename TensorSpearLayout<N, Real>::Spear spear =
+      CLO::layout.spear(multiindex);
+  const std::vector<std::size_t> &indices = CLO::layout.indices;
+  const std::vector<Real> &xs = CLO::hierarchy->coordinates[D];
   const std::size_t n = CLO::dimension();
 
   // Node coordinates.
@@ -33,48 +123,32 @@ void ConstituentMassMatrix<N, Real>::do_operator_parentheses(
   Real v_right;
 
   // Pointers to use when overwriting input array.
-  // TODO: Hoping to replace these with a function in the iterator.
   Real *out_middle;
   Real *out_right;
 
-  TensorIndexRange::iterator p = CLO::indices.begin();
-  // TODO: Could combine `i` and `variable_index`.
-  std::size_t i;
-
-  // TODO: Maybe a combined sort of iterator here. Increment `p` index and
-  // automatically change `alpha`, `v`, `x`, and whatever else.
-
-  variable_index = i = *p++;
-  x_middle = xs.at(i);
-  out_middle = &CLO::hierarchy->at(v, alpha);
+  x_middle = xs[indices[0]];
+  out_middle = v + spear[0];
   v_middle = *out_middle;
 
-  variable_index = i = *p++;
-  x_right = xs.at(i);
+  x_right = xs[indices[1]];
   h_right = x_right - x_middle;
-  out_right = &CLO::hierarchy->at(v, alpha);
+  out_right = v + spear[1];
   v_right = *out_right;
 
-  // TODO: Figure out changing.
   *out_middle = h_right / 3 * v_middle + h_right / 6 * v_right;
 
-  // TODO: Careful. We've already incremented twice. Check the limits.
   for (std::size_t j = 2; j < n; ++j) {
-    // `j` isn't the index of anything – just a count.
-    variable_index = i = *p++;
-
     x_middle = x_right;
     h_left = h_right;
     v_left = v_middle;
     v_middle = v_right;
     out_middle = out_right;
 
-    x_right = xs.at(i);
+    x_right = xs[indices[j]];
     h_right = x_right - x_middle;
-    out_right = &CLO::hierarchy->at(v, alpha);
+    out_right = v + spear[j];
     v_right = *out_right;
 
-    // TODO: Figure out changing.
     *out_middle = h_left / 6 * v_left + (h_left + h_right) / 3 * v_middle +
                   h_right / 6 * v_right;
   }
@@ -85,23 +159,69 @@ void ConstituentMassMatrix<N, Real>::do_operator_parentheses(
   v_middle = v_right;
   out_middle = out_right;
 
-  // TODO: Figure out changing.
   *out_middle = h_left / 6 * v_left + h_left / 3 * v_middle;
 }
 
+template <std::size_t N, typename Real>
+template <std::size_t D>
+void ConstituentMassMatrix<N, Real>::apply_to_uniform_spear(
+    const std::array<std::size_t, N> &multiindex, Real *const v) const {
+  const typename TensorSpearLayout<N, Real>::Spear spear =
+      CLO::layout.spear(multiindex);
+  const std::size_t n = CLO::dimension();
+
+  // Entries of the mass matrix. The diagonal entries are `2 * h / 3` except in
+  // the first and last rows, where they are `h / 3`.
+  const Real offdiagonal = spacing / 6;
+  const Real diagonal_boundary = spacing / 3;
+  const Real diagonal_interior = 2 * spacing / 3;
+
+  // Function values at nodes.
+  Real v_left;
+  Real v_middle;
+  Real v_right;
+
+  // Pointers to use when overwriting input array.
+  Real *out_middle;
+  Real *out_right;
+
+  out_middle = v + spear[0];
+  v_middle = *out_middle;
+
+  out_right = v + spear[1];
+  v_right = *out_right;
+
+  *out_middle = diagonal_boundary * v_middle + offdiagonal * v_right;
+
+  for (std::size_t j = 2; j < n; ++j) {
+    v_left = v_middle;
+    v_middle = v_right;
+    out_middle = out_right;
+
+    out_right = v + spear[j];
+    v_right = *out_right;
+
+    *out_middle =
+        offdiagonal * (v_left + v_right) + diagonal_interior * v_middle;
+  }
+
+  *out_right = offdiagonal * v_middle + diagonal_boundary * v_right;
+}
+
 namespace {
 
 template <std::size_t N, typename Real>
 std::array<ConstituentMassMatrix<N, Real>, N>
 generate_mass_matrices(const TensorMeshHierarchy<N, Real> &hierarchy,
-                       const std::size_t l) {
+                       const std::size_t l, const NodeOrdering ordering) {
   const std::array<std::size_t, N> &SHAPE = hierarchy.shapes.back();
   std::array<ConstituentMassMatrix<N, Real>, N> mass_matrices;
   for (std::size_t i = 0; i < N; ++i) {
     if (SHAPE.at(i) == 1) {
       continue;
     }
-    mass_matrices.at(i) = ConstituentMassMatrix<N, Real>(hierarchy, l, i);
+    mass_matrices.at(i) =
+        ConstituentMassMatrix<N, Real>(hierarchy, l, i, ordering);
   }
   return mass_matrices;
 }
@@ -110,30 +230,40 @@ generate_mass_matrices(const TensorMeshHierarchy<N, Real> &hierarchy,
 
 template <std::size_t N, typename Real>
 TensorMassMatrix<N, Real>::TensorMassMatrix(
-    const TensorMeshHierarchy<N, Real> &hierarchy, const std::size_t l)
+    const TensorMeshHierarchy<N, Real> &hierarchy, const std::size_t l,
+    const NodeOrdering ordering)
     : TensorLinearOperator<N, Real>(hierarchy, l),
-      mass_matrices(generate_mass_matrices(hierarchy, l)) {
+      mass_matrices(generate_mass_matrices(hierarchy, l, ordering)) {
   const std::array<std::size_t, N> &SHAPE = hierarchy.shapes.back();
   for (std::size_t i = 0; i < N; ++i) {
     TLO::operators.at(i) = SHAPE.at(i) == 1 ? nullptr : &mass_matrices.at(i);
   }
 }
 
+template <std::size_t N, typename Real>
+void TensorMassMatrix<N, Real>::operator()(Real *const v) const {
+  TLO::apply(mass_matrices, v);
+}
+
 template <std::size_t N, typename Real>
 ConstituentMassMatrixInverse<N, Real>::ConstituentMassMatrixInverse(
     const TensorMeshHierarchy<N, Real> &hierarchy, const std::size_t l,
-    const std::size_t dimension)
-    : ConstituentLinearOperator<N, Real>(hierarchy, l, dimension) {
+    const std::size_t dimension, const NodeOrdering ordering)
+    : SCLO(hierarchy, l, dimension, ordering) {
   const std::size_t n = CLO::dimension();
   if (n < 2) {
     throw std::invalid_argument("mass matrix inverse implementation assumes "
                                 "that 'spear' has at least two nodes");
   }
 
-  // Populate `divisors`.
+  // Populate `divisors`, `multipliers`, and `superdiagonal`. See the
+  // description of the Thomas algorithm below.
   divisors.resize(n);
+  multipliers.resize(n);
+  superdiagonal.resize(n - 1);
 
   const std::vector<Real> &xs = CLO::hierarchy->coordinates.at(CLO::dimension_);
+  const std::vector<std::size_t> &indices = CLO::layout.indices;
   // Node coordinates.
   Real x_middle;
   Real x_right;
@@ -142,26 +272,28 @@ ConstituentMassMatrixInverse<N, Real>::ConstituentMassMatrixInverse(
   Real h_left;
   Real h_right;
 
-  TensorIndexRange::iterator p = CLO::indices.begin();
-  x_middle = xs.at(*p);
+  x_middle = xs.at(indices.at(0));
 
-  x_right = xs.at(*++p);
+  x_right = xs.at(indices.at(1));
   h_right = x_right - x_middle;
 
   divisors[0] = 2 * h_right / 6;
+  multipliers[0] = 0;
 
   for (std::size_t j = 1; j + 1 < n; ++j) {
     // `j` is the index of the current ('middle') row.
     x_middle = x_right;
     h_left = h_right;
 
-    x_right = xs.at(*++p);
+    x_right = xs.at(indices.at(j + 1));
     h_right = x_right - x_middle;
 
     // Subdiagonal element `a_i` in the current row, equal to the superdiagonal
     // element `c_{i - 1}` in the previous row.
     const Real a_j = h_left / 6;
     const Real w = a_j / divisors[j - 1];
+    superdiagonal[j - 1] = a_j;
+    multipliers[j] = w;
     // In general (for example, if the matrix weren't symmetric), `a_i` here is
     // `c_{i - 1}`.
     divisors[j] = 2 * (h_left + h_right) / 6 - w * a_j;
@@ -172,13 +304,16 @@ ConstituentMassMatrixInverse<N, Real>::ConstituentMassMatrixInverse(
     h_left = h_right;
     const Real a_j = h_left / 6;
     const Real w = a_j / divisors[n - 2];
+    superdiagonal[n - 2] = a_j;
+    multipliers[n - 1] = w;
     divisors[n - 1] = 2 * h_left / 6 - w * a_j;
   }
 }
 
 template <std::size_t N, typename Real>
-void ConstituentMassMatrixInverse<N, Real>::do_operator_parentheses(
-    const std::array<std::size_t, N> multiindex, Real *const v) const {
+template <std::size_t D>
+void ConstituentMassMatrixInverse<N, Real>::apply_to_spear(
+    const std::array<std::size_t, N> &multiindex, Real *const v) const {
   // The system is solved using the Thomas algorithm. See <https://
   // en.wikipedia.org/wiki/Tridiagonal_matrix_algorithm>. In case the article
   // changes, the algorithm is copied here.
@@ -196,23 +331,14 @@ void ConstituentMassMatrixInverse<N, Real>::do_operator_parentheses(
   //      x_i = (d_i - c_i * x_{i + 1}) / b_i
   //    end
   // Because the mass matrix is symmetric, `a_i` is equal to `c_{i - 1}`. We
-  // precompute the divisors (the modified `[b_1, …, b_n]`) in the constructor.
-  std::array<std::size_t, N> alpha = multiindex;
-  std::size_t &variable_index = alpha.at(CLO::dimension_);
-  const std::vector<Real> &xs = CLO::hierarchy->coordinates.at(CLO::dimension_);
+  // precompute the multipliers `[w_2, …, w_n]`, the divisors (the modified
+  // `[b_1, …, b_n]`), and the superdiagonal in the constructor.
+  const typename TensorSpearLayout<N, Real>::Spear spear =
+      CLO::layout.spear(multiindex);
   const std::size_t n = CLO::dimension();
 
-  // Node coordinates.
-  Real x_middle;
-  Real x_right;
-
-  // Node spacings.
-  Real h_left;
-  Real h_right;
-
-  // Pointers to use when overwriting input array.
-  Real *out_middle;
-  Real *out_right;
+  // Pointer to use when overwriting input array.
+  Real *out;
 
   // Previous value of the input array *after* overwriting (in the algorithm
   // above, `d_{i - 1}` when we're updating `d_i`).
@@ -221,71 +347,96 @@ void ConstituentMassMatrixInverse<N, Real>::do_operator_parentheses(
   // `x_{i + 1}` when we're updating `x_i`.)
   Real x_next;
 
-  TensorIndexRange::iterator p = CLO::indices.begin();
-  std::size_t i;
-
-  variable_index = i = *p;
-  x_middle = xs.at(i);
-  out_middle = &CLO::hierarchy->at(v, alpha);
-
-  variable_index = i = *++p;
-  x_right = xs.at(i);
-  out_right = &CLO::hierarchy->at(v, alpha);
-  h_right = x_right - x_middle;
-
-  rhs_previous = *out_middle;
-
-  // Forward sweep (except for last entry).
-  for (std::size_t j = 1; j + 1 < n; ++j) {
-    // `j` is the index of the current ('middle') row.
-    variable_index = i = *++p;
+  out = v + spear[0];
+  rhs_previous = *out;
 
-    x_middle = x_right;
-    out_middle = out_right;
-    h_left = h_right;
+  // Forward sweep.
+  for (std::size_t j = 1; j < n; ++j) {
+    out = v + spear[j];
+    rhs_previous = *out -= multipliers[j] * rhs_previous;
+  }
 
-    x_right = xs.at(i);
-    out_right = &CLO::hierarchy->at(v, alpha);
-    h_right = x_right - x_middle;
+  // Start of backward sweep (first entry).
+  { x_next = *out /= divisors[n - 1]; }
 
-    // Subdiagonal element `a_i` in the current row, equal to the superdiagonal
-    // element `c_{i - 1}` in the previous row.
-    const Real a_j = h_left / 6;
-    const Real w = a_j / divisors[j - 1];
-    rhs_previous = *out_middle -= w * rhs_previous;
+  // Backward sweep (remaining entries).
+  for (std::size_t k = 2; k <= n; ++k) {
+    const std::size_t j = n - k;
+    out = v + spear[j];
+    *out -= superdiagonal[j] * x_next;
+    x_next = *out /= divisors[j];
   }
+}
 
-  // Forward sweep (last entry).
-  {
-    x_middle = x_right;
-    out_middle = out_right;
-    h_left = h_right;
-    const Real a_j = h_left / 6;
-    const Real w = a_j / divisors[n - 2];
-    // We are done with `rhs_previous`, so we don't update it.
-    *out_middle -= w * rhs_previous;
+template <std::size_t N, typename Real>
+template <std::size_t D>
+void ConstituentMassMatrixInverse<N, Real>::apply(
+    std::array<std::size_t, N> const *const multiindices, const std::size_t m,
+    Real *const v) const {
+  if (m == 1) {
+    return apply_to_spear<D>(multiindices[0], v);
   }
+  // See `apply_to_spear` for the algorithm. The operations (and so the results)
+  // are exactly the same; they're just done for `m` spears at once.
+  const std::size_t n = CLO::dimension();
 
-  // Start of backward sweep (first entry).
-  { x_next = *out_middle /= divisors[n - 1]; }
+  // Positions of the spears' nodes in `v` and the righthand sides, both
+  // interleaved so that the entries for the `j`th nodes of the spears are
+  // contiguous.
+  // The buffers are kept from call to call so that no memory is allocated
+  // once they are large enough.
+  thread_local std::vector<std::size_t> offsets;
+  thread_local std::vector<Real> rhs;
+  offsets.resize(n * m);
+  rhs.resize(n * m);
+  CLO::layout.interleaved_offsets(multiindices, m, offsets.data());
+  for (std::size_t i = 0; i < n * m; ++i) {
+    rhs[i] = v[offsets[i]];
+  }
 
-  // Up to now (apart from its very first usage), `p` has pointed to the 'right'
-  // index. From now on it will point to the 'middle' index.
+  solve(rhs.data(), m);
 
-  // Backward sweep (remaining entries).
-  for (std::size_t k = 2; k <= n; ++k) {
-    const std::size_t j = n - k;
-    variable_index = i = *--p;
+  for (std::size_t i = 0; i < n * m; ++i) {
+    v[offsets[i]] = rhs[i];
+  }
+}
 
-    x_right = x_middle;
+template <std::size_t N, typename Real>
+void ConstituentMassMatrixInverse<N, Real>::solve(Real *const d,
+                                                  const std::size_t m) const {
+  const std::size_t n = CLO::dimension();
 
-    x_middle = xs.at(i);
-    out_middle = &CLO::hierarchy->at(v, alpha);
-    h_right = x_right - x_middle;
+  // Forward sweep.
+  for (std::size_t j = 1; j < n; ++j) {
+    const Real w = multipliers[j];
+    Real *const d_j = d + j * m;
+    Real const *const d_previous = d_j - m;
+#pragma omp simd
+    for (std::size_t k = 0; k < m; ++k) {
+      d_j[k] -= w * d_previous[k];
+    }
+  }
 
-    const Real c_j = h_right / 6;
-    *out_middle -= c_j * x_next;
-    x_next = *out_middle /= divisors[j];
+  // Backward sweep.
+  {
+    const Real b = divisors[n - 1];
+    Real *const d_j = d + (n - 1) * m;
+#pragma omp simd
+    for (std::size_t k = 0; k < m; ++k) {
+      d_j[k] /= b;
+    }
+  }
+  for (std::size_t i = 2; i <= n; ++i) {
+    const std::size_t j = n - i;
+    const Real b = divisors[j];
+    const Real c = superdiagonal[j];
+    Real *const d_j = d + j * m;
+    Real const *const x_next = d_j + m;
+#pragma omp simd
+    for (std::size_t k = 0; k < m; ++k) {
+      d_j[k] -= c * x_next[k];
+      d_j[k] /= b;
+    }
   }
 }
 
@@ -294,14 +445,16 @@ namespace {
 template <std::size_t N, typename Real>
 std::array<ConstituentMassMatrixInverse<N, Real>, N>
 generate_mass_matrix_inverses(const TensorMeshHierarchy<N, Real> &hierarchy,
-                              const std::size_t l) {
+                              const std::size_t l,
+                              const NodeOrdering ordering) {
   const std::array<std::size_t, N> &SHAPE = hierarchy.shapes.back();
   std::array<ConstituentMassMatrixInverse<N, Real>, N> operators;
   for (std::size_t i = 0; i < N; ++i) {
     if (SHAPE.at(i) == 1) {
       continue;
     }
-    operators.at(i) = ConstituentMassMatrixInverse<N, Real>(hierarchy, l, i);
+    operators.at(i) =
+        ConstituentMassMatrixInverse<N, Real>(hierarchy, l, i, ordering);
   }
   return operators;
 }
@@ -310,9 +463,11 @@ generate_mass_matrix_inverses(const TensorMeshHierarchy<N, Real> &hierarchy,
 
 template <std::size_t N, typename Real>
 TensorMassMatrixInverse<N, Real>::TensorMassMatrixInverse(
-    const TensorMeshHierarchy<N, Real> &hierarchy, const std::size_t l)
+    const TensorMeshHierarchy<N, Real> &hierarchy, const std::size_t l,
+    const NodeOrdering ordering)
     : TensorLinearOperator<N, Real>(hierarchy, l),
-      mass_matrix_inverses(generate_mass_matrix_inverses(hierarchy, l)) {
+      mass_matrix_inverses(
+          generate_mass_matrix_inverses(hierarchy, l, ordering)) {
   const std::array<std::size_t, N> &SHAPE = hierarchy.shapes.back();
   for (std::size_t i = 0; i < N; ++i) {
     TLO::operators.at(i) =
@@ -320,4 +475,9 @@ TensorMassMatrixInverse<N, Real>::TensorMassMatrixInverse(
   }
 }
 
+template <std::size_t N, typename Real>
+void TensorMassMatrixInverse<N, Real>::operator()(Real *const v) const {
+  TLO::apply(mass_matrix_inverses, v);
+}
+
 } // namespace mgard
@@ -93,6 +93,20 @@ public:
   //! level which introduced that node (its 'date of birth').
   std::array<std::vector<std::size_t>, N> dates_of_birth;
 
+  //! For each mesh, for each dimension, for each node in the finest level, the
+  //! number of nodes of that mesh preceding that node in that dimension.
+  //!
+  //! These counts are used to compute the positions of nodes in shuffled
+  //! arrays without any divisions. See `number_nodes_before`.
+  std::vector<std::array<std::vector<std::size_t>, N>> numbers_nodes_before;
+
+  //! For each mesh, for each dimension, the spacing of the nodes of that mesh
+  //! in that dimension if they are equispaced (up to rounding), and zero
+  //! otherwise.
+  //!
+  //! Operators use this to switch to constant stencil coefficients.
+  std::vector<std::array<Real, N>> uniform_spacings;
+
 protected:
   //! Check that a mesh index is in bounds.
   //!
@@ -112,6 +126,15 @@ protected:
   void check_mesh_index_nonzero(const std::size_t l) const;
 
 private:
+  //! Compute the spacing of the nodes of a mesh in a dimension if they are
+  //! equispaced.
+  //!
+  //! Zero is returned if the nodes are not equispaced.
+  //!
+  //!\param l Mesh index.
+  //!\param dimension Dimension index.
+  Real uniform_spacing(const std::size_t l, const std::size_t dimension) const;
+
   //! Compute the index of a node in the 'shuffled' ordering.
   //!
   //!\param multiindex Multiindex of the node.
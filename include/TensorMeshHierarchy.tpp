@@ -1,3 +1,5 @@
+#include <cmath>
+
 #include <algorithm>
 #include <functional>
 #include <limits>
@@ -106,6 +108,59 @@ TensorMeshHierarchy<N, Real>::TensorMeshHierarchy(
       }
     }
   }
+
+  numbers_nodes_before.resize(L + 1);
+  for (std::size_t l = 0; l <= L; ++l) {
+    for (std::size_t i = 0; i < N; ++i) {
+      const std::size_t m = shapes.at(l).at(i);
+      const std::size_t M = shapes.at(L).at(i);
+      std::vector<std::size_t> &counts = numbers_nodes_before.at(l).at(i);
+      counts.resize(M);
+      // See `number_nodes_before` for the derivation of this count. If the
+      // mesh is flat in this dimension, the count is always zero.
+      const std::size_t denominator = M - 1;
+      for (std::size_t index = 0; index < M; ++index) {
+        counts.at(index) =
+            denominator ? (index * (m - 1) + (denominator - 1)) / denominator
+                        : 0;
+      }
+    }
+  }
+
+  uniform_spacings.resize(L + 1);
+  for (std::size_t l = 0; l <= L; ++l) {
+    for (std::size_t i = 0; i < N; ++i) {
+      uniform_spacings.at(l).at(i) = uniform_spacing(l, i);
+    }
+  }
+}
+
+template <std::size_t N, typename Real>
+Real TensorMeshHierarchy<N, Real>::uniform_spacing(
+    const std::size_t l, const std::size_t dimension) const {
+  const std::size_t n = shapes.at(l).at(dimension);
+  if (n < 2) {
+    return 0;
+  }
+  const std::vector<Real> &xs = coordinates.at(dimension);
+  const TensorIndexRange range = indices(l, dimension);
+  TensorIndexRange::iterator p = range.begin();
+  const Real first = xs.at(*p);
+  const Real last = xs.at(shapes.back().at(dimension) - 1);
+  const Real h = (last - first) / (n - 1);
+  // Default coordinates are computed as `j * h`, so the spacings will only
+  // agree up to rounding.
+  const Real tolerance = 4 * std::numeric_limits<Real>::epsilon() *
+                         std::max(std::abs(first), std::abs(last));
+  Real x = first;
+  for (++p; p != range.end(); ++p) {
+    const Real x_next = xs.at(*p);
+    if (!(std::abs((x_next - x) - h) <= tolerance)) {
+      return 0;
+    }
+    x = x_next;
+  }
+  return h;
 }
 
 namespace {
@@ -174,7 +229,6 @@ template <std::size_t N, typename Real>
 std::size_t TensorMeshHierarchy<N, Real>::number_nodes_before(
     const std::size_t l, const std::array<std::size_t, N> multiindex) const {
   check_mesh_index_bounds(l);
-  const std::array<std::size_t, N> &SHAPE = shapes.back();
   const std::array<std::size_t, N> &shape = shapes.at(l);
   // Let `α` be the given node (its multiindex). A node (multiindex) `β` comes
   // before `α` if
@@ -208,25 +262,23 @@ std::size_t TensorMeshHierarchy<N, Real>::number_nodes_before(
   // That above assumes that `M_{i} ≠ 1`. In that case, it is impossible for
   // `β_{i}` to be less than `α_{i}` (both must be zero), so instead of
   // `ceil((α_{i} * (m_{i} - 1)) / (M_{i} - 1))` we get a factor of zero.
+  //
+  // The factors `ceil((α_{i} * (m_{i} - 1)) / (M_{i} - 1))` are precomputed
+  // (for every level, dimension, and index) in the constructor and stored in
+  // `numbers_nodes_before`.
+  const std::array<std::vector<std::size_t>, N> &counts =
+      numbers_nodes_before.at(l);
   std::size_t count = 0;
   bool impossible_constraint_encountered = false;
   for (std::size_t i = 0; i < N; ++i) {
     const std::size_t m = shape.at(i);
-    const std::size_t M = SHAPE.at(i);
     // Notice that this has no effect in the first iteration.
     count *= m;
     if (impossible_constraint_encountered) {
       continue;
     }
     const std::size_t index = multiindex.at(i);
-    const std::size_t numerator = index * (m - 1);
-    const std::size_t denominator = M - 1;
-    // We want to add `ceil(numerator / denominator)`. We can compute this term
-    // using only integer divisions by adding one less than the denominator to
-    // the numerator.
-    // If the mesh is flat in this dimension (if `M == 1`), then `β_{i}` cannot
-    // be less than `α_{i}` and so this case contributes nothing to the count.
-    count += denominator ? (numerator + (denominator - 1)) / denominator : 0;
+    count += counts.at(i).at(index);
     // The 'impossible constraint' will be encountered in the next iteration,
     // when we stipulate that `β_{i} = α_{i}` (current value of `i`).
     impossible_constraint_encountered =
@@ -316,8 +368,9 @@ template <std::size_t N, typename Real>
 std::size_t TensorMeshHierarchy<N, Real>::ndof(const std::size_t l) const {
   check_mesh_index_bounds(l);
   const std::array<std::size_t, N> &shape = shapes.at(l);
-  return std::accumulate(shape.begin(), shape.end(), 1,
-                         std::multiplies<Real>());
+  return std::accumulate(shape.begin(), shape.end(),
+                         static_cast<std::size_t>(1),
+                         std::multiplies<std::size_t>());
 }
 
 template <std::size_t N, typename Real>
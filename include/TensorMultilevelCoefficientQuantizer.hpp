@@ -3,12 +3,126 @@
 //!\file
 //!\brief Quantizer for multilevel coefficients on tensor product grids.
 
+#include <cstddef>
+
+#include <array>
+#include <vector>
+
 #include "LinearQuantizer.hpp"
 #include "TensorMeshHierarchy.hpp"
+#include "TensorMeshHierarchyIteration.hpp"
+#include "TensorSpearLayout.hpp"
 #include "utilities.hpp"
 
 namespace mgard {
 
+//! Quanta used to quantize multilevel coefficients on tensor product grids.
+//!
+//! The quantum of a coefficient depends on the level which introduced its node
+//! and on the spacing of the node's neighbors in that level. (If the
+//! coefficients come from a decomposition stopped at the `l_target`th mesh,
+//! the nodes of that mesh are all treated as though that level introduced
+//! them.) The quantum is a product of factors for each dimension, and the
+//! products over all but the last dimension are tabulated for each row of
+//! each level. Each quantum is then a single product of two table entries,
+//! whether it is computed a row at a time or for a single node. The tables
+//! are built once, a dimension at a time, and 'flat' dimensions contribute
+//! factors of exactly `1`, so the quanta don't depend on how the compiler
+//! orders floating point operations or on how many 'flat' dimensions the
+//! hierarchy has.
+template <std::size_t N, typename Real>
+class TensorMultilevelCoefficientQuanta {
+public:
+  //! Constructor.
+  //!
+  //!\param hierarchy Mesh hierarchy on which the coefficients are defined.
+  //!\param s Smoothness parameter. Determines the error norm in which
+  //! quantization error is controlled.
+  //!\param tolerance Quantization error tolerance for the entire set of
+  //! multilevel coefficients.
+  //!\param l_target Index of the coarsest mesh onto which the coefficients
+  //! were decomposed. See `DecompositionPlan`.
+  TensorMultilevelCoefficientQuanta(
+      const TensorMeshHierarchy<N, Real> &hierarchy, const Real s,
+      const Real tolerance, const std::size_t l_target = 0);
+
+  //! Compute the quantum of a coefficient.
+  //!
+  //!\param multiindex Multiindex of the node corresponding to the coefficient.
+  Real operator()(const std::array<std::size_t, N> &multiindex) const;
+
+  //! Visit the coefficients a row at a time.
+  //!
+  //! The coefficients introduced by each level are grouped into runs lying in
+  //! the same row (a 'spear' along the last dimension) of the level's mesh.
+  //! Long rows are split into several runs. The runs of each level are visited
+  //! in parallel, so `f` must be safe to call concurrently on different runs.
+  //! `f` is called as `f(position, offset, indices, quanta, n)` for each run,
+  //! where
+  //! - `n` is the number of coefficients in the run,
+  //! - `position + k` is the position of the `k`th coefficient in shuffled
+  //!   arrays,
+  //! - `offset + indices[k]` is its position in unshuffled arrays, and
+  //! - `quanta[k]` is its quantum.
+  //!
+  //!\param f Function to call on each run.
+  template <typename F> void for_each_row(F &&f) const;
+
+  //! Visit the coefficients in a range of positions in shuffled arrays a row
+  //! at a time.
+  //!
+  //! See `for_each_row(F &&)`. Runs are trimmed to the range.
+  //!
+  //!\param begin Beginning of the range of positions.
+  //!\param end End of the range of positions.
+  //!\param f Function to call on each run.
+  template <typename F>
+  void for_each_row(const std::size_t begin, const std::size_t end,
+                    F &&f) const;
+
+  //! Associated mesh hierarchy.
+  const TensorMeshHierarchy<N, Real> &hierarchy;
+
+private:
+  //! Whether error is controlled in the supremum norm.
+  bool supremum;
+
+  //! Quantum to use when controlling error in the supremum norm.
+  Real supremum_quantum_;
+
+  //! For each level, for each dimension, for each index of the finest mesh,
+  //! the factor contributed to the quanta by the spacing of the neighbors (in
+  //! that level) of the nodes with that index.
+  //!
+  //! The entries for dimensions of size 1 are all `1`.
+  std::vector<std::array<std::vector<Real>, N>> index_factors;
+
+  //! For each level, for each row of the level's mesh (in row-major order), the
+  //! product of the factor contributed by the level and the factors
+  //! contributed by the first `N - 1` indices of the row.
+  std::vector<std::vector<Real>> row_factors;
+
+  //! For each level, for each dimension but the last, for each index of the
+  //! finest mesh in the level's mesh, the position of the index in the level's
+  //! mesh.
+  std::vector<std::array<std::vector<std::size_t>, N>> level_positions;
+
+  //! Layout used to find the positions of the runs in shuffled arrays.
+  TensorSpearLayout<N, Real> layout;
+};
+
+//! Quantized multilevel coefficients too large for a compact representation.
+//!
+//! In the compact representation, the smallest value of the narrow integer
+//! type marks the positions of the outliers, whose values are stored here.
+template <typename Int> struct QuantizedOutliers {
+  //! Positions of the outliers, in increasing order.
+  std::vector<std::size_t> indices;
+
+  //! Quantized values of the outliers.
+  std::vector<Int> values;
+};
+
 //! Quantizer for multilevel coefficients on tensor product grids. Each
 //! coefficient is quantized according to its contribution to the error
 //! indicator.
@@ -23,15 +137,15 @@ public:
   //! quantization error is controlled.
   //!\param tolerance Quantization error tolerance for the entire set of
   //! multilevel coefficients.
+  //!\param l_target Index of the coarsest mesh onto which the coefficients
+  //! were decomposed. See `DecompositionPlan`.
   TensorMultilevelCoefficientQuantizer(
       const TensorMeshHierarchy<N, Real> &hierarchy, const Real s,
-      const Real tolerance);
+      const Real tolerance, const std::size_t l_target = 0);
 
   //! Quantize a multilevel coefficient.
   //!
-  //! IMPORTANT: `node` must be produced by iterating over the mesh which first
-  //! introduced the node! Use `ShuffledTensorNodeRange`. This is needed so that
-  //! the quantum is calculated correctly.
+  //! Only the multiindex of `node` is used.
   //!
   //!\param node Auxiliary node data corresponding to the coefficient.
   //!\param coefficient Multilevel coefficient to be quantized.
@@ -46,6 +160,68 @@ public:
   //!\param u Multilevel coefficients to be quantized.
   RangeSlice<iterator> operator()(Real const *const u) const;
 
+  //! Quantize a set of multilevel coefficients in bulk.
+  //!
+  //! The quanta are computed a row at a time from precomputed tables (see
+  //! `TensorMultilevelCoefficientQuanta`), and each row is quantized in a
+  //! single vectorizable loop. The results match those of `operator()`.
+  //!
+  //!\param [in] u Multilevel coefficients to be quantized.
+  //!\param [out] quantized Quantized multilevel coefficients, in the shuffled
+  //! order.
+  //!\param [in] ordering Order of the multilevel coefficients.
+  void quantize(Real const *const u, Int *const quantized,
+                const NodeOrdering ordering = NodeOrdering::Shuffled) const;
+
+  //! Quantize a set of multilevel coefficients in bulk into a narrow integer
+  //! type.
+  //!
+  //! Quantized coefficients which can't be represented by `Narrow` (and those
+  //! equal to its smallest value, which marks outliers) are replaced by the
+  //! smallest value of `Narrow` and set aside in `outliers`.
+  //!
+  //!\param [in] u Multilevel coefficients to be quantized.
+  //!\param [out] quantized Quantized multilevel coefficients, in the shuffled
+  //! order.
+  //!\param [out] outliers Quantized multilevel coefficients not representable
+  //! by `Narrow`.
+  //!\param [in] ordering Order of the multilevel coefficients.
+  template <typename Narrow>
+  void quantize(Real const *const u, Narrow *const quantized,
+                QuantizedOutliers<Int> &outliers,
+                const NodeOrdering ordering = NodeOrdering::Shuffled) const;
+
+  //! Quantize a range of multilevel coefficients in bulk into a narrow integer
+  //! type.
+  //!
+  //! This allows a set of coefficients to be quantized (and, say, compressed)
+  //! a chunk at a time. See `quantize(Real const *const, Narrow *const,
+  //! QuantizedOutliers<Int> &, const NodeOrdering) const`.
+  //!
+  //!\param [in] u Multilevel coefficients to be quantized.
+  //!\param [in] begin Beginning of the range of positions in shuffled arrays.
+  //!\param [in] end End of the range of positions in shuffled arrays.
+  //!\param [out] quantized Quantized multilevel coefficients in the range, in
+  //! the shuffled order.
+  //!\param [in, out] outliers Quantized multilevel coefficients not
+  //! representable by `Narrow`. Those in the range are appended.
+  //!\param [in] ordering Order of the multilevel coefficients.
+  template <typename Narrow>
+  void quantize(Real const *const u, const std::size_t begin,
+                const std::size_t end, Narrow *const quantized,
+                QuantizedOutliers<Int> &outliers,
+                const NodeOrdering ordering = NodeOrdering::Shuffled) const;
+
+  //! Count the quantized multilevel coefficients which would be outliers in a
+  //! compact representation.
+  //!
+  //!\param u Multilevel coefficients to be quantized.
+  //!\param ordering Order of the multilevel coefficients.
+  template <typename Narrow>
+  std::size_t
+  count_outliers(Real const *const u,
+                 const NodeOrdering ordering = NodeOrdering::Shuffled) const;
+
   //! Associated mesh hierarchy.
   const TensorMeshHierarchy<N, Real> &hierarchy;
 
@@ -55,12 +231,15 @@ public:
   //! Global quantization error tolerance.
   const Real tolerance;
 
+  //! Index of the coarsest mesh onto which the coefficients were decomposed.
+  const std::size_t l_target;
+
 private:
   //! Nodes of the finest mesh in the hierarchy.
   const ShuffledTensorNodeRange<N, Real> nodes;
 
-  //! Quantizer to use when controlling error in the supremum norm.
-  const LinearQuantizer<Real, Int> supremum_quantizer;
+  //! Quanta of the coefficients.
+  const TensorMultilevelCoefficientQuanta<N, Real> quanta;
 };
 
 //! Equality comparison.
@@ -140,20 +319,27 @@ public:
   //! quantization error was controlled.
   //!\param tolerance Quantization error tolerance for the entire set of
   //! multilevel coefficients.
+  //!\param l_target Index of the coarsest mesh onto which the coefficients
+  //! were decomposed. See `DecompositionPlan`.
   TensorMultilevelCoefficientDequantizer(
       const TensorMeshHierarchy<N, Real> &hierarchy, const Real s,
-      const Real tolerance);
+      const Real tolerance, const std::size_t l_target = 0);
 
   //! Dequantize a multilevel coefficient.
   //!
-  //! IMPORTANT: `node` must be produced by iterating over the mesh which first
-  //! introduced the node! Use `ShuffledTensorNodeRange`. This is needed so that
-  //! the quantum is calculated correctly.
+  //! Only the multiindex of `node` is used.
   //!
   //!\param node Auxiliary node data corresponding to the coefficient.
   //!\param n Multilevel coefficient to be dequantized.
   Real operator()(const TensorNode<N> node, const Int n) const;
 
+  //! Dequantize a multilevel coefficient.
+  //!
+  //!\param multiindex Multiindex of the node corresponding to the coefficient.
+  //!\param n Multilevel coefficient to be dequantized.
+  Real operator()(const std::array<std::size_t, N> &multiindex,
+                  const Int n) const;
+
   //! Iterator used to traverse a quantized range. Note that the iterator is not
   //! used to iterate over the `TensorMultilevelCoefficientDequantizer` itself.
   template <typename It> class iterator;
@@ -165,6 +351,53 @@ public:
   template <typename It>
   RangeSlice<iterator<It>> operator()(const It begin, const It end) const;
 
+  //! Dequantize a set of multilevel coefficients in bulk.
+  //!
+  //! See `TensorMultilevelCoefficientQuantizer::quantize`. The results match
+  //! those of `operator()`.
+  //!
+  //!\param [in] quantized Quantized multilevel coefficients, in the shuffled
+  //! order.
+  //!\param [out] u Dequantized multilevel coefficients.
+  //!\param [in] ordering Order of the dequantized multilevel coefficients.
+  void dequantize(Int const *const quantized, Real *const u,
+                  const NodeOrdering ordering = NodeOrdering::Shuffled) const;
+
+  //! Dequantize a set of multilevel coefficients quantized into a narrow
+  //! integer type.
+  //!
+  //! See `TensorMultilevelCoefficientQuantizer::quantize`.
+  //!
+  //!\param [in] quantized Quantized multilevel coefficients, in the shuffled
+  //! order.
+  //!\param [in] outliers Quantized multilevel coefficients not representable
+  //! by `Narrow`.
+  //!\param [out] u Dequantized multilevel coefficients.
+  //!\param [in] ordering Order of the dequantized multilevel coefficients.
+  template <typename Narrow>
+  void dequantize(Narrow const *const quantized,
+                  const QuantizedOutliers<Int> &outliers, Real *const u,
+                  const NodeOrdering ordering = NodeOrdering::Shuffled) const;
+
+  //! Dequantize a range of multilevel coefficients quantized into a narrow
+  //! integer type.
+  //!
+  //! See `TensorMultilevelCoefficientQuantizer::quantize`.
+  //!
+  //!\param [in] quantized Quantized multilevel coefficients in the range, in
+  //! the shuffled order.
+  //!\param [in] begin Beginning of the range of positions in shuffled arrays.
+  //!\param [in] end End of the range of positions in shuffled arrays.
+  //!\param [in] outliers Quantized multilevel coefficients not representable
+  //! by `Narrow`. Only those in the range need be present.
+  //!\param [out] u Dequantized multilevel coefficients.
+  //!\param [in] ordering Order of the dequantized multilevel coefficients.
+  template <typename Narrow>
+  void dequantize(Narrow const *const quantized, const std::size_t begin,
+                  const std::size_t end,
+                  const QuantizedOutliers<Int> &outliers, Real *const u,
+                  const NodeOrdering ordering = NodeOrdering::Shuffled) const;
+
   //! Associated mesh hierarchy.
   const TensorMeshHierarchy<N, Real> &hierarchy;
 
@@ -174,12 +407,15 @@ public:
   //! Global quantization error tolerance.
   const Real tolerance;
 
+  //! Index of the coarsest mesh onto which the coefficients were decomposed.
+  const std::size_t l_target;
+
 private:
   //! Nodes of the finest mesh in the hierarchy.
   const ShuffledTensorNodeRange<N, Real> nodes;
 
-  //! Dequantizer to use when controlling error in the supremum norm.
-  const LinearDequantizer<Int, Real> supremum_dequantizer;
+  //! Quanta of the coefficients.
+  const TensorMultilevelCoefficientQuanta<N, Real> quanta;
 };
 
 //! Equality comparison.
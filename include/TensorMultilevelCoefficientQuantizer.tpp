@@ -1,6 +1,9 @@
+#include <algorithm>
 #include <cmath>
 
 #include <limits>
+#include <stdexcept>
+#include <utility>
 
 namespace mgard {
 
@@ -8,9 +11,12 @@ namespace mgard {
 
 namespace {
 
+//! Maximum number of coefficients quantized together.
+const std::size_t quantization_block_size = 2048;
+
 template <std::size_t N, typename Real>
 Real supremum_quantum(const TensorMeshHierarchy<N, Real> &hierarchy,
-                      const Real tolerance) {
+                      const Real tolerance, const std::size_t l_target) {
   // Effective dimension.
   std::size_t d = 0;
   const std::array<std::size_t, N> &SHAPE = hierarchy.shapes.back();
@@ -20,61 +26,453 @@ Real supremum_quantum(const TensorMeshHierarchy<N, Real> &hierarchy,
       ++d;
     }
   }
-  // The maximum error is half the quantizer.
-  return (2 * tolerance) / ((hierarchy.L + 1) * (1 + std::pow(3, d)));
-}
-
-// IMPORTANT: `node` must be produced by iterating over the mesh which first
-// introduced the node! It should be produced by dereferencing a
-// `TensorReservedNodeRange<N, Real>::iterator`. This is needed so that
-// `volume_factor` is calculated correctly. It must be determined by the
-// distances to the neighboring nodes in the *introducing* mesh, not the finest
-// mesh (which is what is directly being iterated over in the quantization and
-// dequantization operations). You'd get the neighboring nodes in the finest
-// mesh if you dereferenced a `TensorNodeRange<N, Real>::iterator` (assuming it
-// was iterating over the finest mesh, of course).
+  // The maximum error is half the quantizer. Only the levels the
+  // decomposition reached contribute to the error.
+  return (2 * tolerance) /
+         ((hierarchy.L - l_target + 1) * (1 + std::pow(3, d)));
+}
+
+//! Check whether a coefficient can be quantized without overflowing `Int`.
+template <typename Int, typename Real>
+bool is_quantizable(const Real quantum, const Real x) {
+  const Real minimum = quantum * (std::numeric_limits<Int>::min() - 0.5);
+  const Real maximum = quantum * (std::numeric_limits<Int>::max() + 0.5);
+  return minimum < x && x < maximum;
+}
+
+//! Quantize a coefficient, or return zero if it can't be quantized.
+//!
+//! This matches `LinearQuantizer`, but doesn't throw, so that it can be used in
+//! vectorized loops.
+template <typename Int, typename Real>
+Int quantize_coefficient(const Real quantum, const Real x,
+                         const bool quantizable) {
+  // See `LinearQuantizer::operator()`.
+  return quantizable ? std::copysign(0.5 + std::abs(x / quantum), x) : 0;
+}
+
+//! Quantize a run of coefficients visited by
+//! `TensorMultilevelCoefficientQuanta::for_each_row`.
+//!
+//! Returns `false` if any coefficient could not be quantized.
+template <typename Int, typename Real>
+bool quantize_run(Real const *const u, const NodeOrdering ordering,
+                  const std::size_t position, const std::size_t offset,
+                  std::size_t const *const indices, Real const *const quanta,
+                  const std::size_t n, Int *const q) {
+  bool in_range = true;
+  if (ordering == NodeOrdering::Shuffled) {
+    Real const *const x = u + position;
+#pragma omp simd reduction(&& : in_range)
+    for (std::size_t k = 0; k < n; ++k) {
+      const bool quantizable = is_quantizable<Int>(quanta[k], x[k]);
+      in_range = in_range && quantizable;
+      q[k] = quantize_coefficient<Int>(quanta[k], x[k], quantizable);
+    }
+  } else {
+    Real const *const x = u + offset;
+#pragma omp simd reduction(&& : in_range)
+    for (std::size_t k = 0; k < n; ++k) {
+      const Real y = x[indices[k]];
+      const bool quantizable = is_quantizable<Int>(quanta[k], y);
+      in_range = in_range && quantizable;
+      q[k] = quantize_coefficient<Int>(quanta[k], y, quantizable);
+    }
+  }
+  return in_range;
+}
+
+//! Dequantize a run of coefficients visited by
+//! `TensorMultilevelCoefficientQuanta::for_each_row`.
+template <typename Int, typename Real>
+void dequantize_run(Int const *const q, const NodeOrdering ordering,
+                    const std::size_t position, const std::size_t offset,
+                    std::size_t const *const indices, Real const *const quanta,
+                    const std::size_t n, Real *const u) {
+  // See `LinearDequantizer::operator()`.
+  if (ordering == NodeOrdering::Shuffled) {
+    Real *const x = u + position;
+#pragma omp simd
+    for (std::size_t k = 0; k < n; ++k) {
+      x[k] = quanta[k] * q[k];
+    }
+  } else {
+    Real *const x = u + offset;
+#pragma omp simd
+    for (std::size_t k = 0; k < n; ++k) {
+      x[indices[k]] = quanta[k] * q[k];
+    }
+  }
+}
+
+} // namespace
+
 template <std::size_t N, typename Real>
-Real s_quantum(const TensorMeshHierarchy<N, Real> &hierarchy, const Real s,
-               const Real tolerance, const TensorNode<N> node) {
-  Real volume_factor = 1;
+TensorMultilevelCoefficientQuanta<N, Real>::TensorMultilevelCoefficientQuanta(
+    const TensorMeshHierarchy<N, Real> &hierarchy, const Real s,
+    const Real tolerance, const std::size_t l_target)
+    : hierarchy(hierarchy),
+      supremum(s == std::numeric_limits<Real>::infinity()),
+      supremum_quantum_(supremum_quantum(hierarchy, tolerance, l_target)),
+      index_factors(hierarchy.L + 1), row_factors(hierarchy.L + 1),
+      level_positions(hierarchy.L + 1),
+      layout(hierarchy, hierarchy.L, N - 1) {
+  if (l_target > hierarchy.L) {
+    throw std::out_of_range("mesh index out of range encountered");
+  }
+  if (supremum) {
+    return;
+  }
   const std::array<std::size_t, N> &SHAPE = hierarchy.shapes.back();
-  for (std::size_t i = 0; i < N; ++i) {
-    // Treat 'flat' meshes as having lower dimension.
-    if (SHAPE.at(i) > 1) {
+  const Real root_ndof = std::sqrt(static_cast<Real>(hierarchy.ndof()));
+  for (std::size_t ell = 0; ell <= hierarchy.L; ++ell) {
+    // The nodes of the `l_target`th mesh are all coefficients of that level.
+    const std::size_t l = std::max(ell, l_target);
+    for (std::size_t i = 0; i < N; ++i) {
+      std::vector<Real> &factors = index_factors.at(ell).at(i);
+      factors.assign(SHAPE.at(i), 1);
+      // Treat 'flat' meshes as having lower dimension.
+      if (SHAPE.at(i) == 1) {
+        continue;
+      }
+      // The neighbors are those in the mesh which introduced the node, not the
+      // finest mesh. At the boundary, the node is its own neighbor. The factor
+      // is one over the square root of half the distance between them.
       const std::vector<Real> &coordinates = hierarchy.coordinates.at(i);
-      volume_factor *= (coordinates.at(node.successor(i).multiindex.at(i)) -
-                        coordinates.at(node.predecessor(i).multiindex.at(i))) /
-                       2;
+      const TensorIndexRange range = hierarchy.indices(l, i);
+      const std::vector<std::size_t> indices(range.begin(), range.end());
+      const std::size_t n = indices.size();
+      for (std::size_t j = 0; j < n; ++j) {
+        const std::size_t predecessor = indices.at(j ? j - 1 : j);
+        const std::size_t successor = indices.at(j + 1 < n ? j + 1 : j);
+        factors.at(indices.at(j)) = std::sqrt(
+            2 / (coordinates.at(successor) - coordinates.at(predecessor)));
+      }
+    }
+
+    // The maximum error is half the quantizer. The rows are built up a
+    // dimension at a time, each entry the product of two stored values.
+    std::vector<Real> &rows = row_factors.at(ell);
+    rows.assign(1, (2 * tolerance) / (std::exp2(s * l) * root_ndof));
+    for (std::size_t i = 0; i + 1 < N; ++i) {
+      const TensorIndexRange range = hierarchy.indices(ell, i);
+      const std::vector<std::size_t> indices(range.begin(), range.end());
+      const std::size_t n = indices.size();
+      std::vector<std::size_t> &positions = level_positions.at(ell).at(i);
+      positions.assign(SHAPE.at(i), 0);
+      for (std::size_t j = 0; j < n; ++j) {
+        positions.at(indices.at(j)) = j;
+      }
+      const std::vector<Real> &factors = index_factors.at(ell).at(i);
+      std::vector<Real> products(rows.size() * n);
+      for (std::size_t r = 0; r < rows.size(); ++r) {
+        for (std::size_t j = 0; j < n; ++j) {
+          products[r * n + j] = rows[r] * factors[indices[j]];
+        }
+      }
+      rows = std::move(products);
     }
   }
-  const std::size_t l = hierarchy.date_of_birth(node.multiindex);
-  // The maximum error is half the quantizer.
-  return (2 * tolerance) /
-         (std::exp2(s * l) * std::sqrt(hierarchy.ndof() * volume_factor));
 }
 
-} // namespace
+template <std::size_t N, typename Real>
+Real TensorMultilevelCoefficientQuanta<N, Real>::operator()(
+    const std::array<std::size_t, N> &multiindex) const {
+  if (supremum) {
+    return supremum_quantum_;
+  }
+  const std::size_t l = hierarchy.date_of_birth(multiindex);
+  const std::array<std::size_t, N> &shape = hierarchy.shapes[l];
+  const std::array<std::vector<std::size_t>, N> &positions =
+      level_positions[l];
+  std::size_t r = 0;
+  for (std::size_t i = 0; i + 1 < N; ++i) {
+    r = r * shape[i] + positions[i][multiindex[i]];
+  }
+  return row_factors[l][r] * index_factors[l][N - 1][multiindex[N - 1]];
+}
+
+template <std::size_t N, typename Real>
+template <typename F>
+void TensorMultilevelCoefficientQuanta<N, Real>::for_each_row(F &&f) const {
+  for_each_row(0, hierarchy.ndof(), std::forward<F>(f));
+}
+
+template <std::size_t N, typename Real>
+template <typename F>
+void TensorMultilevelCoefficientQuanta<N, Real>::for_each_row(
+    const std::size_t begin, const std::size_t end, F &&f) const {
+  const std::array<std::size_t, N> &SHAPE = hierarchy.shapes.back();
+  std::array<std::size_t, N> strides;
+  {
+    std::size_t stride = 1;
+    for (std::size_t k = 0; k < N; ++k) {
+      const std::size_t i = N - 1 - k;
+      strides.at(i) = stride;
+      stride *= SHAPE.at(i);
+    }
+  }
+  const std::vector<std::size_t> &last_dates_of_birth =
+      hierarchy.dates_of_birth.back();
+
+  for (std::size_t l = 0; l <= hierarchy.L; ++l) {
+    const std::size_t level_begin = l ? hierarchy.ndof(l - 1) : 0;
+    const std::size_t level_end = hierarchy.ndof(l);
+    if (level_end <= begin || end <= level_begin) {
+      continue;
+    }
+
+    const std::array<std::size_t, N> &shape = hierarchy.shapes.at(l);
+    std::array<std::vector<std::size_t>, N> indices;
+    for (std::size_t i = 0; i < N; ++i) {
+      const TensorIndexRange range = hierarchy.indices(l, i);
+      indices.at(i).assign(range.begin(), range.end());
+    }
+    // Indices in the last dimension of the nodes of a row which are new to
+    // this level, both when the row is itself new and when it isn't.
+    const std::vector<std::size_t> &all_last_indices = indices.back();
+    std::vector<std::size_t> new_last_indices;
+    for (const std::size_t index : all_last_indices) {
+      if (last_dates_of_birth.at(index) == l) {
+        new_last_indices.push_back(index);
+      }
+    }
+    // These are empty when controlling error in the supremum norm.
+    const std::vector<Real> &rows = row_factors.at(l);
+    const std::vector<Real> &last_factors = index_factors.at(l).back();
+
+    // Multiindex (with last index zero) of the first node of a row.
+    const auto row_multiindex = [&](const std::size_t r) {
+      std::array<std::size_t, N> multiindex;
+      multiindex.back() = 0;
+      std::size_t remainder = r;
+      for (std::size_t k = 1; k < N; ++k) {
+        const std::size_t i = N - 1 - k;
+        multiindex[i] = indices[i][remainder % shape[i]];
+        remainder /= shape[i];
+      }
+      return multiindex;
+    };
+    // Position in shuffled arrays of the first new node of a row (or of the
+    // following row, if the row has no new nodes). Nondecreasing in `r`.
+    const auto row_position = [&](const std::size_t r) {
+      return layout.offset(l, row_multiindex(r));
+    };
+
+    // Rows overlapping the range, found by bisection.
+    const std::size_t nrows = hierarchy.ndof(l) / shape.back();
+    std::size_t row_begin = 0;
+    {
+      std::size_t count = nrows;
+      while (count) {
+        const std::size_t step = count / 2;
+        if (row_position(row_begin + step) <= begin) {
+          row_begin += step + 1;
+          count -= step + 1;
+        } else {
+          count = step;
+        }
+      }
+      row_begin = row_begin ? row_begin - 1 : 0;
+    }
+    std::size_t row_end = row_begin;
+    {
+      std::size_t count = nrows - row_begin;
+      while (count) {
+        const std::size_t step = count / 2;
+        if (row_position(row_end + step) < end) {
+          row_end += step + 1;
+          count -= step + 1;
+        } else {
+          count = step;
+        }
+      }
+    }
+
+    // Long rows are split into blocks so that there is enough work to go
+    // around even when there are only a few rows (in particular, in 1D).
+    const std::size_t nblocks =
+        (shape.back() + quantization_block_size - 1) / quantization_block_size;
+
+#pragma omp parallel
+    {
+      std::vector<Real> block_quanta(quantization_block_size);
+#pragma omp for
+      for (std::size_t t = 0; t < (row_end - row_begin) * nblocks; ++t) {
+        const std::size_t r = row_begin + t / nblocks;
+        const std::size_t block_begin =
+            (t % nblocks) * quantization_block_size;
+
+        const std::array<std::size_t, N> multiindex = row_multiindex(r);
+        std::size_t offset = 0;
+        bool row_is_new = false;
+        for (std::size_t i = 0; i + 1 < N; ++i) {
+          const std::size_t index = multiindex[i];
+          offset += index * strides[i];
+          row_is_new = row_is_new || hierarchy.dates_of_birth[i][index] == l;
+        }
+
+        const std::vector<std::size_t> &row_indices =
+            row_is_new ? all_last_indices : new_last_indices;
+        if (block_begin >= row_indices.size()) {
+          continue;
+        }
+        const std::size_t block_position =
+            layout.offset(l, multiindex) + block_begin;
+        const std::size_t block_size =
+            std::min(quantization_block_size, row_indices.size() - block_begin);
+        // Trim the block to the range.
+        const std::size_t position = std::max(block_position, begin);
+        const std::size_t position_end =
+            std::min(block_position + block_size, end);
+        if (position >= position_end) {
+          continue;
+        }
+        const std::size_t n = position_end - position;
+        std::size_t const *const p =
+            row_indices.data() + block_begin + (position - block_position);
+        if (supremum) {
+          std::fill(block_quanta.begin(), block_quanta.begin() + n,
+                    supremum_quantum_);
+        } else {
+          const Real row_factor = rows[r];
+#pragma omp simd
+          for (std::size_t k = 0; k < n; ++k) {
+            block_quanta[k] = row_factor * last_factors[p[k]];
+          }
+        }
+        f(position, offset, p, static_cast<Real const *>(block_quanta.data()),
+          n);
+      }
+    }
+  }
+}
 
 template <std::size_t N, typename Real, typename Int>
 Qntzr<N, Real, Int>::Qntzr(const TensorMeshHierarchy<N, Real> &hierarchy,
-                           const Real s, const Real tolerance)
-    : hierarchy(hierarchy), s(s), tolerance(tolerance),
+                           const Real s, const Real tolerance,
+                           const std::size_t l_target)
+    : hierarchy(hierarchy), s(s), tolerance(tolerance), l_target(l_target),
       nodes(hierarchy, hierarchy.L),
-      supremum_quantizer(supremum_quantum(hierarchy, tolerance)) {}
+      quanta(hierarchy, s, tolerance, l_target) {}
 
 template <std::size_t N, typename Real, typename Int>
 Int Qntzr<N, Real, Int>::operator()(const TensorNode<N> node,
                                     const Real coefficient) const {
-  // TODO: Look into moving this test outside of the operator.
-  if (s == std::numeric_limits<Real>::infinity()) {
-    return supremum_quantizer(coefficient);
-  } else {
-    const LinearQuantizer<Real, Int> quantizer(
-        s_quantum(hierarchy, s, tolerance, node));
-    return quantizer(coefficient);
+  const LinearQuantizer<Real, Int> quantizer(quanta(node.multiindex));
+  return quantizer(coefficient);
+}
+
+template <std::size_t N, typename Real, typename Int>
+void Qntzr<N, Real, Int>::quantize(Real const *const u, Int *const quantized,
+                                   const NodeOrdering ordering) const {
+  // Exceptions can't be thrown out of the parallel loops in `for_each_row`.
+  bool out_of_range = false;
+  quanta.for_each_row([&](const std::size_t position, const std::size_t offset,
+                          std::size_t const *const indices,
+                          Real const *const quanta, const std::size_t n) {
+    if (!quantize_run(u, ordering, position, offset, indices, quanta, n,
+                      quantized + position)) {
+#pragma omp atomic write
+      out_of_range = true;
+    }
+  });
+  if (out_of_range) {
+    throw std::domain_error("number too large to be quantized");
+  }
+}
+
+template <std::size_t N, typename Real, typename Int>
+template <typename Narrow>
+void Qntzr<N, Real, Int>::quantize(Real const *const u, Narrow *const quantized,
+                                   QuantizedOutliers<Int> &outliers,
+                                   const NodeOrdering ordering) const {
+  outliers.indices.clear();
+  outliers.values.clear();
+  quantize(u, 0, hierarchy.ndof(), quantized, outliers, ordering);
+}
+
+template <std::size_t N, typename Real, typename Int>
+template <typename Narrow>
+void Qntzr<N, Real, Int>::quantize(Real const *const u, const std::size_t begin,
+                                   const std::size_t end,
+                                   Narrow *const quantized,
+                                   QuantizedOutliers<Int> &outliers,
+                                   const NodeOrdering ordering) const {
+  const Narrow marker = std::numeric_limits<Narrow>::min();
+  const Narrow maximum = std::numeric_limits<Narrow>::max();
+  bool out_of_range = false;
+  std::vector<std::pair<std::size_t, Int>> found;
+  quanta.for_each_row(begin, end, [&](const std::size_t position,
+                                      const std::size_t offset,
+                                      std::size_t const *const indices,
+                                      Real const *const quanta,
+                                      const std::size_t n) {
+    std::array<Int, quantization_block_size> wide;
+    if (!quantize_run(u, ordering, position, offset, indices, quanta, n,
+                      wide.data())) {
+#pragma omp atomic write
+      out_of_range = true;
+    }
+    Narrow *const q = quantized + (position - begin);
+    bool representable = true;
+#pragma omp simd reduction(&& : representable)
+    for (std::size_t k = 0; k < n; ++k) {
+      const bool fits = marker < wide[k] && wide[k] <= maximum;
+      q[k] = fits ? static_cast<Narrow>(wide[k]) : marker;
+      representable = representable && fits;
+    }
+    if (!representable) {
+#pragma omp critical
+      for (std::size_t k = 0; k < n; ++k) {
+        if (q[k] == marker) {
+          found.push_back({position + k, wide[k]});
+        }
+      }
+    }
+  });
+  if (out_of_range) {
+    throw std::domain_error("number too large to be quantized");
+  }
+
+  std::sort(found.begin(), found.end());
+  for (const std::pair<std::size_t, Int> &outlier : found) {
+    outliers.indices.push_back(outlier.first);
+    outliers.values.push_back(outlier.second);
   }
 }
 
+template <std::size_t N, typename Real, typename Int>
+template <typename Narrow>
+std::size_t Qntzr<N, Real, Int>::count_outliers(
+    Real const *const u, const NodeOrdering ordering) const {
+  const Narrow marker = std::numeric_limits<Narrow>::min();
+  const Narrow maximum = std::numeric_limits<Narrow>::max();
+  bool out_of_range = false;
+  std::size_t count = 0;
+  quanta.for_each_row([&](const std::size_t position, const std::size_t offset,
+                          std::size_t const *const indices,
+                          Real const *const quanta, const std::size_t n) {
+    std::array<Int, quantization_block_size> wide;
+    if (!quantize_run(u, ordering, position, offset, indices, quanta, n,
+                      wide.data())) {
+#pragma omp atomic write
+      out_of_range = true;
+    }
+    std::size_t run_count = 0;
+#pragma omp simd reduction(+ : run_count)
+    for (std::size_t k = 0; k < n; ++k) {
+      run_count += !(marker < wide[k] && wide[k] <= maximum);
+    }
+#pragma omp atomic
+    count += run_count;
+  });
+  if (out_of_range) {
+    throw std::domain_error("number too large to be quantized");
+  }
+  return count;
+}
+
 template <std::size_t N, typename Real, typename Int>
 RangeSlice<typename Qntzr<N, Real, Int>::iterator> Qntzr<N, Real, Int>::
 operator()(Real const *const u) const {
@@ -84,7 +482,8 @@ operator()(Real const *const u) const {
 
 template <std::size_t N, typename Real, typename Int>
 bool operator==(const Qntzr<N, Real, Int> &a, const Qntzr<N, Real, Int> &b) {
-  return a.hierarchy == b.hierarchy && a.s == b.s && a.tolerance == b.tolerance;
+  return a.hierarchy == b.hierarchy && a.s == b.s &&
+         a.tolerance == b.tolerance && a.l_target == b.l_target;
 }
 
 template <std::size_t N, typename Real, typename Int>
@@ -133,27 +532,84 @@ Int Qntzr<N, Real, Int>::iterator::operator*() const {
   return quantizer(*inner_node, *inner_coeff);
 }
 
-#undef Qntzer
+#undef Qntzr
 #define Dqntzr TensorMultilevelCoefficientDequantizer
 
 template <std::size_t N, typename Int, typename Real>
 Dqntzr<N, Int, Real>::Dqntzr(const TensorMeshHierarchy<N, Real> &hierarchy,
-                             const Real s, const Real tolerance)
-    : hierarchy(hierarchy), s(s), tolerance(tolerance),
+                             const Real s, const Real tolerance,
+                             const std::size_t l_target)
+    : hierarchy(hierarchy), s(s), tolerance(tolerance), l_target(l_target),
       nodes(hierarchy, hierarchy.L),
-      supremum_dequantizer(supremum_quantum(hierarchy, tolerance)) {}
+      quanta(hierarchy, s, tolerance, l_target) {}
 
 template <std::size_t N, typename Int, typename Real>
 Real Dqntzr<N, Int, Real>::operator()(const TensorNode<N> node,
                                       const Int n) const {
-  // TODO: Look into moving this test outside of the operator.
-  if (s == std::numeric_limits<Real>::infinity()) {
-    return supremum_dequantizer(n);
-  } else {
-    const LinearDequantizer<Int, Real> dequantizer(
-        s_quantum(hierarchy, s, tolerance, node));
-    return dequantizer(n);
-  }
+  return operator()(node.multiindex, n);
+}
+
+template <std::size_t N, typename Int, typename Real>
+Real Dqntzr<N, Int, Real>::operator()(
+    const std::array<std::size_t, N> &multiindex, const Int n) const {
+  const LinearDequantizer<Int, Real> dequantizer(quanta(multiindex));
+  return dequantizer(n);
+}
+
+template <std::size_t N, typename Int, typename Real>
+void Dqntzr<N, Int, Real>::dequantize(Int const *const quantized, Real *const u,
+                                      const NodeOrdering ordering) const {
+  quanta.for_each_row([&](const std::size_t position, const std::size_t offset,
+                          std::size_t const *const indices,
+                          Real const *const quanta, const std::size_t n) {
+    dequantize_run(quantized + position, ordering, position, offset, indices,
+                   quanta, n, u);
+  });
+}
+
+template <std::size_t N, typename Int, typename Real>
+template <typename Narrow>
+void Dqntzr<N, Int, Real>::dequantize(Narrow const *const quantized,
+                                      const QuantizedOutliers<Int> &outliers,
+                                      Real *const u,
+                                      const NodeOrdering ordering) const {
+  dequantize(quantized, 0, hierarchy.ndof(), outliers, u, ordering);
+}
+
+template <std::size_t N, typename Int, typename Real>
+template <typename Narrow>
+void Dqntzr<N, Int, Real>::dequantize(Narrow const *const quantized,
+                                      const std::size_t begin,
+                                      const std::size_t end,
+                                      const QuantizedOutliers<Int> &outliers,
+                                      Real *const u,
+                                      const NodeOrdering ordering) const {
+  const Narrow marker = std::numeric_limits<Narrow>::min();
+  const std::vector<std::size_t> &outlier_indices = outliers.indices;
+  quanta.for_each_row(begin, end, [&](const std::size_t position,
+                                      const std::size_t offset,
+                                      std::size_t const *const indices,
+                                      Real const *const quanta,
+                                      const std::size_t n) {
+    std::array<Int, quantization_block_size> wide;
+    Narrow const *const q = quantized + (position - begin);
+    bool representable = true;
+#pragma omp simd reduction(&& : representable)
+    for (std::size_t k = 0; k < n; ++k) {
+      wide[k] = q[k];
+      representable = representable && q[k] != marker;
+    }
+    if (!representable) {
+      std::vector<std::size_t>::const_iterator p = std::lower_bound(
+          outlier_indices.begin(), outlier_indices.end(), position);
+      for (; p != outlier_indices.end() && *p < position + n; ++p) {
+        wide[*p - position] =
+            outliers.values.at(p - outlier_indices.begin());
+      }
+    }
+    dequantize_run(wide.data(), ordering, position, offset, indices, quanta,
+                   n, u);
+  });
 }
 
 template <std::size_t N, typename Int, typename Real>
@@ -166,7 +622,8 @@ Dqntzr<N, Int, Real>::operator()(const It begin, const It end) const {
 
 template <std::size_t N, typename Int, typename Real>
 bool operator==(const Dqntzr<N, Int, Real> &a, const Dqntzr<N, Int, Real> &b) {
-  return a.hierarchy == b.hierarchy && a.s == b.s && a.tolerance == b.tolerance;
+  return a.hierarchy == b.hierarchy && a.s == b.s &&
+         a.tolerance == b.tolerance && a.l_target == b.l_target;
 }
 
 template <std::size_t N, typename Int, typename Real>
@@ -226,3 +683,4 @@ Real Dqntzr<N, Int, Real>::iterator<It>::iterator::operator*() const {
 #undef Dqntzr
 
 } // namespace mgard
+
@@ -17,10 +17,14 @@ namespace mgard {
 //!\param [in] u Nodal values of the function.
 //!\param [in, out] f Product of the mass matrix and the nodal values of the
 //! function.
+//!\param [in] l_target Index of the coarsest mesh to project onto. The entry
+//! for this level is the square norm of the projection onto its mesh, and the
+//! entries for the coarser levels are zero.
 template <std::size_t N, typename Real>
 std::vector<Real>
 orthogonal_component_square_norms(const TensorMeshHierarchy<N, Real> &hierarchy,
-                                  Real const *const u, Real *const f);
+                                  Real const *const u, Real *const f,
+                                  const std::size_t l_target = 0);
 
 //! Compute the norm of a function on a mesh hierarchy.
 //!
@@ -30,12 +34,16 @@ orthogonal_component_square_norms(const TensorMeshHierarchy<N, Real> &hierarchy,
 //!\param [in] u Nodal values of the function.
 //!\param [in] s Smoothness parameter for the norm.
 //!
+//!\param [in] l_target Index of the coarsest mesh used to split the function
+//! into components. See `DecompositionPlan`.
+//!
 //! If `s` is `+inf`, the `L^inf` norm (supremum norm) is calculated. Otherwise,
 //! the '`s` norm' is calculated. When `s` is zero, this norm is equal to the
-//!`L^2` norm.
+//!`L^2` norm. The components on the levels up through `l_target` are weighted
+//! together, as the `l_target`th level's.
 template <std::size_t N, typename Real>
 Real norm(const TensorMeshHierarchy<N, Real> &hierarchy, Real const *const u,
-          const Real s);
+          const Real s, const std::size_t l_target = 0);
 
 } // namespace mgard
 
@@ -4,6 +4,7 @@
 
 #include <algorithm>
 #include <array>
+#include <stdexcept>
 
 #include "TensorMassMatrix.hpp"
 #include "TensorRestriction.hpp"
@@ -45,10 +46,15 @@ Real L_2_norm(const TensorMeshHierarchy<N, Real> &hierarchy,
 template <std::size_t N, typename Real>
 std::vector<Real>
 orthogonal_component_square_norms(const TensorMeshHierarchy<N, Real> &hierarchy,
-                                  Real const *const u, Real *const f) {
+                                  Real const *const u, Real *const f,
+                                  const std::size_t l_target) {
+  if (l_target > hierarchy.L) {
+    throw std::out_of_range("mesh index out of range encountered");
+  }
   // Square `L^2` norms of the `L^2` projections of `u` onto the levels in the
-  // hierarchy, ordered from coarsest to finest.
-  std::vector<Real> square_norms(hierarchy.L + 1);
+  // hierarchy, ordered from coarsest to finest. The projections onto the
+  // levels before the `l_target`th aren't computed.
+  std::vector<Real> square_norms(hierarchy.L + 1, 0);
 
   // For the finest level, we don't need to compute the projection.
   square_norms.at(hierarchy.L) = blas::dotu(hierarchy.ndof(), u, f);
@@ -66,7 +72,7 @@ orthogonal_component_square_norms(const TensorMeshHierarchy<N, Real> &hierarchy,
   // impression that it's agnostic to it. The functions at the top of
   // `mgard.tpp` more nicely mix statements that might work for arrays shuffled
   // differently and statements that rely on the current shuffling algorithm.
-  for (std::size_t i = 1; i <= hierarchy.L; ++i) {
+  for (std::size_t i = 1; i <= hierarchy.L - l_target; ++i) {
     const std::size_t l = hierarchy.L - i;
 
     const PseudoArray<Real> f_on_finer = hierarchy.on_nodes(f, l + 1);
@@ -86,7 +92,7 @@ orthogonal_component_square_norms(const TensorMeshHierarchy<N, Real> &hierarchy,
   }
   std::free(projection);
 
-  for (std::size_t i = 1; i <= hierarchy.L; ++i) {
+  for (std::size_t i = 1; i <= hierarchy.L - l_target; ++i) {
     const std::size_t l = hierarchy.L - i;
 
     // In the Python implementation, I found I could get negative differences
@@ -101,7 +107,7 @@ namespace {
 
 template <std::size_t N, typename Real>
 Real s_norm(const TensorMeshHierarchy<N, Real> &hierarchy, Real const *const u,
-            const Real s) {
+            const Real s, const std::size_t l_target) {
   const std::size_t ndof = hierarchy.ndof();
 
   Real *const f = static_cast<Real *>(std::malloc(sizeof(Real) * ndof));
@@ -111,11 +117,11 @@ Real s_norm(const TensorMeshHierarchy<N, Real> &hierarchy, Real const *const u,
     M(f);
   }
   const std::vector<Real> squares_for_norm =
-      orthogonal_component_square_norms<N, Real>(hierarchy, u, f);
+      orthogonal_component_square_norms<N, Real>(hierarchy, u, f, l_target);
   std::free(f);
 
   Real square_norm = 0;
-  for (std::size_t l = 0; l <= hierarchy.L; ++l) {
+  for (std::size_t l = l_target; l <= hierarchy.L; ++l) {
     square_norm += std::exp2(2 * s * l) * squares_for_norm.at(l);
   }
   return std::sqrt(square_norm);
@@ -125,13 +131,13 @@ Real s_norm(const TensorMeshHierarchy<N, Real> &hierarchy, Real const *const u,
 
 template <std::size_t N, typename Real>
 Real norm(const TensorMeshHierarchy<N, Real> &hierarchy, Real const *const u,
-          const Real s) {
+          const Real s, const std::size_t l_target) {
   if (s == std::numeric_limits<Real>::infinity()) {
     return L_infinity_norm(hierarchy, u);
   } else if (s == 0) {
     return L_2_norm(hierarchy, u);
   } else {
-    return s_norm(hierarchy, u, s);
+    return s_norm(hierarchy, u, s, l_target);
   }
 }
 
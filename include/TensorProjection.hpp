@@ -0,0 +1,175 @@
+#ifndef TENSORPROJECTION_HPP
+#define TENSORPROJECTION_HPP
+//!\file
+//!\brief Projection to the next coarser mesh for tensor product grids.
+
+#include <vector>
+
+#include "TensorLinearOperator.hpp"
+#include "TensorMassMatrix.hpp"
+
+namespace mgard {
+
+//! Projection of continuous piecewise linear functions defined on a mesh
+//! 'spear' to the coarse 'spear.'
+//!
+//! The operator is the product of the mass matrix on the fine 'spear,' the
+//! restriction to the coarse 'spear,' and the inverse of the mass matrix on the
+//! coarse 'spear.' The three are applied in a single pass, and only the values
+//! at the nodes of the coarse 'spear' are written.
+template <std::size_t N, typename Real>
+class ConstituentProjection
+    : public StaticConstituentLinearOperator<N, Real,
+                                             ConstituentProjection<N, Real>> {
+public:
+  //! Constructor.
+  //!
+  //! This constructor is provided so that arrays of this class may be formed. A
+  //! default-constructed instance must be assigned to before being used.
+  ConstituentProjection() = default;
+
+  //! Constructor.
+  //!
+  //!\param hierarchy Mesh hierarchy on which the functions are defined.
+  //!\param l Index of the mesh on which the projection is to be applied. This
+  //! is the index of the fine mesh (corresponding to the domain).
+  //!\param dimension Index of the dimension in which the projection is to be
+  //! applied.
+  //!\param ordering Order of the arrays to which the projection is to be
+  //! applied.
+  ConstituentProjection(const TensorMeshHierarchy<N, Real> &hierarchy,
+                        const std::size_t l, const std::size_t dimension,
+                        const NodeOrdering ordering = NodeOrdering::Shuffled);
+
+  //! Apply the operator along several 'spears' in place.
+  //!
+  //! See `StaticConstituentLinearOperator`. No checks are made. The values at
+  //! the nodes of the fine 'spears' not in the coarse 'spears' are left
+  //! unchanged.
+  //!
+  //!\param [in] multiindices Starting multiindices of the 'spears.'
+  //!\param [in] n Number of 'spears.'
+  //!\param [in, out] v Element in the domain, to be transformed into an element
+  //! in the range.
+  template <std::size_t D>
+  void apply(std::array<std::size_t, N> const *const multiindices,
+             const std::size_t n, Real *const v) const;
+
+  //! Apply the operator along several 'spears' to a function supported on the
+  //! nodes new to the fine mesh.
+  //!
+  //! The function is taken to agree with `u` at the nodes new to the fine mesh
+  //! and to vanish at the nodes of the coarse mesh, so those entries of `u` are
+  //! never read. No checks are made.
+  //!
+  //!\param [in] multiindices Starting multiindices of the 'spears.'
+  //!\param [in] n Number of 'spears.'
+  //!\param [in] u Element in the domain.
+  //!\param [out] v Element in the range. Only the values at the nodes of the
+  //! coarse 'spears' are written.
+  template <std::size_t D>
+  void apply_to_new_nodes(std::array<std::size_t, N> const *const multiindices,
+                          const std::size_t n, Real const *const u,
+                          Real *const v) const;
+
+private:
+  using CLO = ConstituentLinearOperator<N, Real>;
+  using SCLO = StaticConstituentLinearOperator<N, Real, ConstituentProjection>;
+
+  //! Index of the fine mesh.
+  std::size_t l = 0;
+
+  //! Positions in the fine 'spear' of the nodes of the coarse 'spear.'
+  std::vector<std::size_t> coarse_positions;
+
+  //! Spacing of the nodes of the fine 'spear' if they are equispaced and the
+  //! coarse nodes are every other fine node, and zero otherwise. In that case
+  //! the mass matrix entries are `h / 6`, `2 * h / 3`, and `h / 3` and the
+  //! restriction weights are all `1 / 2`.
+  Real spacing = 0;
+
+  //! Subdiagonal, diagonal, and superdiagonal entries of the rows of the mass
+  //! matrix on the fine 'spear.' The first subdiagonal and last superdiagonal
+  //! entries are zero.
+  std::vector<Real> mass_subdiagonal;
+  std::vector<Real> mass_diagonal;
+  std::vector<Real> mass_superdiagonal;
+
+  //! For each node of the fine 'spear,' the position in the coarse 'spear' of
+  //! the coarse node at or to the left of it.
+  std::vector<std::size_t> left_coarse_positions;
+
+  //! Restriction weights of the nodes of the fine 'spear' for the coarse nodes
+  //! at or to the left of them and to the right of them. The right weights of
+  //! the coarse nodes are zero.
+  std::vector<Real> left_weights;
+  std::vector<Real> right_weights;
+
+  //! Inverse of the mass matrix on the coarse 'spear.'
+  ConstituentMassMatrixInverse<N, Real> coarse_mass_matrix_inverse;
+
+  //! Apply the operator along a tile of 'spears.'
+  //!
+  //! If `new_nodes_only` is `true`, the values of `u` at the nodes of the
+  //! coarse mesh are taken to be zero.
+  template <std::size_t D, bool new_nodes_only>
+  void apply_to_tile(std::array<std::size_t, N> const *const multiindices,
+                     const std::size_t m, Real const *const u,
+                     Real *const v) const;
+};
+
+//! Projection of tensor products of continuous piecewise linear functions
+//! defined on a Cartesian product mesh hierarchy to the next coarser mesh.
+//!
+//! This is the product of `TensorMassMatrix` on the fine mesh,
+//! `TensorRestriction`, and `TensorMassMatrixInverse` on the coarse mesh. The
+//! three are applied dimension by dimension in a single pass, and in each
+//! dimension only the 'spears' through nodes of the coarse mesh in the
+//! dimensions already processed are visited.
+template <std::size_t N, typename Real>
+class TensorProjection : public TensorLinearOperator<N, Real> {
+public:
+  //! Constructor.
+  //!
+  //!\param hierarchy Mesh hierarchy on which the functions are defined.
+  //!\param l Index of the mesh on which the projection is to be applied. This
+  //! is the index of the fine mesh (corresponding to the domain).
+  //!\param ordering Order of the arrays to which the projection is to be
+  //! applied.
+  TensorProjection(const TensorMeshHierarchy<N, Real> &hierarchy,
+                   const std::size_t l,
+                   const NodeOrdering ordering = NodeOrdering::Shuffled);
+
+  //! Apply the operator to an element in place.
+  //!
+  //! Only the values at the nodes of the coarse mesh are meaningful afterwards.
+  //! The values at the other nodes of the fine mesh may be overwritten.
+  //!
+  //!\param [in, out] v Element in the domain, to be transformed into an element
+  //! in the range.
+  void operator()(Real *const v) const;
+
+  //! Apply the operator to a function supported on the nodes new to the fine
+  //! mesh.
+  //!
+  //! The function is taken to agree with `u` at the nodes new to the fine mesh
+  //! and to vanish at the nodes of the coarse mesh, so those entries of `u` are
+  //! never read. This saves zeroing them in a separate pass.
+  //!
+  //!\param [in] u Element in the domain.
+  //!\param [out] v Element in the range. Only the values at the nodes of the
+  //! coarse mesh are meaningful afterwards. The values at the other nodes of
+  //! the fine mesh may be overwritten.
+  void operator()(Real const *const u, Real *const v) const;
+
+private:
+  using TLO = TensorLinearOperator<N, Real>;
+
+  //! Constituent projections for each dimension.
+  const std::array<ConstituentProjection<N, Real>, N> projections;
+};
+
+} // namespace mgard
+
+#include "TensorProjection.tpp"
+#endif
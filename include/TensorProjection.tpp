@@ -0,0 +1,288 @@
+#include <algorithm>
+
+namespace mgard {
+
+template <std::size_t N, typename Real>
+ConstituentProjection<N, Real>::ConstituentProjection(
+    const TensorMeshHierarchy<N, Real> &hierarchy, const std::size_t l,
+    const std::size_t dimension, const NodeOrdering ordering)
+    : SCLO(hierarchy, l, dimension, ordering), l(l),
+      coarse_positions(
+          CLO::layout.positions(hierarchy.indices(l - 1, dimension))),
+      coarse_mass_matrix_inverse(hierarchy, l - 1, dimension, ordering) {
+  const std::size_t n = CLO::dimension();
+  if (n < 2) {
+    throw std::invalid_argument("projection implementation assumes that "
+                                "'spear' has at least two nodes");
+  }
+  const std::vector<std::size_t> &indices = CLO::layout.indices;
+  const std::vector<Real> &xs = hierarchy.coordinates.at(dimension);
+
+  // See `ConstituentRestriction`.
+  bool uniform = hierarchy.uniform_spacings.at(l).at(dimension) &&
+                 2 * coarse_positions.size() == n + 1;
+  for (std::size_t p = 0; uniform && p < coarse_positions.size(); ++p) {
+    uniform = coarse_positions.at(p) == 2 * p;
+  }
+  if (uniform) {
+    spacing = hierarchy.uniform_spacings.at(l).at(dimension);
+  }
+
+  // Mass matrix entries. See `ConstituentMassMatrix`.
+  mass_subdiagonal.resize(n);
+  mass_diagonal.resize(n);
+  mass_superdiagonal.resize(n);
+  for (std::size_t j = 0; j < n; ++j) {
+    const Real h_left = j ? xs.at(indices.at(j)) - xs.at(indices.at(j - 1)) : 0;
+    const Real h_right =
+        j + 1 < n ? xs.at(indices.at(j + 1)) - xs.at(indices.at(j)) : 0;
+    mass_subdiagonal.at(j) = h_left / 6;
+    mass_diagonal.at(j) = (h_left + h_right) / 3;
+    mass_superdiagonal.at(j) = h_right / 6;
+  }
+
+  // Restriction weights. See `ConstituentRestriction`.
+  left_coarse_positions.resize(n);
+  left_weights.resize(n);
+  right_weights.resize(n);
+  for (std::size_t p = 0; p < coarse_positions.size(); ++p) {
+    const std::size_t J_left = coarse_positions.at(p);
+    left_coarse_positions.at(J_left) = p;
+    left_weights.at(J_left) = 1;
+    right_weights.at(J_left) = 0;
+    if (p + 1 == coarse_positions.size()) {
+      continue;
+    }
+    const std::size_t J = coarse_positions.at(p + 1);
+    const Real x_left = xs.at(indices.at(J_left));
+    const Real x_right = xs.at(indices.at(J));
+    const Real width_reciprocal = 1 / (x_right - x_left);
+    for (std::size_t j = J_left + 1; j < J; ++j) {
+      const Real x_middle = xs.at(indices.at(j));
+      left_coarse_positions.at(j) = p;
+      left_weights.at(j) = (x_right - x_middle) * width_reciprocal;
+      right_weights.at(j) = (x_middle - x_left) * width_reciprocal;
+    }
+  }
+}
+
+template <std::size_t N, typename Real>
+template <std::size_t D>
+void ConstituentProjection<N, Real>::apply(
+    std::array<std::size_t, N> const *const multiindices, const std::size_t n,
+    Real *const v) const {
+  apply_to_tile<D, false>(multiindices, n, v, v);
+}
+
+template <std::size_t N, typename Real>
+template <std::size_t D>
+void ConstituentProjection<N, Real>::apply_to_new_nodes(
+    std::array<std::size_t, N> const *const multiindices, const std::size_t n,
+    Real const *const u, Real *const v) const {
+  apply_to_tile<D, true>(multiindices, n, u, v);
+}
+
+template <std::size_t N, typename Real>
+template <std::size_t D, bool new_nodes_only>
+void ConstituentProjection<N, Real>::apply_to_tile(
+    std::array<std::size_t, N> const *const multiindices, const std::size_t m,
+    Real const *const u, Real *const v) const {
+  const std::size_t n = CLO::dimension();
+  const std::size_t n_coarse = coarse_positions.size();
+
+  // Positions of the spears' nodes in `u` and `v`, the input values, and the
+  // righthand sides of the coarse mass matrix systems, all interleaved so that
+  // the entries for the `j`th nodes of the spears are contiguous. The input
+  // values are padded with a row of zeros at each end so that every row of the
+  // mass matrix can be applied in the same way.
+  // The buffers are kept from call to call so that no memory is allocated
+  // once they are large enough.
+  thread_local std::vector<std::size_t> offsets;
+  thread_local std::vector<Real> values;
+  thread_local std::vector<Real> rhs;
+  offsets.resize(n * m);
+  values.resize((n + 2) * m);
+  rhs.resize(n_coarse * m);
+  CLO::layout.interleaved_offsets(multiindices, m, offsets.data());
+  std::fill(values.begin(), values.begin() + m, 0);
+  std::fill(values.end() - m, values.end(), 0);
+  Real *const w = values.data() + m;
+  if (new_nodes_only) {
+    const std::array<std::vector<std::size_t>, N> &dates_of_birth =
+        CLO::hierarchy->dates_of_birth;
+    for (std::size_t k = 0; k < m; ++k) {
+      // A node of the spear is on the coarse mesh if its index in this
+      // dimension is and the spear itself passes through the coarse mesh.
+      std::size_t date_of_birth = 0;
+      for (std::size_t i = 0; i < N; ++i) {
+        if (i != D) {
+          date_of_birth = std::max(date_of_birth,
+                                   dates_of_birth[i][multiindices[k][i]]);
+        }
+      }
+      const bool spear_is_new = date_of_birth == l;
+      for (std::size_t j = 0; j < n; ++j) {
+        const std::size_t i = j * m + k;
+        w[i] = spear_is_new || right_weights[j] ? u[offsets[i]] : 0;
+      }
+    }
+  } else {
+    for (std::size_t i = 0; i < n * m; ++i) {
+      w[i] = u[offsets[i]];
+    }
+  }
+
+  // Apply the mass matrix a row at a time, adding each entry of the product
+  // into the coarse righthand sides with its restriction weights.
+  Real *const d = rhs.data();
+  std::fill(rhs.begin(), rhs.end(), 0);
+  if (spacing) {
+    // The even nodes are the coarse nodes. See
+    // `ConstituentMassMatrix::apply_to_uniform_spear` and
+    // `ConstituentRestriction::apply_to_uniform_spear`.
+    const Real offdiagonal = spacing / 6;
+    const Real diagonal_boundary = spacing / 3;
+    const Real diagonal_interior = 2 * spacing / 3;
+    for (std::size_t j = 0; j < n; j += 2) {
+      const Real b = j && j + 1 < n ? diagonal_interior : diagonal_boundary;
+      Real const *const w_middle = w + j * m;
+      Real const *const w_left = w_middle - m;
+      Real const *const w_right = w_middle + m;
+      Real *const d_middle = d + j / 2 * m;
+#pragma omp simd
+      for (std::size_t k = 0; k < m; ++k) {
+        d_middle[k] +=
+            offdiagonal * (w_left[k] + w_right[k]) + b * w_middle[k];
+      }
+    }
+    for (std::size_t j = 1; j < n; j += 2) {
+      Real const *const w_middle = w + j * m;
+      Real const *const w_left = w_middle - m;
+      Real const *const w_right = w_middle + m;
+      Real *const d_left = d + j / 2 * m;
+      Real *const d_right = d_left + m;
+#pragma omp simd
+      for (std::size_t k = 0; k < m; ++k) {
+        const Real half_product = (offdiagonal * (w_left[k] + w_right[k]) +
+                                   diagonal_interior * w_middle[k]) /
+                                  2;
+        d_left[k] += half_product;
+        d_right[k] += half_product;
+      }
+    }
+  } else {
+    for (std::size_t j = 0; j < n; ++j) {
+      const Real a = mass_subdiagonal[j];
+      const Real b = mass_diagonal[j];
+      const Real c = mass_superdiagonal[j];
+      Real const *const w_middle = w + j * m;
+      Real const *const w_left = w_middle - m;
+      Real const *const w_right = w_middle + m;
+      Real *const d_left = d + left_coarse_positions[j] * m;
+      const Real weight_left = left_weights[j];
+      const Real weight_right = right_weights[j];
+      if (!weight_right) {
+#pragma omp simd
+        for (std::size_t k = 0; k < m; ++k) {
+          d_left[k] += a * w_left[k] + b * w_middle[k] + c * w_right[k];
+        }
+      } else {
+        Real *const d_right = d_left + m;
+#pragma omp simd
+        for (std::size_t k = 0; k < m; ++k) {
+          const Real product = a * w_left[k] + b * w_middle[k] + c * w_right[k];
+          d_left[k] += weight_left * product;
+          d_right[k] += weight_right * product;
+        }
+      }
+    }
+  }
+
+  coarse_mass_matrix_inverse.solve(d, m);
+
+  for (std::size_t p = 0; p < n_coarse; ++p) {
+    std::size_t const *const out = offsets.data() + coarse_positions[p] * m;
+    Real const *const d_p = d + p * m;
+#pragma omp simd
+    for (std::size_t k = 0; k < m; ++k) {
+      v[out[k]] = d_p[k];
+    }
+  }
+}
+
+namespace {
+
+template <std::size_t N, typename Real>
+std::array<ConstituentProjection<N, Real>, N>
+generate_projections(const TensorMeshHierarchy<N, Real> &hierarchy,
+                     const std::size_t l, const NodeOrdering ordering) {
+  const std::array<std::size_t, N> &SHAPE = hierarchy.shapes.back();
+  std::array<ConstituentProjection<N, Real>, N> projections;
+  for (std::size_t i = 0; i < N; ++i) {
+    if (SHAPE.at(i) == 1) {
+      continue;
+    }
+    projections.at(i) =
+        ConstituentProjection<N, Real>(hierarchy, l, i, ordering);
+  }
+  return projections;
+}
+
+} // namespace
+
+template <std::size_t N, typename Real>
+TensorProjection<N, Real>::TensorProjection(
+    const TensorMeshHierarchy<N, Real> &hierarchy, const std::size_t l,
+    const NodeOrdering ordering)
+    : TensorLinearOperator<N, Real>(hierarchy, l),
+      projections(generate_projections(hierarchy, l, ordering)) {
+  const std::array<std::size_t, N> &SHAPE = hierarchy.shapes.back();
+  for (std::size_t i = 0; i < N; ++i) {
+    TLO::operators.at(i) = SHAPE.at(i) == 1 ? nullptr : &projections.at(i);
+  }
+}
+
+template <std::size_t N, typename Real>
+void TensorProjection<N, Real>::operator()(Real *const v) const {
+  const std::array<std::size_t, N> &SHAPE = TLO::hierarchy.shapes.back();
+  for (std::size_t i = 0; i < N; ++i) {
+    if (SHAPE.at(i) == 1) {
+      continue;
+    }
+    TLO::for_each_spear_batch(
+        i, true,
+        [&](const auto D, std::array<std::size_t, N> const *const multiindices,
+            const std::size_t n) {
+          projections[D].template apply<decltype(D)::value>(multiindices, n,
+                                                            v);
+        });
+  }
+}
+
+template <std::size_t N, typename Real>
+void TensorProjection<N, Real>::operator()(Real const *const u,
+                                           Real *const v) const {
+  const std::array<std::size_t, N> &SHAPE = TLO::hierarchy.shapes.back();
+  // The first dimension reads the new nodes of `u`. The rest work on `v`.
+  bool first = true;
+  for (std::size_t i = 0; i < N; ++i) {
+    if (SHAPE.at(i) == 1) {
+      continue;
+    }
+    TLO::for_each_spear_batch(
+        i, true,
+        [&](const auto D, std::array<std::size_t, N> const *const multiindices,
+            const std::size_t n) {
+          const ConstituentProjection<N, Real> &A = projections[D];
+          if (first) {
+            A.template apply_to_new_nodes<decltype(D)::value>(multiindices, n,
+                                                              u, v);
+          } else {
+            A.template apply<decltype(D)::value>(multiindices, n, v);
+          }
+        });
+    first = false;
+  }
+}
+
+} // namespace mgard
@@ -10,7 +10,9 @@ namespace mgard {
 //! Restriction for continuous piecewise linear functions defined on a
 //! mesh 'spear.'
 template <std::size_t N, typename Real>
-class ConstituentRestriction : public ConstituentLinearOperator<N, Real> {
+class ConstituentRestriction
+    : public StaticConstituentLinearOperator<N, Real,
+                                             ConstituentRestriction<N, Real>> {
 public:
   //! Constructor.
   //!
@@ -25,18 +27,55 @@ public:
   //! is the index of the fine mesh (corresponding to the domain).
   //!\param dimension Index of the dimension in which the restriction is to be
   //! applied.
+  //!\param ordering Order of the arrays to which the restriction is to be
+  //! applied.
   ConstituentRestriction(const TensorMeshHierarchy<N, Real> &hierarchy,
-                         const std::size_t l, const std::size_t dimension);
+                         const std::size_t l, const std::size_t dimension,
+                         const NodeOrdering ordering = NodeOrdering::Shuffled);
+
+  //! Apply the operator along several 'spears' in place.
+  //!
+  //! See `StaticConstituentLinearOperator`. No checks are made. The 'spears'
+  //! are processed together as a tile, so that the innermost loop runs across
+  //! the 'spears' rather than along them.
+  //!
+  //!\param [in] multiindices Starting multiindices of the 'spears.'
+  //!\param [in] n Number of 'spears.'
+  //!\param [in, out] v Element in the domain, to be transformed into an element
+  //! in the range.
+  template <std::size_t D>
+  void apply(std::array<std::size_t, N> const *const multiindices,
+             const std::size_t n, Real *const v) const;
 
 private:
   using CLO = ConstituentLinearOperator<N, Real>;
+  using SCLO = StaticConstituentLinearOperator<N, Real, ConstituentRestriction>;
 
   //! Indices of the coarse 'spear' in the chosen dimension.
   TensorIndexRange coarse_indices;
 
-  virtual void
-  do_operator_parentheses(const std::array<std::size_t, N> multiindex,
-                          Real *const v) const override;
+  //! Positions in the fine 'spear' of the nodes of the coarse 'spear.'
+  std::vector<std::size_t> coarse_positions;
+
+  //! Whether the nodes of the fine 'spears' are equispaced and the coarse nodes
+  //! are every other fine node, so that the interpolation weights are all
+  //! `1 / 2`.
+  bool uniform = false;
+
+  //! Apply the operator along a single 'spear' in place.
+  template <std::size_t D>
+  void apply_to_spear(const std::array<std::size_t, N> &multiindex,
+                      Real *const v) const;
+
+  //! Apply the operator along a single 'spear' with equispaced nodes in place.
+  template <std::size_t D>
+  void apply_to_uniform_spear(const std::array<std::size_t, N> &multiindex,
+                              Real *const v) const;
+
+  //! Apply the operator along a tile of 'spears' in place.
+  template <std::size_t D>
+  void apply_to_tile(std::array<std::size_t, N> const *const multiindices,
+                     const std::size_t m, Real *const v) const;
 };
 
 //! Restriction for tensor products of continuous piecewise linear functions
@@ -49,8 +88,20 @@ public:
   //!\param hierarchy Mesh hierarchy on which the functions are defined.
   //!\param l Index of the mesh on which the restriction is to be applied. This
   //! is the index of the fine mesh (corresponding to the domain).
+  //!\param ordering Order of the arrays to which the restriction is to be
+  //! applied.
   TensorRestriction(const TensorMeshHierarchy<N, Real> &hierarchy,
-                    const std::size_t l);
+                    const std::size_t l,
+                    const NodeOrdering ordering = NodeOrdering::Shuffled);
+
+  //! Apply the operator to an element in place.
+  //!
+  //! The constituent operators' kernels are called directly. See
+  //! `TensorLinearOperator::operator()`.
+  //!
+  //!\param [in, out] v Element in the domain, to be transformed into an element
+  //! in the range.
+  void operator()(Real *const v) const;
 
 private:
   using TLO = TensorLinearOperator<N, Real>;
@@ -5,9 +5,12 @@ namespace mgard {
 template <std::size_t N, typename Real>
 ConstituentRestriction<N, Real>::ConstituentRestriction(
     const TensorMeshHierarchy<N, Real> &hierarchy, const std::size_t l,
-    const std::size_t dimension)
-    : ConstituentLinearOperator<N, Real>(hierarchy, l, dimension),
-      coarse_indices(hierarchy.indices(l - 1, dimension)) {
+    const std::size_t dimension, const NodeOrdering ordering)
+    : SCLO(hierarchy, l, dimension, ordering),
+      coarse_indices(hierarchy.indices(l - 1, dimension)),
+      coarse_positions(CLO::layout.positions(coarse_indices)),
+      uniform(hierarchy.uniform_spacings.at(l).at(dimension) &&
+              2 * coarse_positions.size() == CLO::layout.size() + 1) {
   // This is almost certainly superfluous, since `hierarchy.indices` checks that
   // `l - 1` is a valid mesh index.
   if (!l) {
@@ -18,71 +21,164 @@ ConstituentRestriction<N, Real>::ConstituentRestriction(
   // `indices.begin()`. Assuming I haven't made a mistake, though, this is
   // enforced by the constructor of `TensorIndexRange` called by
   // `TensorMeshHierarchy::indices`. Possibly fragile.
+  for (std::size_t k = 0; uniform && k < coarse_positions.size(); ++k) {
+    uniform = coarse_positions.at(k) == 2 * k;
+  }
+}
+
+template <std::size_t N, typename Real>
+template <std::size_t D>
+void ConstituentRestriction<N, Real>::apply(
+    std::array<std::size_t, N> const *const multiindices, const std::size_t n,
+    Real *const v) const {
+  if (n > 1) {
+    return apply_to_tile<D>(multiindices, n, v);
+  } else if (uniform) {
+    return apply_to_uniform_spear<D>(multiindices[0], v);
+  } else {
+    return apply_to_spear<D>(multiindices[0], v);
+  }
 }
 
 template <std::size_t N, typename Real>
-void ConstituentRestriction<N, Real>::do_operator_parentheses(
-    const std::array<std::size_t, N> multiindex, Real *const v) const {
-  const std::vector<Real> &xs = CLO::hierarchy->coordinates.at(CLO::dimension_);
+template <std::size_t D>
+void ConstituentRestriction<N, Real>::apply_to_spear(
+    const std::array<std::size_t, N> &multiindex, Real *const v) const {
+  const typename TensorSpearLayout<N, Real>::Spear spear =
+      CLO::layout.spear(multiindex);
+  const std::vector<std::size_t> &indices = CLO::layout.indices;
+  const std::vector<Real> &xs = CLO::hierarchy->coordinates[D];
 
   // `x_left` and `out_left` are declared and defined inside the loop.
   Real x_right;
   Real *out_right;
 
-  std::array<std::size_t, N> alpha = multiindex;
-  std::size_t &variable_index = alpha.at(CLO::dimension_);
-
-  TensorIndexRange::iterator p = coarse_indices.begin();
-  std::size_t i;
-
-  variable_index = i = *p++;
-  x_right = xs.at(i);
-  out_right = &CLO::hierarchy->at(v, alpha);
-
-  std::array<std::size_t, N> ALPHA = multiindex;
-  std::size_t &VARIABLE_INDEX = ALPHA.at(CLO::dimension_);
+  std::vector<std::size_t>::const_iterator p = coarse_positions.begin();
+  std::size_t J = *p++;
 
-  TensorIndexRange::iterator P = CLO::indices.begin();
-  std::size_t I;
+  x_right = xs[indices[J]];
+  out_right = v + spear[J];
 
-  VARIABLE_INDEX = I = *P++;
-
-  const TensorIndexRange::iterator p_end = coarse_indices.end();
+  const std::vector<std::size_t>::const_iterator p_end = coarse_positions.end();
   while (p != p_end) {
-    assert(I == i);
-
     const Real x_left = x_right;
     Real *const out_left = out_right;
+    const std::size_t J_left = J;
 
-    variable_index = i = *p++;
-    x_right = xs.at(i);
-    out_right = &CLO::hierarchy->at(v, alpha);
+    J = *p++;
+    x_right = xs[indices[J]];
+    out_right = v + spear[J];
 
     const Real width_reciprocal = 1 / (x_right - x_left);
 
-    while ((VARIABLE_INDEX = I = *P++) != i) {
-      const Real x_middle = xs.at(I);
+    for (std::size_t j = J_left + 1; j < J; ++j) {
+      const Real x_middle = xs[indices[j]];
       assert(x_left < x_middle && x_middle < x_right);
-      const Real v_middle = CLO::hierarchy->at(v, ALPHA);
+      const Real v_middle = v[spear[j]];
       *out_left += v_middle * (x_right - x_middle) * width_reciprocal;
       *out_right += v_middle * (x_middle - x_left) * width_reciprocal;
     }
   }
 }
 
+template <std::size_t N, typename Real>
+template <std::size_t D>
+void ConstituentRestriction<N, Real>::apply_to_uniform_spear(
+    const std::array<std::size_t, N> &multiindex, Real *const v) const {
+  const typename TensorSpearLayout<N, Real>::Spear spear =
+      CLO::layout.spear(multiindex);
+  const std::size_t n = CLO::dimension();
+
+  // The coarse nodes are the even-numbered fine nodes, and each new node is
+  // the midpoint of its neighbors.
+  Real *out_right = v + spear[0];
+  for (std::size_t j = 1; j < n; j += 2) {
+    Real *const out_left = out_right;
+    out_right = v + spear[j + 1];
+    const Real half_v_middle = v[spear[j]] / 2;
+    *out_left += half_v_middle;
+    *out_right += half_v_middle;
+  }
+}
+
+template <std::size_t N, typename Real>
+template <std::size_t D>
+void ConstituentRestriction<N, Real>::apply_to_tile(
+    std::array<std::size_t, N> const *const multiindices, const std::size_t m,
+    Real *const v) const {
+  const std::vector<std::size_t> &indices = CLO::layout.indices;
+  const std::vector<Real> &xs = CLO::hierarchy->coordinates[D];
+  const std::size_t n = CLO::dimension();
+
+  // Positions of the spears' nodes in `v` and the values there, both
+  // interleaved so that the entries for the `j`th nodes of the spears are
+  // contiguous.
+  // The buffers are kept from call to call so that no memory is allocated
+  // once they are large enough.
+  thread_local std::vector<std::size_t> offsets;
+  thread_local std::vector<Real> values;
+  offsets.resize(n * m);
+  values.resize(n * m);
+  CLO::layout.interleaved_offsets(multiindices, m, offsets.data());
+  for (std::size_t i = 0; i < n * m; ++i) {
+    values[i] = v[offsets[i]];
+  }
+
+  // See `apply_to_spear` and `apply_to_uniform_spear`. Only the entries
+  // corresponding to coarse nodes are changed, so only those are written back.
+  Real *const u = values.data();
+  for (std::size_t p = 1; p < coarse_positions.size(); ++p) {
+    const std::size_t J_left = coarse_positions[p - 1];
+    const std::size_t J = coarse_positions[p];
+    const Real x_left = xs[indices[J_left]];
+    const Real x_right = xs[indices[J]];
+    const Real width_reciprocal = 1 / (x_right - x_left);
+    Real *const u_left = u + J_left * m;
+    Real *const u_right = u + J * m;
+    for (std::size_t j = J_left + 1; j < J; ++j) {
+      Real const *const u_middle = u + j * m;
+      if (uniform) {
+#pragma omp simd
+        for (std::size_t k = 0; k < m; ++k) {
+          const Real half_v_middle = u_middle[k] / 2;
+          u_left[k] += half_v_middle;
+          u_right[k] += half_v_middle;
+        }
+      } else {
+        const Real x_middle = xs[indices[j]];
+        const Real weight_left = x_right - x_middle;
+        const Real weight_right = x_middle - x_left;
+#pragma omp simd
+        for (std::size_t k = 0; k < m; ++k) {
+          u_left[k] += u_middle[k] * weight_left * width_reciprocal;
+          u_right[k] += u_middle[k] * weight_right * width_reciprocal;
+        }
+      }
+    }
+  }
+
+  for (const std::size_t J : coarse_positions) {
+#pragma omp simd
+    for (std::size_t k = 0; k < m; ++k) {
+      v[offsets[J * m + k]] = u[J * m + k];
+    }
+  }
+}
+
 namespace {
 
 template <std::size_t N, typename Real>
 std::array<ConstituentRestriction<N, Real>, N>
 generate_restrictions(const TensorMeshHierarchy<N, Real> &hierarchy,
-                      const std::size_t l) {
+                      const std::size_t l, const NodeOrdering ordering) {
   const std::array<std::size_t, N> &SHAPE = hierarchy.shapes.back();
   std::array<ConstituentRestriction<N, Real>, N> restrictions;
   for (std::size_t i = 0; i < N; ++i) {
     if (SHAPE.at(i) == 1) {
       continue;
     }
-    restrictions.at(i) = ConstituentRestriction<N, Real>(hierarchy, l, i);
+    restrictions.at(i) =
+        ConstituentRestriction<N, Real>(hierarchy, l, i, ordering);
   }
   return restrictions;
 }
@@ -91,13 +187,19 @@ generate_restrictions(const TensorMeshHierarchy<N, Real> &hierarchy,
 
 template <std::size_t N, typename Real>
 TensorRestriction<N, Real>::TensorRestriction(
-    const TensorMeshHierarchy<N, Real> &hierarchy, const std::size_t l)
+    const TensorMeshHierarchy<N, Real> &hierarchy, const std::size_t l,
+    const NodeOrdering ordering)
     : TensorLinearOperator<N, Real>(hierarchy, l),
-      restrictions(generate_restrictions(hierarchy, l)) {
+      restrictions(generate_restrictions(hierarchy, l, ordering)) {
   const std::array<std::size_t, N> &SHAPE = hierarchy.shapes.back();
   for (std::size_t i = 0; i < N; ++i) {
     TLO::operators.at(i) = SHAPE.at(i) == 1 ? nullptr : &restrictions.at(i);
   }
 }
 
+template <std::size_t N, typename Real>
+void TensorRestriction<N, Real>::operator()(Real *const v) const {
+  TLO::apply(restrictions, v);
+}
+
 } // namespace mgard
@@ -0,0 +1,203 @@
+#ifndef TENSORSPEARLAYOUT_HPP
+#define TENSORSPEARLAYOUT_HPP
+//!\file
+//!\brief Precomputed addressing of the 'spears' of a mesh in shuffled arrays.
+
+#include <cstddef>
+
+#include <array>
+#include <vector>
+
+#include "TensorMeshHierarchy.hpp"
+
+namespace mgard {
+
+//! Order in which the values of a function on a mesh hierarchy are stored.
+enum class NodeOrdering {
+  //! Grouped by the mesh in which the nodes are introduced, as produced by
+  //! `shuffle`.
+  Shuffled,
+
+  //! Row-major order on the finest mesh, with the nodes of the coarser meshes
+  //! found by striding.
+  Unshuffled
+};
+
+//! Positions in shuffled arrays of the nodes of the 'spears' of a mesh.
+//!
+//! A 'spear' is the set of nodes of a mesh whose multiindices agree in every
+//! dimension but one. Constituent operators are applied spear by spear, and
+//! looking up each node with `TensorMeshHierarchy::at` (which recomputes the
+//! date of birth and a couple of node counts, with bounds checks and integer
+//! divisions, every time) dominates their cost. This class precomputes the
+//! quantities which depend only on the level and dimension so that the
+//! position of each node of a spear can be found with a handful of table
+//! lookups.
+//!
+//! The spears can also be addressed in unshuffled arrays, in which case the
+//! positions are found from the strides of the finest mesh.
+template <std::size_t N, typename Real> class TensorSpearLayout {
+public:
+  //! Constructor.
+  //!
+  //! This constructor is provided so that arrays of classes containing layouts
+  //! may be formed. A default-constructed layout must be assigned to before
+  //! being used.
+  TensorSpearLayout() = default;
+
+  //! Constructor.
+  //!
+  //!\param hierarchy Mesh hierarchy on which the spears are defined.
+  //!\param l Index of the mesh containing the spears.
+  //!\param dimension Index of the dimension along which the spears point.
+  //!\param ordering Order of the arrays in which the spears are addressed.
+  TensorSpearLayout(const TensorMeshHierarchy<N, Real> &hierarchy,
+                    const std::size_t l, const std::size_t dimension,
+                    const NodeOrdering ordering = NodeOrdering::Shuffled);
+
+  //! Return the number of nodes in each spear.
+  std::size_t size() const;
+
+  //! Compute the position of a node in an array.
+  //!
+  //! For shuffled arrays, this is equivalent to `TensorMeshHierarchy::index`
+  //! but does no bounds checking.
+  //!
+  //!\param multiindex Multiindex of a node of the mesh.
+  std::size_t offset(const std::array<std::size_t, N> &multiindex) const;
+
+  //! Compute the position in a shuffled array of the first node introduced in
+  //! a given mesh not preceding a node in the usual (unshuffled) order.
+  //!
+  //! If the node is itself introduced in the given mesh, this is its position.
+  //! The ordering of the layout is ignored.
+  //!
+  //!\param date_of_birth Index of the mesh.
+  //!\param multiindex Multiindex of a node of the finest mesh.
+  std::size_t offset(const std::size_t date_of_birth,
+                     const std::array<std::size_t, N> &multiindex) const;
+
+  //! Find the positions in each spear of a subset of its nodes.
+  //!
+  //! This is used to locate the nodes of a coarser mesh in the spears of a
+  //! finer mesh.
+  //!
+  //!\param subset Indices in the finest mesh of the nodes of the subset. Every
+  //! index must be in `indices`.
+  std::vector<std::size_t> positions(const TensorIndexRange &subset) const;
+
+  //! Compute the positions in an array of the nodes of several spears.
+  //!
+  //! The positions are interleaved, so that those of the `j`th nodes of the
+  //! spears are contiguous. This is meant for processing a tile of spears
+  //! together, and it is considerably cheaper per node than `Spear`, since the
+  //! contributions of the dimensions other than the spear dimension are
+  //! computed once per spear rather than once per node.
+  //!
+  //!\param [in] multiindices Starting multiindices of the spears. The entries
+  //! in the spear dimension are ignored.
+  //!\param [in] m Number of spears.
+  //!\param [out] offsets Positions of the nodes. The position of the `j`th node
+  //! of the `k`th spear is written to `offsets[j * m + k]`.
+  void interleaved_offsets(std::array<std::size_t, N> const *const multiindices,
+                           const std::size_t m,
+                           std::size_t *const offsets) const;
+
+  // Forward declaration.
+  class Spear;
+
+  //! Prepare to address the nodes of a spear.
+  //!
+  //!\param multiindex Starting multiindex of the spear. The entry in the
+  //! spear dimension is ignored.
+  Spear spear(const std::array<std::size_t, N> &multiindex) const;
+
+  //! Indices in the finest mesh (in the spear dimension) of the nodes of each
+  //! spear.
+  std::vector<std::size_t> indices;
+
+private:
+  //! Mesh hierarchy on which the spears are defined.
+  TensorMeshHierarchy<N, Real> const *hierarchy;
+
+  //! Index of the dimension along which the spears point.
+  std::size_t dimension;
+
+  //! Order of the arrays in which the spears are addressed.
+  NodeOrdering ordering;
+
+  //! Distances in unshuffled arrays between consecutive indices in each
+  //! dimension.
+  std::array<std::size_t, N> strides;
+
+  //! Compute the position of a node in an unshuffled array.
+  std::size_t
+  unshuffled_offset(const std::array<std::size_t, N> &multiindex) const;
+
+  //! Number of nodes in each of the meshes up to and including the `l`th.
+  std::vector<std::size_t> ndofs;
+
+  //! Compute the number of nodes of a mesh preceding a node.
+  //!
+  //! This is equivalent to `TensorMeshHierarchy::number_nodes_before`.
+  std::size_t
+  number_nodes_before(const std::size_t ell,
+                      const std::array<std::size_t, N> &multiindex) const;
+
+  //! Contributions to `number_nodes_before` of the dimensions other than the
+  //! spear dimension.
+  struct PartialCount {
+    //! Count obtained if the index in the spear dimension contributes nothing.
+    std::size_t base;
+
+    //! Product of the sizes of the dimensions following the spear dimension.
+    std::size_t stride;
+
+    //! Contribution of the dimensions following the spear dimension.
+    std::size_t tail;
+
+    //! Whether a dimension preceding the spear dimension ends the count.
+    bool truncated;
+  };
+
+  //! Compute the contributions of the dimensions other than the spear
+  //! dimension to `number_nodes_before`.
+  PartialCount
+  partial_count(const std::size_t ell,
+                const std::array<std::size_t, N> &multiindex) const;
+};
+
+//! Addressing of the nodes of a single spear.
+template <std::size_t N, typename Real>
+class TensorSpearLayout<N, Real>::Spear {
+public:
+  //! Constructor.
+  //!
+  //!\param layout Layout of the spears of the mesh.
+  //!\param multiindex Starting multiindex of the spear.
+  Spear(const TensorSpearLayout &layout,
+        const std::array<std::size_t, N> &multiindex);
+
+  //! Compute the position in an array of a node of the spear.
+  //!
+  //!\param j Position of the node in the spear.
+  std::size_t operator[](const std::size_t j) const;
+
+private:
+  //! Layout of the spears of the mesh.
+  const TensorSpearLayout *layout;
+
+  //! Starting multiindex of the spear.
+  std::array<std::size_t, N> multiindex;
+
+  //! Latest date of birth of the spear's indices in the other dimensions.
+  std::size_t date_of_birth;
+
+  //! Position in an unshuffled array of the node of the spear with index `0`.
+  std::size_t base;
+};
+
+} // namespace mgard
+
+#include "TensorSpearLayout.tpp"
+#endif
@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <stdexcept>
+
+namespace mgard {
+
+template <std::size_t N, typename Real>
+TensorSpearLayout<N, Real>::TensorSpearLayout(
+    const TensorMeshHierarchy<N, Real> &hierarchy, const std::size_t l,
+    const std::size_t dimension, const NodeOrdering ordering)
+    : hierarchy(&hierarchy), dimension(dimension), ordering(ordering),
+      ndofs(l + 1) {
+  const TensorIndexRange range = hierarchy.indices(l, dimension);
+  indices.assign(range.begin(), range.end());
+  for (std::size_t ell = 0; ell <= l; ++ell) {
+    ndofs.at(ell) = hierarchy.ndof(ell);
+  }
+  const std::array<std::size_t, N> &SHAPE = hierarchy.shapes.back();
+  std::size_t stride = 1;
+  for (std::size_t k = 0; k < N; ++k) {
+    const std::size_t i = N - 1 - k;
+    strides.at(i) = stride;
+    stride *= SHAPE.at(i);
+  }
+}
+
+template <std::size_t N, typename Real>
+std::size_t TensorSpearLayout<N, Real>::size() const {
+  return indices.size();
+}
+
+template <std::size_t N, typename Real>
+std::vector<std::size_t>
+TensorSpearLayout<N, Real>::positions(const TensorIndexRange &subset) const {
+  std::vector<std::size_t> positions_;
+  positions_.reserve(subset.size());
+  std::vector<std::size_t>::const_iterator p = indices.begin();
+  for (const std::size_t index : subset) {
+    p = std::lower_bound(p, indices.end(), index);
+    if (p == indices.end() || *p != index) {
+      throw std::invalid_argument("subset index not found in spear");
+    }
+    positions_.push_back(p - indices.begin());
+  }
+  return positions_;
+}
+
+template <std::size_t N, typename Real>
+std::size_t TensorSpearLayout<N, Real>::number_nodes_before(
+    const std::size_t ell, const std::array<std::size_t, N> &multiindex) const {
+  // See `TensorMeshHierarchy::number_nodes_before` for an explanation.
+  const std::array<std::size_t, N> &shape = hierarchy->shapes[ell];
+  const std::array<std::vector<std::size_t>, N> &counts =
+      hierarchy->numbers_nodes_before[ell];
+  std::size_t count = 0;
+  bool impossible_constraint_encountered = false;
+  for (std::size_t i = 0; i < N; ++i) {
+    count *= shape[i];
+    if (impossible_constraint_encountered) {
+      continue;
+    }
+    const std::size_t index = multiindex[i];
+    count += counts[i][index];
+    impossible_constraint_encountered =
+        hierarchy->dates_of_birth[i][index] > ell;
+  }
+  return count;
+}
+
+template <std::size_t N, typename Real>
+std::size_t TensorSpearLayout<N, Real>::offset(
+    const std::size_t date_of_birth,
+    const std::array<std::size_t, N> &multiindex) const {
+  if (!date_of_birth) {
+    return number_nodes_before(0, multiindex);
+  }
+  return ndofs[date_of_birth - 1] +
+         number_nodes_before(date_of_birth, multiindex) -
+         number_nodes_before(date_of_birth - 1, multiindex);
+}
+
+template <std::size_t N, typename Real>
+std::size_t TensorSpearLayout<N, Real>::unshuffled_offset(
+    const std::array<std::size_t, N> &multiindex) const {
+  std::size_t offset_ = 0;
+  for (std::size_t i = 0; i < N; ++i) {
+    offset_ += multiindex[i] * strides[i];
+  }
+  return offset_;
+}
+
+template <std::size_t N, typename Real>
+std::size_t TensorSpearLayout<N, Real>::offset(
+    const std::array<std::size_t, N> &multiindex) const {
+  if (ordering == NodeOrdering::Unshuffled) {
+    return unshuffled_offset(multiindex);
+  }
+  std::size_t dob = 0;
+  for (std::size_t i = 0; i < N; ++i) {
+    dob = std::max(dob, hierarchy->dates_of_birth[i][multiindex[i]]);
+  }
+  return offset(dob, multiindex);
+}
+
+template <std::size_t N, typename Real>
+typename TensorSpearLayout<N, Real>::PartialCount
+TensorSpearLayout<N, Real>::partial_count(
+    const std::size_t ell, const std::array<std::size_t, N> &multiindex) const {
+  // `number_nodes_before` is a Horner-style accumulation over the dimensions,
+  // each of which stops contributing once one index is found not to be in the
+  // mesh. Splitting the accumulation at the spear dimension, the count for a
+  // node of the spear with index `index` in the spear dimension is
+  //   `base` if `truncated`, and otherwise
+  //   `base + c * stride + (dob > ell ? 0 : tail)`,
+  // where `c` is the count of `index` in the spear dimension and `dob` is its
+  // date of birth.
+  const std::array<std::size_t, N> &shape = hierarchy->shapes[ell];
+  const std::array<std::vector<std::size_t>, N> &counts =
+      hierarchy->numbers_nodes_before[ell];
+  PartialCount partial;
+  std::size_t head = 0;
+  partial.truncated = false;
+  for (std::size_t i = 0; i < dimension; ++i) {
+    head *= shape[i];
+    if (partial.truncated) {
+      continue;
+    }
+    const std::size_t index = multiindex[i];
+    head += counts[i][index];
+    partial.truncated = hierarchy->dates_of_birth[i][index] > ell;
+  }
+  partial.stride = 1;
+  partial.tail = 0;
+  bool tail_truncated = false;
+  for (std::size_t i = dimension + 1; i < N; ++i) {
+    partial.stride *= shape[i];
+    partial.tail *= shape[i];
+    if (tail_truncated) {
+      continue;
+    }
+    const std::size_t index = multiindex[i];
+    partial.tail += counts[i][index];
+    tail_truncated = hierarchy->dates_of_birth[i][index] > ell;
+  }
+  partial.base = head * shape[dimension] * partial.stride;
+  return partial;
+}
+
+template <std::size_t N, typename Real>
+void TensorSpearLayout<N, Real>::interleaved_offsets(
+    std::array<std::size_t, N> const *const multiindices, const std::size_t m,
+    std::size_t *const offsets) const {
+  const std::size_t l = ndofs.size() - 1;
+  const std::size_t n = indices.size();
+  if (ordering == NodeOrdering::Unshuffled) {
+    const std::size_t stride = strides[dimension];
+    for (std::size_t k = 0; k < m; ++k) {
+      std::array<std::size_t, N> multiindex = multiindices[k];
+      multiindex[dimension] = 0;
+      const std::size_t base = unshuffled_offset(multiindex);
+      for (std::size_t j = 0; j < n; ++j) {
+        offsets[j * m + k] = base + indices[j] * stride;
+      }
+    }
+    return;
+  }
+  const std::vector<std::size_t> &dates_of_birth =
+      hierarchy->dates_of_birth[dimension];
+  // Kept from call to call so that no memory is allocated once it is large
+  // enough.
+  thread_local std::vector<PartialCount> partials;
+  partials.resize(l + 1);
+  for (std::size_t k = 0; k < m; ++k) {
+    const std::array<std::size_t, N> &multiindex = multiindices[k];
+    std::size_t date_of_birth = 0;
+    for (std::size_t i = 0; i < N; ++i) {
+      if (i != dimension) {
+        date_of_birth = std::max(date_of_birth,
+                                 hierarchy->dates_of_birth[i][multiindex[i]]);
+      }
+    }
+    // Only the meshes from the one preceding the spear's date of birth onward
+    // are needed.
+    for (std::size_t ell = date_of_birth ? date_of_birth - 1 : 0; ell <= l;
+         ++ell) {
+      partials[ell] = partial_count(ell, multiindex);
+    }
+    for (std::size_t j = 0; j < n; ++j) {
+      const std::size_t index = indices[j];
+      const std::size_t dob = dates_of_birth[index];
+      const auto count = [&](const std::size_t ell) -> std::size_t {
+        const PartialCount &partial = partials[ell];
+        if (partial.truncated) {
+          return partial.base;
+        }
+        return partial.base +
+               hierarchy->numbers_nodes_before[ell][dimension][index] *
+                   partial.stride +
+               (dob > ell ? 0 : partial.tail);
+      };
+      const std::size_t lambda = std::max(date_of_birth, dob);
+      offsets[j * m + k] =
+          lambda ? ndofs[lambda - 1] + count(lambda) - count(lambda - 1)
+                 : count(0);
+    }
+  }
+}
+
+template <std::size_t N, typename Real>
+typename TensorSpearLayout<N, Real>::Spear TensorSpearLayout<N, Real>::spear(
+    const std::array<std::size_t, N> &multiindex) const {
+  return Spear(*this, multiindex);
+}
+
+template <std::size_t N, typename Real>
+TensorSpearLayout<N, Real>::Spear::Spear(
+    const TensorSpearLayout &layout,
+    const std::array<std::size_t, N> &multiindex)
+    : layout(&layout), multiindex(multiindex), date_of_birth(0), base(0) {
+  const std::size_t dimension = layout.dimension;
+  if (layout.ordering == NodeOrdering::Unshuffled) {
+    this->multiindex[dimension] = 0;
+    base = layout.unshuffled_offset(this->multiindex);
+    return;
+  }
+  for (std::size_t i = 0; i < N; ++i) {
+    if (i != dimension) {
+      date_of_birth = std::max(
+          date_of_birth, layout.hierarchy->dates_of_birth[i][multiindex[i]]);
+    }
+  }
+}
+
+template <std::size_t N, typename Real>
+std::size_t TensorSpearLayout<N, Real>::Spear::
+operator[](const std::size_t j) const {
+  const std::size_t dimension = layout->dimension;
+  const std::size_t index = layout->indices[j];
+  if (layout->ordering == NodeOrdering::Unshuffled) {
+    return base + index * layout->strides[dimension];
+  }
+  std::array<std::size_t, N> alpha = multiindex;
+  alpha[dimension] = index;
+  return layout->offset(
+      std::max(date_of_birth,
+               layout->hierarchy->dates_of_birth[dimension][index]),
+      alpha);
+}
+
+} // namespace mgard
@@ -16,19 +16,31 @@ namespace mgard {
 
 //! Transform nodal coefficients into multilevel coefficients.
 //!
+//! This constructs (and discards) a `DecompositionPlan`. To decompose many
+//! datasets defined on the same hierarchy, construct a plan once and reuse it.
+//!
 //!\param[in] hierarchy Mesh hierarchy on which the input function is defined.
 //!\param[in, out] v Nodal coefficients of the input function on the finest mesh
 //! in the hierarchy.
+//!\param[in] l_target Index of the coarsest mesh to decompose onto. See
+//! `DecompositionPlan`.
 template <std::size_t N, typename Real>
-void decompose(const TensorMeshHierarchy<N, Real> &hierarchy, Real *const v);
+void decompose(const TensorMeshHierarchy<N, Real> &hierarchy, Real *const v,
+               const std::size_t l_target = 0);
 
 //! Transform multilevel coefficients into nodal coefficients.
 //!
+//! This constructs (and discards) a `DecompositionPlan`. To recompose many
+//! datasets defined on the same hierarchy, construct a plan once and reuse it.
+//!
 //!\param[in] hierarchy Mesh hierarchy on which the output function is defined.
 //!\param[in, out] v Multilevel coefficients of the output function on the
 //! finest mesh in the hierarchy.
+//!\param[in] l_target Index of the coarsest mesh onto which the function was
+//! decomposed.
 template <std::size_t N, typename Real>
-void recompose(const TensorMeshHierarchy<N, Real> &hierarchy, Real *const v);
+void recompose(const TensorMeshHierarchy<N, Real> &hierarchy, Real *const v,
+               const std::size_t l_target = 0);
 
 } // namespace mgard
 
@@ -11,8 +11,11 @@
 //!\brief Compression and decompression API.
 
 #include "TensorMeshHierarchy.hpp"
+#include "mgard_compress.hpp"
 
+#include <array>
 #include <memory>
+#include <vector>
 
 #include "cuda/Common.h"
 #include "cuda/CompressionWorkflow.h"
@@ -27,7 +30,9 @@ public:
   //! Constructor.
   //!
   //! The buffer pointed to by `data` is freed when this object is destructed.
-  //! It should be allocated with `new unsigned char[size]`.
+  //! It should be allocated with `new unsigned char[size]`. `l_target` is read
+  //! from the header of the compressed dataset. Throws `std::invalid_argument`
+  //! (and frees the buffer) if the header is invalid.
   //!
   //!\param hierarchy Associated mesh hierarchy.
   //!\param s Smoothness parameter.
@@ -38,6 +43,18 @@ public:
                     const Real tolerance, void const *const data,
                     const std::size_t size);
 
+  //! Constructor.
+  //!
+  //! The compressed dataset is taken over from `data` without being copied.
+  //! Throws `std::invalid_argument` if the header is invalid.
+  //!
+  //!\param hierarchy Associated mesh hierarchy.
+  //!\param s Smoothness parameter.
+  //!\param tolerance Error tolerance.
+  //!\param data Compressed dataset.
+  CompressedDataset(const TensorMeshHierarchy<N, Real> &hierarchy, const Real s,
+                    const Real tolerance, std::vector<unsigned char> &&data);
+
   //! Mesh hierarchy used in compressing the dataset.
   const TensorMeshHierarchy<N, Real> hierarchy;
 
@@ -47,6 +64,81 @@ public:
   //! Error tolerance used in compressing the dataset.
   const Real tolerance;
 
+  //! Index of the coarsest mesh onto which the dataset was decomposed, as
+  //! recorded in the compressed dataset.
+  const std::size_t l_target;
+
+  //! Return a pointer to the compressed dataset.
+  void const *data() const;
+
+  //! Return the size in bytes of the compressed dataset.
+  std::size_t size() const;
+
+private:
+  //! Compressed dataset, if it was handed over as a pointer.
+  std::unique_ptr<const unsigned char[]> data_;
+
+  //! Compressed dataset, if it was handed over as a vector.
+  std::vector<unsigned char> buffer_;
+
+  //! Size of the compressed dataset in bytes.
+  const std::size_t size_;
+};
+
+//! Dataset compressed a tile at a time and associated compression parameters.
+//!
+//! The finest mesh is partitioned into boxes ('tiles') which are compressed
+//! independently, each on its own mesh hierarchy. The compressed tiles follow
+//! a tagged and versioned index of their offsets, so any one of them can be
+//! decompressed without reading the others.
+template <std::size_t N, typename Real> class TiledCompressedDataset {
+public:
+  //! Constructor.
+  //!
+  //! The buffer pointed to by `data` is freed when this object is destructed.
+  //! It should be allocated with `new unsigned char[size]`.
+  //!
+  //!\param hierarchy Mesh hierarchy of the whole dataset.
+  //!\param s Smoothness parameter.
+  //!\param tolerance Error tolerance for the whole dataset.
+  //!\param tile_shape Shape of the tiles. See `compress_tiled`.
+  //!\param data Compressed dataset.
+  //!\param size Size of the compressed dataset in bytes.
+  TiledCompressedDataset(const TensorMeshHierarchy<N, Real> &hierarchy,
+                         const Real s, const Real tolerance,
+                         const std::array<std::size_t, N> &tile_shape,
+                         void const *const data, const std::size_t size);
+
+  //! Mesh hierarchy of the whole dataset.
+  const TensorMeshHierarchy<N, Real> hierarchy;
+
+  //! Smoothness parameter used in compressing the dataset.
+  const Real s;
+
+  //! Error tolerance used in compressing the dataset.
+  const Real tolerance;
+
+  //! Shape of the tiles. The tiles along the upper boundaries may differ.
+  const std::array<std::size_t, N> tile_shape;
+
+  //! Return the number of tiles.
+  std::size_t ntiles() const;
+
+  //! Return the multiindex of the lower corner of a tile.
+  //!
+  //!\param t Index of the tile. The tiles are numbered in row-major order.
+  std::array<std::size_t, N> tile_lower_corner(const std::size_t t) const;
+
+  //! Return the compressed dataset of a tile.
+  //!
+  //! The tile can be decompressed with `decompress`. Only the tile's part of
+  //! the compressed dataset is copied. Throws `std::out_of_range` if the index
+  //! is out of range and `std::invalid_argument` if the compressed dataset
+  //! isn't a tiled compressed dataset of this version with this tiling.
+  //!
+  //!\param t Index of the tile.
+  CompressedDataset<N, Real> tile(const std::size_t t) const;
+
   //! Return a pointer to the compressed dataset.
   void const *data() const;
 
@@ -59,6 +151,10 @@ private:
 
   //! Size of the compressed dataset in bytes.
   const std::size_t size_;
+
+  //! For each dimension, the indices of the first nodes of the tiles, followed
+  //! by the size of the finest mesh.
+  std::array<std::vector<std::size_t>, N> boundaries;
 };
 
 //! Decompressed dataset and associated compression parameters.
@@ -74,7 +170,32 @@ public:
   DecompressedDataset(const CompressedDataset<N, Real> &compressed,
                       Real const *const data);
 
-  //! Mesh hierarchy used in compressing the original dataset.
+  //! Constructor.
+  //!
+  //! The buffer pointed to by `data` is freed when this object is destructed.
+  //! It should be allocated with `new Real[hierarchy.ndof()]`.
+  //!
+  //!\param compressed Compressed dataset which was decompressed.
+  //!\param hierarchy Mesh hierarchy on which the decompressed function is
+  //! defined.
+  //!\param data Nodal values of the decompressed function.
+  DecompressedDataset(const CompressedDataset<N, Real> &compressed,
+                      const TensorMeshHierarchy<N, Real> &hierarchy,
+                      Real const *const data);
+
+  //! Constructor.
+  //!
+  //! The buffer pointed to by `data` is freed when this object is destructed.
+  //! It should be allocated with `new Real[compressed.hierarchy.ndof()]`.
+  //!
+  //!\param compressed Tiled compressed dataset which was decompressed.
+  //!\param data Nodal values of the decompressed function.
+  DecompressedDataset(const TiledCompressedDataset<N, Real> &compressed,
+                      Real const *const data);
+
+  //! Mesh hierarchy on which the decompressed function is defined. Unless the
+  //! dataset was decompressed to a coarser level, this is the mesh hierarchy
+  //! used in compressing the original dataset.
   const TensorMeshHierarchy<N, Real> hierarchy;
 
   //! Smoothness parameter used in compressing the original dataset.
@@ -94,13 +215,63 @@ private:
 //! Compress a function on a tensor product grid.
 //!
 //!\param hierarchy Mesh hierarchy to use in compressing the function.
-//!\param v Nodal values of the function.
+//!\param v Nodal values of the function. The function is decomposed in place,
+//! so on return `v` holds its multilevel coefficients. Copy the values first if
+//! they are still needed. The decomposition needs one more array the size of
+//! `v` as workspace: each level's interpolant and projection are computed from
+//! values of `v` before those values are overwritten.
 //!\param s Smoothness parameter to use in compressing the function.
 //!\param tolerance Absolute error tolerance to use in compressing the function.
+//!\param l_target Index of the coarsest mesh onto which to decompose the
+//! function. The coarsest levels are small and cost a pass of operator setup
+//! each, so stopping the decomposition early can save time, particularly on
+//! meshes with a short dimension. The values of the projection onto the
+//! `l_target`th mesh are quantized as though they were multilevel coefficients
+//! of that level.
+//!\param lossless Lossless compressor to apply to the quantized coefficients.
+//! The compressor is recorded in the compressed dataset, and `decompress` uses
+//! the compressor recorded.
 template <std::size_t N, typename Real>
 CompressedDataset<N, Real>
 compress(const TensorMeshHierarchy<N, Real> &hierarchy, Real *const v,
-         const Real s, const Real tolerance);
+         const Real s, const Real tolerance, const std::size_t l_target = 0,
+         const LosslessOptions &lossless = LosslessOptions());
+
+//! Compress a function on a tensor product grid to a given size.
+//!
+//! The function is decomposed once. The error tolerance is then found by
+//! bisection, requantizing the multilevel coefficients at each step and
+//! estimating the compressed size from the entropy of the quantized
+//! coefficients of each level. The coefficients are then losslessly
+//! compressed once, at the tolerance found. The lossless compressor can do
+//! better or worse than the entropy. If the result is over budget, the budget
+//! given to the estimate is lowered to match and the coefficients are
+//! compressed again, at most three more times. The result is thus under budget
+//! by however much the lossless compressor beats the estimate, and may be well
+//! under budget after a correction.
+//!
+//! To compress to a given compression ratio `R`, use a budget of
+//! `hierarchy.ndof() * sizeof(Real) / R` bytes.
+//!
+//!\param hierarchy Mesh hierarchy to use in compressing the function.
+//!\param v Nodal values of the function. Overwritten with its multilevel
+//! coefficients. See `compress`.
+//!\param s Smoothness parameter to use in compressing the function.
+//!\param size Maximum size in bytes.
+//!\param l_target Index of the coarsest mesh onto which to decompose the
+//! function. See `compress`.
+//!\param lossless Lossless compressor to use. See `compress`.
+//!
+//!\return Compressed function. The `tolerance` member is the error tolerance
+//! found. If the budget isn't met after the corrections (say, because it is
+//! smaller than the header), the function is compressed with the largest
+//! tolerance tried, and the result is over budget.
+template <std::size_t N, typename Real>
+CompressedDataset<N, Real>
+compress_to_size(const TensorMeshHierarchy<N, Real> &hierarchy, Real *const v,
+                 const Real s, const std::size_t size,
+                 const std::size_t l_target = 0,
+                 const LosslessOptions &lossless = LosslessOptions());
 
 //! Decompress a function on a tensor product grid.
 //!
@@ -109,6 +280,123 @@ template <std::size_t N, typename Real>
 DecompressedDataset<N, Real>
 decompress(const CompressedDataset<N, Real> &compressed);
 
+//! Decompress a function on a tensor product grid onto a coarser mesh.
+//!
+//! The multilevel coefficients of the levels finer than `l` are neither
+//! decoded nor allocated, so the cost scales with the size of the `l`th mesh.
+//! Only the initial part of the compressed dataset given by
+//! `compressed_size_through_level` need be present.
+//!
+//!\param compressed Compressed function to be decompressed.
+//!\param l Index of the mesh on which to decompress the function.
+//!
+//!\return Nodal values on `compressed.hierarchy.shapes.at(l)` of the
+//! projection of the function onto that mesh. The `hierarchy` member is the
+//! mesh hierarchy whose finest mesh is that mesh.
+template <std::size_t N, typename Real>
+DecompressedDataset<N, Real>
+decompress_to_level(const CompressedDataset<N, Real> &compressed,
+                    const std::size_t l);
+
+//! Decompress a function on a tensor product grid on a box.
+//!
+//! Only the multilevel coefficients near the box (and the coarse-level data
+//! needed to recompose them) are dequantized, and only the values on the box
+//! are stored, so the cost scales with the size of the box rather than with
+//! the size of the dataset. The values agree with those on the box returned by
+//! `decompress` up to rounding error. See `RegionRecompositionPlan`.
+//!
+//!\param compressed Compressed function to be decompressed.
+//!\param lower_corner Multiindex of the lower corner of the box.
+//!\param upper_corner Multiindex of the upper corner of the box. The box
+//! includes this node, and must contain more than one node.
+//!
+//!\return Values of the function on the box. The `hierarchy` member is the
+//! mesh hierarchy whose finest mesh is the box.
+template <std::size_t N, typename Real>
+DecompressedDataset<N, Real>
+decompress_region(const CompressedDataset<N, Real> &compressed,
+                  const std::array<std::size_t, N> &lower_corner,
+                  const std::array<std::size_t, N> &upper_corner);
+
+//! Compress a function on a tensor product grid a tile at a time.
+//!
+//! The finest mesh is partitioned into tiles of shape `tile_shape`. A tile
+//! along an upper boundary is cut short if the mesh ends first, and absorbs
+//! the remaining node if only one would be left over. The tiles are compressed
+//! concurrently, each on its own mesh hierarchy.
+//!
+//! The error of the whole function, measured in the `s`-norm on the whole
+//! mesh, is at most `tolerance`. Only `s` zero and infinite are supported,
+//! since the `s`-norms of the errors on the tiles don't control the `s`-norm
+//! of the error of the whole function for other `s`. With `s` infinite, every
+//! tile is compressed with the full tolerance. With `s` zero, the square of
+//! `tolerance` is split among the tiles by the fraction of the domain each
+//! gets, and each tile's share is divided by a factor accounting for the
+//! elements between the tiles, which belong to none of them. On a uniform mesh
+//! this factor is three in each dimension for tiles with neighbors on both
+//! sides.
+//!
+//!\param hierarchy Mesh hierarchy of the whole function.
+//!\param v Nodal values of the function.
+//!\param s Smoothness parameter to use in compressing the function. Must be
+//! zero or infinite.
+//!\param tolerance Absolute error tolerance to use in compressing the function.
+//!\param tile_shape Shape of the tiles. Must be at least two in every
+//! dimension in which the mesh isn't 'flat.'
+//!\param lossless Lossless compressor to use for every tile. See `compress`.
+template <std::size_t N, typename Real>
+TiledCompressedDataset<N, Real>
+compress_tiled(const TensorMeshHierarchy<N, Real> &hierarchy,
+               Real const *const v, const Real s, const Real tolerance,
+               const std::array<std::size_t, N> &tile_shape,
+               const LosslessOptions &lossless = LosslessOptions());
+
+//! Decompress a function on a tensor product grid compressed a tile at a time.
+//!
+//! The tiles are decompressed concurrently. To decompress a single tile, use
+//! `decompress(compressed.tile(t))`.
+//!
+//!\param compressed Compressed function to be decompressed.
+template <std::size_t N, typename Real>
+DecompressedDataset<N, Real>
+decompress(const TiledCompressedDataset<N, Real> &compressed);
+
+//! Size in bytes of the fixed part of the header of a compressed dataset.
+//!
+//! The fixed part tags the buffer as a compressed dataset and records the
+//! version of its layout, and is enough to find the size of the whole header.
+constexpr std::size_t compressed_header_prefix_size = 10;
+
+//! Compute the size of the header of a compressed dataset.
+//!
+//! The header of a compressed dataset is followed by one segment for each
+//! level of the mesh hierarchy, coarsest first. The header records the sizes
+//! of the segments, so that the multilevel coefficients of the coarsest levels
+//! can be fetched without reading the rest of the compressed dataset. Throws
+//! `std::invalid_argument` if the data isn't a compressed dataset of this
+//! version or doesn't match the hierarchy.
+//!
+//!\param hierarchy Mesh hierarchy used in compressing the dataset.
+//!\param data Compressed dataset. Only the first
+//! `compressed_header_prefix_size` bytes are read.
+template <std::size_t N, typename Real>
+std::size_t
+compressed_header_size(const TensorMeshHierarchy<N, Real> &hierarchy,
+                       void const *const data);
+
+//! Compute the size of the initial part of a compressed dataset containing
+//! the multilevel coefficients of the levels up through a given level.
+//!
+//!\param hierarchy Mesh hierarchy used in compressing the dataset.
+//!\param data Compressed dataset. Only the header (see
+//! `compressed_header_size`) is read.
+//!\param l Index of the finest level whose coefficients are needed.
+template <std::size_t N, typename Real>
+std::size_t
+compressed_size_through_level(const TensorMeshHierarchy<N, Real> &hierarchy,
+                              void const *const data, const std::size_t l);
+
 } // namespace mgard
 
 namespace mgard_cuda {
@@ -8,30 +8,201 @@
 #ifndef MGARD_API_TPP
 #define MGARD_API_TPP
 
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 
 #include <algorithm>
 #include <array>
+#include <exception>
+#include <limits>
+#include <memory>
 #include <numeric>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 
+#include "DecompositionPlan.hpp"
+#include "RegionRecompositionPlan.hpp"
+#include "TensorMeshHierarchyIteration.hpp"
 #include "TensorMultilevelCoefficientQuantizer.hpp"
 #include "TensorNorms.hpp"
+#include "TensorSpearLayout.hpp"
 #include "mgard.hpp"
+#include "mgard_compress.hpp"
 #include "shuffle.hpp"
 
 namespace mgard {
 
+namespace {
+
+//! Tag at the beginning of every compressed dataset.
+constexpr std::array<unsigned char, 4> quantized_magic = {'M', 'G', 'L', 'S'};
+
+//! Version of the compressed dataset layout. Datasets written with another
+//! version are rejected.
+constexpr std::uint8_t quantized_format_version = 1;
+
+//! Header of a compressed dataset.
+//!
+//! The header is followed by an index of the segments (one per level of the
+//! mesh hierarchy, coarsest first) and then the segments themselves, in the
+//! same order. Each segment consists of the losslessly compressed quantized
+//! coefficients introduced by its level followed by the losslessly compressed
+//! outliers among them. The coefficients of the coarsest levels thus occupy an
+//! initial part of the compressed dataset.
+//!
+//! Each entry of the index is stored little-endian in `field_width` bytes,
+//! the fewest of 1, 2, 4, and 8 holding every entry.
+struct QuantizedHeader {
+  //! Format tag. See `quantized_magic`.
+  std::array<unsigned char, 4> magic;
+
+  //! Layout version. See `quantized_format_version`.
+  std::uint8_t version;
+
+  //! Size in bytes of the compact representation of each coefficient.
+  std::uint8_t width;
+
+  //! Lossless compressor used, as a `LosslessCompressor`.
+  std::uint8_t compressor;
+
+  //! Number of segments. A mesh hierarchy has fewer than 64 levels.
+  std::uint8_t nsegments;
+
+  //! Index of the coarsest mesh onto which the dataset was decomposed.
+  std::uint8_t l_target;
+
+  //! Size in bytes of each entry of the segment index.
+  std::uint8_t field_width;
+};
+
+static_assert(sizeof(QuantizedHeader) == compressed_header_prefix_size,
+              "compressed dataset header must not be padded");
+
+//! Entry in the segment index of a compressed dataset.
+struct QuantizedSegment {
+  //! Size in bytes of the compressed compact representation.
+  std::size_t primary_size;
+
+  //! Number of coefficients not representable in the compact representation.
+  std::size_t noutliers;
+
+  //! Size in bytes of the compressed outliers.
+  std::size_t outliers_size;
+};
+
+//! Compute the fewest bytes, of 1, 2, 4, and 8, in which a value fits.
+inline std::uint8_t index_field_width(const std::size_t value) {
+  std::uint8_t width = 1;
+  while (width < sizeof(std::size_t) && value >> (8 * width)) {
+    width *= 2;
+  }
+  return width;
+}
+
+//! Write an entry of a segment index.
+inline void write_index_field(unsigned char *const p, std::size_t value,
+                              const std::size_t width) {
+  for (std::size_t k = 0; k < width; ++k, value >>= 8) {
+    p[k] = static_cast<unsigned char>(value);
+  }
+}
+
+//! Read an entry of a segment index.
+inline std::size_t read_index_field(unsigned char const *const p,
+                                    const std::size_t width) {
+  std::size_t value = 0;
+  for (std::size_t k = width; k; --k) {
+    value = value << 8 | p[k - 1];
+  }
+  return value;
+}
+
+//! Compute the size in bytes of the header and segment index.
+inline std::size_t quantized_header_size(const std::size_t nsegments,
+                                         const std::size_t field_width) {
+  return sizeof(QuantizedHeader) + nsegments * 3 * field_width;
+}
+
+//! Compute the size in bytes of the header and segment index.
+inline std::size_t quantized_header_size(const QuantizedHeader &header) {
+  return quantized_header_size(header.nsegments, header.field_width);
+}
+
+//! Read the header of a compressed dataset, checking its tag and version.
+//!
+//!\param data Compressed dataset.
+//!\param size Size in bytes of `data`.
+inline QuantizedHeader read_quantized_prefix(void const *const data,
+                                             const std::size_t size) {
+  QuantizedHeader header;
+  if (size < sizeof(header)) {
+    throw std::invalid_argument("compressed dataset is truncated");
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if (header.magic != quantized_magic) {
+    throw std::invalid_argument("not a compressed dataset");
+  }
+  if (header.version != quantized_format_version) {
+    throw std::invalid_argument("unsupported compressed dataset version");
+  }
+  const std::uint8_t field_width = header.field_width;
+  if (field_width != 1 && field_width != 2 && field_width != 4 &&
+      field_width != 8) {
+    throw std::invalid_argument("invalid segment index field width");
+  }
+  return header;
+}
+
+//! Read the index of the coarsest mesh onto which a compressed dataset was
+//! decomposed.
+//!
+//! Unless `owned` is `false`, the dataset is freed if its header is invalid,
+//! as the `CompressedDataset` which would have taken ownership of it is then
+//! never constructed.
+template <std::size_t N, typename Real>
+std::size_t compressed_l_target(const TensorMeshHierarchy<N, Real> &hierarchy,
+                                void const *const data, const std::size_t size,
+                                const bool owned = true) {
+  try {
+    const QuantizedHeader header = read_quantized_prefix(data, size);
+    if (header.l_target > hierarchy.L) {
+      throw std::invalid_argument(
+          "coarsest mesh index doesn't match the mesh hierarchy");
+    }
+    return header.l_target;
+  } catch (...) {
+    if (owned) {
+      delete[] static_cast<unsigned char const *>(data);
+    }
+    throw;
+  }
+}
+
+} // namespace
+
 template <std::size_t N, typename Real>
 CompressedDataset<N, Real>::CompressedDataset(
     const TensorMeshHierarchy<N, Real> &hierarchy, const Real s,
     const Real tolerance, void const *const data, const std::size_t size)
     : hierarchy(hierarchy), s(s), tolerance(tolerance),
+      l_target(compressed_l_target(hierarchy, data, size)),
       data_(static_cast<unsigned char const *>(data)), size_(size) {}
 
+template <std::size_t N, typename Real>
+CompressedDataset<N, Real>::CompressedDataset(
+    const TensorMeshHierarchy<N, Real> &hierarchy, const Real s,
+    const Real tolerance, std::vector<unsigned char> &&data)
+    : hierarchy(hierarchy), s(s), tolerance(tolerance),
+      l_target(compressed_l_target(hierarchy, data.data(), data.size(),
+                                   false)),
+      buffer_(std::move(data)), size_(buffer_.size()) {}
+
 template <std::size_t N, typename Real>
 void const *CompressedDataset<N, Real>::data() const {
-  return data_.get();
+  return data_ ? data_.get() : buffer_.data();
 }
 
 template <std::size_t N, typename Real>
@@ -39,9 +210,281 @@ std::size_t CompressedDataset<N, Real>::size() const {
   return size_;
 }
 
+namespace {
+
+//! Tag at the beginning of every tiled compressed dataset.
+constexpr std::array<unsigned char, 4> tiled_magic = {'M', 'G', 'L', 'T'};
+
+//! Version of the tiled compressed dataset layout. Datasets written with
+//! another version are rejected.
+constexpr std::uint8_t tiled_format_version = 1;
+
+//! Size in bytes of each entry of the tile index.
+constexpr std::size_t tile_index_field_width = 8;
+
+//! Compute the size in bytes of the tag, version, and tile index of a tiled
+//! compressed dataset.
+//!
+//! The tag and version are followed by the number of tiles and then the
+//! offsets of the tiles (and of the end of the last) from the end of the
+//! index, each stored little-endian in `tile_index_field_width` bytes.
+inline std::size_t tile_index_size(const std::size_t ntiles) {
+  return tiled_magic.size() + 1 + (ntiles + 2) * tile_index_field_width;
+}
+
+//! Compute the boundaries of the tiles of a tiled compressed dataset.
+//!
+//! See `TiledCompressedDataset::boundaries`.
+template <std::size_t N>
+std::array<std::vector<std::size_t>, N>
+tile_boundaries(const std::array<std::size_t, N> &SHAPE,
+                const std::array<std::size_t, N> &tile_shape) {
+  std::array<std::vector<std::size_t>, N> boundaries;
+  for (std::size_t i = 0; i < N; ++i) {
+    const std::size_t n = SHAPE.at(i);
+    std::vector<std::size_t> &starts = boundaries.at(i);
+    if (n == 1) {
+      starts = {0, 1};
+      continue;
+    }
+    const std::size_t m = tile_shape.at(i);
+    if (m < 2) {
+      throw std::invalid_argument(
+          "tiles must have at least two nodes in each dimension");
+    }
+    for (std::size_t start = 0; start < n; start += m) {
+      starts.push_back(start);
+    }
+    // A tile with a single node in some dimension would have no elements.
+    if (n - starts.back() == 1) {
+      starts.pop_back();
+    }
+    starts.push_back(n);
+  }
+  return boundaries;
+}
+
+//! Count the tiles of a tiled compressed dataset.
+template <std::size_t N>
+std::size_t ntiles(const std::array<std::vector<std::size_t>, N> &boundaries) {
+  std::size_t product = 1;
+  for (const std::vector<std::size_t> &starts : boundaries) {
+    product *= starts.size() - 1;
+  }
+  return product;
+}
+
+//! Find the lower corner and the shape of a tile.
+template <std::size_t N>
+void tile_extent(const std::array<std::vector<std::size_t>, N> &boundaries,
+                 const std::size_t t, std::array<std::size_t, N> &lower,
+                 std::array<std::size_t, N> &shape) {
+  if (t >= ntiles(boundaries)) {
+    throw std::out_of_range("tile index out of range");
+  }
+  std::size_t remainder = t;
+  for (std::size_t k = 0; k < N; ++k) {
+    const std::size_t i = N - 1 - k;
+    const std::vector<std::size_t> &starts = boundaries.at(i);
+    const std::size_t j = remainder % (starts.size() - 1);
+    remainder /= starts.size() - 1;
+    lower.at(i) = starts.at(j);
+    shape.at(i) = starts.at(j + 1) - starts.at(j);
+  }
+}
+
+//! Form the mesh hierarchy whose finest mesh is a box in the finest mesh of a
+//! hierarchy.
+template <std::size_t N, typename Real>
+TensorMeshHierarchy<N, Real>
+box_hierarchy(const TensorMeshHierarchy<N, Real> &hierarchy,
+              const std::array<std::size_t, N> &lower,
+              const std::array<std::size_t, N> &shape) {
+  std::array<std::vector<Real>, N> coordinates;
+  for (std::size_t i = 0; i < N; ++i) {
+    const std::vector<Real> &xs = hierarchy.coordinates.at(i);
+    coordinates.at(i).assign(xs.begin() + lower.at(i),
+                             xs.begin() + lower.at(i) + shape.at(i));
+  }
+  return TensorMeshHierarchy<N, Real>(shape, coordinates);
+}
+
+//! Compute the error tolerance of a tile.
+//!
+//! See `compress_tiled`. For `s` zero, the tolerance is derived as follows. In
+//! one dimension, the square error of the whole function is the sum of the
+//! square errors on the tiles and on the elements between them. On an element
+//! of length `g` between nodes with errors `a` and `b`, the square error is at
+//! most `g (a^2 + b^2) / 2`. On the element of length `h` at the end of a tile
+//! at which the error is `a`, the square error is at least `h a^2 / 4`. So the
+//! element between two tiles adds at most `2 g / h` times the square error on
+//! the end elements next to it, and the whole square error is at most the sum
+//! over the tiles of `c` times their square errors, where `c` is `1 + 2 g / h`
+//! for the worse end of the tile (or both ends, if the tile is one element).
+//! As quadratic forms, the mass matrix of the whole mesh is thus bounded by the
+//! mass matrices of the tiles scaled by `c`, and the same holds for their
+//! tensor products with the product of the factors. Giving each tile a square
+//! tolerance equal to the fraction of the domain it gets (splitting at the
+//! midpoints of the elements between the tiles) divided by this product times
+//! the square of `tolerance` bounds the square error of the whole function by
+//! the square of `tolerance`.
+template <std::size_t N, typename Real>
+Real tile_tolerance(const TensorMeshHierarchy<N, Real> &hierarchy,
+                    const Real s, const Real tolerance,
+                    const std::array<std::size_t, N> &lower,
+                    const std::array<std::size_t, N> &shape) {
+  if (s == std::numeric_limits<Real>::infinity()) {
+    return tolerance;
+  }
+  Real fraction = 1;
+  Real factor = 1;
+  for (std::size_t i = 0; i < N; ++i) {
+    const std::vector<Real> &xs = hierarchy.coordinates.at(i);
+    if (xs.size() == 1) {
+      continue;
+    }
+    const std::size_t first = lower.at(i);
+    const std::size_t last = first + shape.at(i) - 1;
+    const Real a = first ? (xs.at(first - 1) + xs.at(first)) / 2 : xs.front();
+    const Real b =
+        last + 1 < xs.size() ? (xs.at(last) + xs.at(last + 1)) / 2 : xs.back();
+    fraction *= (b - a) / (xs.back() - xs.front());
+
+    // Ratios of the elements between the tiles to the end elements of the tile.
+    const Real before =
+        first ? (xs.at(first) - xs.at(first - 1)) /
+                    (xs.at(first + 1) - xs.at(first))
+              : 0;
+    const Real after =
+        last + 1 < xs.size()
+            ? (xs.at(last + 1) - xs.at(last)) / (xs.at(last) - xs.at(last - 1))
+            : 0;
+    factor *=
+        1 + 2 * (last - first == 1 ? before + after : std::max(before, after));
+  }
+  return tolerance * std::sqrt(fraction / factor);
+}
+
+//! Visit the rows of a box in an array on the finest mesh of a hierarchy.
+//!
+//! `f` is called as `f(offset, k, n)` for each row (a 'spear' along the last
+//! dimension) of the box, where `offset` is the position in the array of the
+//! first node of the row, `k` is its position in row-major arrays on the box,
+//! and `n` is the length of the row.
+template <std::size_t N, typename F>
+void for_each_box_row(const std::array<std::size_t, N> &SHAPE,
+                      const std::array<std::size_t, N> &lower,
+                      const std::array<std::size_t, N> &shape, F &&f) {
+  const std::size_t n = shape.back();
+  std::size_t nrows = 1;
+  for (std::size_t i = 0; i + 1 < N; ++i) {
+    nrows *= shape.at(i);
+  }
+  for (std::size_t r = 0; r < nrows; ++r) {
+    std::size_t offset = 0;
+    std::size_t remainder = r;
+    std::size_t stride = SHAPE.back();
+    for (std::size_t k = 1; k < N; ++k) {
+      const std::size_t i = N - 1 - k;
+      offset += (lower.at(i) + remainder % shape.at(i)) * stride;
+      remainder /= shape.at(i);
+      stride *= SHAPE.at(i);
+    }
+    f(offset + lower.back(), r * n, n);
+  }
+}
+
+} // namespace
+
+template <std::size_t N, typename Real>
+TiledCompressedDataset<N, Real>::TiledCompressedDataset(
+    const TensorMeshHierarchy<N, Real> &hierarchy, const Real s,
+    const Real tolerance, const std::array<std::size_t, N> &tile_shape,
+    void const *const data, const std::size_t size)
+    : hierarchy(hierarchy), s(s), tolerance(tolerance), tile_shape(tile_shape),
+      data_(static_cast<unsigned char const *>(data)), size_(size),
+      boundaries(tile_boundaries(hierarchy.shapes.back(), tile_shape)) {}
+
+template <std::size_t N, typename Real>
+std::size_t TiledCompressedDataset<N, Real>::ntiles() const {
+  return mgard::ntiles(boundaries);
+}
+
+template <std::size_t N, typename Real>
+std::array<std::size_t, N>
+TiledCompressedDataset<N, Real>::tile_lower_corner(const std::size_t t) const {
+  std::array<std::size_t, N> lower;
+  std::array<std::size_t, N> shape;
+  tile_extent(boundaries, t, lower, shape);
+  return lower;
+}
+
+template <std::size_t N, typename Real>
+CompressedDataset<N, Real>
+TiledCompressedDataset<N, Real>::tile(const std::size_t t) const {
+  std::array<std::size_t, N> lower;
+  std::array<std::size_t, N> shape;
+  // Throws if `t` is out of range.
+  tile_extent(boundaries, t, lower, shape);
+  const std::size_t n = ntiles();
+  const std::size_t index_size = tile_index_size(n);
+  if (size_ < index_size) {
+    throw std::invalid_argument("compressed dataset is truncated");
+  }
+  unsigned char const *p = data_.get();
+  if (!std::equal(tiled_magic.begin(), tiled_magic.end(), p)) {
+    throw std::invalid_argument("not a tiled compressed dataset");
+  }
+  p += tiled_magic.size();
+  if (*p++ != tiled_format_version) {
+    throw std::invalid_argument("unsupported tiled compressed dataset version");
+  }
+  if (read_index_field(p, tile_index_field_width) != n) {
+    throw std::invalid_argument("number of tiles doesn't match the tiling");
+  }
+  p += (t + 1) * tile_index_field_width;
+  const std::size_t begin = read_index_field(p, tile_index_field_width);
+  const std::size_t end =
+      read_index_field(p + tile_index_field_width, tile_index_field_width);
+  if (begin > end) {
+    throw std::invalid_argument("invalid tile index");
+  }
+  if (end > size_ - index_size) {
+    throw std::invalid_argument("compressed dataset is truncated");
+  }
+  const std::size_t tile_size = end - begin;
+  unsigned char *const buffer = new unsigned char[tile_size];
+  std::memcpy(buffer, data_.get() + index_size + begin, tile_size);
+  return CompressedDataset<N, Real>(
+      box_hierarchy(hierarchy, lower, shape), s,
+      tile_tolerance(hierarchy, s, tolerance, lower, shape), buffer, tile_size);
+}
+
+template <std::size_t N, typename Real>
+void const *TiledCompressedDataset<N, Real>::data() const {
+  return data_.get();
+}
+
+template <std::size_t N, typename Real>
+std::size_t TiledCompressedDataset<N, Real>::size() const {
+  return size_;
+}
+
 template <std::size_t N, typename Real>
 DecompressedDataset<N, Real>::DecompressedDataset(
     const CompressedDataset<N, Real> &compressed, Real const *const data)
+    : DecompressedDataset(compressed, compressed.hierarchy, data) {}
+
+template <std::size_t N, typename Real>
+DecompressedDataset<N, Real>::DecompressedDataset(
+    const CompressedDataset<N, Real> &compressed,
+    const TensorMeshHierarchy<N, Real> &hierarchy, Real const *const data)
+    : hierarchy(hierarchy), s(compressed.s), tolerance(compressed.tolerance),
+      data_(data) {}
+
+template <std::size_t N, typename Real>
+DecompressedDataset<N, Real>::DecompressedDataset(
+    const TiledCompressedDataset<N, Real> &compressed, Real const *const data)
     : hierarchy(compressed.hierarchy), s(compressed.s),
       tolerance(compressed.tolerance), data_(data) {}
 
@@ -52,81 +495,922 @@ Real const *DecompressedDataset<N, Real>::data() const {
 
 using DEFAULT_INT_T = long int;
 
+namespace {
+
+//! Read the header and segment index of a compressed dataset.
+//!
+//!\param hierarchy Mesh hierarchy used in compressing the dataset.
+//!\param data Compressed dataset.
+//!\param size Size in bytes of `data`. Only the header and index are read.
+//!\param header Header of the dataset.
+template <std::size_t N, typename Real>
+std::vector<QuantizedSegment>
+read_quantized_header(const TensorMeshHierarchy<N, Real> &hierarchy,
+                      void const *const data, const std::size_t size,
+                      QuantizedHeader &header) {
+  header = read_quantized_prefix(data, size);
+  if (header.nsegments != hierarchy.L + 1) {
+    throw std::invalid_argument(
+        "number of segments doesn't match the mesh hierarchy");
+  }
+  if (size < quantized_header_size(header)) {
+    throw std::invalid_argument("compressed dataset is truncated");
+  }
+  const std::size_t field_width = header.field_width;
+  unsigned char const *p =
+      static_cast<unsigned char const *>(data) + sizeof(header);
+  std::vector<QuantizedSegment> segments(header.nsegments);
+  for (QuantizedSegment &segment : segments) {
+    segment.primary_size = read_index_field(p, field_width);
+    segment.noutliers = read_index_field(p + field_width, field_width);
+    segment.outliers_size = read_index_field(p + 2 * field_width, field_width);
+    p += 3 * field_width;
+  }
+  return segments;
+}
+
+//! A compact representation is abandoned if more than one in this many
+//! coefficients are outliers. Each outlier takes up an index and a
+//! full-width value, so beyond this point a wider representation is smaller.
+const std::size_t max_outlier_ratio = 16;
+
+//! Number of quantized coefficients compressed together in the streaming
+//! pipeline.
+const std::size_t compression_chunk_size = 1 << 20;
+
+//! Quantize a range of multilevel coefficients and losslessly compress the
+//! results, appending them to `output`.
+//!
+//! The outliers are appended to `outliers` but not compressed. The compressor
+//! is looked up in the registry (see `lossless_backend`). Huffman pipelines
+//! code the coefficients and hand the result to their backend; otherwise the
+//! coefficients go to the backend directly. Either way they are quantized a
+//! chunk at a time unless the backend only compresses whole buffers.
+template <typename Narrow, std::size_t N, typename Real, typename Int>
+void quantize_and_compress(
+    const TensorMultilevelCoefficientQuantizer<N, Real, Int> &quantizer,
+    Real const *const u, const std::size_t begin, const std::size_t end,
+    QuantizedOutliers<Int> &outliers, const LosslessOptions &lossless,
+    std::vector<unsigned char> &output) {
+  const LosslessBackend &backend = lossless_backend(lossless.compressor);
+  if (is_huffman_pipeline(lossless.compressor)) {
+    // The coefficients are quantized twice, once to count their frequencies
+    // and once to be encoded, so the outliers found the first time are dropped
+    // when the second pass starts.
+    const std::size_t noutliers = outliers.indices.size();
+    compress_stream_huffman<Narrow>(
+        end - begin,
+        [&](const std::size_t chunk_begin, const std::size_t chunk_end,
+            Narrow *const chunk) {
+          if (!chunk_begin) {
+            outliers.indices.resize(noutliers);
+            outliers.values.resize(noutliers);
+          }
+          quantizer.quantize(u, begin + chunk_begin, begin + chunk_end, chunk,
+                             outliers, NodeOrdering::Unshuffled);
+        },
+        output, lossless.compressor, lossless.level);
+    return;
+  }
+  if (backend.compress_stream) {
+    // Only one chunk of quantized coefficients is held in memory at once.
+    std::vector<Narrow> chunk(std::min(end - begin, compression_chunk_size));
+    std::size_t chunk_begin = begin;
+    backend.compress_stream(
+        [&]() -> std::pair<void const *, std::size_t> {
+          const std::size_t chunk_end =
+              std::min(chunk_begin + chunk.size(), end);
+          quantizer.quantize(u, chunk_begin, chunk_end, chunk.data(),
+                             outliers, NodeOrdering::Unshuffled);
+          const std::size_t n = chunk_end - chunk_begin;
+          chunk_begin = chunk_end;
+          return {chunk.data(), n * sizeof(Narrow)};
+        },
+        lossless.level, output);
+    return;
+  }
+
+  std::vector<Narrow> quantized(end - begin);
+  quantizer.quantize(u, begin, end, quantized.data(), outliers,
+                     NodeOrdering::Unshuffled);
+  std::vector<unsigned char> compressed;
+  backend.compress(quantized.data(), quantized.size() * sizeof(Narrow),
+                   lossless.level, compressed);
+  output.insert(output.end(), compressed.begin(), compressed.end());
+}
+
+//! Decompress an array of quantized coefficients compressed with
+//! `quantize_and_compress`.
+template <typename Int>
+void decompress_quantized(unsigned char const *const data,
+                          const std::size_t size, Int *const quantized,
+                          const std::size_t n,
+                          const LosslessCompressor compressor) {
+  if (is_huffman_pipeline(compressor)) {
+    decompress_memory_huffman(const_cast<unsigned char *>(data), size,
+                              quantized, n, compressor);
+  } else {
+    lossless_backend(compressor).decompress(data, size, quantized,
+                                            n * sizeof(Int));
+  }
+}
+
+//! Losslessly compress a buffer of bytes.
+inline std::vector<unsigned char>
+compress_bytes(void const *const data, const std::size_t size,
+               const LosslessOptions &lossless) {
+  std::vector<unsigned char> output;
+  lossless_backend(lossless.compressor)
+      .compress(data, size, lossless.level, output);
+  return output;
+}
+
+//! Decompress a buffer of bytes compressed with `compress_bytes`.
+inline void decompress_bytes(unsigned char const *const src,
+                             const std::size_t size, unsigned char *const dst,
+                             const std::size_t dst_size,
+                             const LosslessCompressor compressor) {
+  lossless_backend(compressor).decompress(src, size, dst, dst_size);
+}
+
+//! Quantize multilevel coefficients into a compact representation and
+//! losslessly compress them, a level at a time.
+template <typename Narrow, std::size_t N, typename Real, typename Int>
+void compress_compact(
+    const TensorMultilevelCoefficientQuantizer<N, Real, Int> &quantizer,
+    Real const *const u, std::vector<unsigned char> &output,
+    const LosslessOptions &lossless) {
+  const TensorMeshHierarchy<N, Real> &hierarchy = quantizer.hierarchy;
+  std::vector<QuantizedSegment> segments(hierarchy.L + 1);
+  // The segments are compressed into place after room for the widest header
+  // and index. The header is written once the width of the index entries is
+  // known, and the room it doesn't need is then removed.
+  const std::size_t reserved =
+      quantized_header_size(segments.size(), sizeof(std::size_t));
+  output.assign(reserved, 0);
+  std::size_t largest = 0;
+  for (std::size_t l = 0; l <= hierarchy.L; ++l) {
+    QuantizedSegment &segment = segments.at(l);
+    QuantizedOutliers<Int> outliers;
+    const std::size_t primary_begin = output.size();
+    quantize_and_compress<Narrow>(quantizer, u, l ? hierarchy.ndof(l - 1) : 0,
+                                  hierarchy.ndof(l), outliers, lossless,
+                                  output);
+    segment.primary_size = output.size() - primary_begin;
+
+    segment.noutliers = outliers.indices.size();
+    segment.outliers_size = 0;
+    if (segment.noutliers) {
+      const std::size_t indices_size = segment.noutliers * sizeof(std::size_t);
+      std::vector<unsigned char> buffer(indices_size +
+                                        segment.noutliers * sizeof(Int));
+      std::memcpy(buffer.data(), outliers.indices.data(), indices_size);
+      std::memcpy(buffer.data() + indices_size, outliers.values.data(),
+                  segment.noutliers * sizeof(Int));
+      const std::vector<unsigned char> secondary =
+          compress_bytes(buffer.data(), buffer.size(), lossless);
+      segment.outliers_size = secondary.size();
+      output.insert(output.end(), secondary.begin(), secondary.end());
+    }
+    largest = std::max({largest, segment.primary_size, segment.noutliers,
+                        segment.outliers_size});
+  }
+
+  const QuantizedHeader header{
+      quantized_magic,
+      quantized_format_version,
+      sizeof(Narrow),
+      static_cast<std::uint8_t>(lossless.compressor),
+      static_cast<std::uint8_t>(segments.size()),
+      static_cast<std::uint8_t>(quantizer.l_target),
+      index_field_width(largest)};
+  const std::size_t field_width = header.field_width;
+  const std::size_t unused = reserved - quantized_header_size(header);
+  unsigned char *p = output.data() + unused;
+  std::memcpy(p, &header, sizeof(header));
+  p += sizeof(header);
+  for (const QuantizedSegment &segment : segments) {
+    write_index_field(p, segment.primary_size, field_width);
+    write_index_field(p + field_width, segment.noutliers, field_width);
+    write_index_field(p + 2 * field_width, segment.outliers_size, field_width);
+    p += 3 * field_width;
+  }
+  output.erase(output.begin(), output.begin() + unused);
+}
+
+//! Decompress the outliers of a segment written by `compress_compact`.
+//!
+//!\param data Beginning of the compressed outliers of the segment.
+//!\param segment Sizes of the segment.
+//!\param compressor Lossless compressor used.
+template <typename Int>
+QuantizedOutliers<Int>
+decompress_outliers(unsigned char const *const data,
+                    const QuantizedSegment &segment,
+                    const LosslessCompressor compressor) {
+  const std::size_t noutliers = segment.noutliers;
+  QuantizedOutliers<Int> outliers;
+  if (noutliers) {
+    const std::size_t indices_size = noutliers * sizeof(std::size_t);
+    std::vector<unsigned char> buffer(indices_size + noutliers * sizeof(Int));
+    decompress_bytes(data, segment.outliers_size, buffer.data(), buffer.size(),
+                     compressor);
+    outliers.indices.resize(noutliers);
+    outliers.values.resize(noutliers);
+    std::memcpy(outliers.indices.data(), buffer.data(), indices_size);
+    std::memcpy(outliers.values.data(), buffer.data() + indices_size,
+                noutliers * sizeof(Int));
+  }
+  return outliers;
+}
+
+//! Decompress the quantized coefficients at some positions of an array
+//! compressed with `quantize_and_compress`.
+//!
+//! If the array was Huffman coded only the chunks of the Huffman stream
+//! containing the positions are decoded, and otherwise it is decompressed a
+//! chunk at a time if the backend streams, so in either case it is never held
+//! in memory all at once.
+//!
+//!\param data Compressed array.
+//!\param size Size in bytes of the compressed array.
+//!\param n Number of coefficients in the array.
+//!\param positions Positions of the coefficients wanted, in increasing order.
+//!\param selected Buffer in which to store the coefficients wanted.
+//!\param compressor Lossless compressor used.
+template <typename Narrow>
+void decompress_quantized_at(unsigned char const *const data,
+                             const std::size_t size, const std::size_t n,
+                             const std::vector<std::size_t> &positions,
+                             Narrow *const selected,
+                             const LosslessCompressor compressor) {
+  if (positions.empty()) {
+    return;
+  }
+  if (is_huffman_pipeline(compressor)) {
+    decompress_memory_huffman_at(const_cast<unsigned char *>(data), size, n,
+                                 positions, selected, compressor);
+    return;
+  }
+  const LosslessBackend &backend = lossless_backend(compressor);
+  if (!backend.decompress_stream) {
+    std::vector<Narrow> quantized(n);
+    decompress_quantized(data, size, quantized.data(), n, compressor);
+    for (std::size_t k = 0; k < positions.size(); ++k) {
+      selected[k] = quantized[positions[k]];
+    }
+    return;
+  }
+  std::vector<Narrow> chunk(std::min(n, compression_chunk_size));
+  std::size_t chunk_begin = 0;
+  std::size_t k = 0;
+  backend.decompress_stream(
+      data, size, chunk.data(), chunk.size() * sizeof(Narrow),
+      [&](const std::size_t chunk_size) {
+        const std::size_t chunk_end = chunk_begin + chunk_size / sizeof(Narrow);
+        for (; k < positions.size() && positions[k] < chunk_end; ++k) {
+          selected[k] = chunk[positions[k] - chunk_begin];
+        }
+        chunk_begin = chunk_end;
+      });
+  if (k < positions.size()) {
+    throw std::invalid_argument("compressed dataset is truncated");
+  }
+}
+
+//! Decompress and dequantize the multilevel coefficients of the coarsest
+//! levels of a dataset compressed with `compress_compact`.
+//!
+//! Only the segments of the levels up through `l` are read, so `size` may be
+//! the size of just that initial part of the compressed dataset.
+template <typename Narrow, std::size_t N, typename Int, typename Real>
+void decompress_compact(
+    const TensorMultilevelCoefficientDequantizer<N, Int, Real> &dequantizer,
+    void const *const data, const std::size_t size,
+    const QuantizedHeader &header,
+    const std::vector<QuantizedSegment> &segments, const std::size_t l,
+    Real *const v, const NodeOrdering ordering) {
+  const TensorMeshHierarchy<N, Real> &hierarchy = dequantizer.hierarchy;
+  const LosslessCompressor compressor =
+      static_cast<LosslessCompressor>(header.compressor);
+  std::size_t position = quantized_header_size(header);
+  for (std::size_t ell = 0; ell <= l; ++ell) {
+    const QuantizedSegment &segment = segments.at(ell);
+    if (position + segment.primary_size + segment.outliers_size > size) {
+      throw std::invalid_argument("compressed dataset is truncated");
+    }
+    unsigned char const *const p =
+        static_cast<unsigned char const *>(data) + position;
+    const std::size_t begin = ell ? hierarchy.ndof(ell - 1) : 0;
+    const std::size_t end = hierarchy.ndof(ell);
+
+    std::vector<Narrow> quantized(end - begin);
+    decompress_quantized(p, segment.primary_size, quantized.data(),
+                         quantized.size(), compressor);
+    const QuantizedOutliers<Int> outliers =
+        decompress_outliers<Int>(p + segment.primary_size, segment, compressor);
+
+    dequantizer.dequantize(quantized.data(), begin, end, outliers, v,
+                           ordering);
+    position += segment.primary_size + segment.outliers_size;
+  }
+}
+
+//! Decompress and dequantize the multilevel coefficients of the levels up
+//! through `l` of a compressed dataset.
+//!
+//!\param compressed Compressed dataset. Only the segments of the levels up
+//! through `l` need be present.
+//!\param l Index of the finest level whose coefficients are needed.
+//!\param v Buffer in which to store the coefficients. If `ordering` is
+//! `NodeOrdering::Shuffled`, it need only be large enough to hold the
+//! coefficients of the levels up through `l`.
+//!\param ordering Order in which to store the coefficients.
+template <std::size_t N, typename Real>
+void decompress_levels(const CompressedDataset<N, Real> &compressed,
+                       const std::size_t l, Real *const v,
+                       const NodeOrdering ordering) {
+  const TensorMeshHierarchy<N, Real> &hierarchy = compressed.hierarchy;
+  using Dqntzr = TensorMultilevelCoefficientDequantizer<N, DEFAULT_INT_T, Real>;
+  const Dqntzr dequantizer(hierarchy, compressed.s, compressed.tolerance,
+                           compressed.l_target);
+  QuantizedHeader header;
+  const std::vector<QuantizedSegment> segments =
+      read_quantized_header(hierarchy, compressed.data(), compressed.size(),
+                            header);
+  void const *const data = compressed.data();
+  const std::size_t size = compressed.size();
+  if (header.width == sizeof(std::int16_t)) {
+    decompress_compact<std::int16_t>(dequantizer, data, size, header, segments,
+                                     l, v, ordering);
+  } else if (header.width == sizeof(std::int32_t)) {
+    decompress_compact<std::int32_t>(dequantizer, data, size, header, segments,
+                                     l, v, ordering);
+  } else if (header.width == sizeof(DEFAULT_INT_T)) {
+    decompress_compact<DEFAULT_INT_T>(dequantizer, data, size, header,
+                                      segments, l, v, ordering);
+  } else {
+    throw std::invalid_argument("unsupported quantized coefficient width");
+  }
+}
+
+//! Decompress and dequantize the multilevel coefficients needed to recompose
+//! a dataset compressed with `compress_compact` on a box, and recompose it.
+//!
+//! Only the coefficients in the windows of the plan are dequantized.
+template <typename Narrow, std::size_t N, typename Int, typename Real>
+void decompress_region_compact(
+    const TensorMultilevelCoefficientDequantizer<N, Int, Real> &dequantizer,
+    void const *const data, const std::size_t size,
+    const QuantizedHeader &header,
+    const std::vector<QuantizedSegment> &segments,
+    const RegionRecompositionPlan<N, Real> &plan, Real *const v) {
+  const TensorMeshHierarchy<N, Real> &hierarchy = dequantizer.hierarchy;
+  const LosslessCompressor compressor =
+      static_cast<LosslessCompressor>(header.compressor);
+  const TensorSpearLayout<N, Real> layout(hierarchy, hierarchy.L, N - 1);
+  const Narrow marker = std::numeric_limits<Narrow>::min();
+  std::size_t position = quantized_header_size(header);
+  std::vector<std::size_t> positions;
+  std::vector<std::size_t> window_positions;
+  std::vector<std::array<std::size_t, N>> multiindices;
+  std::vector<Narrow> quantized;
+  std::vector<std::size_t> node_positions;
+  std::vector<std::size_t> node_window_positions;
+  std::vector<std::array<std::size_t, N>> node_multiindices;
+  plan.recompose(
+      [&](const std::size_t l, Real *const w) {
+        // The nodes of a mesh new to it are shuffled in row-major order, so
+        // the positions are found in increasing order.
+        node_positions.clear();
+        node_window_positions.clear();
+        node_multiindices.clear();
+        plan.for_each_new_node(
+            l, [&](const std::array<std::size_t, N> &multiindex,
+                   const std::size_t k) {
+              node_positions.push_back(layout.offset(multiindex));
+              node_window_positions.push_back(k);
+              node_multiindices.push_back(multiindex);
+            });
+
+        // The window of the `l_target`th level takes in the nodes introduced
+        // by the coarser levels as well.
+        for (std::size_t ell = l == plan.l_target ? 0 : l; ell <= l; ++ell) {
+          const QuantizedSegment &segment = segments.at(ell);
+          if (position + segment.primary_size + segment.outliers_size > size) {
+            throw std::invalid_argument("compressed dataset is truncated");
+          }
+          unsigned char const *const p =
+              static_cast<unsigned char const *>(data) + position;
+          position += segment.primary_size + segment.outliers_size;
+          const std::size_t begin = ell ? hierarchy.ndof(ell - 1) : 0;
+          const std::size_t end = hierarchy.ndof(ell);
+
+          positions.clear();
+          window_positions.clear();
+          multiindices.clear();
+          for (std::size_t j = 0; j < node_positions.size(); ++j) {
+            if (begin <= node_positions[j] && node_positions[j] < end) {
+              positions.push_back(node_positions[j] - begin);
+              window_positions.push_back(node_window_positions[j]);
+              multiindices.push_back(node_multiindices[j]);
+            }
+          }
+          quantized.resize(positions.size());
+          decompress_quantized_at(p, segment.primary_size, end - begin,
+                                  positions, quantized.data(), compressor);
+          const QuantizedOutliers<Int> outliers = decompress_outliers<Int>(
+              p + segment.primary_size, segment, compressor);
+
+          for (std::size_t j = 0; j < positions.size(); ++j) {
+            Int n = quantized[j];
+            if (quantized[j] == marker) {
+              const std::vector<std::size_t> &indices = outliers.indices;
+              const std::size_t index =
+                  std::lower_bound(indices.begin(), indices.end(),
+                                   begin + positions[j]) -
+                  indices.begin();
+              n = outliers.values.at(index);
+            }
+            w[window_positions[j]] = dequantizer(multiindices[j], n);
+          }
+        }
+      },
+      v);
+}
+
+//! Quantize multilevel coefficients and losslessly compress them.
+//!
+//! The narrowest compact representation whose outliers wouldn't take up too
+//! much space is used. The outliers are counted in a first pass so that the
+//! coefficients can then be quantized and compressed in a single streaming
+//! pass.
+//!
+//!\param quantizer Quantizer to use.
+//!\param u Multilevel coefficients, in the unshuffled order.
+//!\param lossless Lossless compressor to use.
+template <std::size_t N, typename Real, typename Int>
+CompressedDataset<N, Real> compress_coefficients(
+    const TensorMultilevelCoefficientQuantizer<N, Real, Int> &quantizer,
+    Real const *const u, const LosslessOptions &lossless) {
+  const TensorMeshHierarchy<N, Real> &hierarchy = quantizer.hierarchy;
+  // Fail before quantizing if the compressor isn't available or the level is
+  // invalid.
+  check_lossless_options(lossless);
+  const std::size_t max_outliers = hierarchy.ndof() / max_outlier_ratio;
+  std::vector<unsigned char> output;
+  if (quantizer.template count_outliers<std::int16_t>(
+          u, NodeOrdering::Unshuffled) <= max_outliers) {
+    compress_compact<std::int16_t>(quantizer, u, output, lossless);
+  } else if (quantizer.template count_outliers<std::int32_t>(
+                 u, NodeOrdering::Unshuffled) <= max_outliers) {
+    compress_compact<std::int32_t>(quantizer, u, output, lossless);
+  } else {
+    compress_compact<Int>(quantizer, u, output, lossless);
+  }
+
+  return CompressedDataset<N, Real>(hierarchy, quantizer.s, quantizer.tolerance,
+                                    std::move(output));
+}
+
+//! Estimate the size of multilevel coefficients quantized and compressed by
+//! `compress_coefficients`.
+//!
+//! The quantized coefficients of each level are taken to occupy as many bits
+//! as their (zeroth-order) entropy in a 16-bit compact representation, with
+//! the outliers stored uncompressed. This costs a quantization pass, but no
+//! lossless compression.
+//!
+//!\param quantizer Quantizer to use.
+//!\param u Multilevel coefficients, in the unshuffled order.
+template <std::size_t N, typename Real, typename Int>
+std::size_t estimate_compressed_size(
+    const TensorMultilevelCoefficientQuantizer<N, Real, Int> &quantizer,
+    Real const *const u) {
+  using Narrow = std::int16_t;
+  const TensorMeshHierarchy<N, Real> &hierarchy = quantizer.hierarchy;
+  const Narrow minimum = std::numeric_limits<Narrow>::min();
+  std::vector<std::size_t> counts(
+      static_cast<std::size_t>(std::numeric_limits<Narrow>::max() - minimum) +
+      1);
+  std::vector<Narrow> chunk;
+  QuantizedOutliers<Int> outliers;
+  double bits = 0;
+  std::size_t noutliers = 0;
+  for (std::size_t l = 0; l <= hierarchy.L; ++l) {
+    const std::size_t begin = l ? hierarchy.ndof(l - 1) : 0;
+    const std::size_t end = hierarchy.ndof(l);
+    std::fill(counts.begin(), counts.end(), 0);
+    chunk.resize(std::min(end - begin, compression_chunk_size));
+    for (std::size_t chunk_begin = begin; chunk_begin < end;
+         chunk_begin += chunk.size()) {
+      const std::size_t chunk_end = std::min(chunk_begin + chunk.size(), end);
+      outliers.indices.clear();
+      outliers.values.clear();
+      quantizer.quantize(u, chunk_begin, chunk_end, chunk.data(), outliers,
+                         NodeOrdering::Unshuffled);
+      noutliers += outliers.indices.size();
+      for (std::size_t k = 0; k < chunk_end - chunk_begin; ++k) {
+        ++counts[chunk[k] - minimum];
+      }
+    }
+    const double n = end - begin;
+    for (const std::size_t count : counts) {
+      if (count) {
+        bits += count * std::log2(n / count);
+      }
+    }
+  }
+  const std::size_t body = static_cast<std::size_t>(std::ceil(bits / 8)) +
+                           noutliers * (sizeof(std::size_t) + sizeof(Int));
+  return quantized_header_size(hierarchy.L + 1, index_field_width(body)) +
+         body;
+}
+
+//! Factor by which the tolerance is scaled while bracketing it in
+//! `compress_to_size`.
+const double tolerance_search_factor = 4;
+
+//! Maximum number of steps taken while bracketing the tolerance in
+//! `compress_to_size`.
+const std::size_t max_tolerance_search_steps = 32;
+
+//! Relative width of the bracket at which the bisection in `compress_to_size`
+//! stops.
+const double tolerance_search_precision = 0.01;
+
+//! Maximum number of times `compress_to_size` compresses again after a result
+//! over budget.
+const std::size_t max_size_corrections = 3;
+
+//! Fraction by which `compress_to_size` aims under the budget, per attempt,
+//! after a result over budget.
+const double size_correction_margin = 0.03;
+
+//! Smallest exponent `compress_to_size` fits to the actual size as a power of
+//! the estimated size. Lossless compressors insensitive to the entropy, like
+//! `LosslessCompressor::Fast`, give small exponents.
+const double min_size_exponent = 0.25;
+
+//! Form the mesh hierarchy whose finest mesh is a given mesh of a hierarchy.
+template <std::size_t N, typename Real>
+TensorMeshHierarchy<N, Real>
+coarsened_hierarchy(const TensorMeshHierarchy<N, Real> &hierarchy,
+                    const std::size_t l) {
+  std::array<std::vector<Real>, N> coordinates;
+  for (std::size_t i = 0; i < N; ++i) {
+    const std::vector<Real> &xs = hierarchy.coordinates.at(i);
+    for (const std::size_t index : hierarchy.indices(l, i)) {
+      coordinates.at(i).push_back(xs.at(index));
+    }
+  }
+  // The meshes of the hierarchies coincide, since all but the finest mesh of
+  // a hierarchy are dyadic.
+  return TensorMeshHierarchy<N, Real>(hierarchy.shapes.at(l), coordinates);
+}
+
+} // namespace
+
 template <std::size_t N, typename Real>
 CompressedDataset<N, Real>
 compress(const TensorMeshHierarchy<N, Real> &hierarchy, Real *const v,
-         const Real s, const Real tolerance) {
+         const Real s, const Real tolerance, const std::size_t l_target,
+         const LosslessOptions &lossless) {
+  // The input is decomposed in place and in its natural order. The
+  // coefficients are only put into the shuffled order as they are quantized.
+  DecompositionPlan<N, Real> plan(hierarchy, NodeOrdering::Unshuffled,
+                                  l_target);
+  plan.decompose(v);
+
+  using Qntzr = TensorMultilevelCoefficientQuantizer<N, Real, DEFAULT_INT_T>;
+  return compress_coefficients(Qntzr(hierarchy, s, tolerance, l_target), v,
+                               lossless);
+}
+
+template <std::size_t N, typename Real>
+CompressedDataset<N, Real>
+compress_to_size(const TensorMeshHierarchy<N, Real> &hierarchy, Real *const v,
+                 const Real s, const std::size_t size,
+                 const std::size_t l_target, const LosslessOptions &lossless) {
+  // The size is estimated by quantizing, so check the options first.
+  check_lossless_options(lossless);
   const std::size_t ndof = hierarchy.ndof();
-  // TODO: Can be smarter about copies later.
-  Real *const u = static_cast<Real *>(std::malloc(ndof * sizeof(Real)));
-  shuffle(hierarchy, v, u);
-  decompose(hierarchy, u);
+  DecompositionPlan<N, Real> plan(hierarchy, NodeOrdering::Unshuffled,
+                                  l_target);
+  plan.decompose(v);
 
   using Qntzr = TensorMultilevelCoefficientQuantizer<N, Real, DEFAULT_INT_T>;
-  const Qntzr quantizer(hierarchy, s, tolerance);
-  using It = typename Qntzr::iterator;
-  const RangeSlice<It> quantized_range = quantizer(u);
-  const std::vector<DEFAULT_INT_T> quantized(quantized_range.begin(),
-                                             quantized_range.end());
-  std::free(u);
-#ifndef MGARD_ZSTD
-  std::vector<std::uint8_t> z_output;
-  // TODO: Check whether `compress_memory_z` changes its input.
-  compress_memory_z(
-      const_cast<void *>(static_cast<void const *>(quantized.data())),
-      sizeof(DEFAULT_INT_T) * hierarchy.ndof(), z_output);
-  // Possibly we should check that `sizeof(std::uint8_t)` is `1`.
-  const std::size_t size = z_output.size();
-
-  void *const buffer = new unsigned char[size];
-  std::copy(z_output.begin(), z_output.end(),
-            static_cast<unsigned char *>(buffer));
-#else
-  // Compress an array of data using `zstd`.
-  std::vector<unsigned char> zstd_output;
-  int zstd_outsize;
-
-  void *const buffer =
-      compress_memory_huffman(quantized, zstd_output, zstd_outsize);
-
-  const std::size_t size = zstd_outsize;
-#endif
-  return CompressedDataset<N, Real>(hierarchy, s, tolerance, buffer, size);
+  const auto estimate = [&](const Real tolerance) -> std::size_t {
+    try {
+      return estimate_compressed_size(Qntzr(hierarchy, s, tolerance, l_target),
+                                      v);
+    } catch (const std::domain_error &) {
+      // The coefficients are too large to quantize with this tolerance.
+      return std::numeric_limits<std::size_t>::max();
+    }
+  };
+  const auto fits = [&](const Real tolerance,
+                        const std::size_t budget) -> bool {
+    return estimate(tolerance) <= budget;
+  };
+
+  // Find the smallest tolerance (to within `tolerance_search_precision`) at
+  // which the estimated size is within `budget`, starting from `tolerance`.
+  const auto search = [&](Real tolerance, const std::size_t budget) -> Real {
+    // First bracket the tolerance. `lower` is too small a tolerance and
+    // `upper` is large enough. Zero means not yet found.
+    Real lower = 0;
+    Real upper = 0;
+    (fits(tolerance, budget) ? upper : lower) = tolerance;
+    for (std::size_t k = 0;
+         k < max_tolerance_search_steps && !(lower && upper); ++k) {
+      tolerance = upper ? tolerance / tolerance_search_factor
+                        : tolerance * tolerance_search_factor;
+      (fits(tolerance, budget) ? upper : lower) = tolerance;
+    }
+    if (!upper) {
+      upper = tolerance;
+    }
+    // Then bisect (geometrically) until the bracket is tight.
+    if (lower) {
+      while (upper > lower * (1 + tolerance_search_precision)) {
+        const Real middle = std::sqrt(lower * upper);
+        (fits(middle, budget) ? upper : lower) = middle;
+      }
+    }
+    return upper;
+  };
+
+  // Start from the scale of the coefficients.
+  Real tolerance = 0;
+  for (std::size_t i = 0; i < ndof; ++i) {
+    tolerance = std::max(tolerance, std::abs(v[i]));
+  }
+  if (!(tolerance > 0)) {
+    tolerance = 1;
+  }
+  std::size_t budget = size;
+  tolerance = search(tolerance, budget);
+
+  // The estimate is biased (the lossless compressor can do better or worse
+  // than the entropy), so the coefficients are compressed once at the
+  // tolerance found. Only if the result is over budget is the budget given to
+  // the estimate lowered and the tolerance searched for again. The actual size
+  // is modeled as a power of the estimate, with the exponent fitted to the
+  // last two results (and taken to be one at first), and the estimate aimed at
+  // a little under the budget, by a margin growing with each attempt.
+  double previous_estimate = 0;
+  double previous_actual = 0;
+  for (std::size_t k = 1;; ++k) {
+    CompressedDataset<N, Real> compressed = compress_coefficients(
+        Qntzr(hierarchy, s, tolerance, l_target), v, lossless);
+    const double actual = compressed.size();
+    if (actual <= size || k > max_size_corrections) {
+      return compressed;
+    }
+    const double estimated = estimate(tolerance);
+    double exponent = 1;
+    if (previous_estimate) {
+      exponent = std::log(previous_actual / actual) /
+                 std::log(previous_estimate / estimated);
+      // Also catches the exponent not being a number.
+      if (!(exponent >= min_size_exponent)) {
+        exponent = min_size_exponent;
+      }
+      exponent = std::min(exponent, 1.0);
+    }
+    const double target = (1 - k * size_correction_margin) * size;
+    const double scaled = estimated * std::pow(target / actual, 1 / exponent);
+    budget =
+        budget ? std::min(budget - 1, static_cast<std::size_t>(scaled)) : 0;
+    tolerance = std::max<Real>(search(tolerance, budget),
+                               tolerance * (1 + tolerance_search_precision));
+    previous_estimate = estimated;
+    previous_actual = actual;
+  }
 }
 
 template <std::size_t N, typename Real>
 DecompressedDataset<N, Real>
 decompress(const CompressedDataset<N, Real> &compressed) {
-  const std::size_t ndof = compressed.hierarchy.ndof();
-  DEFAULT_INT_T *const quantized =
-      static_cast<DEFAULT_INT_T *>(std::malloc(ndof * sizeof(*quantized)));
-  // TODO: Figure out all these casts here and above.
-#ifndef MGARD_ZSTD
-  decompress_memory_z(const_cast<void *>(compressed.data()), compressed.size(),
-                      reinterpret_cast<int *>(quantized),
-                      ndof * sizeof(*quantized));
-#else
-  decompress_memory_huffman(
-      reinterpret_cast<unsigned char *>(const_cast<void *>(compressed.data())),
-      compressed.size(), quantized, ndof * sizeof(*quantized));
-#endif
+  const TensorMeshHierarchy<N, Real> &hierarchy = compressed.hierarchy;
+  // The coefficients are dequantized straight into their natural positions
+  // and recomposed there, so no unshuffling is needed.
+  std::unique_ptr<Real[]> v(new Real[hierarchy.ndof()]);
+  decompress_levels(compressed, hierarchy.L, v.get(), NodeOrdering::Unshuffled);
+  DecompositionPlan<N, Real>(hierarchy, NodeOrdering::Unshuffled,
+                             compressed.l_target)
+      .recompose(v.get());
+  return DecompressedDataset<N, Real>(compressed, v.release());
+}
+
+template <std::size_t N, typename Real>
+DecompressedDataset<N, Real>
+decompress_to_level(const CompressedDataset<N, Real> &compressed,
+                    const std::size_t l) {
+  const TensorMeshHierarchy<N, Real> &hierarchy = compressed.hierarchy;
+  if (l > hierarchy.L) {
+    throw std::out_of_range("mesh index out of range encountered");
+  }
+  const std::size_t l_target = compressed.l_target;
+  const TensorMeshHierarchy<N, Real> coarse = coarsened_hierarchy(hierarchy, l);
+  const std::size_t ndof = coarse.ndof();
+  // The nodes of the `l`th mesh come first in shuffled arrays, in the same
+  // order for both hierarchies.
+  std::unique_ptr<Real[]> v(new Real[ndof]);
+  if (l < l_target) {
+    // The coefficients on the `l_target`th mesh are the values there of the
+    // projection onto that mesh. Decomposing those, we get the projection onto
+    // the `l`th mesh.
+    const TensorMeshHierarchy<N, Real> target =
+        coarsened_hierarchy(hierarchy, l_target);
+    std::vector<Real> shuffled(target.ndof());
+    decompress_levels(compressed, l_target, shuffled.data(),
+                      NodeOrdering::Shuffled);
+    DecompositionPlan<N, Real>(target, NodeOrdering::Shuffled, l)
+        .decompose(shuffled.data());
+    unshuffle(coarse, shuffled.data(), v.get());
+  } else {
+    std::vector<Real> shuffled(ndof);
+    decompress_levels(compressed, l, shuffled.data(), NodeOrdering::Shuffled);
+    unshuffle(coarse, shuffled.data(), v.get());
+    DecompositionPlan<N, Real>(coarse, NodeOrdering::Unshuffled, l_target)
+        .recompose(v.get());
+  }
+  return DecompressedDataset<N, Real>(compressed, coarse, v.release());
+}
+
+template <std::size_t N, typename Real>
+DecompressedDataset<N, Real>
+decompress_region(const CompressedDataset<N, Real> &compressed,
+                  const std::array<std::size_t, N> &lower_corner,
+                  const std::array<std::size_t, N> &upper_corner) {
+  const TensorMeshHierarchy<N, Real> &hierarchy = compressed.hierarchy;
+  const RegionRecompositionPlan<N, Real> plan(
+      hierarchy, lower_corner, upper_corner, compressed.l_target);
+  const TensorMeshHierarchy<N, Real> region =
+      box_hierarchy(hierarchy, lower_corner, plan.shape);
+
   using Dqntzr = TensorMultilevelCoefficientDequantizer<N, DEFAULT_INT_T, Real>;
-  const Dqntzr dequantizer(compressed.hierarchy, compressed.s,
-                           compressed.tolerance);
-  using It = typename Dqntzr::template iterator<DEFAULT_INT_T *>;
-  const RangeSlice<It> dequantized_range =
-      dequantizer(quantized, quantized + ndof);
-
-  // TODO: Can be smarter about copies later.
-  Real *const buffer = static_cast<Real *>(std::malloc(ndof * sizeof(Real)));
-  std::copy(dequantized_range.begin(), dequantized_range.end(), buffer);
-  std::free(quantized);
-
-  recompose(compressed.hierarchy, buffer);
-  Real *const v = new Real[ndof];
-  unshuffle(compressed.hierarchy, buffer, v);
-  std::free(buffer);
-  return DecompressedDataset<N, Real>(compressed, v);
+  const Dqntzr dequantizer(hierarchy, compressed.s, compressed.tolerance,
+                           compressed.l_target);
+  QuantizedHeader header;
+  const std::vector<QuantizedSegment> segments =
+      read_quantized_header(hierarchy, compressed.data(), compressed.size(),
+                            header);
+  void const *const data = compressed.data();
+  const std::size_t size = compressed.size();
+  std::unique_ptr<Real[]> v(new Real[plan.ndof()]);
+  if (header.width == sizeof(std::int16_t)) {
+    decompress_region_compact<std::int16_t>(dequantizer, data, size, header,
+                                            segments, plan, v.get());
+  } else if (header.width == sizeof(std::int32_t)) {
+    decompress_region_compact<std::int32_t>(dequantizer, data, size, header,
+                                            segments, plan, v.get());
+  } else if (header.width == sizeof(DEFAULT_INT_T)) {
+    decompress_region_compact<DEFAULT_INT_T>(dequantizer, data, size, header,
+                                             segments, plan, v.get());
+  } else {
+    throw std::invalid_argument("unsupported quantized coefficient width");
+  }
+  return DecompressedDataset<N, Real>(compressed, region, v.release());
+}
+
+template <std::size_t N, typename Real>
+TiledCompressedDataset<N, Real>
+compress_tiled(const TensorMeshHierarchy<N, Real> &hierarchy,
+               Real const *const v, const Real s, const Real tolerance,
+               const std::array<std::size_t, N> &tile_shape,
+               const LosslessOptions &lossless) {
+  if (s != 0 && s != std::numeric_limits<Real>::infinity()) {
+    throw std::invalid_argument(
+        "tiled compression supports only `s` zero and infinite");
+  }
+  check_lossless_options(lossless);
+  const std::array<std::size_t, N> &SHAPE = hierarchy.shapes.back();
+  const std::array<std::vector<std::size_t>, N> boundaries =
+      tile_boundaries(SHAPE, tile_shape);
+  const std::size_t n = ntiles(boundaries);
+  std::vector<std::vector<unsigned char>> tiles(n);
+  // The tiles are the unit of parallelism here, so the operators' own loops
+  // run serially within each tile. Exceptions can't be thrown out of the loop.
+  std::exception_ptr exception;
+#pragma omp parallel for schedule(dynamic)
+  for (std::size_t t = 0; t < n; ++t) {
+    try {
+      std::array<std::size_t, N> lower;
+      std::array<std::size_t, N> shape;
+      tile_extent(boundaries, t, lower, shape);
+      const TensorMeshHierarchy<N, Real> tile =
+          box_hierarchy(hierarchy, lower, shape);
+      std::vector<Real> u(tile.ndof());
+      for_each_box_row(SHAPE, lower, shape,
+                       [&](const std::size_t offset, const std::size_t k,
+                           const std::size_t m) {
+                         std::copy(v + offset, v + offset + m, u.data() + k);
+                       });
+      const CompressedDataset<N, Real> compressed =
+          compress(tile, u.data(), s,
+                   tile_tolerance(hierarchy, s, tolerance, lower, shape), 0,
+                   lossless);
+      unsigned char const *const p =
+          static_cast<unsigned char const *>(compressed.data());
+      tiles.at(t).assign(p, p + compressed.size());
+    } catch (...) {
+#pragma omp critical
+      exception = std::current_exception();
+    }
+  }
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+
+  // The tag and version, then the index (see `tile_index_size`), then the
+  // tiles.
+  const std::size_t index_size = tile_index_size(n);
+  std::size_t size = index_size;
+  for (const std::vector<unsigned char> &tile : tiles) {
+    size += tile.size();
+  }
+  unsigned char *const buffer = new unsigned char[size];
+  unsigned char *p = std::copy(tiled_magic.begin(), tiled_magic.end(), buffer);
+  *p++ = tiled_format_version;
+  write_index_field(p, n, tile_index_field_width);
+  p += tile_index_field_width;
+  std::size_t offset = 0;
+  for (std::size_t t = 0; t < n; ++t) {
+    write_index_field(p, offset, tile_index_field_width);
+    p += tile_index_field_width;
+    std::copy(tiles.at(t).begin(), tiles.at(t).end(),
+              buffer + index_size + offset);
+    offset += tiles.at(t).size();
+  }
+  write_index_field(p, offset, tile_index_field_width);
+  return TiledCompressedDataset<N, Real>(hierarchy, s, tolerance, tile_shape,
+                                         buffer, size);
+}
+
+template <std::size_t N, typename Real>
+DecompressedDataset<N, Real>
+decompress(const TiledCompressedDataset<N, Real> &compressed) {
+  const TensorMeshHierarchy<N, Real> &hierarchy = compressed.hierarchy;
+  const std::array<std::size_t, N> &SHAPE = hierarchy.shapes.back();
+  const std::size_t n = compressed.ntiles();
+  std::unique_ptr<Real[]> v(new Real[hierarchy.ndof()]);
+  std::exception_ptr exception;
+#pragma omp parallel for schedule(dynamic)
+  for (std::size_t t = 0; t < n; ++t) {
+    try {
+      const DecompressedDataset<N, Real> tile = decompress(compressed.tile(t));
+      Real const *const u = tile.data();
+      for_each_box_row(SHAPE, compressed.tile_lower_corner(t),
+                       tile.hierarchy.shapes.back(),
+                       [&](const std::size_t offset, const std::size_t k,
+                           const std::size_t m) {
+                         std::copy(u + k, u + k + m, v.get() + offset);
+                       });
+    } catch (...) {
+#pragma omp critical
+      exception = std::current_exception();
+    }
+  }
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+  return DecompressedDataset<N, Real>(compressed, v.release());
+}
+
+template <std::size_t N, typename Real>
+std::size_t
+compressed_header_size(const TensorMeshHierarchy<N, Real> &hierarchy,
+                       void const *const data) {
+  const QuantizedHeader header =
+      read_quantized_prefix(data, compressed_header_prefix_size);
+  if (header.nsegments != hierarchy.L + 1) {
+    throw std::invalid_argument(
+        "number of segments doesn't match the mesh hierarchy");
+  }
+  return quantized_header_size(header);
+}
+
+template <std::size_t N, typename Real>
+std::size_t
+compressed_size_through_level(const TensorMeshHierarchy<N, Real> &hierarchy,
+                              void const *const data, const std::size_t l) {
+  if (l > hierarchy.L) {
+    throw std::out_of_range("mesh index out of range encountered");
+  }
+  QuantizedHeader header;
+  // Only the header and index are read, and the caller vouches for them.
+  const std::vector<QuantizedSegment> segments =
+      read_quantized_header(hierarchy, data,
+                            std::numeric_limits<std::size_t>::max(), header);
+  std::size_t size = quantized_header_size(header);
+  for (std::size_t ell = 0; ell <= l; ++ell) {
+    const QuantizedSegment &segment = segments.at(ell);
+    size += segment.primary_size + segment.outliers_size;
+  }
+  return size;
 }
 
 } // namespace mgard
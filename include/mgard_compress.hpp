@@ -1,35 +1,218 @@
+#ifndef MGARD_COMPRESS_HPP
+#define MGARD_COMPRESS_HPP
+//!\file
+//!\brief Lossless compression of quantized coefficients.
+
 #include <cstddef>
 #include <cstdint>
 
+#include <functional>
+#include <utility>
 #include <vector>
 
 namespace mgard {
-unsigned char *compress_memory_huffman(const std::vector<long int> &qv,
+//! Lossless compressor applied to quantized coefficients.
+//!
+//! The identifier is recorded in compressed datasets, and decompression uses
+//! the compressor recorded. Further compressors can be added with
+//! `register_lossless_compressor` under other identifiers.
+enum class LosslessCompressor : std::uint8_t {
+  //! No compression.
+  None = 0,
+
+  //! `zlib`. Levels run from 1 (fastest) to 9 (smallest, the default). -1
+  //! selects `zlib`'s own default, `Z_DEFAULT_COMPRESSION`.
+  Zlib = 1,
+
+  //! `zstd`. Any `zstd` level may be used, and the default is 1. Only
+  //! available if MGARD is built with `zstd`.
+  Zstd = 2,
+
+  //! Huffman coding of the quantized coefficients, followed by `zlib`. The
+  //! level applies to the `zlib` stage, which also compresses buffers not
+  //! Huffman coded, like the outliers, and is as for `Zlib`.
+  HuffmanZlib = 3,
+
+  //! The codec of `compress_memory_lz`. The level is ignored.
+  Fast = 4,
+
+  //! Huffman coding of the quantized coefficients, followed by `zstd`. The
+  //! level applies to the `zstd` stage and is as for `Zstd`. Only available if
+  //! MGARD is built with `zstd`.
+  HuffmanZstd = 5
+};
+
+//! Check whether a lossless compressor Huffman codes the quantized
+//! coefficients.
+inline bool is_huffman_pipeline(const LosslessCompressor compressor) {
+  return compressor == LosslessCompressor::HuffmanZlib ||
+         compressor == LosslessCompressor::HuffmanZstd;
+}
+
+//! Lossless compressor used unless another is requested.
+#ifdef MGARD_ZSTD
+constexpr LosslessCompressor default_lossless_compressor =
+    LosslessCompressor::HuffmanZstd;
+#else
+constexpr LosslessCompressor default_lossless_compressor =
+    LosslessCompressor::Zlib;
+#endif
+
+//! Compress an array of quantized coefficients using Huffman coding.
+//!
+//! The Huffman coded stream is then compressed with the backend registered
+//! under `compressor` (see `lossless_backend`), which is `zlib` or `zstd`
+//! unless replaced.
+//!
+//! Implemented for `std::int16_t`, `std::int32_t`, and `long int`.
+//!
+//!\param qv Quantized coefficients.
+//!\param out_data Scratch buffer.
+//!\param outsize Size in bytes of the compressed array.
+//!\param compressor `LosslessCompressor::HuffmanZlib` or
+//! `LosslessCompressor::HuffmanZstd`.
+//!\param level Compression level of the second stage, zero for its default.
+template <typename Int>
+unsigned char *compress_memory_huffman(const std::vector<Int> &qv,
                                        std::vector<unsigned char> &out_data,
-                                       int &outsize);
-void decompress_memory_huffman(unsigned char *data, int data_len,
-                               long int *out_data, int outsize);
-void huffman_encoding(long int *in_data, const std::size_t in_data_size,
+                                       std::size_t &outsize,
+                                       const LosslessCompressor compressor,
+                                       const int level = 0);
+
+//! Compress quantized coefficients produced a chunk at a time using Huffman
+//! coding.
+//!
+//! The coefficients are produced twice over: once to count the frequencies
+//! from which the code is built, and once to be encoded. Only a batch of
+//! chunks of the Huffman stream is held in memory at a time, besides the
+//! stream itself. The result is that of `compress_memory_huffman`.
+//!
+//! Implemented for `std::int16_t`, `std::int32_t`, and `long int`.
+//!
+//!\param n Number of coefficients.
+//!\param produce Function called as `produce(begin, end, chunk)` to store the
+//! coefficients with indices in `[begin, end)` in `chunk`. The ranges are
+//! consecutive, and start over at zero for the second pass.
+//!\param output Vector to which the compressed array is appended.
+//!\param compressor `LosslessCompressor::HuffmanZlib` or
+//! `LosslessCompressor::HuffmanZstd`.
+//!\param level Compression level of the second stage, zero for its default.
+template <typename Int>
+void compress_stream_huffman(
+    const std::size_t n,
+    const std::function<void(std::size_t, std::size_t, Int *)> &produce,
+    std::vector<unsigned char> &output, const LosslessCompressor compressor,
+    const int level = 0);
+
+//! Decompress an array of quantized coefficients compressed with
+//! `compress_memory_huffman`.
+//!
+//! `outsize` is the number of coefficients, not their size in bytes.
+//! `compressor` must be the one the array was compressed with. Throws
+//! `std::invalid_argument` if it isn't a Huffman pipeline with a registered
+//! backend.
+//!
+//! Implemented for `std::int16_t`, `std::int32_t`, and `long int`.
+template <typename Int>
+void decompress_memory_huffman(unsigned char *data, const std::size_t data_len,
+                               Int *out_data, const std::size_t outsize,
+                               const LosslessCompressor compressor);
+
+//! Decompress the coefficients at some positions of an array compressed with
+//! `compress_memory_huffman`.
+//!
+//! Only the chunks of the Huffman stream (see `huffman_encoding`) containing
+//! the positions are decoded, so the whole array is never held in memory.
+//!
+//! Implemented for `std::int16_t`, `std::int32_t`, and `long int`.
+//!
+//!\param data Compressed array.
+//!\param data_len Size in bytes of the compressed array.
+//!\param n Number of coefficients in the array.
+//!\param positions Positions of the coefficients wanted, in increasing order.
+//!\param selected Buffer in which to store the coefficients wanted.
+//!\param compressor Huffman pipeline the array was compressed with. See
+//! `decompress_memory_huffman`.
+template <typename Int>
+void decompress_memory_huffman_at(unsigned char *data,
+                                  const std::size_t data_len,
+                                  const std::size_t n,
+                                  const std::vector<std::size_t> &positions,
+                                  Int *const selected,
+                                  const LosslessCompressor compressor);
+
+//! Huffman code an array of quantized coefficients.
+//!
+//! The coefficients are coded in chunks which share a codebook but can be
+//! decoded independently, and the chunks are encoded and decoded in parallel.
+//! The dictionary grows with the range of the coefficients, and codes are at
+//! most 24 bits long. Coefficients outside the dictionary are stored in the
+//! miss buffer as 64-bit integers, so every `long int` level is kept exactly.
+//! The hit stream starts with a table of the offsets of the chunks. Its size
+//! is given in bits; the sizes of the miss and tree buffers are in bytes. The
+//! buffers are allocated with `malloc`.
+template <typename Int>
+void huffman_encoding(Int const *const in_data, const std::size_t in_data_size,
                       unsigned char **out_data_hit, size_t *out_data_hit_size,
                       unsigned char **out_data_miss, size_t *out_data_miss_size,
                       unsigned char **out_tree, size_t *out_tree_size);
 
-void huffman_decoding(long int *const in_data, const std::size_t in_data_size,
+//! Decode an array of quantized coefficients coded with `huffman_encoding`.
+template <typename Int>
+void huffman_decoding(Int *const in_data, const std::size_t in_data_size,
                       unsigned char *out_data_hit, size_t out_data_hit_size,
                       unsigned char *out_data_miss, size_t out_data_miss_size,
                       unsigned char *out_tree, size_t out_tree_size);
 #ifdef MGARD_ZSTD
 //! Compress an array of data using `zstd`.
+//!
+//!\param in_data Pointer to data to be compressed.
+//!\param in_data_size Size in bytes of the data to be compressed.
+//!\param out_data Vector used to store compressed data.
+//!\param level `zstd` compression level.
 void compress_memory_zstd(void *const in_data, const std::size_t in_data_size,
-                          std::vector<std::uint8_t> &out_data);
+                          std::vector<std::uint8_t> &out_data,
+                          const int level = 1);
+
+//! Compress data produced a chunk at a time using `zstd`.
+//!
+//! The chunks are compressed into a single frame, which can be decompressed
+//! with `decompress_memory_zstd_huffman`. Only one chunk need be held in memory
+//! at a time.
+//!
+//!\param next Function returning the next chunk of data to be compressed. See
+//! `compress_stream_z`.
+//!\param out_data Vector to which the compressed data is appended.
+//!\param level `zstd` compression level.
+void compress_stream_zstd(
+    const std::function<std::pair<void const *, std::size_t>()> &next,
+    std::vector<std::uint8_t> &out_data, const int level = 1);
 #endif
 //! Compress an array of data using `zlib`.
 //!
 //!\param in_data Pointer to data to be compressed.
 //!\param in_data_size Size in bytes of the data to be compressed.
 //!\param out_data Vector used to store compressed data.
+//!\param level `zlib` compression level. The default is `Z_BEST_COMPRESSION`.
+//! Throws `std::invalid_argument` if `zlib` rejects the level.
 void compress_memory_z(void *const in_data, const std::size_t in_data_size,
-                       std::vector<std::uint8_t> &out_data);
+                       std::vector<std::uint8_t> &out_data,
+                       const int level = 9);
+
+//! Compress data produced a chunk at a time using `zlib`.
+//!
+//! The chunks are compressed into a single stream, which can be decompressed
+//! with `decompress_memory_z`. Only one chunk need be held in memory at a time.
+//!
+//!\param next Function returning the next chunk of data to be compressed, as
+//! a pointer and a size in bytes. An empty chunk marks the end of the data. The
+//! chunk must remain valid until `next` is called again.
+//!\param out_data Vector to which the compressed data is appended.
+//!\param level `zlib` compression level. The default is `Z_BEST_COMPRESSION`.
+//! Throws `std::invalid_argument` if `zlib` rejects the level.
+void compress_stream_z(
+    const std::function<std::pair<void const *, std::size_t>()> &next,
+    std::vector<std::uint8_t> &out_data, const int level = 9);
 
 //! Decompress an array of data using `zlib`.
 //!
@@ -37,14 +220,146 @@ void compress_memory_z(void *const in_data, const std::size_t in_data_size,
 //!\param srcLen Size in bytes of the data to be decompressed.
 //!\param dst Pointer to buffer used to store decompressed data.
 //!\param dstLen Size in bytes of the decompressed data.
-void decompress_memory_z(void *const src, const int srcLen, int *const dst,
-                         const int dstLen);
+void decompress_memory_z(void *const src, const std::size_t srcLen,
+                         int *const dst, const std::size_t dstLen);
 
-void decompress_memory_z_huffman(void *const src, const int srcLen,
-                                 unsigned char *const dst, const int dstLen);
+//! Decompress data compressed using `zlib` a chunk at a time.
+//!
+//! Only one chunk of the decompressed data need be held in memory at a time.
+//!
+//!\param src Pointer to data to be decompressed.
+//!\param srcLen Size in bytes of the data to be decompressed.
+//!\param chunk Pointer to buffer used to store each chunk of decompressed
+//! data.
+//!\param chunkLen Size in bytes of `chunk`. Every chunk but the last fills the
+//! buffer.
+//!\param consume Function called with the size in bytes of each chunk once it
+//! has been decompressed into `chunk`.
+void decompress_stream_z(void const *const src, const std::size_t srcLen,
+                         void *const chunk, const std::size_t chunkLen,
+                         const std::function<void(std::size_t)> &consume);
+
+void decompress_memory_z_huffman(void *const src, const std::size_t srcLen,
+                                 unsigned char *const dst,
+                                 const std::size_t dstLen);
 
 #ifdef MGARD_ZSTD
-void decompress_memory_zstd_huffman(void *const src, const int srcLen,
-                                    unsigned char *const dst, const int dstLen);
+void decompress_memory_zstd_huffman(void *const src, const std::size_t srcLen,
+                                    unsigned char *const dst,
+                                    const std::size_t dstLen);
 #endif
+
+//! Compress an array of data using a fast byte-oriented LZ77 codec.
+//!
+//! The format is LZ4's block format: each sequence is a token giving the
+//! lengths of a run of literals and of a match, the literals, and the distance
+//! back to the match. As LZ4 requires, the last five bytes are literals and no
+//! match starts in the last twelve. Matches are found with a single hash table
+//! probe, so compression is much faster than with `zlib`, at some cost in
+//! ratio.
+//!
+//!\param in_data Pointer to data to be compressed.
+//!\param in_data_size Size in bytes of the data to be compressed.
+//!\param out_data Vector used to store compressed data.
+void compress_memory_lz(void const *const in_data,
+                        const std::size_t in_data_size,
+                        std::vector<std::uint8_t> &out_data);
+
+//! Decompress an array of data compressed with `compress_memory_lz`.
+//!
+//! Throws `std::invalid_argument` if the data is corrupt or breaks LZ4's end
+//! of block rules.
+//!
+//!\param src Pointer to data to be decompressed.
+//!\param srcLen Size in bytes of the data to be decompressed.
+//!\param dst Pointer to buffer used to store decompressed data.
+//!\param dstLen Size in bytes of the decompressed data.
+void decompress_memory_lz(void const *const src, const std::size_t srcLen,
+                          void *const dst, const std::size_t dstLen);
+
+//! Choice of lossless compressor.
+struct LosslessOptions {
+  //! Lossless compressor to use.
+  LosslessCompressor compressor = default_lossless_compressor;
+
+  //! Compression level, interpreted by the compressor. Zero selects the
+  //! compressor's default.
+  int level = 0;
+};
+
+//! Implementation of a lossless compressor.
+struct LosslessBackend {
+  //! Compress a buffer.
+  //!
+  //! Called as `compress(data, size, level, output)`, where `level` is the
+  //! requested compression level (zero for the default). `output` is empty on
+  //! entry.
+  std::function<void(void const *, std::size_t, int,
+                     std::vector<std::uint8_t> &)>
+      compress;
+
+  //! Decompress a buffer.
+  //!
+  //! Called as `decompress(src, size, dst, dst_size)`, where `dst_size` is the
+  //! size in bytes of the decompressed data.
+  std::function<void(void const *, std::size_t, void *, std::size_t)>
+      decompress;
+
+  //! Check a compression level.
+  //!
+  //! Called as `accepts_level(level)` before anything is compressed. If empty,
+  //! every level is accepted.
+  std::function<bool(int)> accepts_level;
+
+  //! Compress data produced a chunk at a time.
+  //!
+  //! Called as `compress_stream(next, level, output)`, where `next` returns
+  //! the chunks as for `compress_stream_z`. The result is appended to `output`
+  //! and must be readable by `decompress`. If empty, the chunks are gathered
+  //! into one buffer and passed to `compress`.
+  std::function<void(
+      const std::function<std::pair<void const *, std::size_t>()> &, int,
+      std::vector<std::uint8_t> &)>
+      compress_stream;
+
+  //! Decompress a buffer a chunk at a time.
+  //!
+  //! Called as `decompress_stream(src, size, chunk, chunk_size, consume)`, with
+  //! the parameters of `decompress_stream_z`. If empty, the buffer is
+  //! decompressed whole with `decompress`.
+  std::function<void(void const *, std::size_t, void *, std::size_t,
+                     const std::function<void(std::size_t)> &)>
+      decompress_stream;
+};
+
+//! Register a lossless compressor.
+//!
+//! Any compressor registered under the same identifier is replaced, built-in
+//! ones included. Every stage of a built-in pipeline goes through the
+//! registry: the quantized coefficients and the outliers are compressed with
+//! the backend of the identifier requested, and for the Huffman pipelines that
+//! backend is the stage following the Huffman coding. The registry isn't
+//! synchronized, so compressors should be registered before any compression or
+//! decompression starts.
+//!
+//!\param compressor Identifier of the compressor.
+//!\param backend Implementation of the compressor.
+void register_lossless_compressor(const LosslessCompressor compressor,
+                                  const LosslessBackend &backend);
+
+//! Find a registered lossless compressor.
+//!
+//! Throws `std::invalid_argument` if no compressor is registered under the
+//! identifier.
+//!
+//!\param compressor Identifier of the compressor.
+const LosslessBackend &lossless_backend(const LosslessCompressor compressor);
+
+//! Check that a lossless compressor is registered and accepts a level.
+//!
+//! Throws `std::invalid_argument` otherwise.
+//!
+//!\param lossless Lossless compressor and level.
+void check_lossless_options(const LosslessOptions &lossless);
 } // namespace mgard
+#endif
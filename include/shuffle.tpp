@@ -1,39 +1,111 @@
+#include <algorithm>
+#include <array>
 #include <vector>
 
-#include "TensorMeshHierarchyIteration.hpp"
+#include "TensorSpearLayout.hpp"
 
 namespace mgard {
 
+namespace {
+
+//! Number of nodes in the blocks into which the rows are split by
+//! `for_each_shuffled_block`.
+constexpr std::size_t shuffle_block_size = 4096;
+
+//! Visit blocks of nodes of the finest mesh of a hierarchy, in parallel.
+//!
+//! A row is a 'spear' along the last dimension. Within a row, the nodes
+//! introduced in any one mesh occupy consecutive positions in a shuffled
+//! array. The rows are split into blocks of at most `shuffle_block_size`
+//! nodes, each of which can be shuffled or unshuffled independently of the
+//! others once the position of its first node from each mesh is known.
+//!
+//! `f` is called as `f(begin, end, date_of_birth, cursors)`, where `begin` and
+//! `end` are the positions in an unshuffled array of the first node of the
+//! block and of the node following the block, `date_of_birth` is the latest
+//! date of birth of the row's indices in the dimensions other than the last,
+//! and `cursors[ell]` (for `ell` at least `date_of_birth`) is the position in a
+//! shuffled array of the first node of the block with date of birth `ell`.
+//! `f` may modify the cursors.
+template <std::size_t N, typename Real, typename F>
+void for_each_shuffled_block(const TensorMeshHierarchy<N, Real> &hierarchy,
+                             F &&f) {
+  const std::size_t L = hierarchy.L;
+  const std::array<std::size_t, N> &SHAPE = hierarchy.shapes.back();
+  const std::size_t n = SHAPE.back();
+  const std::size_t nrows = hierarchy.ndof() / n;
+  const std::size_t nblocks =
+      (n + shuffle_block_size - 1) / shuffle_block_size;
+  const TensorSpearLayout<N, Real> layout(hierarchy, L, N - 1);
+
+#pragma omp parallel
+  {
+    std::vector<std::size_t> cursors(L + 1);
+#pragma omp for
+    for (std::size_t t = 0; t < nrows * nblocks; ++t) {
+      const std::size_t r = t / nblocks;
+      const std::size_t j = (t % nblocks) * shuffle_block_size;
+      std::array<std::size_t, N> multiindex;
+      multiindex.back() = j;
+      std::size_t remainder = r;
+      for (std::size_t k = 1; k < N; ++k) {
+        const std::size_t i = N - 1 - k;
+        multiindex[i] = remainder % SHAPE[i];
+        remainder /= SHAPE[i];
+      }
+      std::size_t date_of_birth = 0;
+      for (std::size_t i = 0; i + 1 < N; ++i) {
+        date_of_birth =
+            std::max(date_of_birth, hierarchy.dates_of_birth[i][multiindex[i]]);
+      }
+      // Every node of the row is introduced in the `date_of_birth`th mesh or
+      // later.
+      for (std::size_t ell = date_of_birth; ell <= L; ++ell) {
+        cursors[ell] = layout.offset(ell, multiindex);
+      }
+      const std::size_t begin = r * n + j;
+      f(begin, begin + std::min(shuffle_block_size, n - j), date_of_birth,
+        cursors.data());
+    }
+  }
+}
+
+} // namespace
+
 template <std::size_t N, typename Real>
 void shuffle(const TensorMeshHierarchy<N, Real> &hierarchy,
              Real const *const src, Real *const dst) {
-  std::vector<Real *> writers(hierarchy.L + 1);
-  writers.at(0) = dst;
-  for (std::size_t l = 1; l <= hierarchy.L; ++l) {
-    writers.at(l) = dst + hierarchy.ndof(l - 1);
-  }
-
-  Real const *p = src;
-  for (const TensorNode<N> node :
-       UnshuffledTensorNodeRange<N, Real>(hierarchy, hierarchy.L)) {
-    *writers.at(hierarchy.date_of_birth(node.multiindex))++ = *p++;
-  }
+  const std::vector<std::size_t> &dates_of_birth =
+      hierarchy.dates_of_birth.back();
+  const std::size_t n = hierarchy.shapes.back().back();
+  for_each_shuffled_block(hierarchy, [&](const std::size_t begin,
+                                         const std::size_t end,
+                                         const std::size_t date_of_birth,
+                                         std::size_t *const cursors) {
+    std::size_t const *const dobs = dates_of_birth.data() + begin % n;
+    Real const *const p = src + begin;
+    for (std::size_t k = 0; k < end - begin; ++k) {
+      dst[cursors[std::max(date_of_birth, dobs[k])]++] = p[k];
+    }
+  });
 }
 
 template <std::size_t N, typename Real>
 void unshuffle(const TensorMeshHierarchy<N, Real> &hierarchy,
                Real const *const src, Real *const dst) {
-  std::vector<Real const *> readers(hierarchy.L + 1);
-  readers.at(0) = src;
-  for (std::size_t l = 1; l <= hierarchy.L; ++l) {
-    readers.at(l) = src + hierarchy.ndof(l - 1);
-  }
-
-  Real *q = dst;
-  for (const TensorNode<N> node :
-       UnshuffledTensorNodeRange<N, Real>(hierarchy, hierarchy.L)) {
-    *q++ = *readers.at(hierarchy.date_of_birth(node.multiindex))++;
-  }
+  const std::vector<std::size_t> &dates_of_birth =
+      hierarchy.dates_of_birth.back();
+  const std::size_t n = hierarchy.shapes.back().back();
+  for_each_shuffled_block(hierarchy, [&](const std::size_t begin,
+                                         const std::size_t end,
+                                         const std::size_t date_of_birth,
+                                         std::size_t *const cursors) {
+    std::size_t const *const dobs = dates_of_birth.data() + begin % n;
+    Real *const q = dst + begin;
+    for (std::size_t k = 0; k < end - begin; ++k) {
+      q[k] = src[cursors[std::max(date_of_birth, dobs[k])]++];
+    }
+  });
 }
 
 } // namespace mgard
@@ -3,6 +3,7 @@
 #include <numeric>
 #include <random>
 #include <string>
+#include <vector>
 
 #include "blas.hpp"
 #include "moab/Core.hpp"
@@ -14,7 +15,9 @@
 #include "UniformMeshHierarchy.hpp"
 #include "data.hpp"
 
+#include "DecompositionPlan.hpp"
 #include "TensorMassMatrix.hpp"
+#include "TensorMeshHierarchyIteration.hpp"
 #include "TensorMultilevelCoefficientQuantizer.hpp"
 #include "TensorProlongation.hpp"
 #include "TensorRestriction.hpp"
@@ -113,6 +116,59 @@ static void BM_structured_unshuffle(benchmark::State &state) {
   state.SetComplexityN(ndof);
 }
 
+// Serial element-by-element implementations of `shuffle` and `unshuffle`,
+// kept for comparison.
+
+template <std::size_t N, typename Real>
+static void BM_structured_shuffle_serial(benchmark::State &state) {
+  const mgard::TensorMeshHierarchy<N, Real> hierarchy(
+      mesh_shape<N>(state.range(0)));
+
+  const std::size_t ndof = hierarchy.ndof();
+  Real *const u = static_cast<Real *>(std::malloc(ndof * sizeof(Real)));
+  Real *const v = static_cast<Real *>(std::malloc(ndof * sizeof(Real)));
+  std::vector<Real *> writers(hierarchy.L + 1);
+  for (auto _ : state) {
+    for (std::size_t l = 0; l <= hierarchy.L; ++l) {
+      writers.at(l) = v + (l ? hierarchy.ndof(l - 1) : 0);
+    }
+    Real const *p = u;
+    for (const mgard::TensorNode<N> node :
+         mgard::UnshuffledTensorNodeRange<N, Real>(hierarchy, hierarchy.L)) {
+      *writers.at(hierarchy.date_of_birth(node.multiindex))++ = *p++;
+    }
+  }
+  std::free(v);
+  std::free(u);
+
+  state.SetComplexityN(ndof);
+}
+
+template <std::size_t N, typename Real>
+static void BM_structured_unshuffle_serial(benchmark::State &state) {
+  const mgard::TensorMeshHierarchy<N, Real> hierarchy(
+      mesh_shape<N>(state.range(0)));
+
+  const std::size_t ndof = hierarchy.ndof();
+  Real *const u = static_cast<Real *>(std::malloc(ndof * sizeof(Real)));
+  Real *const v = static_cast<Real *>(std::malloc(ndof * sizeof(Real)));
+  std::vector<Real const *> readers(hierarchy.L + 1);
+  for (auto _ : state) {
+    for (std::size_t l = 0; l <= hierarchy.L; ++l) {
+      readers.at(l) = u + (l ? hierarchy.ndof(l - 1) : 0);
+    }
+    Real *q = v;
+    for (const mgard::TensorNode<N> node :
+         mgard::UnshuffledTensorNodeRange<N, Real>(hierarchy, hierarchy.L)) {
+      *q++ = *readers.at(hierarchy.date_of_birth(node.multiindex))++;
+    }
+  }
+  std::free(v);
+  std::free(u);
+
+  state.SetComplexityN(ndof);
+}
+
 #define SHUFFLE_UNSHUFFLE_BENCHMARK_OPTIONS                                    \
   ->RangeMultiplier(2)                                                         \
       ->Range(1 << LOG_RANGE_LO, 1 << LOG_RANGE_HI)                            \
@@ -123,6 +179,10 @@ static void BM_structured_unshuffle(benchmark::State &state) {
   BENCHMARK_TEMPLATE(BM_structured_shuffle, N, Real)                           \
   SHUFFLE_UNSHUFFLE_BENCHMARK_OPTIONS;                                         \
   BENCHMARK_TEMPLATE(BM_structured_unshuffle, N, Real)                         \
+  SHUFFLE_UNSHUFFLE_BENCHMARK_OPTIONS;                                         \
+  BENCHMARK_TEMPLATE(BM_structured_shuffle_serial, N, Real)                    \
+  SHUFFLE_UNSHUFFLE_BENCHMARK_OPTIONS;                                         \
+  BENCHMARK_TEMPLATE(BM_structured_unshuffle_serial, N, Real)                  \
   SHUFFLE_UNSHUFFLE_BENCHMARK_OPTIONS
 
 SHUFFLE_UNSHUFFLE_BENCHMARK(1, double);
@@ -159,6 +219,38 @@ static void BM_structured_recompose(benchmark::State &state) {
   state.SetComplexityN(ndof);
 }
 
+template <std::size_t N, typename Real>
+static void BM_structured_planned_decompose(benchmark::State &state) {
+  const mgard::TensorMeshHierarchy<N, Real> hierarchy(
+      mesh_shape<N>(state.range(0)));
+  mgard::DecompositionPlan<N, Real> plan(hierarchy);
+
+  const std::size_t ndof = hierarchy.ndof();
+  Real *const u = static_cast<Real *>(std::malloc(ndof * sizeof(Real)));
+  for (auto _ : state) {
+    plan.decompose(u);
+  }
+  std::free(u);
+
+  state.SetComplexityN(ndof);
+}
+
+template <std::size_t N, typename Real>
+static void BM_structured_planned_recompose(benchmark::State &state) {
+  const mgard::TensorMeshHierarchy<N, Real> hierarchy(
+      mesh_shape<N>(state.range(0)));
+  mgard::DecompositionPlan<N, Real> plan(hierarchy);
+
+  const std::size_t ndof = hierarchy.ndof();
+  Real *const u = static_cast<Real *>(std::malloc(ndof * sizeof(Real)));
+  for (auto _ : state) {
+    plan.recompose(u);
+  }
+  std::free(u);
+
+  state.SetComplexityN(ndof);
+}
+
 #define DECOMPOSE_RECOMPOSE_BENCHMARK_OPTIONS                                  \
   ->RangeMultiplier(2)                                                         \
       ->Range(1 << LOG_RANGE_LO, 1 << LOG_RANGE_HI)                            \
@@ -169,6 +261,10 @@ static void BM_structured_recompose(benchmark::State &state) {
   BENCHMARK_TEMPLATE(BM_structured_decompose, N, Real)                         \
   DECOMPOSE_RECOMPOSE_BENCHMARK_OPTIONS;                                       \
   BENCHMARK_TEMPLATE(BM_structured_recompose, N, Real)                         \
+  DECOMPOSE_RECOMPOSE_BENCHMARK_OPTIONS;                                       \
+  BENCHMARK_TEMPLATE(BM_structured_planned_decompose, N, Real)                 \
+  DECOMPOSE_RECOMPOSE_BENCHMARK_OPTIONS;                                       \
+  BENCHMARK_TEMPLATE(BM_structured_planned_recompose, N, Real)                 \
   DECOMPOSE_RECOMPOSE_BENCHMARK_OPTIONS
 
 DECOMPOSE_RECOMPOSE_BENCHMARK(1, double);
@@ -1,11 +1,18 @@
 #include "mgard_compress.hpp"
 
 #include <algorithm>
+#include <array>
 #include <bitset>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
 #include <cstring>
-#include <queue>
+#include <exception>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 
 #ifdef MGARD_TIMING
@@ -20,300 +27,538 @@
 #endif
 
 namespace mgard {
+//! Largest size of a Huffman dictionary.
 const int nql = 32768 * 4;
 
-struct htree_node {
-  int q;
-  size_t cnt;
-  unsigned int code;
-  size_t len;
-  htree_node *left;
-  htree_node *right;
-};
-
-struct huffman_codec {
-  int q;
-  unsigned int code;
-  size_t len;
+namespace {
+
+//! Maximum length of a Huffman code.
+constexpr std::size_t max_code_length = 24;
+
+//! Number of bits resolved by a single probe of the decoding table.
+constexpr std::size_t decoding_table_bits = 12;
+
+//! Number of symbols in each independently decodable chunk of a Huffman
+//! stream.
+constexpr std::size_t huffman_chunk_size = std::size_t(1) << 18;
+
+//! Number of chunks of a Huffman stream encoded together. Only one batch of
+//! quantized coefficients is held in memory at a time, and its chunks are
+//! encoded in parallel.
+constexpr std::size_t huffman_batch_chunks = 16;
+
+//! Canonical Huffman code.
+//!
+//! Codes are assigned in order of length and then of symbol, so the code is
+//! determined by the number of codes of each length and the list of symbols in
+//! that order. Those are what get transmitted. This is the same construction
+//! used by the GPU codec (see `GPU::GetCanonicalCode`).
+struct CanonicalCode {
+  //! Number of codes of each length.
+  std::array<std::uint32_t, max_code_length + 1> counts{};
+
+  //! Symbols in canonical order.
+  std::vector<std::uint32_t> symbols;
+
+  //! First code of each length.
+  std::array<std::uint64_t, max_code_length + 2> firsts{};
+
+  //! Position in `symbols` of the first symbol with each code length.
+  std::array<std::uint32_t, max_code_length + 2> offsets{};
+
+  //! Compute `firsts` and `offsets` from `counts`.
+  void assign() {
+    std::uint64_t code = 0;
+    std::uint32_t offset = 0;
+    for (std::size_t length = 1; length <= max_code_length; ++length) {
+      code = (code + counts.at(length - 1)) << 1;
+      firsts.at(length) = code;
+      offsets.at(length) = offset;
+      offset += counts.at(length);
+    }
+  }
 };
 
-bool myfunction(htree_node i, htree_node j) { return (i.cnt < j.cnt); }
-
-htree_node *new_htree_node(int q, size_t cnt) {
-  htree_node *new_node = new htree_node;
-  new_node->q = q;
-  new_node->cnt = cnt;
-  new_node->code = 0;
-  new_node->len = 0;
-  new_node->left = 0;
-  new_node->right = 0;
+// Convert quantization level to positive so that counting freq can be
+// easily done. Level 0 is reserved a out-of-range flag.
+template <typename Int>
+long int shifted_level(const Int q, const std::size_t dictionary_size) {
+  return static_cast<long int>(q) + static_cast<long int>(dictionary_size / 2);
+}
 
-  return new_node;
+//! Check whether a shifted quantization level has a symbol of its own.
+bool in_dictionary(const long int q, const std::size_t dictionary_size) {
+  return q > 0 && q < static_cast<long int>(dictionary_size);
 }
 
-struct LessThanByCnt {
-  bool operator()(const htree_node *lhs, const htree_node *rhs) const {
-    return lhs->cnt > rhs->cnt;
-  }
+//! Frequencies of the quantization levels of an array, counted a batch at a
+//! time.
+//!
+//! The levels are counted against the largest dictionary, of size `nql`, and
+//! the table is narrowed to the dictionary chosen once the whole array has
+//! been seen.
+struct FrequencyTable {
+  //! Constructor.
+  FrequencyTable() : counts(nql, 0) {}
+
+  //! Count the quantization levels of a batch.
+  template <typename Int>
+  void add(Int const *const quantized_data, const std::size_t n);
+
+  //! Choose the size of the Huffman dictionary and count its symbols.
+  //!
+  //! The dictionary is the smallest power of two covering every level counted,
+  //! up to `nql`. Levels outside it are coded as out of range.
+  //!
+  //!\param dictionary_size Size of the dictionary.
+  //!\return Frequency of each symbol of the dictionary.
+  std::vector<std::size_t> narrow(std::size_t &dictionary_size) const;
+
+  //! Frequency of each symbol of the largest dictionary.
+  std::vector<std::size_t> counts;
+
+  //! Largest magnitude of the levels counted, clamped to `nql`.
+  long int largest = 0;
 };
 
-template <class T>
-using my_priority_queue =
-    std::priority_queue<T *, std::vector<T *>, LessThanByCnt>;
-
-void build_codec(htree_node *root, unsigned int code, size_t len,
-                 huffman_codec *codec) {
-
-  root->len = len;
-  root->code = code;
-
-  if (!root->left && !root->right) {
-    codec[root->q].q = root->q;
-    codec[root->q].code = code;
-    codec[root->q].len = len;
+template <typename Int>
+void FrequencyTable::add(Int const *const quantized_data, const std::size_t n) {
+  const long int cap = nql;
+  long int largest_ = largest;
+  // Each thread counts into its own table, and the tables are summed at the
+  // end. Small batches aren't worth the extra tables.
+#pragma omp parallel if (n > huffman_chunk_size)
+  {
+    std::vector<std::size_t> local(nql, 0);
+#pragma omp for reduction(max : largest_) nowait
+    for (std::size_t i = 0; i < n; i++) {
+      const long int q = quantized_data[i];
+      // Clamp before negating so the magnitude can't overflow.
+      largest_ =
+          std::max(largest_, q < 0 ? (q < -cap ? cap : -q) : std::min(q, cap));
+      const long int shifted = shifted_level(q, nql);
+      ++local[in_dictionary(shifted, nql) ? shifted : 0];
+    }
+#pragma omp critical
+    for (std::size_t i = 0; i < counts.size(); ++i) {
+      counts[i] += local[i];
+    }
   }
+  largest = largest_;
+}
 
-  if (root->left) {
-    build_codec(root->left, code << 1, len + 1, codec);
+std::vector<std::size_t>
+FrequencyTable::narrow(std::size_t &dictionary_size) const {
+  std::size_t size = 2;
+  while (size < static_cast<std::size_t>(nql) &&
+         static_cast<long int>(size / 2) <= largest) {
+    size <<= 1;
   }
-
-  if (root->right) {
-    build_codec(root->right, code << 1 | 0x1, len + 1, codec);
+  dictionary_size = size;
+  std::vector<std::size_t> cnt(size, 0);
+  // Symbol `i` of the largest dictionary is symbol `i - offset` of this one.
+  const long int offset = (nql - size) / 2;
+  for (std::size_t i = 0; i < counts.size(); ++i) {
+    const long int q = static_cast<long int>(i) - offset;
+    cnt[in_dictionary(q, size) ? q : 0] += counts[i];
   }
+  return cnt;
 }
 
-my_priority_queue<htree_node> *build_tree(size_t *cnt) {
-  my_priority_queue<htree_node> *phtree;
-  phtree = new my_priority_queue<htree_node>;
-#if 1
-  for (int i = 0; i < nql; i++) {
-    if (cnt[i] != 0) {
-      htree_node *new_node = new_htree_node(i, cnt[i]);
-      phtree->push(new_node);
+//! Compute the lengths of the Huffman codes of the symbols.
+//!
+//! The symbols are sorted by frequency, after which the tree is built in
+//! linear time with two queues: the leaves in order, and the internal nodes in
+//! the order they're created (which is also in order of weight). Only the
+//! shape of the tree is needed, so it's stored as an array of parent indices.
+//!
+//! Codes longer than `max_code_length` are then shortened as in Annex K.3 of
+//! the JPEG standard: two of the longest codes are replaced by one a bit
+//! shorter, which frees room for the other by splitting a code at least two
+//! bits shorter in two. Finally the lengths are handed out in order of
+//! frequency.
+//!
+//!\param cnt Frequency of each symbol.
+//!\param lengths Length of the code of each symbol, or zero if the symbol
+//! doesn't occur.
+void build_code_lengths(const std::vector<std::size_t> &cnt,
+                        std::vector<std::uint8_t> &lengths) {
+  lengths.assign(cnt.size(), 0);
+  std::vector<std::size_t> leaves;
+  for (std::size_t i = 0; i < cnt.size(); ++i) {
+    if (cnt[i]) {
+      leaves.push_back(i);
     }
   }
-
-  while (phtree->size() > 1) {
-    htree_node *top_node1 = phtree->top();
-    phtree->pop();
-    htree_node *top_node2 = phtree->top();
-    phtree->pop();
-
-    htree_node *new_node = new_htree_node(-1, top_node1->cnt + top_node2->cnt);
-    new_node->left = top_node1;
-    new_node->right = top_node2;
-    phtree->push(new_node);
+  const std::size_t m = leaves.size();
+  if (m == 0) {
+    return;
   }
-#endif
-  return phtree;
-}
-
-void free_htree_node(htree_node *node) {
-  if (node->left) {
-    free_htree_node(node->left);
-    node->left = 0;
+  if (m == 1) {
+    // A lone symbol still needs a one-bit code.
+    lengths.at(leaves.front()) = 1;
+    return;
   }
-
-  if (node->right) {
-    free_htree_node(node->right);
-    node->right = 0;
+  std::sort(leaves.begin(), leaves.end(),
+            [&](const std::size_t a, const std::size_t b) {
+              return cnt[a] < cnt[b] || (cnt[a] == cnt[b] && a < b);
+            });
+
+  // Leaves are nodes `0` through `m - 1`, in order of frequency. Every
+  // internal node is created after its children, so its index is greater than
+  // theirs.
+  std::vector<std::size_t> weights(2 * m - 1);
+  std::vector<std::size_t> parents(2 * m - 1);
+  for (std::size_t i = 0; i < m; ++i) {
+    weights[i] = cnt[leaves[i]];
+  }
+  std::size_t next_leaf = 0;
+  std::size_t next_internal = m;
+  // Take the lighter of the front of the leaf queue and the front of the
+  // internal node queue.
+  const auto pop = [&](const std::size_t node) -> std::size_t {
+    if (next_leaf < m && (next_internal == node ||
+                          weights[next_leaf] <= weights[next_internal])) {
+      return next_leaf++;
+    }
+    return next_internal++;
+  };
+  for (std::size_t node = m; node < 2 * m - 1; ++node) {
+    const std::size_t a = pop(node);
+    const std::size_t b = pop(node);
+    parents[a] = parents[b] = node;
+    weights[node] = weights[a] + weights[b];
   }
 
-  delete node;
-}
-
-void free_tree(my_priority_queue<htree_node> *phtree) {
-  if (phtree) {
-    free_htree_node(phtree->top());
+  // Overwrite the parent indices with depths, starting from the root. Parents
+  // are visited before their children.
+  std::vector<std::size_t> &depths = parents;
+  depths.back() = 0;
+  for (std::size_t node = 2 * m - 2; node-- > 0;) {
+    depths[node] = depths[parents[node]] + 1;
+  }
+  // Number of codes of each length.
+  const std::size_t longest =
+      *std::max_element(depths.begin(), depths.begin() + m);
+  std::vector<std::size_t> nlengths(longest + 1, 0);
+  for (std::size_t i = 0; i < m; ++i) {
+    ++nlengths[depths[i]];
+  }
 
-    phtree->pop();
+  for (std::size_t length = nlengths.size() - 1; length > max_code_length;) {
+    if (!nlengths[length]) {
+      --length;
+      continue;
+    }
+    std::size_t shorter = length - 2;
+    while (!nlengths[shorter]) {
+      --shorter;
+    }
+    assert(shorter);
+    nlengths[length] -= 2;
+    nlengths[length - 1] += 1;
+    nlengths[shorter + 1] += 2;
+    nlengths[shorter] -= 1;
+  }
 
-    delete phtree;
+  // The least frequent symbols get the longest codes.
+  std::size_t i = 0;
+  for (std::size_t length = std::min(nlengths.size() - 1, max_code_length);
+       length > 0; --length) {
+    for (std::size_t j = 0; j < nlengths[length]; ++j) {
+      lengths[leaves[i++]] = length;
+    }
   }
+  assert(i == m);
 }
 
-// Note this function will change the quantized data.
-size_t *build_ft(long int *quantized_data, const std::size_t n,
-                 size_t &num_outliers) {
-  size_t *cnt = (size_t *)malloc(nql * sizeof(size_t));
-  memset(cnt, 0, nql * sizeof(size_t));
-
-  for (std::size_t i = 0; i < n; i++) {
-    // Convert quantization level to positive so that counting freq can be
-    // easily done. Level 0 is reserved a out-of-range flag.
-    quantized_data[i] = quantized_data[i] + nql / 2;
-    if (quantized_data[i] > 0 && quantized_data[i] < nql) {
-      cnt[quantized_data[i]]++;
-    } else {
-      cnt[0]++;
+//! Build the canonical code with the given code lengths.
+//!
+//!\param lengths Length of the code of each symbol, or zero if the symbol
+//! doesn't occur.
+//!\param code Canonical code.
+//!\param codewords Code of each symbol.
+void build_canonical_code(const std::vector<std::uint8_t> &lengths,
+                          CanonicalCode &code,
+                          std::vector<std::uint32_t> &codewords) {
+  code.counts.fill(0);
+  for (const std::uint8_t length : lengths) {
+    if (length) {
+      ++code.counts.at(length);
+    }
+  }
+  code.assign();
+
+  code.symbols.resize(code.offsets.at(max_code_length) +
+                      code.counts.at(max_code_length));
+  std::array<std::uint32_t, max_code_length + 2> positions = code.offsets;
+  codewords.assign(lengths.size(), 0);
+  for (std::size_t i = 0; i < lengths.size(); ++i) {
+    const std::uint8_t length = lengths.at(i);
+    if (length) {
+      const std::uint32_t position = positions.at(length)++;
+      code.symbols.at(position) = i;
+      codewords.at(i) =
+          code.firsts.at(length) + (position - code.offsets.at(length));
     }
   }
-
-  num_outliers = cnt[0];
-
-  return cnt;
 }
 
-huffman_codec *build_huffman_codec(long int *quantized_data, size_t **ft,
-                                   const std::size_t n, size_t &num_outliers) {
-  size_t *cnt;
-
-  cnt = build_ft(quantized_data, n, num_outliers);
-  *ft = cnt;
-
-  my_priority_queue<htree_node> *phtree = build_tree(cnt);
-
-  huffman_codec *codec = (huffman_codec *)malloc(sizeof(huffman_codec) * nql);
-  memset(codec, 0, sizeof(huffman_codec) * nql);
-
-  build_codec(phtree->top(), 0, 0, codec);
+//! Entry of the table used to decode the first `decoding_table_bits` bits of
+//! a code.
+struct DecodingEntry {
+  //! Decoded symbol.
+  std::uint32_t symbol;
 
-  free_tree(phtree);
-  phtree = 0;
+  //! Length of the code, or zero if the code is longer than
+  //! `decoding_table_bits`.
+  std::uint32_t length;
+};
 
-  return codec;
+//! Build the table used to decode codes of up to `bits` bits with one probe.
+std::vector<DecodingEntry> build_decoding_table(const CanonicalCode &code,
+                                                const std::size_t bits) {
+  std::vector<DecodingEntry> table(std::size_t(1) << bits, {0, 0});
+  for (std::size_t length = 1; length <= bits; ++length) {
+    const std::size_t span = std::size_t(1) << (bits - length);
+    for (std::uint32_t j = 0; j < code.counts.at(length); ++j) {
+      const std::size_t start = (code.firsts.at(length) + j) << (bits - length);
+      const DecodingEntry entry{code.symbols.at(code.offsets.at(length) + j),
+                                static_cast<std::uint32_t>(length)};
+      std::fill(table.begin() + start, table.begin() + start + span, entry);
+    }
+  }
+  return table;
 }
 
-void decompress_memory_huffman(unsigned char *data, int data_len,
-                               long int *out_data, int out_size) {
-  unsigned char *out_data_hit = 0;
-  size_t out_data_hit_size;
-  unsigned char *out_data_miss = 0;
-  size_t out_data_miss_size;
-  unsigned char *out_tree = 0;
-  size_t out_tree_size;
-
-  unsigned char *buf = data;
-
-  out_tree_size = *(size_t *)buf;
-  buf += sizeof(size_t);
-
-  out_data_hit_size = *(size_t *)buf;
-  buf += sizeof(size_t);
+//! Append the code of each symbol in a chunk to a stream.
+//!
+//!\param quantized_data Quantized coefficients in the chunk.
+//!\param n Number of coefficients in the chunk.
+//!\param codewords Code of each symbol.
+//!\param lengths Length of the code of each symbol. Its size is that of the
+//! dictionary.
+//!\param cur Start of the chunk's portion of the stream, filled with zeros.
+//!\param p_miss Buffer in which to store the chunk's out-of-range levels.
+template <typename Int>
+void encode_chunk(Int const *const quantized_data, const std::size_t n,
+                  const std::vector<std::uint32_t> &codewords,
+                  const std::vector<std::uint8_t> &lengths,
+                  std::uint32_t *const cur, std::int64_t *p_miss) {
+  size_t start_bit = 0;
+  for (std::size_t i = 0; i < n; i++) {
+    const long int q = shifted_level(quantized_data[i], lengths.size());
+    unsigned int code;
+    size_t len;
 
-  out_data_miss_size = *(size_t *)buf;
-  buf += sizeof(size_t);
+    if (in_dictionary(q, lengths.size())) {
+      // for those that are within the range
+      code = codewords[q];
+      len = lengths[q];
+    } else {
+      // for those that are out of the range, q is set to 0
+      code = codewords[0];
+      len = lengths[0];
 
-  size_t total_huffman_size =
-      out_tree_size + out_data_hit_size / 8 + 4 + out_data_miss_size;
-  unsigned char *huffman_encoding_p =
-      (unsigned char *)malloc(total_huffman_size);
-#ifndef MGARD_ZSTD
-  mgard::decompress_memory_z_huffman(buf, data_len - 3 * sizeof(size_t),
-                                     huffman_encoding_p, total_huffman_size);
-#else
-  mgard::decompress_memory_zstd_huffman(buf, data_len - 3 * sizeof(size_t),
-                                        huffman_encoding_p, total_huffman_size);
-#endif
-  out_tree = huffman_encoding_p;
-  out_data_hit = huffman_encoding_p + out_tree_size;
-  out_data_miss =
-      huffman_encoding_p + out_tree_size + out_data_hit_size / 8 + 4;
+      *p_miss = q;
+      p_miss++;
+    }
 
-  mgard::huffman_decoding(out_data, out_size, out_data_hit, out_data_hit_size,
-                          out_data_miss, out_data_miss_size, out_tree,
-                          out_tree_size);
+    assert(len > 0);
 
-  free(huffman_encoding_p);
+    if (32 - start_bit % 32 >= len) {
+      code = code << (32 - start_bit % 32 - len);
+      *(cur + start_bit / 32) = (*(cur + start_bit / 32)) | code;
+      start_bit += len;
+    } else {
+      // current unsigned int cannot hold the code
+      // copy 32 - start_bit % 32 bits to the current int
+      // and copy  the rest len - (32 - start_bit % 32) to the next int
+      size_t rshift = len - (32 - start_bit % 32);
+      size_t lshift = 32 - rshift;
+      *(cur + start_bit / 32) = (*(cur + start_bit / 32)) | (code >> rshift);
+      *(cur + start_bit / 32 + 1) =
+          (*(cur + start_bit / 32 + 1)) | (code << lshift);
+      start_bit += len;
+    }
+  }
 }
 
-void huffman_decoding(long int *quantized_data, const std::size_t n,
-                      unsigned char *out_data_hit, size_t out_data_hit_size,
-                      unsigned char *out_data_miss, size_t out_data_miss_size,
-                      unsigned char *out_tree, size_t out_tree_size) {
-  size_t *cft = (size_t *)out_tree;
-  int nonZeros = out_tree_size / (2 * sizeof(size_t));
-  size_t *ft = (size_t *)malloc(nql * sizeof(size_t));
+//! Huffman code of an array of quantized coefficients.
+struct HuffmanCode {
+  //! Constructor.
+  //!
+  //!\param ft Frequency of each symbol of the dictionary.
+  explicit HuffmanCode(const std::vector<std::size_t> &ft);
 
-  memset(ft, 0, nql * sizeof(size_t));
+  //! Write the code as it's transmitted: the size of the dictionary, the
+  //! number of codes of each length, and the symbols in canonical order.
+  std::vector<unsigned char> tree() const;
 
-  for (int j = 0; j < nonZeros; j++) {
-    ft[cft[2 * j]] = cft[2 * j + 1];
-  }
+  //! Length of the code of each symbol, or zero if the symbol doesn't occur.
+  std::vector<std::uint8_t> lengths;
 
-  my_priority_queue<htree_node> *phtree = build_tree(ft);
+  //! Canonical code.
+  CanonicalCode canonical;
 
-  unsigned int *buf = (unsigned int *)out_data_hit;
+  //! Code of each symbol.
+  std::vector<std::uint32_t> codewords;
+};
 
-  // The out_data_miss may not be aligned. Therefore, the code
-  // here makes a new buffer.
-  int *miss_buf = (int *)malloc(out_data_miss_size);
-  memcpy(miss_buf, out_data_miss, out_data_miss_size);
+HuffmanCode::HuffmanCode(const std::vector<std::size_t> &ft) {
+  build_code_lengths(ft, lengths);
+  build_canonical_code(lengths, canonical, codewords);
+}
 
-  int *miss_bufp = miss_buf;
+std::vector<unsigned char> HuffmanCode::tree() const {
+  std::vector<unsigned char> tree(
+      (1 + max_code_length + canonical.symbols.size()) * sizeof(std::uint32_t));
+  const std::uint32_t dictionary_size = lengths.size();
+  std::memcpy(tree.data(), &dictionary_size, sizeof(std::uint32_t));
+  std::memcpy(tree.data() + sizeof(std::uint32_t), canonical.counts.data() + 1,
+              max_code_length * sizeof(std::uint32_t));
+  std::memcpy(tree.data() + (1 + max_code_length) * sizeof(std::uint32_t),
+              canonical.symbols.data(),
+              canonical.symbols.size() * sizeof(std::uint32_t));
+  return tree;
+}
 
-  size_t start_bit = 0;
-  unsigned int mask = 0x80000000;
+//! Buffers of a Huffman coded stream. See `huffman_encoding`.
+struct HuffmanEncoded {
+  //! Canonical code.
+  std::vector<unsigned char> tree;
 
-  long int *q = quantized_data;
-  size_t i = 0;
-  size_t num_missed = 0;
-  while (start_bit < out_data_hit_size) {
-    htree_node *root = phtree->top();
-    assert(root);
-
-    size_t len = 0;
-    int offset = 0;
-    while (root->left) {
-      int flag = *(buf + start_bit / 32 + offset) & mask;
-      if (!flag) {
-        root = root->left;
-      } else {
-        root = root->right;
-      }
+  //! Hit stream, including the chunk table and followed by a word of padding.
+  std::vector<std::uint32_t> words;
 
-      len++;
+  //! Out-of-range levels.
+  std::vector<std::int64_t> misses;
+};
 
-      mask >>= 1;
-      if (!mask) {
-        mask = 0x80000000;
-        offset = 1;
-      } else {
-        //        offset = 0;
+//! Huffman code an array of quantized coefficients a batch of chunks at a
+//! time.
+//!
+//! The array is read twice: once to count the frequencies from which the code
+//! is built, and once to be encoded. Batches of `huffman_batch_chunks` chunks
+//! are read in order each time, and only the encoded stream is kept.
+//!
+//!\param n Number of coefficients.
+//!\param batch Function called as `batch(begin, end)` to get a pointer to the
+//! coefficients with indices in `[begin, end)`, which must remain valid until
+//! it is called again.
+template <typename Int, typename Batch>
+HuffmanEncoded huffman_encode(const std::size_t n, Batch &&batch) {
+  static_assert(sizeof(Int) <= sizeof(std::int64_t),
+                "out-of-range levels are stored as 64-bit integers");
+  const std::size_t nchunks = (n + huffman_chunk_size - 1) / huffman_chunk_size;
+  const std::size_t batch_size = huffman_batch_chunks * huffman_chunk_size;
+
+  FrequencyTable frequencies;
+  for (std::size_t begin = 0; begin < n; begin += batch_size) {
+    const std::size_t end = std::min(n, begin + batch_size);
+    frequencies.add<Int>(batch(begin, end), end - begin);
+  }
+  std::size_t dictionary_size;
+  const std::vector<std::size_t> ft = frequencies.narrow(dictionary_size);
+  const HuffmanCode code(ft);
+  const std::vector<std::uint8_t> &lengths = code.lengths;
+
+  HuffmanEncoded encoded;
+  encoded.tree = code.tree();
+  /* The stream starts with the chunk table: the offset in words of each chunk
+   * (from the end of the table) followed by the index of each chunk's first
+   * out-of-range level. Each chunk starts on a word boundary, and a word of
+   * padding follows the last. The frequencies bound the size of the stream.
+   */
+  const std::size_t table_words = 4 * nchunks;
+  std::size_t total_bits = 0;
+  for (std::size_t i = 0; i < dictionary_size; ++i) {
+    total_bits += ft[i] * lengths[i];
+  }
+  encoded.words.reserve(table_words + total_bits / 32 + nchunks + 1);
+  encoded.words.assign(table_words, 0);
+  encoded.misses.reserve(ft[0]);
+  std::vector<std::uint64_t> chunk_words(nchunks);
+  std::vector<std::uint64_t> chunk_misses(nchunks);
+  for (std::size_t first = 0; first < nchunks; first += huffman_batch_chunks) {
+    const std::size_t last = std::min(nchunks, first + huffman_batch_chunks);
+    const std::size_t begin = first * huffman_chunk_size;
+    Int const *const quantized_data =
+        batch(begin, std::min(n, last * huffman_chunk_size));
+
+    // Size in words and number of out-of-range levels of each chunk, which
+    // become the offsets of the chunks once summed.
+    std::vector<std::uint64_t> words(last - first + 1, 0);
+    std::vector<std::uint64_t> misses(last - first + 1, 0);
+#pragma omp parallel for
+    for (std::size_t c = first; c < last; ++c) {
+      Int const *const chunk =
+          quantized_data + (c * huffman_chunk_size - begin);
+      const std::size_t m =
+          std::min(n - c * huffman_chunk_size, huffman_chunk_size);
+      std::size_t nbits = 0;
+      std::size_t nmisses = 0;
+      for (std::size_t i = 0; i < m; ++i) {
+        const long int q = shifted_level(chunk[i], dictionary_size);
+        if (in_dictionary(q, dictionary_size)) {
+          nbits += lengths[q];
+        } else {
+          nbits += lengths[0];
+          ++nmisses;
+        }
       }
+      words.at(c - first + 1) = (nbits + 31) / 32;
+      misses.at(c - first + 1) = nmisses;
     }
-
-    if (root->q != 0) {
-      *q = root->q - nql / 2;
-
-    } else {
-      *q = *miss_buf - nql / 2;
-
-      miss_buf++;
-      num_missed++;
+    std::partial_sum(words.begin(), words.end(), words.begin());
+    std::partial_sum(misses.begin(), misses.end(), misses.begin());
+
+    const std::size_t word_base = encoded.words.size();
+    const std::size_t miss_base = encoded.misses.size();
+    for (std::size_t c = first; c < last; ++c) {
+      chunk_words.at(c) = word_base - table_words + words.at(c - first);
+      chunk_misses.at(c) = miss_base + misses.at(c - first);
+    }
+    // The new words are zeroed, as `encode_chunk` requires.
+    encoded.words.resize(word_base + words.back(), 0);
+    encoded.misses.resize(miss_base + misses.back());
+#pragma omp parallel for schedule(dynamic)
+    for (std::size_t c = first; c < last; ++c) {
+      encode_chunk(quantized_data + (c * huffman_chunk_size - begin),
+                   std::min(n - c * huffman_chunk_size, huffman_chunk_size),
+                   code.codewords, lengths,
+                   encoded.words.data() + word_base + words.at(c - first),
+                   encoded.misses.data() + miss_base + misses.at(c - first));
     }
-
-    q++;
-    i++;
-
-    start_bit += len;
   }
-
-  assert(sizeof(int) * num_missed == out_data_miss_size);
-
-  free(miss_bufp);
-  miss_bufp = 0;
-  free_tree(phtree);
-  phtree = 0;
-  free(ft);
-  ft = 0;
+  assert(encoded.misses.size() == ft[0]);
+  std::memcpy(encoded.words.data(), chunk_words.data(),
+              nchunks * sizeof(std::uint64_t));
+  std::memcpy(encoded.words.data() + 2 * nchunks, chunk_misses.data(),
+              nchunks * sizeof(std::uint64_t));
+  encoded.words.push_back(0);
+  return encoded;
 }
 
-unsigned char *compress_memory_huffman(const std::vector<long int> &qv,
-                                       std::vector<unsigned char> &out_data,
-                                       int &outsize) {
-  unsigned char *out_data_hit = 0;
-  size_t out_data_hit_size;
-  unsigned char *out_data_miss = 0;
-  size_t out_data_miss_size;
-  unsigned char *out_tree = 0;
-  size_t out_tree_size;
+//! Huffman code an array of quantized coefficients and compress the result
+//! with the second stage of a Huffman pipeline.
+//!
+//! The sizes of the tree, hit, and miss buffers are appended to `output`,
+//! followed by the compressed buffers. See `huffman_encode` for `n` and
+//! `batch`, and `compress_memory_huffman` for the other parameters.
+template <typename Int, typename Batch>
+void compress_huffman(const std::size_t n, Batch &&batch,
+                      std::vector<unsigned char> &output,
+                      const LosslessCompressor compressor, const int level) {
+  if (!is_huffman_pipeline(compressor)) {
+    throw std::invalid_argument("not a Huffman pipeline");
+  }
+  const LosslessBackend &backend = lossless_backend(compressor);
 #ifdef MGARD_TIMING
   auto huff_time1 = std::chrono::high_resolution_clock::now();
 #endif
-  mgard::huffman_encoding(const_cast<long int *>(qv.data()), qv.size(),
-                          &out_data_hit, &out_data_hit_size, &out_data_miss,
-                          &out_data_miss_size, &out_tree, &out_tree_size);
+  const HuffmanEncoded encoded =
+      huffman_encode<Int>(n, std::forward<Batch>(batch));
 #ifdef MGARD_TIMING
   auto huff_time2 = std::chrono::high_resolution_clock::now();
   auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
@@ -321,167 +566,462 @@ unsigned char *compress_memory_huffman(const std::vector<long int> &qv,
   std::cout << "Huffman tree time = " << (double)duration.count() / 1000000
             << "\n";
 #endif
-  size_t total_size =
-      out_data_hit_size / 8 + 4 + out_data_miss_size + out_tree_size;
-  unsigned char *payload = (unsigned char *)malloc(total_size);
-  unsigned char *bufp = payload;
-
-  memcpy(bufp, out_tree, out_tree_size);
-  bufp += out_tree_size;
-
-  memcpy(bufp, out_data_hit, out_data_hit_size / 8 + 4);
-  bufp += out_data_hit_size / 8 + 4;
-
-  memcpy(bufp, out_data_miss, out_data_miss_size);
-  bufp += out_data_miss_size;
-
-  free(out_tree);
-  free(out_data_hit);
-  free(out_data_miss);
-#ifndef MGARD_ZSTD
+  // Note: hit size is in bits, while miss size is in bytes.
+  const std::array<std::size_t, 3> sizes = {
+      encoded.tree.size(), 32 * (encoded.words.size() - 1),
+      encoded.misses.size() * sizeof(std::int64_t)};
+  unsigned char const *const p =
+      reinterpret_cast<unsigned char const *>(sizes.data());
+  output.insert(output.end(), p, p + sizeof(sizes));
+
+  // The buffers are handed to the second stage one after another.
+  const std::array<std::pair<void const *, std::size_t>, 3> buffers = {{
+      {encoded.tree.data(), encoded.tree.size()},
+      {encoded.words.data(), encoded.words.size() * sizeof(std::uint32_t)},
+      {encoded.misses.data(), sizes.at(2)},
+  }};
 #ifdef MGARD_TIMING
   auto z_time1 = std::chrono::high_resolution_clock::now();
 #endif
-  mgard::compress_memory_z(payload, total_size, out_data);
+  if (backend.compress_stream) {
+    std::size_t k = 0;
+    backend.compress_stream(
+        [&]() -> std::pair<void const *, std::size_t> {
+          // An empty buffer would end the stream early.
+          while (k < buffers.size() && !buffers.at(k).second) {
+            ++k;
+          }
+          return k < buffers.size() ? buffers.at(k++)
+                                    : std::pair<void const *, std::size_t>();
+        },
+        level, output);
+  } else {
+    std::vector<unsigned char> payload;
+    payload.reserve(buffers.at(0).second + buffers.at(1).second +
+                    buffers.at(2).second);
+    for (const std::pair<void const *, std::size_t> &buffer : buffers) {
+      unsigned char const *const q =
+          static_cast<unsigned char const *>(buffer.first);
+      payload.insert(payload.end(), q, q + buffer.second);
+    }
+    std::vector<std::uint8_t> compressed;
+    backend.compress(payload.data(), payload.size(), level, compressed);
+    output.insert(output.end(), compressed.begin(), compressed.end());
+  }
 #ifdef MGARD_TIMING
   auto z_time2 = std::chrono::high_resolution_clock::now();
   auto z_duration =
       std::chrono::duration_cast<std::chrono::microseconds>(z_time2 - z_time1);
-  std::cout << "ZLIB compression time = "
+  std::cout << "second stage compression time = "
             << (double)z_duration.count() / 1000000 << "\n";
 #endif
-#else
-#ifdef MGARD_TIMING
-  auto zstd_time1 = std::chrono::high_resolution_clock::now();
-#endif
-  mgard::compress_memory_zstd(payload, total_size, out_data);
-#ifdef MGARD_TIMING
-  auto zstd_time2 = std::chrono::high_resolution_clock::now();
-  auto zstd_duration = std::chrono::duration_cast<std::chrono::microseconds>(
-      zstd_time2 - zstd_time1);
-  std::cout << "ZSTD compression time = "
-            << (double)zstd_duration.count() / 1000000 << "\n";
-#endif
-#endif
-  free(payload);
-  payload = 0;
+}
+
+//! Decode the symbols of a chunk.
+//!
+//!\param quantized_data Buffer in which to store the chunk's coefficients.
+//!\param n Number of coefficients in the chunk.
+//!\param buf Start of the chunk's portion of the stream. At least one word
+//! must follow the chunk.
+//!\param code Canonical code.
+//!\param table Table decoding the first `bits` bits of a code.
+//!\param bits Number of bits resolved by a probe of `table`.
+//!\param max_length Length of the longest code.
+//!\param miss_buf The chunk's out-of-range levels.
+//!\param num_miss Number of out-of-range levels in the chunk.
+//!\param dictionary_size Size of the dictionary.
+template <typename Int>
+void decode_chunk(Int *const quantized_data, const std::size_t n,
+                  std::uint32_t const *const buf, const CanonicalCode &code,
+                  const std::vector<DecodingEntry> &table,
+                  const std::size_t bits, const std::size_t max_length,
+                  std::int64_t const *const miss_buf,
+                  const std::size_t num_miss,
+                  const std::size_t dictionary_size) {
+  const long int shift = dictionary_size / 2;
+  size_t start_bit = 0;
+  size_t num_missed = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    // Next 32 bits of the stream, starting at `start_bit`.
+    const std::size_t word = start_bit / 32;
+    const std::uint32_t peek = static_cast<std::uint32_t>(
+        ((static_cast<std::uint64_t>(buf[word]) << 32 | buf[word + 1])
+         << (start_bit % 32)) >>
+        32);
+
+    std::uint32_t symbol;
+    std::size_t length;
+    const DecodingEntry &entry = table[peek >> (32 - bits)];
+    if (entry.length) {
+      symbol = entry.symbol;
+      length = entry.length;
+    } else {
+      // The codes of each length are consecutive and precede the prefixes of
+      // the longer codes, so the code is the first prefix falling in the range
+      // of codes of its length.
+      std::uint64_t prefix;
+      for (length = bits + 1;; ++length) {
+        if (length > max_length) {
+          throw std::runtime_error("invalid Huffman code");
+        }
+        prefix = peek >> (32 - length);
+        if (prefix < code.firsts.at(length) + code.counts.at(length)) {
+          break;
+        }
+      }
+      symbol = code.symbols.at(code.offsets.at(length) +
+                               (prefix - code.firsts.at(length)));
+    }
 
-  outsize = out_data.size() + 3 * sizeof(size_t);
-  unsigned char *buffer = (unsigned char *)malloc(outsize);
+    if (symbol != 0) {
+      quantized_data[i] = static_cast<long int>(symbol) - shift;
+    } else if (num_missed < num_miss) {
+      quantized_data[i] = miss_buf[num_missed++] - shift;
+    } else {
+      throw std::runtime_error("too few out-of-range quantization levels");
+    }
 
-  bufp = buffer;
-  *(size_t *)bufp = out_tree_size;
-  bufp += sizeof(size_t);
+    start_bit += length;
+  }
+}
 
-  *(size_t *)bufp = out_data_hit_size;
-  bufp += sizeof(size_t);
+//! Huffman coded stream, read from the buffers written by `huffman_encoding`
+//! and ready to be decoded a chunk at a time.
+struct HuffmanStream {
+  //! Constructor.
+  //!
+  //! See `huffman_decoding` for the parameters.
+  HuffmanStream(const std::size_t n, unsigned char const *const hit,
+                const std::size_t hit_size, unsigned char const *const miss,
+                const std::size_t miss_size, unsigned char const *const tree,
+                const std::size_t tree_size);
 
-  *(size_t *)bufp = out_data_miss_size;
-  bufp += sizeof(size_t);
+  //! Number of chunks.
+  std::size_t nchunks() const { return chunk_words.size() - 1; }
 
-  std::copy(out_data.begin(), out_data.end(), bufp);
-  return buffer;
-}
+  //! Decode a chunk.
+  //!
+  //!\param c Index of the chunk.
+  //!\param quantized_data Buffer in which to store the chunk's coefficients.
+  template <typename Int>
+  void decode(const std::size_t c, Int *const quantized_data) const;
 
-void huffman_encoding(long int *quantized_data, const std::size_t n,
-                      unsigned char **out_data_hit, size_t *out_data_hit_size,
-                      unsigned char **out_data_miss, size_t *out_data_miss_size,
-                      unsigned char **out_tree, size_t *out_tree_size) {
-  size_t num_miss = 0;
-  size_t *ft = 0;
-  ;
+  //! Number of symbols.
+  std::size_t n;
 
-  huffman_codec *codec = build_huffman_codec(quantized_data, &ft, n, num_miss);
+  //! Size of the dictionary.
+  std::size_t dictionary_size;
 
-  assert(n >= num_miss);
+  //! Canonical code.
+  CanonicalCode code;
 
-  /* For those miss points, we still need to maintain a flag (q = 0),
-   * and therefore we need to allocate space for n numbers.
-   */
-  unsigned char *p_hit = (unsigned char *)malloc(n * sizeof(int));
-  memset(p_hit, 0, n * sizeof(int));
+  //! Length of the longest code.
+  std::size_t max_length;
 
-  int *p_miss = 0;
-  if (num_miss > 0) {
-    p_miss = (int *)malloc(num_miss * sizeof(int));
-    memset(p_miss, 0, num_miss * sizeof(int));
-  }
+  //! Number of bits resolved by a probe of `table`.
+  std::size_t bits;
 
-  *out_data_hit = p_hit;
-  *out_data_miss = (unsigned char *)p_miss;
-  *out_data_hit_size = 0;
-  *out_data_miss_size = 0;
+  //! Table decoding the first `bits` bits of a code.
+  std::vector<DecodingEntry> table;
 
-  size_t start_bit = 0;
-  unsigned int *cur = (unsigned int *)p_hit;
-  size_t cnt_missed = 0;
-  for (std::size_t i = 0; i < n; i++) {
-    int q = quantized_data[i];
-    unsigned int code;
-    size_t len;
+  //! Hit stream, including the chunk table and followed by a word of padding.
+  std::vector<std::uint32_t> words;
 
-    if (q > 0 && q < nql) {
-      // for those that are within the range
-      code = codec[q].code;
-      len = codec[q].len;
-    } else {
-      // for those that are out of the range, q is set to 0
-      code = codec[0].code;
-      len = codec[0].len;
+  //! Size in words of the chunk table.
+  std::size_t table_words;
 
-      *p_miss = q;
-      p_miss++;
-      cnt_missed++;
-    }
+  //! Out-of-range levels.
+  std::vector<std::int64_t> misses;
 
-    assert(len > 0);
+  //! Offset in words (from the end of the chunk table) and index of the first
+  //! out-of-range level of each chunk, followed by the totals.
+  std::vector<std::uint64_t> chunk_words;
+  std::vector<std::uint64_t> chunk_misses;
+};
 
-    if (32 - start_bit % 32 >= len) {
-      code = code << (32 - start_bit % 32 - len);
-      *(cur + start_bit / 32) = (*(cur + start_bit / 32)) | code;
-      start_bit += len;
-    } else {
-      // current unsigned int cannot hold the code
-      // copy 32 - start_bit % 32 bits to the current int
-      // and copy  the rest len - (32 - start_bit % 32) to the next int
-      size_t rshift = len - (32 - start_bit % 32);
-      size_t lshift = 32 - rshift;
-      *(cur + start_bit / 32) = (*(cur + start_bit / 32)) | (code >> rshift);
-      *(cur + start_bit / 32 + 1) =
-          (*(cur + start_bit / 32 + 1)) | (code << lshift);
-      start_bit += len;
+HuffmanStream::HuffmanStream(const std::size_t n,
+                             unsigned char const *const hit,
+                             const std::size_t hit_size,
+                             unsigned char const *const miss,
+                             const std::size_t miss_size,
+                             unsigned char const *const tree,
+                             const std::size_t tree_size)
+    : n(n) {
+  // The tree buffer holds the dictionary size, the number of codes of each
+  // length, and then the symbols.
+  const std::size_t tree_header_size =
+      (1 + max_code_length) * sizeof(std::uint32_t);
+  if (tree_size < tree_header_size) {
+    throw std::invalid_argument("Huffman code table is truncated");
+  }
+  std::uint32_t dictionary_size_;
+  std::memcpy(&dictionary_size_, tree, sizeof(std::uint32_t));
+  dictionary_size = dictionary_size_;
+  std::memcpy(code.counts.data() + 1, tree + sizeof(std::uint32_t),
+              max_code_length * sizeof(std::uint32_t));
+  code.assign();
+  code.symbols.resize((tree_size - tree_header_size) / sizeof(std::uint32_t));
+  std::uint64_t ncodes = 0;
+  for (std::size_t length = 1; length <= max_code_length; ++length) {
+    ncodes += code.counts.at(length);
+  }
+  if (ncodes != code.symbols.size()) {
+    throw std::invalid_argument("invalid Huffman code table");
+  }
+  std::memcpy(code.symbols.data(),
+              tree + (1 + max_code_length) * sizeof(std::uint32_t),
+              code.symbols.size() * sizeof(std::uint32_t));
+
+  max_length = 0;
+  for (std::size_t length = 1; length <= max_code_length; ++length) {
+    if (code.counts.at(length)) {
+      max_length = length;
     }
   }
+  bits = std::min(max_length, decoding_table_bits);
+  table = build_decoding_table(code, bits);
+
+  // The hit stream may not be aligned, and each probe reads the word after
+  // the one containing the start of the code. Therefore, the code here makes a
+  // new, padded buffer.
+  const std::size_t nwords = hit_size / 32 + 1;
+  words.assign(nwords + 1, 0);
+  std::memcpy(words.data(), hit, nwords * sizeof(std::uint32_t));
+
+  // The miss stream may not be aligned either.
+  const std::size_t num_miss = miss_size / sizeof(std::int64_t);
+  misses.resize(num_miss);
+  std::memcpy(misses.data(), miss, miss_size);
+
+  const std::size_t nchunks = (n + huffman_chunk_size - 1) / huffman_chunk_size;
+  table_words = 4 * nchunks;
+  if (table_words > nwords) {
+    throw std::runtime_error("Huffman chunk table truncated");
+  }
+  chunk_words.resize(nchunks + 1);
+  chunk_misses.resize(nchunks + 1);
+  std::memcpy(chunk_words.data(), words.data(),
+              nchunks * sizeof(std::uint64_t));
+  std::memcpy(chunk_misses.data(), words.data() + 2 * nchunks,
+              nchunks * sizeof(std::uint64_t));
+  chunk_words.back() = nwords - table_words;
+  chunk_misses.back() = num_miss;
+  for (std::size_t c = 0; c < nchunks; ++c) {
+    if (chunk_words.at(c) > chunk_words.at(c + 1) ||
+        chunk_misses.at(c) > chunk_misses.at(c + 1)) {
+      throw std::runtime_error("invalid Huffman chunk table");
+    }
+  }
+}
 
-  // Note: hit size is in bits, while miss size is in bytes.
-  *out_data_hit_size = start_bit;
-  *out_data_miss_size = num_miss * sizeof(int);
+template <typename Int>
+void HuffmanStream::decode(const std::size_t c,
+                           Int *const quantized_data) const {
+  const std::size_t begin = c * huffman_chunk_size;
+  decode_chunk(quantized_data, std::min(n - begin, huffman_chunk_size),
+               words.data() + table_words + chunk_words.at(c), code, table,
+               bits, max_length, misses.data() + chunk_misses.at(c),
+               chunk_misses.at(c + 1) - chunk_misses.at(c), dictionary_size);
+}
+
+//! Undo the second stage of `compress_memory_huffman`.
+//!
+//! Returns the tree, hit, and miss buffers written by `huffman_encoding`, one
+//! after another.
+std::vector<unsigned char>
+read_huffman_payload(unsigned char *data, const std::size_t data_len,
+                     std::size_t &tree_size, std::size_t &hit_size,
+                     std::size_t &miss_size,
+                     const LosslessCompressor compressor) {
+  if (!is_huffman_pipeline(compressor)) {
+    throw std::invalid_argument("not a Huffman pipeline");
+  }
+  const LosslessBackend &backend = lossless_backend(compressor);
+  if (data_len < 3 * sizeof(size_t)) {
+    throw std::invalid_argument("compressed data is truncated");
+  }
+  unsigned char *buf = data;
+
+  tree_size = *(size_t *)buf;
+  buf += sizeof(size_t);
+
+  hit_size = *(size_t *)buf;
+  buf += sizeof(size_t);
+
+  miss_size = *(size_t *)buf;
+  buf += sizeof(size_t);
 
-  // write frequency table to buffer
-  int nonZeros = 0;
-  for (int i = 0; i < nql; i++) {
-    if (ft[i] > 0) {
-      nonZeros++;
+  std::vector<unsigned char> payload(tree_size + hit_size / 8 + 4 + miss_size);
+  backend.decompress(buf, data_len - 3 * sizeof(size_t), payload.data(),
+                     payload.size());
+  return payload;
+}
+
+} // namespace
+
+template <typename Int>
+void decompress_memory_huffman(unsigned char *data, const std::size_t data_len,
+                               Int *out_data, const std::size_t out_size,
+                               const LosslessCompressor compressor) {
+  std::size_t tree_size;
+  std::size_t hit_size;
+  std::size_t miss_size;
+  std::vector<unsigned char> payload = read_huffman_payload(
+      data, data_len, tree_size, hit_size, miss_size, compressor);
+  unsigned char *const tree = payload.data();
+  unsigned char *const hit = tree + tree_size;
+  unsigned char *const miss = hit + hit_size / 8 + 4;
+
+  mgard::huffman_decoding(out_data, out_size, hit, hit_size, miss, miss_size,
+                          tree, tree_size);
+}
+
+template <typename Int>
+void decompress_memory_huffman_at(unsigned char *data,
+                                  const std::size_t data_len,
+                                  const std::size_t n,
+                                  const std::vector<std::size_t> &positions,
+                                  Int *const selected,
+                                  const LosslessCompressor compressor) {
+  if (positions.empty()) {
+    return;
+  }
+  if (positions.back() >= n) {
+    throw std::out_of_range("position out of range");
+  }
+  std::size_t tree_size;
+  std::size_t hit_size;
+  std::size_t miss_size;
+  std::vector<unsigned char> payload = read_huffman_payload(
+      data, data_len, tree_size, hit_size, miss_size, compressor);
+  unsigned char const *const tree = payload.data();
+  unsigned char const *const hit = tree + tree_size;
+  unsigned char const *const miss = hit + hit_size / 8 + 4;
+  const HuffmanStream stream(n, hit, hit_size, miss, miss_size, tree,
+                             tree_size);
+
+  // Index in `positions` of the first position in each chunk needed.
+  std::vector<std::size_t> firsts;
+  for (std::size_t k = 0; k < positions.size(); ++k) {
+    if (!k || positions[k] / huffman_chunk_size !=
+                  positions[k - 1] / huffman_chunk_size) {
+      firsts.push_back(k);
     }
   }
+  const std::size_t ngroups = firsts.size();
+  firsts.push_back(positions.size());
+
+  // Exceptions can't be thrown out of the loop.
+  std::exception_ptr exception;
+#pragma omp parallel
+  {
+    std::vector<Int> chunk;
+#pragma omp for schedule(dynamic)
+    for (std::size_t g = 0; g < ngroups; ++g) {
+      try {
+        const std::size_t c = positions[firsts[g]] / huffman_chunk_size;
+        const std::size_t begin = c * huffman_chunk_size;
+        chunk.resize(std::min(n - begin, huffman_chunk_size));
+        stream.decode(c, chunk.data());
+        for (std::size_t k = firsts[g]; k < firsts[g + 1]; ++k) {
+          selected[k] = chunk[positions[k] - begin];
+        }
+      } catch (...) {
+#pragma omp critical
+        exception = std::current_exception();
+      }
+    }
+  }
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+}
 
-  size_t *cft = (size_t *)malloc(2 * nonZeros * sizeof(size_t));
-  int off = 0;
-  for (int i = 0; i < nql; i++) {
-    if (ft[i] > 0) {
-      cft[2 * off] = i;
-      cft[2 * off + 1] = ft[i];
-      off++;
+template <typename Int>
+void huffman_decoding(Int *quantized_data, const std::size_t n,
+                      unsigned char *out_data_hit, size_t out_data_hit_size,
+                      unsigned char *out_data_miss, size_t out_data_miss_size,
+                      unsigned char *out_tree, size_t out_tree_size) {
+  const HuffmanStream stream(n, out_data_hit, out_data_hit_size, out_data_miss,
+                             out_data_miss_size, out_tree, out_tree_size);
+
+  // Exceptions can't be thrown out of the loop.
+  std::exception_ptr exception;
+#pragma omp parallel for schedule(dynamic)
+  for (std::size_t c = 0; c < stream.nchunks(); ++c) {
+    try {
+      stream.decode(c, quantized_data + c * huffman_chunk_size);
+    } catch (...) {
+#pragma omp critical
+      exception = std::current_exception();
     }
   }
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+}
 
-  *out_tree = (unsigned char *)cft;
-  *out_tree_size = 2 * nonZeros * sizeof(size_t);
-  free(ft);
-  ft = 0;
+template <typename Int>
+unsigned char *compress_memory_huffman(const std::vector<Int> &qv,
+                                       std::vector<unsigned char> &out_data,
+                                       std::size_t &outsize,
+                                       const LosslessCompressor compressor,
+                                       const int level) {
+  out_data.clear();
+  compress_huffman<Int>(
+      qv.size(),
+      [&](const std::size_t begin, std::size_t) { return qv.data() + begin; },
+      out_data, compressor, level);
+  outsize = out_data.size();
+  unsigned char *const buffer = (unsigned char *)malloc(outsize);
+  std::copy(out_data.begin(), out_data.end(), buffer);
+  return buffer;
+}
 
-  free(codec);
-  codec = 0;
+template <typename Int>
+void compress_stream_huffman(
+    const std::size_t n,
+    const std::function<void(std::size_t, std::size_t, Int *)> &produce,
+    std::vector<unsigned char> &output, const LosslessCompressor compressor,
+    const int level) {
+  std::vector<Int> chunk(
+      std::min(n, huffman_batch_chunks * huffman_chunk_size));
+  compress_huffman<Int>(
+      n,
+      [&](const std::size_t begin, const std::size_t end) -> Int const * {
+        produce(begin, end, chunk.data());
+        return chunk.data();
+      },
+      output, compressor, level);
+}
+
+template <typename Int>
+void huffman_encoding(Int const *const quantized_data, const std::size_t n,
+                      unsigned char **out_data_hit, size_t *out_data_hit_size,
+                      unsigned char **out_data_miss, size_t *out_data_miss_size,
+                      unsigned char **out_tree, size_t *out_tree_size) {
+  const HuffmanEncoded encoded = huffman_encode<Int>(
+      n, [&](const std::size_t begin, std::size_t) {
+        return quantized_data + begin;
+      });
+
+  // Note: hit size is in bits, while miss size is in bytes.
+  const std::size_t hit_size = encoded.words.size() * sizeof(std::uint32_t);
+  *out_data_hit = (unsigned char *)malloc(hit_size);
+  std::memcpy(*out_data_hit, encoded.words.data(), hit_size);
+  *out_data_hit_size = 32 * (encoded.words.size() - 1);
+
+  const std::size_t miss_size = encoded.misses.size() * sizeof(std::int64_t);
+  *out_data_miss = 0;
+  if (miss_size) {
+    *out_data_miss = (unsigned char *)malloc(miss_size);
+    std::memcpy(*out_data_miss, encoded.misses.data(), miss_size);
+  }
+  *out_data_miss_size = miss_size;
+
+  *out_tree = (unsigned char *)malloc(encoded.tree.size());
+  std::memcpy(*out_tree, encoded.tree.data(), encoded.tree.size());
+  *out_tree_size = encoded.tree.size();
 }
 
 #ifdef MGARD_ZSTD
@@ -513,24 +1053,131 @@ void huffman_encoding(long int *quantized_data, const std::size_t n,
   } while (0)
 
 void compress_memory_zstd(void *const in_data, const std::size_t in_data_size,
-                          std::vector<std::uint8_t> &out_data) {
+                          std::vector<std::uint8_t> &out_data,
+                          const int level) {
   size_t const cBuffSize = ZSTD_compressBound(in_data_size);
   uint8_t *cBuff = (uint8_t *)malloc(cBuffSize);
 
   assert(cBuff);
 
   size_t const cSize =
-      ZSTD_compress(cBuff, cBuffSize, in_data, in_data_size, 1);
+      ZSTD_compress(cBuff, cBuffSize, in_data, in_data_size, level);
   CHECK_ZSTD(cSize);
 
   std::copy(cBuff, cBuff + cSize, back_inserter(out_data));
 
   free(cBuff);
 }
+
+void compress_stream_zstd(
+    const std::function<std::pair<void const *, std::size_t>()> &next,
+    std::vector<std::uint8_t> &out_data, const int level) {
+  ZSTD_CCtx *const cctx = ZSTD_createCCtx();
+  if (!cctx) {
+    throw std::runtime_error("failed to initialize zstd compression");
+  }
+  if (ZSTD_isError(
+          ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level))) {
+    ZSTD_freeCCtx(cctx);
+    throw std::invalid_argument("invalid zstd compression level");
+  }
+  std::vector<std::uint8_t> temp_buffer(ZSTD_CStreamOutSize());
+  bool last = false;
+  while (!last) {
+    const std::pair<void const *, std::size_t> chunk = next();
+    last = !chunk.second;
+    const ZSTD_EndDirective mode = last ? ZSTD_e_end : ZSTD_e_continue;
+    ZSTD_inBuffer input = {chunk.first, chunk.second, 0};
+    bool done;
+    do {
+      ZSTD_outBuffer output = {temp_buffer.data(), temp_buffer.size(), 0};
+      const std::size_t remaining =
+          ZSTD_compressStream2(cctx, &output, &input, mode);
+      if (ZSTD_isError(remaining)) {
+        ZSTD_freeCCtx(cctx);
+        throw std::runtime_error("zstd compression failed");
+      }
+      out_data.insert(out_data.end(), temp_buffer.begin(),
+                      temp_buffer.begin() + output.pos);
+      // The frame is complete once nothing remains to be flushed.
+      done = last ? !remaining : input.pos == input.size;
+    } while (!done);
+  }
+  ZSTD_freeCCtx(cctx);
+}
 #endif
 
+namespace {
+
+//! Largest number of bytes `zlib` takes in or puts out in one call.
+constexpr std::size_t zlib_max_chunk = std::numeric_limits<uInt>::max();
+
+//! Hand `zlib` the next part of a buffer once it has used up the last.
+//!
+//!\param avail `avail_in` or `avail_out` of a `zlib` stream.
+//!\param remaining Number of bytes of the buffer not yet handed over.
+void refill(uInt &avail, std::size_t &remaining) {
+  if (!avail) {
+    avail = std::min(remaining, zlib_max_chunk);
+    remaining -= avail;
+  }
+}
+
+//! Decompress a buffer compressed with `zlib` into a buffer of known size.
+void inflate_memory(void const *const src, const std::size_t srcLen,
+                    void *const dst, const std::size_t dstLen) {
+  z_stream strm = {};
+  std::size_t in_remaining = srcLen;
+  std::size_t out_remaining = dstLen;
+  strm.next_in = static_cast<Bytef *>(const_cast<void *>(src));
+  strm.next_out = static_cast<Bytef *>(dst);
+
+  strm.zalloc = Z_NULL;
+  strm.zfree = Z_NULL;
+  strm.opaque = Z_NULL;
+
+  [[maybe_unused]] int res;
+  res = inflateInit2(&strm, (15 + 32)); // 15 window bits, and the +32 tells
+                                        // zlib to to detect if using gzip or
+                                        // zlib
+  assert(res == Z_OK);
+  do {
+    refill(strm.avail_in, in_remaining);
+    refill(strm.avail_out, out_remaining);
+    res = inflate(&strm, Z_NO_FLUSH);
+  } while (res == Z_OK);
+  assert(res == Z_STREAM_END);
+  res = inflateEnd(&strm);
+  assert(res == Z_OK);
+}
+
+//! Initialize a `zlib` stream for compression.
+//!
+//! Throws `std::invalid_argument` if `zlib` rejects the level.
+void deflate_init(z_stream &strm, const int level) {
+  const int res = deflateInit(&strm, level);
+  if (res == Z_STREAM_ERROR) {
+    throw std::invalid_argument("invalid zlib compression level");
+  } else if (res != Z_OK) {
+    throw std::runtime_error("failed to initialize zlib compression");
+  }
+}
+
+//! Compress with `zlib`, ending the stream and throwing on failure.
+int checked_deflate(z_stream &strm, const int flush) {
+  const int res = deflate(&strm, flush);
+  // `Z_BUF_ERROR` only means no progress could be made this call.
+  if (res != Z_OK && res != Z_STREAM_END && res != Z_BUF_ERROR) {
+    deflateEnd(&strm);
+    throw std::runtime_error("zlib compression failed");
+  }
+  return res;
+}
+
+} // namespace
+
 void compress_memory_z(void *const in_data, const std::size_t in_data_size,
-                       std::vector<std::uint8_t> &out_data) {
+                       std::vector<std::uint8_t> &out_data, const int level) {
   std::vector<std::uint8_t> buffer;
 
   const std::size_t BUFSIZE = 2048 * 1024;
@@ -539,21 +1186,23 @@ void compress_memory_z(void *const in_data, const std::size_t in_data_size,
   z_stream strm;
   strm.zalloc = Z_NULL;
   strm.zfree = Z_NULL;
+  std::size_t remaining = in_data_size;
   strm.next_in = static_cast<std::uint8_t *>(in_data);
-  strm.avail_in = in_data_size;
+  strm.avail_in = 0;
   strm.next_out = temp_buffer;
   strm.avail_out = BUFSIZE;
 
-  deflateInit(&strm, Z_BEST_COMPRESSION);
+  deflate_init(strm, level);
 
+  refill(strm.avail_in, remaining);
   while (strm.avail_in != 0) {
-    [[maybe_unused]] const int res = deflate(&strm, Z_NO_FLUSH);
-    assert(res == Z_OK);
+    checked_deflate(strm, Z_NO_FLUSH);
     if (strm.avail_out == 0) {
       buffer.insert(buffer.end(), temp_buffer, temp_buffer + BUFSIZE);
       strm.next_out = temp_buffer;
       strm.avail_out = BUFSIZE;
     }
+    refill(strm.avail_in, remaining);
   }
 
   int res = Z_OK;
@@ -563,10 +1212,13 @@ void compress_memory_z(void *const in_data, const std::size_t in_data_size,
       strm.next_out = temp_buffer;
       strm.avail_out = BUFSIZE;
     }
-    res = deflate(&strm, Z_FINISH);
+    res = checked_deflate(strm, Z_FINISH);
   }
 
-  assert(res == Z_STREAM_END);
+  if (res != Z_STREAM_END) {
+    deflateEnd(&strm);
+    throw std::runtime_error("zlib compression failed");
+  }
   buffer.insert(buffer.end(), temp_buffer,
                 temp_buffer + BUFSIZE - strm.avail_out);
   deflateEnd(&strm);
@@ -574,63 +1226,428 @@ void compress_memory_z(void *const in_data, const std::size_t in_data_size,
   out_data.swap(buffer);
 }
 
-void decompress_memory_z(void *const src, const int srcLen, int *const dst,
-                         const int dstLen) {
+void compress_stream_z(
+    const std::function<std::pair<void const *, std::size_t>()> &next,
+    std::vector<std::uint8_t> &out_data, const int level) {
+  const std::size_t BUFSIZE = 2048 * 1024;
+  std::vector<std::uint8_t> temp_buffer(BUFSIZE);
+
+  z_stream strm;
+  strm.zalloc = Z_NULL;
+  strm.zfree = Z_NULL;
+  strm.opaque = Z_NULL;
+  strm.next_in = Z_NULL;
+  strm.avail_in = 0;
+  strm.next_out = temp_buffer.data();
+  strm.avail_out = BUFSIZE;
+
+  deflate_init(strm, level);
+
+  int flush = Z_NO_FLUSH;
+  int res = Z_OK;
+  // Bytes of the current chunk not yet handed to `zlib`.
+  std::size_t remaining = 0;
+  while (res != Z_STREAM_END) {
+    refill(strm.avail_in, remaining);
+    if (flush == Z_NO_FLUSH && strm.avail_in == 0) {
+      const std::pair<void const *, std::size_t> chunk = next();
+      if (chunk.second) {
+        strm.next_in =
+            static_cast<std::uint8_t *>(const_cast<void *>(chunk.first));
+        remaining = chunk.second;
+        refill(strm.avail_in, remaining);
+      } else {
+        flush = Z_FINISH;
+      }
+    }
+    res = checked_deflate(strm, flush);
+    if (strm.avail_out == 0 || res == Z_STREAM_END) {
+      out_data.insert(out_data.end(), temp_buffer.begin(),
+                      temp_buffer.begin() + (BUFSIZE - strm.avail_out));
+      strm.next_out = temp_buffer.data();
+      strm.avail_out = BUFSIZE;
+    }
+  }
+  deflateEnd(&strm);
+}
+
+void decompress_memory_z(void *const src, const std::size_t srcLen,
+                         int *const dst, const std::size_t dstLen) {
+  inflate_memory(src, srcLen, dst, dstLen);
+}
+
+void decompress_stream_z(void const *const src, const std::size_t srcLen,
+                         void *const chunk, const std::size_t chunkLen,
+                         const std::function<void(std::size_t)> &consume) {
   z_stream strm = {};
-  strm.total_in = strm.avail_in = srcLen;
-  strm.total_out = strm.avail_out = dstLen;
-  strm.next_in = static_cast<Bytef *>(src);
-  strm.next_out = reinterpret_cast<Bytef *>(dst);
+  std::size_t remaining = srcLen;
+  strm.next_in = static_cast<Bytef *>(const_cast<void *>(src));
 
   strm.zalloc = Z_NULL;
   strm.zfree = Z_NULL;
   strm.opaque = Z_NULL;
 
   [[maybe_unused]] int res;
-  res = inflateInit2(&strm, (15 + 32)); // 15 window bits, and the +32 tells
-                                        // zlib to to detect if using gzip or
-                                        // zlib
+  res = inflateInit2(&strm, (15 + 32));
   assert(res == Z_OK);
-  res = inflate(&strm, Z_FINISH);
-  assert(res == Z_STREAM_END);
+  res = Z_OK;
+  while (res != Z_STREAM_END) {
+    strm.next_out = static_cast<Bytef *>(chunk);
+    strm.avail_out = 0;
+    std::size_t chunk_remaining = chunkLen;
+    refill(strm.avail_out, chunk_remaining);
+    while (strm.avail_out && res != Z_STREAM_END) {
+      refill(strm.avail_in, remaining);
+      res = inflate(&strm, Z_NO_FLUSH);
+      if (res != Z_OK && res != Z_STREAM_END) {
+        inflateEnd(&strm);
+        throw std::invalid_argument(
+            "compressed stream is corrupt or truncated");
+      }
+      refill(strm.avail_out, chunk_remaining);
+    }
+    consume(chunkLen - chunk_remaining - strm.avail_out);
+  }
   res = inflateEnd(&strm);
   assert(res == Z_OK);
 }
 
 #ifdef MGARD_ZSTD
-void decompress_memory_zstd_huffman(void *const src, const int srcLen,
+void decompress_memory_zstd_huffman(void *const src, const std::size_t srcLen,
                                     unsigned char *const dst,
-                                    const int dstLen) {
+                                    const std::size_t dstLen) {
   size_t const dSize = ZSTD_decompress(dst, dstLen, src, srcLen);
   CHECK_ZSTD(dSize);
 
   /* When zstd knows the content size, it will error if it doesn't match. */
-  CHECK(dstLen >= 0 && static_cast<std::size_t>(dstLen) == dSize,
-        "Impossible because zstd will check this condition!");
+  CHECK(dstLen == dSize, "Impossible because zstd will check this condition!");
 }
 #endif
 
-void decompress_memory_z_huffman(void *const src, const int srcLen,
-                                 unsigned char *const dst, const int dstLen) {
-  z_stream strm = {};
-  strm.total_in = strm.avail_in = srcLen;
-  strm.total_out = strm.avail_out = dstLen;
-  strm.next_in = static_cast<Bytef *>(src);
-  strm.next_out = reinterpret_cast<Bytef *>(dst);
+void decompress_memory_z_huffman(void *const src, const std::size_t srcLen,
+                                 unsigned char *const dst,
+                                 const std::size_t dstLen) {
+  inflate_memory(src, srcLen, dst, dstLen);
+}
 
-  strm.zalloc = Z_NULL;
-  strm.zfree = Z_NULL;
-  strm.opaque = Z_NULL;
+namespace {
 
-  [[maybe_unused]] int res;
-  res = inflateInit2(&strm, (15 + 32)); // 15 window bits, and the +32 tells
-                                        // zlib to to detect if using gzip or
-                                        // zlib
-  assert(res == Z_OK);
-  res = inflate(&strm, Z_FINISH);
-  assert(res == Z_STREAM_END);
-  res = inflateEnd(&strm);
-  assert(res == Z_OK);
+//! Shortest match encoded by `compress_memory_lz`.
+constexpr std::size_t lz_min_match = 4;
+
+//! Farthest a match may be from the data it repeats.
+constexpr std::size_t lz_max_distance = 65535;
+
+//! Number of bits of the hashes of the hash table used to find matches.
+constexpr std::size_t lz_hash_bits = 16;
+
+//! Number of bytes at the end of a block which must be literals.
+constexpr std::size_t lz_last_literals = 5;
+
+//! Least distance from the start of a match to the end of the block.
+constexpr std::size_t lz_match_limit = 12;
+
+std::uint32_t load_u32(unsigned char const *const p) {
+  std::uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+//! Write the part of a length not fitting in a token nibble.
+void write_lz_length(std::size_t length, std::vector<std::uint8_t> &out) {
+  for (; length >= 255; length -= 255) {
+    out.push_back(255);
+  }
+  out.push_back(length);
+}
+
+//! Read the part of a length not fitting in a token nibble.
+std::size_t read_lz_length(unsigned char const *&p,
+                           unsigned char const *const end) {
+  std::size_t length = 0;
+  unsigned char byte;
+  do {
+    if (p == end) {
+      throw std::invalid_argument("compressed data is truncated");
+    }
+    byte = *p++;
+    length += byte;
+  } while (byte == 255);
+  return length;
+}
+
+//! Write a sequence: a run of literals followed, unless `match_length` is
+//! zero, by a match.
+void write_lz_sequence(unsigned char const *const literals,
+                       const std::size_t literal_length,
+                       const std::size_t distance,
+                       const std::size_t match_length,
+                       std::vector<std::uint8_t> &out) {
+  const std::size_t match_code = match_length ? match_length - lz_min_match : 0;
+  out.push_back((std::min<std::size_t>(literal_length, 15) << 4) |
+                std::min<std::size_t>(match_code, 15));
+  if (literal_length >= 15) {
+    write_lz_length(literal_length - 15, out);
+  }
+  out.insert(out.end(), literals, literals + literal_length);
+  if (match_length) {
+    out.push_back(distance & 0xff);
+    out.push_back(distance >> 8);
+    if (match_code >= 15) {
+      write_lz_length(match_code - 15, out);
+    }
+  }
+}
+
+} // namespace
+
+void compress_memory_lz(void const *const in_data,
+                        const std::size_t in_data_size,
+                        std::vector<std::uint8_t> &out_data) {
+  unsigned char const *const in = static_cast<unsigned char const *>(in_data);
+  const std::size_t n = in_data_size;
+  std::vector<std::uint8_t> buffer;
+  buffer.reserve(n / 2 + 16);
+  // Position of the last occurrence of each hash of four bytes.
+  std::vector<std::uint32_t> table(std::size_t(1) << lz_hash_bits, 0);
+
+  // LZ4's end of block rules: no match starts in the last `lz_match_limit`
+  // bytes, and none reaches into the last `lz_last_literals`.
+  const std::size_t match_end = n > lz_last_literals ? n - lz_last_literals : 0;
+  std::size_t anchor = 0;
+  std::size_t i = 0;
+  while (i + lz_match_limit < n) {
+    const std::uint32_t sequence = load_u32(in + i);
+    const std::size_t h = (sequence * 2654435761u) >> (32 - lz_hash_bits);
+    const std::size_t candidate = table[h];
+    table[h] = i;
+    if (candidate < i && i - candidate <= lz_max_distance &&
+        load_u32(in + candidate) == sequence) {
+      std::size_t length = lz_min_match;
+      while (i + length < match_end &&
+             in[candidate + length] == in[i + length]) {
+        ++length;
+      }
+      write_lz_sequence(in + anchor, i - anchor, i - candidate, length,
+                        buffer);
+      i += length;
+      anchor = i;
+    } else {
+      // Step faster through data which isn't matching, as LZ4 does.
+      i += 1 + ((i - anchor) >> 6);
+    }
+  }
+  // The last sequence is all literals, which is how the decoder knows to stop.
+  write_lz_sequence(in + anchor, n - anchor, 0, 0, buffer);
+
+  out_data.swap(buffer);
 }
 
+void decompress_memory_lz(void const *const src, const std::size_t srcLen,
+                          void *const dst, const std::size_t dstLen) {
+  unsigned char const *p = static_cast<unsigned char const *>(src);
+  unsigned char const *const end = p + srcLen;
+  unsigned char *const out = static_cast<unsigned char *>(dst);
+  std::size_t position = 0;
+  while (true) {
+    if (p == end) {
+      throw std::invalid_argument("compressed data is truncated");
+    }
+    const unsigned char token = *p++;
+
+    std::size_t literal_length = token >> 4;
+    if (literal_length == 15) {
+      literal_length += read_lz_length(p, end);
+    }
+    if (literal_length > static_cast<std::size_t>(end - p) ||
+        literal_length > dstLen - position) {
+      throw std::invalid_argument("compressed data is corrupt");
+    }
+    std::memcpy(out + position, p, literal_length);
+    p += literal_length;
+    position += literal_length;
+    if (p == end) {
+      break;
+    }
+
+    if (end - p < 2) {
+      throw std::invalid_argument("compressed data is truncated");
+    }
+    const std::size_t distance = p[0] | (std::size_t(p[1]) << 8);
+    p += 2;
+    std::size_t match_length = (token & 0xf) + lz_min_match;
+    if ((token & 0xf) == 15) {
+      match_length += read_lz_length(p, end);
+    }
+    if (!distance || distance > position ||
+        lz_match_limit > dstLen - position ||
+        match_length + lz_last_literals > dstLen - position) {
+      throw std::invalid_argument("compressed data is corrupt");
+    }
+    // The match may overlap the data it produces, so copy a byte at a time.
+    for (std::size_t k = 0; k < match_length; ++k, ++position) {
+      out[position] = out[position - distance];
+    }
+  }
+  if (position != dstLen) {
+    throw std::invalid_argument("compressed data is corrupt");
+  }
+}
+
+namespace {
+
+std::map<LosslessCompressor, LosslessBackend> builtin_lossless_backends() {
+  std::map<LosslessCompressor, LosslessBackend> backends;
+  backends[LosslessCompressor::None] = {
+      [](void const *const data, const std::size_t size, int,
+         std::vector<std::uint8_t> &output) {
+        unsigned char const *const p = static_cast<unsigned char const *>(data);
+        output.assign(p, p + size);
+      },
+      [](void const *const src, const std::size_t size, void *const dst,
+         const std::size_t dst_size) {
+        if (size != dst_size) {
+          throw std::invalid_argument("compressed data is corrupt");
+        }
+        std::memcpy(dst, src, size);
+      },
+      nullptr,
+      [](const std::function<std::pair<void const *, std::size_t>()> &next,
+         int, std::vector<std::uint8_t> &output) {
+        for (std::pair<void const *, std::size_t> chunk = next(); chunk.second;
+             chunk = next()) {
+          unsigned char const *const p =
+              static_cast<unsigned char const *>(chunk.first);
+          output.insert(output.end(), p, p + chunk.second);
+        }
+      },
+      [](void const *const src, const std::size_t size, void *const chunk,
+         const std::size_t chunk_size,
+         const std::function<void(std::size_t)> &consume) {
+        unsigned char const *const p = static_cast<unsigned char const *>(src);
+        for (std::size_t begin = 0; begin < size; begin += chunk_size) {
+          const std::size_t n = std::min(chunk_size, size - begin);
+          std::memcpy(chunk, p + begin, n);
+          consume(n);
+        }
+      }};
+  const auto decompress_z = [](void const *const src, const std::size_t size,
+                               void *const dst, const std::size_t dst_size) {
+    decompress_memory_z_huffman(const_cast<void *>(src), size,
+                                static_cast<unsigned char *>(dst), dst_size);
+  };
+  backends[LosslessCompressor::Zlib] = {
+      [](void const *const data, const std::size_t size, const int level,
+         std::vector<std::uint8_t> &output) {
+        compress_memory_z(const_cast<void *>(data), size, output,
+                          level ? level : Z_BEST_COMPRESSION);
+      },
+      decompress_z,
+      [](const int level) -> bool {
+        return level == Z_DEFAULT_COMPRESSION ||
+               (Z_BEST_SPEED <= level && level <= Z_BEST_COMPRESSION);
+      },
+      [](const std::function<std::pair<void const *, std::size_t>()> &next,
+         const int level, std::vector<std::uint8_t> &output) {
+        compress_stream_z(next, output, level ? level : Z_BEST_COMPRESSION);
+      },
+      decompress_stream_z};
+#ifdef MGARD_ZSTD
+  const auto decompress_zstd = [](void const *const src,
+                                  const std::size_t size, void *const dst,
+                                  const std::size_t dst_size) {
+    decompress_memory_zstd_huffman(const_cast<void *>(src), size,
+                                   static_cast<unsigned char *>(dst),
+                                   dst_size);
+  };
+  backends[LosslessCompressor::Zstd] = {
+      [](void const *const data, const std::size_t size, const int level,
+         std::vector<std::uint8_t> &output) {
+        compress_memory_zstd(const_cast<void *>(data), size, output,
+                             level ? level : 1);
+      },
+      decompress_zstd,
+      [](const int level) -> bool {
+        return ZSTD_minCLevel() <= level && level <= ZSTD_maxCLevel();
+      },
+      [](const std::function<std::pair<void const *, std::size_t>()> &next,
+         const int level, std::vector<std::uint8_t> &output) {
+        compress_stream_zstd(next, output, level ? level : 1);
+      },
+      nullptr};
+  backends[LosslessCompressor::HuffmanZstd] =
+      backends.at(LosslessCompressor::Zstd);
+#endif
+  // The backend of a Huffman pipeline is its second stage, which also
+  // compresses the buffers that aren't Huffman coded (outliers, for instance).
+  backends[LosslessCompressor::HuffmanZlib] =
+      backends.at(LosslessCompressor::Zlib);
+  backends[LosslessCompressor::Fast] = {
+      [](void const *const data, const std::size_t size, int,
+         std::vector<std::uint8_t> &output) {
+        compress_memory_lz(data, size, output);
+      },
+      decompress_memory_lz, nullptr, nullptr, nullptr};
+  return backends;
+}
+
+std::map<LosslessCompressor, LosslessBackend> &lossless_registry() {
+  static std::map<LosslessCompressor, LosslessBackend> registry =
+      builtin_lossless_backends();
+  return registry;
+}
+
+} // namespace
+
+void register_lossless_compressor(const LosslessCompressor compressor,
+                                  const LosslessBackend &backend) {
+  lossless_registry()[compressor] = backend;
+}
+
+const LosslessBackend &lossless_backend(const LosslessCompressor compressor) {
+  const std::map<LosslessCompressor, LosslessBackend> &registry =
+      lossless_registry();
+  const auto it = registry.find(compressor);
+  if (it == registry.end()) {
+    throw std::invalid_argument("lossless compressor not available");
+  }
+  return it->second;
+}
+
+void check_lossless_options(const LosslessOptions &lossless) {
+  const LosslessBackend &backend = lossless_backend(lossless.compressor);
+  if (lossless.level && backend.accepts_level &&
+      !backend.accepts_level(lossless.level)) {
+    throw std::invalid_argument("invalid lossless compression level");
+  }
+}
+
+#define MGARD_INSTANTIATE_HUFFMAN(Int)                                         \
+  template unsigned char *compress_memory_huffman<Int>(                        \
+      const std::vector<Int> &, std::vector<unsigned char> &, std::size_t &,   \
+      const LosslessCompressor, const int);                                    \
+  template void compress_stream_huffman<Int>(                                  \
+      const std::size_t,                                                       \
+      const std::function<void(std::size_t, std::size_t, Int *)> &,            \
+      std::vector<unsigned char> &, const LosslessCompressor, const int);      \
+  template void decompress_memory_huffman<Int>(                                \
+      unsigned char *, const std::size_t, Int *, const std::size_t,            \
+      const LosslessCompressor);                                               \
+  template void decompress_memory_huffman_at<Int>(                             \
+      unsigned char *, const std::size_t, const std::size_t,                   \
+      const std::vector<std::size_t> &, Int *const, const LosslessCompressor); \
+  template void huffman_encoding<Int>(Int const *const, const std::size_t,     \
+                                      unsigned char **, size_t *,              \
+                                      unsigned char **, size_t *,              \
+                                      unsigned char **, size_t *);             \
+  template void huffman_decoding<Int>(                                         \
+      Int *const, const std::size_t, unsigned char *, size_t, unsigned char *, \
+      size_t, unsigned char *, size_t);
+
+MGARD_INSTANTIATE_HUFFMAN(std::int16_t)
+MGARD_INSTANTIATE_HUFFMAN(std::int32_t)
+MGARD_INSTANTIATE_HUFFMAN(long int)
+
+#undef MGARD_INSTANTIATE_HUFFMAN
+
 } // namespace mgard
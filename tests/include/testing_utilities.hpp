@@ -7,11 +7,13 @@
 #include <ostream>
 #include <random>
 #include <string>
+#include <vector>
 
 #include "moab/Interface.hpp"
 static const double APPROX_MARGIN_DEFAULT = 0;
 
 #include "TensorMeshHierarchy.hpp"
+#include "testing_random.hpp"
 
 std::string mesh_path(const std::string &filename);
 
@@ -68,5 +70,26 @@ mgard::TensorMeshHierarchy<M, Real>
 make_flat_hierarchy(const mgard::TensorMeshHierarchy<N, Real> &hierarchy,
                     const std::array<std::size_t, M> shape);
 
+//! Check that applying a constituent operator to batches of 'spears' agrees
+//! with applying it to the 'spears' one at a time.
+//!
+//!\param hierarchy Mesh hierarchy on which the operators are defined.
+//!\param u Element to which the operators are applied.
+//!\param l_min Index of the coarsest mesh on which to construct the operators.
+template <typename Operator, std::size_t N, typename Real>
+void test_batched_application(
+    const mgard::TensorMeshHierarchy<N, Real> &hierarchy,
+    const std::vector<Real> &u, const std::size_t l_min = 0);
+
+//! Check that applying a constituent operator to batches of 'spears' agrees
+//! with applying it to the 'spears' one at a time, on a 2D mesh hierarchy with
+//! random node spacing and on a 3D mesh hierarchy with uniform node spacing.
+//!
+//!\param generator Generator to use in generating the meshes and inputs.
+//!\param l_min Index of the coarsest mesh on which to construct the operators.
+template <template <std::size_t, typename> class Operator>
+void test_batched_application(std::default_random_engine &generator,
+                              const std::size_t l_min = 0);
+
 #include "testing_utilities.tpp"
 #endif
@@ -3,6 +3,7 @@
 
 #include <cassert>
 
+#include <algorithm>
 #include <stdexcept>
 
 template <typename T, typename U, typename SizeType>
@@ -58,3 +59,71 @@ make_flat_hierarchy(const mgard::TensorMeshHierarchy<N, Real> &hierarchy,
   }
   return mgard::TensorMeshHierarchy<M, Real>(shape, coordinates);
 }
+
+template <typename Operator, std::size_t N, typename Real>
+void test_batched_application(
+    const mgard::TensorMeshHierarchy<N, Real> &hierarchy,
+    const std::vector<Real> &u, const std::size_t l_min) {
+  TrialTracker tracker;
+  for (std::size_t l = l_min; l <= hierarchy.L; ++l) {
+    for (std::size_t dimension = 0; dimension < N; ++dimension) {
+      if (hierarchy.shapes.at(l).at(dimension) < 2) {
+        continue;
+      }
+      const Operator A(hierarchy, l, dimension);
+      std::array<mgard::TensorIndexRange, N> multiindex_components;
+      for (std::size_t i = 0; i < N; ++i) {
+        multiindex_components.at(i) = i == dimension
+                                          ? mgard::TensorIndexRange::singleton()
+                                          : hierarchy.indices(l, i);
+      }
+      const mgard::CartesianProduct<mgard::TensorIndexRange, N> product(
+          multiindex_components);
+      const std::vector<std::array<std::size_t, N>> multiindices(
+          product.begin(), product.end());
+      const std::size_t M = multiindices.size();
+
+      std::vector<Real> expected = u;
+      for (const std::array<std::size_t, N> &multiindex : multiindices) {
+        A(multiindex, expected.data());
+      }
+
+      // Try a few batch sizes, including ones that don't divide the number of
+      // spears.
+      for (const std::size_t B : {static_cast<std::size_t>(1),
+                                  static_cast<std::size_t>(3), M}) {
+        std::vector<Real> obtained = u;
+        for (std::size_t first = 0; first < M; first += B) {
+          A(multiindices.data() + first, std::min(B, M - first),
+            obtained.data());
+        }
+        for (std::size_t i = 0; i < u.size(); ++i) {
+          tracker += obtained.at(i) == Catch::Approx(expected.at(i));
+        }
+      }
+    }
+  }
+  REQUIRE(tracker);
+}
+
+template <template <std::size_t, typename> class Operator>
+void test_batched_application(std::default_random_engine &generator,
+                              const std::size_t l_min) {
+  {
+    std::uniform_real_distribution<double> distribution(0.1, 0.3);
+    const mgard::TensorMeshHierarchy<2, double> hierarchy =
+        hierarchy_with_random_spacing<2, double>(generator, distribution,
+                                                 {11, 14});
+    std::vector<double> u(hierarchy.ndof());
+    std::uniform_real_distribution<double> values(-2, 2);
+    std::generate(u.begin(), u.end(), [&]() { return values(generator); });
+    test_batched_application<Operator<2, double>>(hierarchy, u, l_min);
+  }
+  {
+    const mgard::TensorMeshHierarchy<3, float> hierarchy({9, 7, 5});
+    std::vector<float> u(hierarchy.ndof());
+    std::uniform_real_distribution<float> values(-5, -3);
+    std::generate(u.begin(), u.end(), [&]() { return values(generator); });
+    test_batched_application<Operator<3, float>>(hierarchy, u, l_min);
+  }
+}
@@ -0,0 +1,160 @@
+#include "catch2/catch_approx.hpp"
+#include "catch2/catch_test_macros.hpp"
+
+#include <cstddef>
+
+#include <array>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "testing_random.hpp"
+#include "testing_utilities.hpp"
+
+#include "DecompositionPlan.hpp"
+#include "TensorMeshHierarchy.hpp"
+#include "TensorSpearLayout.hpp"
+#include "mgard.hpp"
+#include "shuffle.hpp"
+
+namespace {
+
+template <std::size_t N, typename Real>
+void test_plan_matches_free_functions(
+    std::default_random_engine &generator,
+    const std::array<std::size_t, N> shape) {
+  std::uniform_real_distribution<Real> distribution(0.1, 0.4);
+  const mgard::TensorMeshHierarchy<N, Real> hierarchy =
+      hierarchy_with_random_spacing(generator, distribution, shape);
+  const std::size_t ndof = hierarchy.ndof();
+  mgard::DecompositionPlan<N, Real> plan(hierarchy);
+
+  // Use the plan several times to check that the workspace is reset between
+  // uses.
+  for (std::size_t k = 0; k < 3; ++k) {
+    std::vector<Real> u_(ndof);
+    Real *const u = u_.data();
+    generate_reasonable_function(hierarchy, static_cast<Real>(1), generator,
+                                 u);
+    const std::vector<Real> original = u_;
+
+    std::vector<Real> expected_ = u_;
+    mgard::decompose(hierarchy, expected_.data());
+    plan.decompose(u);
+    REQUIRE(u_ == expected_);
+
+    mgard::recompose(hierarchy, expected_.data());
+    plan.recompose(u);
+    REQUIRE(u_ == expected_);
+
+    TrialTracker tracker;
+    for (std::size_t i = 0; i < ndof; ++i) {
+      tracker += u_.at(i) ==
+                 Catch::Approx(original.at(i)).epsilon(1e-3).margin(1e-3);
+    }
+    REQUIRE(tracker);
+  }
+}
+
+template <std::size_t N, typename Real>
+void test_unshuffled_plan(std::default_random_engine &generator,
+                          const std::array<std::size_t, N> shape) {
+  std::uniform_real_distribution<Real> distribution(0.1, 0.4);
+  const mgard::TensorMeshHierarchy<N, Real> hierarchy =
+      hierarchy_with_random_spacing(generator, distribution, shape);
+  const std::size_t ndof = hierarchy.ndof();
+  mgard::DecompositionPlan<N, Real> plan(hierarchy,
+                                         mgard::NodeOrdering::Unshuffled);
+
+  std::vector<Real> u_(ndof);
+  Real *const u = u_.data();
+  generate_reasonable_function(hierarchy, static_cast<Real>(1), generator, u);
+  const std::vector<Real> original = u_;
+
+  std::vector<Real> shuffled(ndof);
+  std::vector<Real> expected(ndof);
+  mgard::shuffle(hierarchy, u, shuffled.data());
+  mgard::decompose(hierarchy, shuffled.data());
+  mgard::unshuffle(hierarchy, shuffled.data(), expected.data());
+  plan.decompose(u);
+  {
+    TrialTracker tracker;
+    for (std::size_t i = 0; i < ndof; ++i) {
+      tracker += u_.at(i) == Catch::Approx(expected.at(i)).margin(1e-6);
+    }
+    REQUIRE(tracker);
+  }
+
+  plan.recompose(u);
+  {
+    TrialTracker tracker;
+    for (std::size_t i = 0; i < ndof; ++i) {
+      tracker += u_.at(i) ==
+                 Catch::Approx(original.at(i)).epsilon(1e-3).margin(1e-3);
+    }
+    REQUIRE(tracker);
+  }
+}
+
+template <std::size_t N, typename Real>
+void test_plan_with_coarsest_level(std::default_random_engine &generator,
+                                   const std::array<std::size_t, N> shape) {
+  std::uniform_real_distribution<Real> distribution(0.1, 0.4);
+  const mgard::TensorMeshHierarchy<N, Real> hierarchy =
+      hierarchy_with_random_spacing(generator, distribution, shape);
+  const std::size_t ndof = hierarchy.ndof();
+
+  std::vector<Real> original(ndof);
+  generate_reasonable_function(hierarchy, static_cast<Real>(1), generator,
+                               original.data());
+  std::vector<Real> expected = original;
+  mgard::decompose(hierarchy, expected.data());
+
+  TrialTracker tracker;
+  for (std::size_t l_target = 0; l_target <= hierarchy.L; ++l_target) {
+    mgard::DecompositionPlan<N, Real> plan(
+        hierarchy, mgard::NodeOrdering::Shuffled, l_target);
+    std::vector<Real> u = original;
+    plan.decompose(u.data());
+    // The coefficients of the levels finer than the `l_target`th are the
+    // usual ones.
+    for (std::size_t i = hierarchy.ndof(l_target); i < ndof; ++i) {
+      tracker += u.at(i) == Catch::Approx(expected.at(i)).margin(1e-6);
+    }
+    plan.recompose(u.data());
+    for (std::size_t i = 0; i < ndof; ++i) {
+      tracker += u.at(i) ==
+                 Catch::Approx(original.at(i)).epsilon(1e-3).margin(1e-3);
+    }
+  }
+  REQUIRE(tracker);
+  REQUIRE_THROWS_AS((mgard::DecompositionPlan<N, Real>(
+                        hierarchy, mgard::NodeOrdering::Shuffled,
+                        hierarchy.L + 1)),
+                    std::out_of_range);
+}
+
+} // namespace
+
+TEST_CASE("decomposition plan with a coarsest level", "[mgard]") {
+  std::default_random_engine generator(720);
+  test_plan_with_coarsest_level<1, float>(generator, {23});
+  test_plan_with_coarsest_level<2, double>(generator, {33, 17});
+  test_plan_with_coarsest_level<3, double>(generator, {9, 1, 17});
+}
+
+TEST_CASE("unshuffled decomposition plan", "[mgard]") {
+  std::default_random_engine generator(719);
+  test_unshuffled_plan<1, float>(generator, {23});
+  test_unshuffled_plan<2, double>(generator, {17, 10});
+  test_unshuffled_plan<3, float>(generator, {6, 1, 9});
+  test_unshuffled_plan<3, double>(generator, {5, 7, 4});
+}
+
+TEST_CASE("decomposition plan", "[mgard]") {
+  std::default_random_engine generator(718);
+  test_plan_matches_free_functions<1, float>(generator, {23});
+  test_plan_matches_free_functions<2, double>(generator, {17, 10});
+  test_plan_matches_free_functions<3, float>(generator, {6, 1, 9});
+  test_plan_matches_free_functions<3, double>(generator, {5, 7, 4});
+}
@@ -0,0 +1,109 @@
+#include "catch2/catch_approx.hpp"
+#include "catch2/catch_test_macros.hpp"
+
+#include <cstddef>
+
+#include <array>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "testing_random.hpp"
+#include "testing_utilities.hpp"
+
+#include "RegionRecompositionPlan.hpp"
+#include "TensorMeshHierarchy.hpp"
+#include "mgard.hpp"
+#include "shuffle.hpp"
+
+namespace {
+
+template <std::size_t N, typename Real>
+void test_region_matches_full_recomposition(
+    std::default_random_engine &generator,
+    const std::array<std::size_t, N> shape,
+    const std::array<std::size_t, N> lower,
+    const std::array<std::size_t, N> upper) {
+  std::uniform_real_distribution<Real> distribution(0.1, 0.4);
+  const mgard::TensorMeshHierarchy<N, Real> hierarchy =
+      hierarchy_with_random_spacing(generator, distribution, shape);
+  const std::size_t ndof = hierarchy.ndof();
+
+  std::vector<Real> u(ndof);
+  generate_reasonable_function(hierarchy, static_cast<Real>(1), generator,
+                               u.data());
+  std::vector<Real> coefficients = u;
+  mgard::decompose(hierarchy, coefficients.data());
+  std::vector<Real> expected(ndof);
+  mgard::unshuffle(hierarchy, u.data(), expected.data());
+
+  const mgard::RegionRecompositionPlan<N, Real> plan(hierarchy, lower, upper);
+  std::vector<Real> obtained(plan.ndof());
+  TrialTracker tracker;
+  plan.recompose(
+      [&](const std::size_t l, Real *const w) {
+        plan.for_each_new_node(
+            l, [&](const std::array<std::size_t, N> &multiindex,
+                   const std::size_t k) {
+              tracker += hierarchy.date_of_birth(multiindex) == l;
+              w[k] = hierarchy.at(coefficients.data(), multiindex);
+            });
+      },
+      obtained.data());
+
+  std::array<std::size_t, N> multiindex = lower;
+  for (std::size_t k = 0; k < plan.ndof(); ++k) {
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < N; ++i) {
+      offset = offset * shape.at(i) + multiindex.at(i);
+    }
+    tracker +=
+        obtained.at(k) == Catch::Approx(expected.at(offset)).margin(1e-5);
+    for (std::size_t j = 0; j < N; ++j) {
+      const std::size_t i = N - 1 - j;
+      if (++multiindex.at(i) <= upper.at(i)) {
+        break;
+      }
+      multiindex.at(i) = lower.at(i);
+    }
+  }
+  REQUIRE(tracker);
+}
+
+} // namespace
+
+TEST_CASE("region recomposition plan", "[mgard]") {
+  std::default_random_engine generator(2741);
+  test_region_matches_full_recomposition<1, double>(generator, {1000}, {400},
+                                                    {420});
+  test_region_matches_full_recomposition<1, float>(generator, {23}, {0}, {22});
+  test_region_matches_full_recomposition<2, double>(generator, {300, 260},
+                                                    {140, 100}, {150, 130});
+  test_region_matches_full_recomposition<2, float>(generator, {17, 10}, {3, 9},
+                                                   {16, 9});
+  test_region_matches_full_recomposition<3, double>(generator, {65, 1, 70},
+                                                    {10, 0, 20}, {30, 0, 25});
+  test_region_matches_full_recomposition<3, double>(generator, {5, 7, 4},
+                                                    {1, 1, 1}, {3, 5, 2});
+}
+
+TEST_CASE("region recomposition plan windows", "[mgard]") {
+  const mgard::TensorMeshHierarchy<2, float> hierarchy({1025, 3});
+  {
+    const mgard::RegionRecompositionPlan<2, float> plan(hierarchy, {500, 0},
+                                                        {505, 2});
+    REQUIRE(plan.ndof() == 18);
+    // The window is widened to coarse nodes (from 500 to 506) and then
+    // extended by `region_halo` coarse nodes on each side.
+    REQUIRE(plan.ndof(hierarchy.L) == (7 + 4 * mgard::region_halo) * 3);
+    for (std::size_t l = 0; l <= hierarchy.L; ++l) {
+      REQUIRE(plan.ndof(l) <= hierarchy.ndof(l));
+    }
+  }
+  REQUIRE_THROWS_AS((mgard::RegionRecompositionPlan<2, float>(
+                        hierarchy, {0, 0}, {1025, 1})),
+                    std::out_of_range);
+  REQUIRE_THROWS_AS(
+      (mgard::RegionRecompositionPlan<2, float>(hierarchy, {3, 0}, {2, 1})),
+      std::invalid_argument);
+}
@@ -234,6 +234,22 @@ TEST_CASE("tensor products of simple constituent operators",
   }
 }
 
+TEST_CASE("tensor product linear operator construction checks",
+          "[TensorLinearOperator]") {
+  const mgard::TensorMeshHierarchy<2, float> hierarchy({5, 5});
+  const std::size_t l = 1;
+  const DiagonalOperator A(hierarchy, l, 0, {1, 2, 3});
+  const DiagonalOperator B(hierarchy, l, 1, {1, 2, 3});
+  const DiagonalOperator C(hierarchy, l - 1, 1, {1, 2});
+  REQUIRE_NOTHROW(
+      mgard::TensorLinearOperator<2, float>(hierarchy, l, {&A, &B}));
+  // Missing operator.
+  REQUIRE_THROWS(
+      mgard::TensorLinearOperator<2, float>(hierarchy, l, {&A, nullptr}));
+  // Operator of the wrong size.
+  REQUIRE_THROWS(mgard::TensorLinearOperator<2, float>(hierarchy, l, {&A, &C}));
+}
+
 TEST_CASE("tensor product linear operators on 'flat' meshes",
           "[TensorLinearOperator]") {
   const std::vector<float> A_diagonal = {2, 2, 3, 5};
@@ -424,6 +424,12 @@ void test_mass_matrix_inversion(
 
 } // namespace
 
+TEST_CASE("batched constituent mass matrices", "[TensorMassMatrix]") {
+  std::default_random_engine generator(176);
+  test_batched_application<mgard::ConstituentMassMatrix>(generator);
+  test_batched_application<mgard::ConstituentMassMatrixInverse>(generator);
+}
+
 TEST_CASE("tensor product mass matrix inverses", "[TensorMassMatrix]") {
   std::default_random_engine generator(741495);
   std::array<float, 1089> u_;
@@ -462,3 +462,38 @@ TEST_CASE("dates of birth", "[TensorMeshHierarchy]") {
     REQUIRE(tracker);
   }
 }
+
+TEST_CASE("uniform spacing detection", "[TensorMeshHierarchy]") {
+  {
+    const mgard::TensorMeshHierarchy<1, float> hierarchy({17});
+    TrialTracker tracker;
+    for (std::size_t l = 0; l <= hierarchy.L; ++l) {
+      tracker += hierarchy.uniform_spacings.at(l).at(0) ==
+                 Catch::Approx(1.0f / (1 << l));
+    }
+    REQUIRE(tracker);
+  }
+
+  {
+    const mgard::TensorMeshHierarchy<2, double> hierarchy({6, 3});
+    REQUIRE(hierarchy.L == 2);
+    // The finest mesh is uniform in the first dimension, but its subsets are
+    // not.
+    REQUIRE(hierarchy.uniform_spacings.at(2).at(0) == Catch::Approx(0.2));
+    REQUIRE(hierarchy.uniform_spacings.at(1).at(0) == 0);
+    REQUIRE(hierarchy.uniform_spacings.at(0).at(0) == 0);
+    REQUIRE(hierarchy.uniform_spacings.at(2).at(1) == Catch::Approx(0.5));
+    REQUIRE(hierarchy.uniform_spacings.at(1).at(1) == Catch::Approx(0.5));
+    REQUIRE(hierarchy.uniform_spacings.at(0).at(1) == Catch::Approx(1));
+  }
+
+  {
+    const std::vector<double> xs = {0, 1, 3};
+    const std::vector<double> ys = {-1};
+    const mgard::TensorMeshHierarchy<2, double> hierarchy({3, 1}, {xs, ys});
+    REQUIRE(hierarchy.uniform_spacings.at(1).at(0) == 0);
+    REQUIRE(hierarchy.uniform_spacings.at(0).at(0) == Catch::Approx(3));
+    // Flat dimensions have no spacing.
+    REQUIRE(hierarchy.uniform_spacings.at(1).at(1) == 0);
+  }
+}
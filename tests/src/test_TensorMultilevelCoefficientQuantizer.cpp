@@ -1,15 +1,23 @@
+#include "catch2/catch_approx.hpp"
 #include "catch2/catch_test_macros.hpp"
 
 #include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include <numeric>
+#include <stdexcept>
+#include <vector>
 
 #include "blas.hpp"
 
 #include "TensorMeshHierarchy.hpp"
+#include "TensorMeshHierarchyIteration.hpp"
 #include "TensorMultilevelCoefficientQuantizer.hpp"
 #include "TensorNorms.hpp"
 #include "mgard.hpp"
+#include "shuffle.hpp"
 
 #include "testing_random.hpp"
 #include "testing_utilities.hpp"
@@ -200,3 +208,222 @@ TEST_CASE("tensor multilevel coefficient (de)quantization error",
     }
   }
 }
+
+namespace {
+
+// Quantum computed directly from the neighbors of a node in the mesh which
+// introduced it.
+template <std::size_t N, typename Real>
+Real expected_quantum(const mgard::TensorMeshHierarchy<N, Real> &hierarchy,
+                      const Real s, const Real tolerance,
+                      const mgard::TensorNode<N> node) {
+  std::size_t d = 0;
+  Real volume_factor = 1;
+  const std::array<std::size_t, N> &SHAPE = hierarchy.shapes.back();
+  for (std::size_t i = 0; i < N; ++i) {
+    if (SHAPE.at(i) > 1) {
+      ++d;
+      const std::vector<Real> &coordinates = hierarchy.coordinates.at(i);
+      volume_factor *= (coordinates.at(node.successor(i).multiindex.at(i)) -
+                        coordinates.at(node.predecessor(i).multiindex.at(i))) /
+                       2;
+    }
+  }
+  if (s == std::numeric_limits<Real>::infinity()) {
+    return (2 * tolerance) / ((hierarchy.L + 1) * (1 + std::pow(3, d)));
+  }
+  const std::size_t l = hierarchy.date_of_birth(node.multiindex);
+  return (2 * tolerance) /
+         (std::exp2(s * l) * std::sqrt(hierarchy.ndof() * volume_factor));
+}
+
+template <std::size_t N, typename Real, typename Int>
+void test_mc_bulk_quantization(const std::array<std::size_t, N> shape,
+                               const Real s, const Real tolerance,
+                               std::default_random_engine &generator) {
+  std::uniform_real_distribution<Real> nodal_spacing_distribution(1, 1.5);
+  const mgard::TensorMeshHierarchy<N, Real> hierarchy =
+      hierarchy_with_random_spacing(generator, nodal_spacing_distribution,
+                                    shape);
+  const std::size_t ndof = hierarchy.ndof();
+
+  const mgard::TensorMultilevelCoefficientQuantizer<N, Real, Int> quantizer(
+      hierarchy, s, tolerance);
+  const mgard::TensorMultilevelCoefficientDequantizer<N, Int, Real> dequantizer(
+      hierarchy, s, tolerance);
+
+  {
+    TrialTracker tracker;
+    for (const mgard::TensorNode<N> node :
+         mgard::ShuffledTensorNodeRange<N, Real>(hierarchy, hierarchy.L)) {
+      // The quanta are computed in a different order than here.
+      tracker += dequantizer(node, 1) ==
+                 Catch::Approx(expected_quantum(hierarchy, s, tolerance, node))
+                     .epsilon(4 * std::numeric_limits<Real>::epsilon());
+    }
+    REQUIRE(tracker);
+  }
+
+  std::vector<Real> u_shuffled(ndof);
+  std::uniform_real_distribution<Real> coefficient_distribution(-10, 10);
+  std::generate(u_shuffled.begin(), u_shuffled.end(),
+                [&]() -> Real { return coefficient_distribution(generator); });
+  std::vector<Real> u_unshuffled(ndof);
+  mgard::unshuffle(hierarchy, u_shuffled.data(), u_unshuffled.data());
+
+  using Qntzr = mgard::TensorMultilevelCoefficientQuantizer<N, Real, Int>;
+  const mgard::RangeSlice<typename Qntzr::iterator> quantized_range =
+      quantizer(u_shuffled.data());
+  const std::vector<Int> expected_quantized(quantized_range.begin(),
+                                            quantized_range.end());
+
+  std::vector<Int> quantized(ndof);
+  quantizer.quantize(u_shuffled.data(), quantized.data());
+  REQUIRE(quantized == expected_quantized);
+  std::fill(quantized.begin(), quantized.end(), 0);
+  quantizer.quantize(u_unshuffled.data(), quantized.data(),
+                     mgard::NodeOrdering::Unshuffled);
+  REQUIRE(quantized == expected_quantized);
+
+  using Dqntzr = mgard::TensorMultilevelCoefficientDequantizer<N, Int, Real>;
+  using It = typename Dqntzr::template iterator<
+      typename std::vector<Int>::const_iterator>;
+  const mgard::RangeSlice<It> dequantized_range =
+      dequantizer(expected_quantized.begin(), expected_quantized.end());
+  const std::vector<Real> expected_shuffled(dequantized_range.begin(),
+                                            dequantized_range.end());
+  std::vector<Real> expected_unshuffled(ndof);
+  mgard::unshuffle(hierarchy, expected_shuffled.data(),
+                   expected_unshuffled.data());
+
+  std::vector<Real> dequantized(ndof);
+  dequantizer.dequantize(expected_quantized.data(), dequantized.data());
+  REQUIRE(dequantized == expected_shuffled);
+  std::fill(dequantized.begin(), dequantized.end(), 0);
+  dequantizer.dequantize(expected_quantized.data(), dequantized.data(),
+                         mgard::NodeOrdering::Unshuffled);
+  REQUIRE(dequantized == expected_unshuffled);
+}
+
+} // namespace
+
+TEST_CASE("tensor multilevel coefficient bulk (de)quantization",
+          "[TensorMultilevelCoefficientQuantizer]") {
+  std::default_random_engine generator(382);
+  const std::vector<double> smoothness_parameters = {
+      std::numeric_limits<double>::infinity(), -1.5, 0, 1};
+  for (const double s : smoothness_parameters) {
+    test_mc_bulk_quantization<1, double, long int>({37}, s, 0.1, generator);
+    test_mc_bulk_quantization<2, double, long int>({17, 12}, s, 0.01,
+                                                   generator);
+    test_mc_bulk_quantization<2, double, int>({1, 22}, s, 0.5, generator);
+    test_mc_bulk_quantization<3, double, long int>({9, 6, 11}, s, 0.05,
+                                                   generator);
+    test_mc_bulk_quantization<3, double, long int>({7, 1, 10}, s, 0.05,
+                                                   generator);
+  }
+  test_mc_bulk_quantization<3, float, int>({10, 9, 8}, 0.5, 0.01, generator);
+  test_mc_bulk_quantization<4, float, long int>({5, 4, 3, 6}, 0, 0.25,
+                                                generator);
+  // Rows long enough to be split into several runs.
+  test_mc_bulk_quantization<1, float, int>({5003}, 1, 0.1, generator);
+  test_mc_bulk_quantization<2, double, long int>({3, 4500}, -0.5, 0.1,
+                                                 generator);
+
+  SECTION("coefficients too large to be quantized") {
+    const mgard::TensorMeshHierarchy<2, float> hierarchy({9, 3000});
+    const std::size_t ndof = hierarchy.ndof();
+    const mgard::TensorMultilevelCoefficientQuantizer<2, float, short>
+        quantizer(hierarchy, 0, 0.01);
+    std::vector<float> u(ndof, 0.25);
+    std::vector<short> quantized(ndof);
+    REQUIRE_NOTHROW(quantizer.quantize(u.data(), quantized.data()));
+    u.at(ndof - 2) = 1e9;
+    REQUIRE_THROWS_AS(quantizer.quantize(u.data(), quantized.data()),
+                      std::domain_error);
+  }
+}
+
+TEST_CASE("tensor multilevel coefficient compact (de)quantization",
+          "[TensorMultilevelCoefficientQuantizer]") {
+  const mgard::TensorMeshHierarchy<2, double> hierarchy({17, 130});
+  const std::size_t ndof = hierarchy.ndof();
+  const double s = 0.5;
+  const double tolerance = 0.01;
+  const mgard::TensorMultilevelCoefficientQuantizer<2, double, long int>
+      quantizer(hierarchy, s, tolerance);
+  const mgard::TensorMultilevelCoefficientDequantizer<2, long int, double>
+      dequantizer(hierarchy, s, tolerance);
+
+  std::vector<double> u(ndof);
+  std::default_random_engine generator(704);
+  std::uniform_real_distribution<double> distribution(-1, 1);
+  std::generate(u.begin(), u.end(),
+                [&]() -> double { return distribution(generator); });
+  for (std::size_t i = 3; i < ndof; i += 41) {
+    u.at(i) *= 1e4;
+  }
+
+  std::vector<long int> expected_quantized(ndof);
+  quantizer.quantize(u.data(), expected_quantized.data(),
+                     mgard::NodeOrdering::Unshuffled);
+  std::vector<double> expected(ndof);
+  dequantizer.dequantize(expected_quantized.data(), expected.data(),
+                         mgard::NodeOrdering::Unshuffled);
+
+  std::vector<std::int8_t> quantized(ndof);
+  mgard::QuantizedOutliers<long int> outliers;
+  quantizer.quantize(u.data(), quantized.data(), outliers,
+                     mgard::NodeOrdering::Unshuffled);
+  REQUIRE(!outliers.indices.empty());
+  REQUIRE(outliers.indices.size() == outliers.values.size());
+  REQUIRE(std::is_sorted(outliers.indices.begin(), outliers.indices.end()));
+  {
+    TrialTracker tracker;
+    std::size_t j = 0;
+    for (std::size_t i = 0; i < ndof; ++i) {
+      const long int n = expected_quantized.at(i);
+      if (n > std::numeric_limits<std::int8_t>::min() &&
+          n <= std::numeric_limits<std::int8_t>::max()) {
+        tracker += quantized.at(i) == n;
+      } else {
+        tracker += quantized.at(i) == std::numeric_limits<std::int8_t>::min();
+        tracker += outliers.indices.at(j) == i;
+        tracker += outliers.values.at(j) == n;
+        ++j;
+      }
+    }
+    tracker += j == outliers.indices.size();
+    REQUIRE(tracker);
+  }
+
+  std::vector<double> obtained(ndof);
+  dequantizer.dequantize(quantized.data(), outliers, obtained.data(),
+                         mgard::NodeOrdering::Unshuffled);
+  REQUIRE(obtained == expected);
+
+  REQUIRE(quantizer.count_outliers<std::int8_t>(
+              u.data(), mgard::NodeOrdering::Unshuffled) ==
+          outliers.indices.size());
+
+  {
+    // Quantize in chunks which don't line up with the rows or levels.
+    std::vector<std::int8_t> chunked(ndof);
+    mgard::QuantizedOutliers<long int> chunked_outliers;
+    const std::size_t chunk_size = 301;
+    for (std::size_t begin = 0; begin < ndof; begin += chunk_size) {
+      const std::size_t end = std::min(begin + chunk_size, ndof);
+      quantizer.quantize(u.data(), begin, end, chunked.data() + begin,
+                         chunked_outliers, mgard::NodeOrdering::Unshuffled);
+    }
+    REQUIRE(chunked == quantized);
+    REQUIRE(chunked_outliers.indices == outliers.indices);
+    REQUIRE(chunked_outliers.values == outliers.values);
+  }
+
+  std::vector<long int> wide(ndof);
+  mgard::QuantizedOutliers<long int> no_outliers;
+  quantizer.quantize(u.data(), wide.data(), no_outliers);
+  REQUIRE(no_outliers.indices.empty());
+  REQUIRE(quantizer.count_outliers<long int>(u.data()) == 0);
+}
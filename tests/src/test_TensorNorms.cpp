@@ -138,6 +138,9 @@ TEST_CASE("comparison with Python implementation: tensor norms", "[norms]") {
   // Small error encountered here.
   REQUIRE(mgard::norm(hierarchy, u, 1.5f) ==
           Catch::Approx(1.5198059864642621).epsilon(0.001));
+  // With no components split off, the function is weighted as a whole.
+  REQUIRE(mgard::norm(hierarchy, u, 1.0f, hierarchy.L) ==
+          Catch::Approx(std::exp2(hierarchy.L) * 1.1242926017063057));
 }
 
 namespace {
@@ -0,0 +1,143 @@
+#include "catch2/catch_approx.hpp"
+#include "catch2/catch_test_macros.hpp"
+
+#include <cstddef>
+
+#include <array>
+#include <random>
+#include <vector>
+
+#include "testing_random.hpp"
+#include "testing_utilities.hpp"
+
+#include "TensorMassMatrix.hpp"
+#include "TensorMeshHierarchy.hpp"
+#include "TensorMeshHierarchyIteration.hpp"
+#include "TensorProjection.hpp"
+#include "TensorRestriction.hpp"
+#include "TensorSpearLayout.hpp"
+#include "shuffle.hpp"
+
+namespace {
+
+template <std::size_t N, typename Real>
+void test_projection_matches_composition(
+    std::default_random_engine &generator,
+    const mgard::TensorMeshHierarchy<N, Real> &hierarchy) {
+  const std::size_t ndof = hierarchy.ndof();
+  std::uniform_real_distribution<Real> distribution(-1, 1);
+  std::vector<Real> u_(ndof);
+  std::vector<Real> expected_(ndof);
+  std::vector<Real> obtained_(ndof);
+  std::vector<Real> natural_(ndof);
+  std::vector<Real> buffer_(ndof);
+  Real *const u = u_.data();
+  Real *const expected = expected_.data();
+  Real *const obtained = obtained_.data();
+  Real *const natural = natural_.data();
+  Real *const buffer = buffer_.data();
+
+  for (std::size_t l = 1; l <= hierarchy.L; ++l) {
+    for (Real &value : u_) {
+      value = distribution(generator);
+    }
+    const std::size_t old_ndof = hierarchy.ndof(l - 1);
+    const std::size_t fine_ndof = hierarchy.ndof(l);
+
+    const mgard::TensorMassMatrix<N, Real> M(hierarchy, l);
+    const mgard::TensorRestriction<N, Real> R(hierarchy, l);
+    const mgard::TensorMassMatrixInverse<N, Real> m_inv(hierarchy, l - 1);
+    const mgard::TensorProjection<N, Real> P(hierarchy, l);
+
+    // In place.
+    expected_ = u_;
+    M(expected);
+    R(expected);
+    m_inv(expected);
+    obtained_ = u_;
+    P(obtained);
+    {
+      TrialTracker tracker;
+      for (std::size_t i = 0; i < old_ndof; ++i) {
+        tracker += obtained_.at(i) ==
+                   Catch::Approx(expected_.at(i)).epsilon(1e-4).margin(1e-5);
+      }
+      REQUIRE(tracker);
+    }
+
+    // From the new nodes only. The values at the old nodes must be ignored.
+    expected_ = u_;
+    std::fill(expected, expected + old_ndof, 0);
+    M(expected);
+    R(expected);
+    m_inv(expected);
+    P(u, obtained);
+    {
+      TrialTracker tracker;
+      for (std::size_t i = 0; i < old_ndof; ++i) {
+        tracker += obtained_.at(i) ==
+                   Catch::Approx(expected_.at(i)).epsilon(1e-4).margin(1e-5);
+      }
+      REQUIRE(tracker);
+    }
+
+    // From the new nodes of an unshuffled array.
+    const mgard::TensorProjection<N, Real> P_natural(
+        hierarchy, l, mgard::NodeOrdering::Unshuffled);
+    std::fill(u + fine_ndof, u + ndof, 0);
+    mgard::unshuffle(hierarchy, u, natural);
+    std::fill(buffer, buffer + ndof, 0);
+    P_natural(natural, buffer);
+    mgard::shuffle(hierarchy, buffer, obtained);
+    {
+      TrialTracker tracker;
+      for (std::size_t i = 0; i < old_ndof; ++i) {
+        tracker += obtained_.at(i) ==
+                   Catch::Approx(expected_.at(i)).epsilon(1e-4).margin(1e-5);
+      }
+      REQUIRE(tracker);
+    }
+  }
+}
+
+template <std::size_t N, typename Real>
+void test_projection_matches_composition(
+    std::default_random_engine &generator,
+    const std::array<std::size_t, N> shape) {
+  std::uniform_real_distribution<Real> spacing_distribution(0.1, 0.4);
+  test_projection_matches_composition(
+      generator,
+      hierarchy_with_random_spacing(generator, spacing_distribution, shape));
+}
+
+} // namespace
+
+TEST_CASE("tensor product projections", "[TensorProjection]") {
+  std::default_random_engine generator(90125);
+
+  SECTION("dyadic") {
+    test_projection_matches_composition<1, double>(generator, {33});
+    test_projection_matches_composition<2, float>(generator, {17, 9});
+    test_projection_matches_composition<3, double>(generator, {9, 5, 17});
+  }
+
+  SECTION("nondyadic") {
+    test_projection_matches_composition<1, float>(generator, {23});
+    test_projection_matches_composition<2, double>(generator, {12, 19});
+    test_projection_matches_composition<3, float>(generator, {7, 10, 6});
+  }
+
+  SECTION("uniform spacing") {
+    test_projection_matches_composition(
+        generator, mgard::TensorMeshHierarchy<1, float>({33}));
+    test_projection_matches_composition(
+        generator, mgard::TensorMeshHierarchy<2, double>({17, 12}));
+    test_projection_matches_composition(
+        generator, mgard::TensorMeshHierarchy<3, double>({9, 5, 7}));
+  }
+
+  SECTION("flat dimensions") {
+    test_projection_matches_composition<2, double>(generator, {1, 21});
+    test_projection_matches_composition<4, float>(generator, {6, 1, 9, 1});
+  }
+}
@@ -1,8 +1,11 @@
 #include "catch2/catch_approx.hpp"
 #include "catch2/catch_test_macros.hpp"
 
+#include <algorithm>
 #include <array>
 #include <numeric>
+#include <random>
+#include <vector>
 
 #include "testing_random.hpp"
 #include "testing_utilities.hpp"
@@ -196,6 +199,12 @@ void test_tensor_product_prolongations(std::default_random_engine &generator,
 
 } // namespace
 
+TEST_CASE("batched constituent prolongations", "[TensorProlongation]") {
+  std::default_random_engine generator(3127);
+  test_batched_application<mgard::ConstituentProlongationAddition>(generator,
+                                                                   1);
+}
+
 TEST_CASE("tensor product prolongations", "[TensorProlongation]") {
   std::default_random_engine generator(176067);
 
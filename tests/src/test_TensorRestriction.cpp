@@ -1,8 +1,11 @@
 #include "catch2/catch_approx.hpp"
 #include "catch2/catch_test_macros.hpp"
 
+#include <algorithm>
 #include <array>
 #include <numeric>
+#include <random>
+#include <vector>
 
 #include "testing_random.hpp"
 #include "testing_utilities.hpp"
@@ -197,6 +200,11 @@ void test_tensor_projection_identity(std::default_random_engine &generator,
 
 } // namespace
 
+TEST_CASE("batched constituent restrictions", "[TensorRestriction]") {
+  std::default_random_engine generator(826);
+  test_batched_application<mgard::ConstituentRestriction>(generator, 1);
+}
+
 TEST_CASE("tensor product restrictions", "[TensorRestriction]") {
   {
     const mgard::TensorMeshHierarchy<2, double> hierarchy(
@@ -0,0 +1,150 @@
+#include "catch2/catch_test_macros.hpp"
+
+#include <cstddef>
+
+#include <array>
+#include <vector>
+
+#include "testing_utilities.hpp"
+
+#include "TensorMeshHierarchy.hpp"
+#include "TensorMeshHierarchyIteration.hpp"
+#include "TensorSpearLayout.hpp"
+
+namespace {
+
+template <std::size_t N>
+void test_spear_layout_offsets(const std::array<std::size_t, N> shape) {
+  const mgard::TensorMeshHierarchy<N, float> hierarchy(shape);
+  std::vector<float> u(hierarchy.ndof());
+  float *const v = u.data();
+  TrialTracker tracker;
+  for (std::size_t l = 0; l <= hierarchy.L; ++l) {
+    for (std::size_t i = 0; i < N; ++i) {
+      const mgard::TensorSpearLayout<N, float> layout(hierarchy, l, i);
+      REQUIRE(layout.size() == hierarchy.shapes.at(l).at(i));
+      std::vector<std::array<std::size_t, N>> multiindices;
+      for (const mgard::TensorNode<N> node :
+           mgard::UnshuffledTensorNodeRange(hierarchy, l)) {
+        const std::array<std::size_t, N> &multiindex = node.multiindex;
+        tracker +=
+            v + layout.offset(multiindex) == &hierarchy.at(v, multiindex);
+        // Only check the spears starting at this node.
+        if (multiindex.at(i)) {
+          continue;
+        }
+        const typename mgard::TensorSpearLayout<N, float>::Spear spear =
+            layout.spear(multiindex);
+        std::array<std::size_t, N> alpha = multiindex;
+        for (std::size_t j = 0; j < layout.size(); ++j) {
+          alpha.at(i) = layout.indices.at(j);
+          tracker += v + spear[j] == &hierarchy.at(v, alpha);
+        }
+        multiindices.push_back(multiindex);
+      }
+      const std::size_t n = layout.size();
+      const std::size_t m = multiindices.size();
+      std::vector<std::size_t> offsets(n * m);
+      layout.interleaved_offsets(multiindices.data(), m, offsets.data());
+      for (std::size_t k = 0; k < m; ++k) {
+        const typename mgard::TensorSpearLayout<N, float>::Spear spear =
+            layout.spear(multiindices.at(k));
+        for (std::size_t j = 0; j < n; ++j) {
+          tracker += offsets.at(j * m + k) == spear[j];
+        }
+      }
+    }
+  }
+  REQUIRE(tracker);
+}
+
+template <std::size_t N>
+void test_unshuffled_spear_layout_offsets(
+    const std::array<std::size_t, N> shape) {
+  const mgard::TensorMeshHierarchy<N, float> hierarchy(shape);
+  TrialTracker tracker;
+  for (std::size_t l = 0; l <= hierarchy.L; ++l) {
+    for (std::size_t i = 0; i < N; ++i) {
+      const mgard::TensorSpearLayout<N, float> layout(
+          hierarchy, l, i, mgard::NodeOrdering::Unshuffled);
+      std::vector<std::array<std::size_t, N>> multiindices;
+      for (const mgard::TensorNode<N> node :
+           mgard::UnshuffledTensorNodeRange(hierarchy, l)) {
+        const std::array<std::size_t, N> &multiindex = node.multiindex;
+        std::size_t expected = 0;
+        for (std::size_t k = 0; k < N; ++k) {
+          expected = expected * shape.at(k) + multiindex.at(k);
+        }
+        tracker += layout.offset(multiindex) == expected;
+        if (multiindex.at(i)) {
+          continue;
+        }
+        const typename mgard::TensorSpearLayout<N, float>::Spear spear =
+            layout.spear(multiindex);
+        std::array<std::size_t, N> alpha = multiindex;
+        for (std::size_t j = 0; j < layout.size(); ++j) {
+          alpha.at(i) = layout.indices.at(j);
+          tracker += spear[j] == layout.offset(alpha);
+        }
+        multiindices.push_back(multiindex);
+      }
+      const std::size_t n = layout.size();
+      const std::size_t m = multiindices.size();
+      std::vector<std::size_t> offsets(n * m);
+      layout.interleaved_offsets(multiindices.data(), m, offsets.data());
+      for (std::size_t k = 0; k < m; ++k) {
+        const typename mgard::TensorSpearLayout<N, float>::Spear spear =
+            layout.spear(multiindices.at(k));
+        for (std::size_t j = 0; j < n; ++j) {
+          tracker += offsets.at(j * m + k) == spear[j];
+        }
+      }
+    }
+  }
+  REQUIRE(tracker);
+}
+
+} // namespace
+
+TEST_CASE("unshuffled spear layout offsets", "[TensorSpearLayout]") {
+  test_unshuffled_spear_layout_offsets<1>({10});
+  test_unshuffled_spear_layout_offsets<2>({9, 5});
+  test_unshuffled_spear_layout_offsets<3>({7, 4, 11});
+  test_unshuffled_spear_layout_offsets<3>({6, 1, 9});
+}
+
+TEST_CASE("spear layout offsets", "[TensorSpearLayout]") {
+  SECTION("dyadic") {
+    test_spear_layout_offsets<1>({17});
+    test_spear_layout_offsets<2>({9, 5});
+    test_spear_layout_offsets<3>({5, 9, 3});
+  }
+
+  SECTION("nondyadic") {
+    test_spear_layout_offsets<1>({10});
+    test_spear_layout_offsets<2>({6, 13});
+    test_spear_layout_offsets<3>({7, 4, 11});
+  }
+
+  SECTION("flat dimensions") {
+    test_spear_layout_offsets<2>({1, 12});
+    test_spear_layout_offsets<3>({6, 1, 9});
+    test_spear_layout_offsets<4>({5, 1, 3, 1});
+  }
+}
+
+TEST_CASE("spear layout positions", "[TensorSpearLayout]") {
+  const mgard::TensorMeshHierarchy<2, double> hierarchy({11, 9});
+  {
+    const mgard::TensorSpearLayout<2, double> layout(hierarchy, 3, 0);
+    const std::vector<std::size_t> expected_indices = {0, 1, 2, 3, 5,
+                                                       6, 7, 8, 10};
+    REQUIRE(layout.indices == expected_indices);
+    const std::vector<std::size_t> expected_positions = {0, 2, 4, 6, 8};
+    REQUIRE(layout.positions(hierarchy.indices(2, 0)) == expected_positions);
+  }
+  {
+    const mgard::TensorSpearLayout<2, double> layout(hierarchy, 2, 0);
+    REQUIRE_THROWS(layout.positions(hierarchy.indices(3, 0)));
+  }
+}
@@ -1,22 +1,31 @@
+#include "catch2/catch_approx.hpp"
 #include "catch2/catch_template_test_macros.hpp"
 #include "catch2/catch_test_macros.hpp"
 
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 
 #include <algorithm>
+#include <array>
+#include <functional>
+#include <limits>
 #include <numeric>
 #include <random>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 
 #include "testing_random.hpp"
 #include "testing_utilities.hpp"
 
+#include "DecompositionPlan.hpp"
 #include "TensorMeshHierarchy.hpp"
 #include "TensorMeshHierarchyIteration.hpp"
 #include "TensorNorms.hpp"
 #include "blas.hpp"
+#include "mgard.hpp"
 #include "mgard_api.h"
 #include "shuffle.hpp"
 
@@ -103,13 +112,14 @@ namespace {
 template <std::size_t N, typename Real>
 void test_compression_error_bound(
     const mgard::TensorMeshHierarchy<N, Real> &hierarchy, Real *const v,
-    const Real s, const Real tolerance) {
+    const Real s, const Real tolerance,
+    const mgard::LosslessOptions &lossless = {}) {
   const std::size_t ndof = hierarchy.ndof();
   Real *const error = static_cast<Real *>(std::malloc(ndof * sizeof(*error)));
   blas::copy(ndof, v, error);
 
   const mgard::CompressedDataset<N, Real> compressed =
-      mgard::compress(hierarchy, v, s, tolerance);
+      mgard::compress(hierarchy, v, s, tolerance, 0, lossless);
   const mgard::DecompressedDataset<N, Real> decompressed =
       mgard::decompress(compressed);
 
@@ -199,6 +209,804 @@ TEST_CASE("2D cosine data", "[mgard_api]") {
   std::free(v);
 }
 
+TEST_CASE("data with large multilevel coefficients", "[mgard_api]") {
+  const mgard::TensorMeshHierarchy<2, double> hierarchy({65, 33});
+  const std::size_t ndof = hierarchy.ndof();
+  std::vector<double> v(ndof);
+  std::default_random_engine generator(1265);
+  std::uniform_real_distribution<double> distribution(-1, 1);
+  const double s = std::numeric_limits<double>::infinity();
+  const double tolerance = 0.001;
+
+  SECTION("a few quantized coefficients too large for 32-bit integers") {
+    std::generate(v.begin(), v.end(),
+                  [&]() -> double { return distribution(generator); });
+    for (std::size_t i = 0; i < ndof; i += 97) {
+      v.at(i) = 1e6 * distribution(generator);
+    }
+    test_compression_error_bound<2, double>(hierarchy, v.data(), s, tolerance);
+  }
+
+  SECTION("quantized coefficients too large for 16-bit integers") {
+    std::generate(v.begin(), v.end(),
+                  [&]() -> double { return 1e3 * distribution(generator); });
+    test_compression_error_bound<2, double>(hierarchy, v.data(), s, tolerance);
+  }
+
+  SECTION("quantized coefficients too large for 32-bit integers") {
+    std::generate(v.begin(), v.end(),
+                  [&]() -> double { return 1e8 * distribution(generator); });
+    test_compression_error_bound<2, double>(hierarchy, v.data(), s, tolerance);
+    // The Huffman pipelines store the out-of-range levels at full width.
+    std::vector<mgard::LosslessCompressor> compressors = {
+        mgard::LosslessCompressor::HuffmanZlib};
+#ifdef MGARD_ZSTD
+    compressors.push_back(mgard::LosslessCompressor::HuffmanZstd);
+#endif
+    for (const mgard::LosslessCompressor compressor : compressors) {
+      test_compression_error_bound<2, double>(hierarchy, v.data(), s,
+                                              tolerance, {compressor});
+    }
+  }
+}
+
+TEST_CASE("compressed dataset segments", "[mgard_api]") {
+  std::default_random_engine generator(528);
+  std::uniform_real_distribution<float> node_spacing_distribution(1, 1.5);
+  const mgard::TensorMeshHierarchy<3, float> hierarchy =
+      hierarchy_with_random_spacing(generator, node_spacing_distribution,
+                                    std::array<std::size_t, 3>{17, 12, 20});
+  const std::size_t ndof = hierarchy.ndof();
+  std::vector<float> u(ndof);
+  std::uniform_real_distribution<float> distribution(-5, 5);
+  std::generate(u.begin(), u.end(),
+                [&]() -> float { return distribution(generator); });
+
+  const mgard::CompressedDataset<3, float> compressed =
+      mgard::compress(hierarchy, u.data(), 0.5f, 0.01f);
+  const std::size_t header_size =
+      mgard::compressed_header_size(hierarchy, compressed.data());
+  REQUIRE(mgard::compressed_header_prefix_size < header_size);
+  REQUIRE(header_size < compressed.size());
+
+  TrialTracker tracker;
+  std::size_t previous = header_size;
+  for (std::size_t l = 0; l <= hierarchy.L; ++l) {
+    const std::size_t size =
+        mgard::compressed_size_through_level(hierarchy, compressed.data(), l);
+    tracker += previous < size;
+    previous = size;
+  }
+  REQUIRE(tracker);
+  REQUIRE(previous == compressed.size());
+  REQUIRE_THROWS(mgard::compressed_size_through_level(
+      hierarchy, compressed.data(), hierarchy.L + 1));
+
+  // Decompression fails cleanly if a segment is missing.
+  const std::size_t size = mgard::compressed_size_through_level(
+      hierarchy, compressed.data(), hierarchy.L - 1);
+  unsigned char *const truncated_data = new unsigned char[size];
+  std::memcpy(truncated_data, compressed.data(), size);
+  const mgard::CompressedDataset<3, float> truncated(
+      hierarchy, compressed.s, compressed.tolerance, truncated_data, size);
+  REQUIRE_THROWS_AS(mgard::decompress(truncated), std::invalid_argument);
+
+  SECTION("foreign and old buffers") {
+    unsigned char *const foreign_data = new unsigned char[compressed.size()];
+    std::memcpy(foreign_data, compressed.data(), compressed.size());
+    const mgard::CompressedDataset<3, float> foreign(
+        hierarchy, compressed.s, compressed.tolerance, foreign_data,
+        compressed.size());
+    // The dataset owns the buffer, which is modified in place.
+    unsigned char *const p = foreign_data;
+
+    // Tag.
+    ++p[0];
+    REQUIRE_THROWS_AS(mgard::decompress(foreign), std::invalid_argument);
+    REQUIRE_THROWS_AS(mgard::compressed_header_size(hierarchy, p),
+                      std::invalid_argument);
+    --p[0];
+    // Version.
+    ++p[4];
+    REQUIRE_THROWS_AS(mgard::decompress(foreign), std::invalid_argument);
+    REQUIRE_THROWS_AS(
+        mgard::compressed_size_through_level(hierarchy, p, hierarchy.L),
+        std::invalid_argument);
+    --p[4];
+    REQUIRE_NOTHROW(mgard::decompress(foreign));
+
+    // A header of `std::size_t`s, as written before the layout was tagged.
+    const std::size_t legacy[3] = {sizeof(std::int16_t), hierarchy.L + 1, 1};
+    std::memcpy(p, legacy, sizeof(legacy));
+    REQUIRE_THROWS_AS(mgard::decompress(foreign), std::invalid_argument);
+
+    // Datasets handed over as vectors are checked too.
+    using Dataset = mgard::CompressedDataset<3, float>;
+    std::vector<unsigned char> bytes(p, p + compressed.size());
+    REQUIRE_THROWS_AS(Dataset(hierarchy, compressed.s, compressed.tolerance,
+                              std::move(bytes)),
+                      std::invalid_argument);
+  }
+
+  SECTION("small datasets") {
+    // The header and index don't swamp a small dataset.
+    const mgard::TensorMeshHierarchy<1, float> small({65});
+    std::vector<float> v(65);
+    for (std::size_t i = 0; i < v.size(); ++i) {
+      v.at(i) = std::sin(0.1f * i);
+    }
+    const mgard::CompressedDataset<1, float> compressed_small =
+        mgard::compress(small, v.data(), 0.0f, 0.01f, 0,
+                        {mgard::LosslessCompressor::Zlib});
+    const std::size_t small_header_size =
+        mgard::compressed_header_size(small, compressed_small.data());
+    REQUIRE(small_header_size ==
+            mgard::compressed_header_prefix_size + (small.L + 1) * 3);
+    REQUIRE(compressed_small.size() <= 160);
+  }
+}
+
+TEST_CASE("decompression to coarse levels", "[mgard_api]") {
+  std::default_random_engine generator(13580);
+  std::uniform_real_distribution<double> node_spacing_distribution(0.5, 1);
+  const mgard::TensorMeshHierarchy<2, double> hierarchy =
+      hierarchy_with_random_spacing(generator, node_spacing_distribution,
+                                    std::array<std::size_t, 2>{19, 34});
+  const std::size_t ndof = hierarchy.ndof();
+  std::vector<double> u(ndof);
+  std::uniform_real_distribution<double> distribution(-2, 2);
+  std::generate(u.begin(), u.end(),
+                [&]() -> double { return distribution(generator); });
+
+  const mgard::CompressedDataset<2, double> compressed =
+      mgard::compress(hierarchy, u.data(), 0.0, 0.001);
+  const mgard::DecompressedDataset<2, double> decompressed =
+      mgard::decompress(compressed);
+
+  {
+    const mgard::DecompressedDataset<2, double> obtained =
+        mgard::decompress_to_level(compressed, hierarchy.L);
+    REQUIRE(obtained.hierarchy.shapes.back() == hierarchy.shapes.back());
+    REQUIRE(std::memcmp(obtained.data(), decompressed.data(),
+                        ndof * sizeof(double)) == 0);
+  }
+
+  // Multilevel coefficients of the decompressed function.
+  std::vector<double> coefficients(ndof);
+  mgard::shuffle(hierarchy, decompressed.data(), coefficients.data());
+  mgard::decompose(hierarchy, coefficients.data());
+
+  TrialTracker tracker;
+  for (std::size_t l = 0; l < hierarchy.L; ++l) {
+    const std::size_t size =
+        mgard::compressed_size_through_level(hierarchy, compressed.data(), l);
+    unsigned char *const truncated_data = new unsigned char[size];
+    std::memcpy(truncated_data, compressed.data(), size);
+    const mgard::CompressedDataset<2, double> truncated(
+        hierarchy, compressed.s, compressed.tolerance, truncated_data, size);
+    const mgard::DecompressedDataset<2, double> obtained =
+        mgard::decompress_to_level(truncated, l);
+
+    const mgard::TensorMeshHierarchy<2, double> &coarse = obtained.hierarchy;
+    REQUIRE(coarse.shapes.back() == hierarchy.shapes.at(l));
+    const std::size_t coarse_ndof = coarse.ndof();
+    REQUIRE(coarse_ndof == hierarchy.ndof(l));
+    for (std::size_t i = 0; i < 2; ++i) {
+      const std::vector<double> &xs = hierarchy.coordinates.at(i);
+      const std::vector<double> &ys = coarse.coordinates.at(i);
+      std::size_t j = 0;
+      for (const std::size_t index : hierarchy.indices(l, i)) {
+        tracker += ys.at(j++) == xs.at(index);
+      }
+    }
+
+    // The result should be the projection of the decompressed function onto
+    // the `l`th mesh, whose multilevel coefficients are those of the
+    // decompressed function on levels up through `l`.
+    std::vector<double> buffer(coefficients.begin(),
+                               coefficients.begin() + coarse_ndof);
+    mgard::recompose(coarse, buffer.data());
+    std::vector<double> expected(coarse_ndof);
+    mgard::unshuffle(coarse, buffer.data(), expected.data());
+    for (std::size_t i = 0; i < coarse_ndof; ++i) {
+      tracker +=
+          obtained.data()[i] == Catch::Approx(expected.at(i)).margin(1e-9);
+    }
+  }
+  REQUIRE(tracker);
+  REQUIRE_THROWS_AS(mgard::decompress_to_level(compressed, hierarchy.L + 1),
+                    std::out_of_range);
+}
+
+namespace {
+
+template <std::size_t N, typename Real>
+void test_region_decompression(
+    const mgard::CompressedDataset<N, Real> &compressed,
+    const mgard::DecompressedDataset<N, Real> &decompressed,
+    const std::array<std::size_t, N> &lower,
+    const std::array<std::size_t, N> &upper, TrialTracker &tracker) {
+  const mgard::TensorMeshHierarchy<N, Real> &hierarchy = compressed.hierarchy;
+  const std::array<std::size_t, N> &SHAPE = hierarchy.shapes.back();
+  const mgard::DecompressedDataset<N, Real> obtained =
+      mgard::decompress_region(compressed, lower, upper);
+  const mgard::TensorMeshHierarchy<N, Real> &region = obtained.hierarchy;
+
+  std::array<std::size_t, N> multiindex = lower;
+  for (std::size_t k = 0; k < region.ndof(); ++k) {
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < N; ++i) {
+      offset = offset * SHAPE.at(i) + multiindex.at(i);
+    }
+    tracker += obtained.data()[k] ==
+               Catch::Approx(decompressed.data()[offset]).margin(1e-10);
+    for (std::size_t j = 0; j < N; ++j) {
+      const std::size_t i = N - 1 - j;
+      if (++multiindex.at(i) <= upper.at(i)) {
+        break;
+      }
+      multiindex.at(i) = lower.at(i);
+    }
+  }
+  for (std::size_t i = 0; i < N; ++i) {
+    tracker += region.shapes.back().at(i) == upper.at(i) - lower.at(i) + 1;
+    tracker += region.coordinates.at(i).front() ==
+               hierarchy.coordinates.at(i).at(lower.at(i));
+  }
+}
+
+} // namespace
+
+TEST_CASE("decompression on regions", "[mgard_api]") {
+  std::default_random_engine generator(70113);
+  std::uniform_real_distribution<double> node_spacing_distribution(1, 2);
+  std::uniform_real_distribution<double> distribution(-3, 3);
+  TrialTracker tracker;
+  {
+    // Large enough that the windows are truncated on the finer levels.
+    const mgard::TensorMeshHierarchy<2, double> hierarchy =
+        hierarchy_with_random_spacing(generator, node_spacing_distribution,
+                                      std::array<std::size_t, 2>{290, 201});
+    std::vector<double> u(hierarchy.ndof());
+    std::generate(u.begin(), u.end(),
+                  [&]() -> double { return distribution(generator); });
+    const mgard::CompressedDataset<2, double> compressed =
+        mgard::compress(hierarchy, u.data(), 1.0, 0.01);
+    const mgard::DecompressedDataset<2, double> decompressed =
+        mgard::decompress(compressed);
+    test_region_decompression<2, double>(compressed, decompressed, {140, 90},
+                                         {151, 97}, tracker);
+    test_region_decompression<2, double>(compressed, decompressed, {0, 5},
+                                         {289, 6}, tracker);
+    test_region_decompression<2, double>(compressed, decompressed, {271, 0},
+                                         {289, 200}, tracker);
+    test_region_decompression<2, double>(compressed, decompressed, {0, 0},
+                                         {289, 200}, tracker);
+  }
+  {
+    const mgard::TensorMeshHierarchy<3, double> hierarchy =
+        hierarchy_with_random_spacing(generator, node_spacing_distribution,
+                                      std::array<std::size_t, 3>{20, 1, 37});
+    std::vector<double> u(hierarchy.ndof());
+    std::generate(u.begin(), u.end(),
+                  [&]() -> double { return distribution(generator); });
+    const mgard::CompressedDataset<3, double> compressed =
+        mgard::compress(hierarchy, u.data(),
+                        std::numeric_limits<double>::infinity(), 0.001);
+    const mgard::DecompressedDataset<3, double> decompressed =
+        mgard::decompress(compressed);
+    test_region_decompression<3, double>(compressed, decompressed, {3, 0, 7},
+                                         {11, 0, 30}, tracker);
+    test_region_decompression<3, double>(compressed, decompressed, {19, 0, 0},
+                                         {19, 0, 1}, tracker);
+    REQUIRE_THROWS_AS((mgard::decompress_region<3, double>(
+                          compressed, {0, 0, 0}, {19, 1, 1})),
+                      std::out_of_range);
+    REQUIRE_THROWS_AS((mgard::decompress_region<3, double>(
+                          compressed, {5, 0, 0}, {4, 0, 1})),
+                      std::invalid_argument);
+  }
+  REQUIRE(tracker);
+}
+
+TEST_CASE("compression with a coarsest level", "[mgard_api]") {
+  std::default_random_engine generator(90121);
+  std::uniform_real_distribution<double> node_spacing_distribution(1, 2);
+  const mgard::TensorMeshHierarchy<2, double> hierarchy =
+      hierarchy_with_random_spacing(generator, node_spacing_distribution,
+                                    std::array<std::size_t, 2>{33, 19});
+  const std::size_t ndof = hierarchy.ndof();
+  const std::size_t l_target = 2;
+  std::vector<double> u(ndof);
+  std::vector<double> shuffled(ndof);
+  generate_reasonable_function(hierarchy, 0.5, generator, shuffled.data());
+  mgard::unshuffle(hierarchy, shuffled.data(), u.data());
+
+  TrialTracker tracker;
+  const std::vector<double> smoothness_parameters = {
+      -0.5, 0, 1, std::numeric_limits<double>::infinity()};
+  for (const double s : smoothness_parameters) {
+    const double tolerance = 0.01;
+    std::vector<double> v = u;
+    const mgard::CompressedDataset<2, double> compressed =
+        mgard::compress(hierarchy, v.data(), s, tolerance, l_target);
+    REQUIRE(compressed.l_target == l_target);
+    // The input is decomposed in place.
+    std::vector<double> coefficients = u;
+    mgard::DecompositionPlan<2, double>(hierarchy,
+                                        mgard::NodeOrdering::Unshuffled,
+                                        l_target)
+        .decompose(coefficients.data());
+    REQUIRE(v == coefficients);
+    const mgard::DecompressedDataset<2, double> decompressed =
+        mgard::decompress(compressed);
+    double const *const p = decompressed.data();
+
+    std::vector<double> error(ndof);
+    for (std::size_t i = 0; i < ndof; ++i) {
+      error.at(i) = u.at(i) - p[i];
+    }
+    mgard::shuffle(hierarchy, error.data(), shuffled.data());
+    tracker +=
+        mgard::norm(hierarchy, shuffled.data(), s, l_target) <= tolerance;
+
+    // The coarsest mesh is recorded in the compressed dataset.
+    {
+      unsigned char *const data = new unsigned char[compressed.size()];
+      std::memcpy(data, compressed.data(), compressed.size());
+      const mgard::CompressedDataset<2, double> rebuilt(
+          hierarchy, s, tolerance, data, compressed.size());
+      REQUIRE(rebuilt.l_target == l_target);
+      const mgard::DecompressedDataset<2, double> obtained =
+          mgard::decompress(rebuilt);
+      tracker +=
+          std::memcmp(obtained.data(), p, ndof * sizeof(double)) == 0;
+    }
+
+    // Decompressing onto a coarse mesh, whether or not it's coarser than the
+    // coarsest mesh of the decomposition, projects the function onto it.
+    for (std::size_t l = 0; l <= hierarchy.L; ++l) {
+      const mgard::DecompressedDataset<2, double> coarse =
+          mgard::decompress_to_level(compressed, l);
+      mgard::shuffle(hierarchy, p, shuffled.data());
+      mgard::decompose(hierarchy, shuffled.data(), l);
+      std::vector<double> expected(hierarchy.ndof(l));
+      mgard::unshuffle(coarse.hierarchy, shuffled.data(), expected.data());
+      for (std::size_t i = 0; i < expected.size(); ++i) {
+        tracker += coarse.data()[i] == Catch::Approx(expected.at(i));
+      }
+    }
+
+    const mgard::DecompressedDataset<2, double> region =
+        mgard::decompress_region(compressed, {10, 3}, {24, 11});
+    for (std::size_t i = 0; i < 15; ++i) {
+      for (std::size_t j = 0; j < 9; ++j) {
+        tracker += region.data()[i * 9 + j] ==
+                   Catch::Approx(p[(10 + i) * 19 + 3 + j]).margin(1e-12);
+      }
+    }
+  }
+  REQUIRE(tracker);
+
+  REQUIRE_THROWS_AS(mgard::compress(hierarchy, u.data(), 0.0, 0.01,
+                                    hierarchy.L + 1),
+                    std::out_of_range);
+
+  // A dataset can't be decomposed onto a mesh its hierarchy doesn't have.
+  {
+    std::vector<double> v = u;
+    const mgard::CompressedDataset<2, double> compressed =
+        mgard::compress(hierarchy, v.data(), 0.0, 0.01, hierarchy.L);
+    const mgard::TensorMeshHierarchy<2, double> coarse({5, 3});
+    unsigned char *const data = new unsigned char[compressed.size()];
+    std::memcpy(data, compressed.data(), compressed.size());
+    using Dataset = mgard::CompressedDataset<2, double>;
+    REQUIRE_THROWS_AS(Dataset(coarse, 0.0, 0.01, data, compressed.size()),
+                      std::invalid_argument);
+  }
+}
+
+TEST_CASE("lossless compressors", "[mgard_api]") {
+  std::default_random_engine generator(5413);
+  std::uniform_real_distribution<float> node_spacing_distribution(1, 3);
+  const mgard::TensorMeshHierarchy<2, float> hierarchy =
+      hierarchy_with_random_spacing(generator, node_spacing_distribution,
+                                    std::array<std::size_t, 2>{37, 26});
+  const std::size_t ndof = hierarchy.ndof();
+  std::vector<float> u(ndof);
+  std::vector<float> shuffled(ndof);
+  generate_reasonable_function(hierarchy, 1.0f, generator, shuffled.data());
+  mgard::unshuffle(hierarchy, shuffled.data(), u.data());
+  const float s = 0;
+  const float tolerance = 0.001;
+
+  std::vector<float> v = u;
+  const mgard::CompressedDataset<2, float> reference =
+      mgard::compress(hierarchy, v.data(), s, tolerance);
+  const mgard::DecompressedDataset<2, float> expected =
+      mgard::decompress(reference);
+  const mgard::DecompressedDataset<2, float> expected_region =
+      mgard::decompress_region(reference, {5, 7}, {20, 19});
+
+  std::vector<mgard::LosslessCompressor> compressors = {
+      mgard::LosslessCompressor::None, mgard::LosslessCompressor::Zlib,
+      mgard::LosslessCompressor::HuffmanZlib, mgard::LosslessCompressor::Fast};
+#ifdef MGARD_ZSTD
+  compressors.push_back(mgard::LosslessCompressor::Zstd);
+  compressors.push_back(mgard::LosslessCompressor::HuffmanZstd);
+#endif
+  for (const mgard::LosslessCompressor compressor : compressors) {
+    for (const int level : {0, 1}) {
+      v = u;
+      const mgard::CompressedDataset<2, float> compressed = mgard::compress(
+          hierarchy, v.data(), s, tolerance, 0, {compressor, level});
+      // The quantized coefficients are the same whatever the lossless
+      // compressor, so the decompressed datasets are too.
+      const mgard::DecompressedDataset<2, float> decompressed =
+          mgard::decompress(compressed);
+      REQUIRE(std::equal(decompressed.data(), decompressed.data() + ndof,
+                         expected.data()));
+      const mgard::DecompressedDataset<2, float> region =
+          mgard::decompress_region(compressed, {5, 7}, {20, 19});
+      REQUIRE(std::equal(region.data(), region.data() + 16 * 13,
+                         expected_region.data()));
+    }
+  }
+
+  {
+    v = u;
+    const mgard::CompressedDataset<2, float> raw =
+        mgard::compress(hierarchy, v.data(), s, tolerance, 0,
+                        {mgard::LosslessCompressor::None});
+    v = u;
+    const mgard::CompressedDataset<2, float> fast =
+        mgard::compress(hierarchy, v.data(), s, tolerance, 0,
+                        {mgard::LosslessCompressor::Fast});
+    REQUIRE(fast.size() < raw.size());
+  }
+
+  v = u;
+  REQUIRE_THROWS_AS(mgard::compress(hierarchy, v.data(), s, tolerance, 0,
+                                    {static_cast<mgard::LosslessCompressor>(
+                                        200)}),
+                    std::invalid_argument);
+#ifndef MGARD_ZSTD
+  REQUIRE_THROWS_AS(mgard::compress(hierarchy, v.data(), s, tolerance, 0,
+                                    {mgard::LosslessCompressor::HuffmanZstd}),
+                    std::invalid_argument);
+#endif
+
+  // `zlib`'s own default level is accepted, but levels it would reject are
+  // caught before anything is quantized.
+  v = u;
+  mgard::compress(hierarchy, v.data(), s, tolerance, 0,
+                  {mgard::LosslessCompressor::Zlib, -1});
+  for (const mgard::LosslessCompressor compressor :
+       {mgard::LosslessCompressor::Zlib,
+        mgard::LosslessCompressor::HuffmanZlib}) {
+    for (const int level : {10, -5}) {
+      const mgard::LosslessOptions options = {compressor, level};
+      v = u;
+      REQUIRE_THROWS_AS(
+          mgard::compress(hierarchy, v.data(), s, tolerance, 0, options),
+          std::invalid_argument);
+      REQUIRE_THROWS_AS(
+          mgard::compress_to_size(hierarchy, v.data(), s, 1000, 0, options),
+          std::invalid_argument);
+      REQUIRE_THROWS_AS(mgard::compress_tiled(hierarchy, u.data(), s,
+                                              tolerance, {10, 10}, options),
+                        std::invalid_argument);
+    }
+  }
+}
+
+TEST_CASE("replacing built-in lossless compressors", "[mgard_api]") {
+  std::default_random_engine generator(5417);
+  std::uniform_real_distribution<float> node_spacing_distribution(1, 3);
+  const mgard::TensorMeshHierarchy<2, float> hierarchy =
+      hierarchy_with_random_spacing(generator, node_spacing_distribution,
+                                    std::array<std::size_t, 2>{37, 26});
+  const std::size_t ndof = hierarchy.ndof();
+  std::vector<float> u(ndof);
+  std::vector<float> shuffled(ndof);
+  generate_reasonable_function(hierarchy, 1.0f, generator, shuffled.data());
+  mgard::unshuffle(hierarchy, shuffled.data(), u.data());
+
+  for (const mgard::LosslessCompressor compressor :
+       {mgard::LosslessCompressor::Zlib,
+        mgard::LosslessCompressor::HuffmanZlib}) {
+    const mgard::LosslessBackend builtin = mgard::lossless_backend(compressor);
+    // Every stage should go through the replacement, at the level requested.
+    std::size_t ncompressions = 0;
+    std::size_t ndecompressions = 0;
+    bool levels_passed = true;
+    mgard::LosslessBackend counting = builtin;
+    counting.compress = [&](void const *const data, const std::size_t size,
+                            const int level,
+                            std::vector<std::uint8_t> &output) {
+      ++ncompressions;
+      levels_passed = levels_passed && level == 3;
+      builtin.compress(data, size, level, output);
+    };
+    counting.compress_stream =
+        [&](const std::function<std::pair<void const *, std::size_t>()> &next,
+            const int level, std::vector<std::uint8_t> &output) {
+          ++ncompressions;
+          levels_passed = levels_passed && level == 3;
+          builtin.compress_stream(next, level, output);
+        };
+    counting.decompress = [&](void const *const src, const std::size_t size,
+                              void *const dst, const std::size_t dst_size) {
+      ++ndecompressions;
+      builtin.decompress(src, size, dst, dst_size);
+    };
+    counting.decompress_stream =
+        [&](void const *const src, const std::size_t size, void *const chunk,
+            const std::size_t chunk_size,
+            const std::function<void(std::size_t)> &consume) {
+          ++ndecompressions;
+          builtin.decompress_stream(src, size, chunk, chunk_size, consume);
+        };
+    mgard::register_lossless_compressor(compressor, counting);
+
+    std::vector<float> v = u;
+    const mgard::CompressedDataset<2, float> compressed =
+        mgard::compress(hierarchy, v.data(), 0.0f, 0.001f, 0, {compressor, 3});
+    REQUIRE(ncompressions >= hierarchy.L + 1);
+    REQUIRE(levels_passed);
+    mgard::decompress(compressed);
+    REQUIRE(ndecompressions >= hierarchy.L + 1);
+    ndecompressions = 0;
+    mgard::decompress_region(compressed, {5, 7}, {20, 19});
+    REQUIRE(ndecompressions >= hierarchy.L + 1);
+
+    mgard::register_lossless_compressor(compressor, builtin);
+  }
+}
+
+TEST_CASE("compression to a size", "[mgard_api]") {
+  std::default_random_engine generator(31337);
+  std::uniform_real_distribution<double> node_spacing_distribution(1, 2);
+  const mgard::TensorMeshHierarchy<2, double> hierarchy =
+      hierarchy_with_random_spacing(generator, node_spacing_distribution,
+                                    std::array<std::size_t, 2>{65, 70});
+  const std::size_t ndof = hierarchy.ndof();
+  std::vector<double> u(ndof);
+  {
+    std::vector<double> shuffled(ndof);
+    generate_reasonable_function(hierarchy, 0.5, generator, shuffled.data());
+    mgard::unshuffle(hierarchy, shuffled.data(), u.data());
+  }
+
+  // The coefficients are losslessly compressed only a few times, so the result
+  // can fall well under the budget after a correction, but not this far.
+  const double fraction = 0.4;
+  TrialTracker tracker;
+  const std::vector<double> smoothness_parameters = {
+      0, 1, std::numeric_limits<double>::infinity()};
+  // The fast compressor does much worse than the estimate.
+  const std::vector<mgard::LosslessOptions> lossless = {
+      {}, {mgard::LosslessCompressor::Fast}};
+  for (const mgard::LosslessOptions &options : lossless) {
+    for (const double s : smoothness_parameters) {
+      double previous = 0;
+      for (const std::size_t size : {8000, 3000, 1000}) {
+        std::vector<double> v = u;
+        const mgard::CompressedDataset<2, double> compressed =
+            mgard::compress_to_size(hierarchy, v.data(), s, size, 0, options);
+        tracker += fraction * size <= compressed.size() &&
+                   compressed.size() <= size;
+        // Smaller budgets call for larger tolerances.
+        tracker += compressed.tolerance > previous;
+        previous = compressed.tolerance;
+
+        v = u;
+        const mgard::CompressedDataset<2, double> expected = mgard::compress(
+            hierarchy, v.data(), s, compressed.tolerance, 0, options);
+        tracker += compressed.size() == expected.size() &&
+                   !std::memcmp(compressed.data(), expected.data(),
+                                expected.size());
+      }
+    }
+  }
+
+  // Smooth data, on which the lossless compressors do much better than the
+  // estimate.
+  const mgard::TensorMeshHierarchy<3, float> cube({33, 33, 33});
+  std::vector<float> w(cube.ndof());
+  {
+    std::vector<float> shuffled(cube.ndof());
+    generate_reasonable_function(cube, 3.0f, generator, shuffled.data());
+    mgard::unshuffle(cube, shuffled.data(), w.data());
+  }
+  for (const mgard::LosslessCompressor compressor :
+       {mgard::LosslessCompressor::Zlib,
+        mgard::LosslessCompressor::HuffmanZlib}) {
+    for (const std::size_t size : {20000, 5000}) {
+      std::vector<float> v = w;
+      const mgard::CompressedDataset<3, float> compressed =
+          mgard::compress_to_size(cube, v.data(), 0.0f, size, 0, {compressor});
+      tracker += fraction * size <= compressed.size() &&
+                 compressed.size() <= size;
+    }
+  }
+  REQUIRE(tracker);
+}
+
+TEST_CASE("tiled compression", "[mgard_api]") {
+  std::default_random_engine generator(80557);
+  std::uniform_real_distribution<double> node_spacing_distribution(1, 2);
+  std::uniform_real_distribution<double> distribution(-3, 3);
+  const mgard::TensorMeshHierarchy<3, double> hierarchy =
+      hierarchy_with_random_spacing(generator, node_spacing_distribution,
+                                    std::array<std::size_t, 3>{20, 1, 37});
+  const std::array<std::size_t, 3> &SHAPE = hierarchy.shapes.back();
+  std::vector<double> u(hierarchy.ndof());
+  std::generate(u.begin(), u.end(),
+                [&]() -> double { return distribution(generator); });
+
+  SECTION("tile layout") {
+    // The last tiles in the first and last dimensions would have only one
+    // node, so they're absorbed into their neighbors.
+    const mgard::TiledCompressedDataset<3, double> compressed =
+        mgard::compress_tiled(hierarchy, u.data(), 0.0, 0.1, {19, 1, 12});
+    REQUIRE(compressed.ntiles() == 3);
+    const std::array<std::size_t, 3> expected = {0, 0, 24};
+    REQUIRE(compressed.tile_lower_corner(2) == expected);
+    REQUIRE(compressed.tile(2).hierarchy.shapes.back() ==
+            std::array<std::size_t, 3>{20, 1, 13});
+    REQUIRE_THROWS_AS(compressed.tile(3), std::out_of_range);
+
+    // The index is checked before a tile is copied.
+    const auto copy = [&](const std::array<std::size_t, 3> &tile_shape,
+                          const std::size_t position,
+                          const unsigned char value) {
+      unsigned char *const data = new unsigned char[compressed.size()];
+      std::memcpy(data, compressed.data(), compressed.size());
+      data[position] = value;
+      return mgard::TiledCompressedDataset<3, double>(
+          hierarchy, 0.0, 0.1, tile_shape, data, compressed.size());
+    };
+    unsigned char const *const p =
+        static_cast<unsigned char const *>(compressed.data());
+    // Tag.
+    REQUIRE_THROWS_AS(copy({19, 1, 12}, 0, p[0] + 1).tile(0),
+                      std::invalid_argument);
+    // Version.
+    REQUIRE_THROWS_AS(copy({19, 1, 12}, 4, p[4] + 1).tile(0),
+                      std::invalid_argument);
+    // Number of tiles.
+    REQUIRE_THROWS_AS(copy({10, 1, 12}, 0, p[0]).tile(0),
+                      std::invalid_argument);
+    // Offsets out of order. The index starts after the tag and version, and
+    // its entries are little-endian.
+    REQUIRE_THROWS_AS(copy({19, 1, 12}, 5 + 2 * 8 + 7, 0xff).tile(1),
+                      std::invalid_argument);
+    // Offsets past the end of the dataset.
+    REQUIRE_THROWS_AS(copy({19, 1, 12}, 5 + 4 * 8 + 6, 0xff).tile(2),
+                      std::invalid_argument);
+    REQUIRE_NOTHROW(copy({19, 1, 12}, 0, p[0]).tile(2));
+    REQUIRE_THROWS_AS((mgard::compress_tiled<3, double>(
+                          hierarchy, u.data(), 0.0, 0.1, {1, 1, 12})),
+                      std::invalid_argument);
+  }
+
+  SECTION("decompression") {
+    const double tolerance = 0.01;
+    const mgard::TiledCompressedDataset<3, double> compressed =
+        mgard::compress_tiled(hierarchy, u.data(),
+                              std::numeric_limits<double>::infinity(),
+                              tolerance, {6, 4, 10});
+    REQUIRE(compressed.ntiles() == 4 * 1 * 4);
+    const mgard::DecompressedDataset<3, double> decompressed =
+        mgard::decompress(compressed);
+    double const *const v = decompressed.data();
+
+    TrialTracker tracker;
+    for (std::size_t i = 0; i < u.size(); ++i) {
+      tracker += std::abs(u.at(i) - v[i]) <= tolerance;
+    }
+    // Each tile can be decompressed on its own.
+    for (std::size_t t = 0; t < compressed.ntiles(); ++t) {
+      const std::array<std::size_t, 3> lower = compressed.tile_lower_corner(t);
+      const mgard::DecompressedDataset<3, double> tile =
+          mgard::decompress(compressed.tile(t));
+      const std::array<std::size_t, 3> &shape = tile.hierarchy.shapes.back();
+      double const *p = tile.data();
+      for (std::size_t i = 0; i < shape.at(0); ++i) {
+        for (std::size_t k = 0; k < shape.at(2); ++k) {
+          tracker +=
+              *p++ == v[(lower.at(0) + i) * SHAPE.at(2) + lower.at(2) + k];
+        }
+      }
+    }
+    REQUIRE(tracker);
+  }
+
+  SECTION("error of the whole function") {
+    const mgard::TensorMeshHierarchy<2, double> square({65, 65});
+    std::vector<double> w(square.ndof());
+    std::generate(w.begin(), w.end(),
+                  [&]() -> double { return distribution(generator); });
+    std::vector<double> error(square.ndof());
+    std::vector<double> shuffled(square.ndof());
+    const double tolerance = 0.1;
+    TrialTracker tracker;
+    for (const double s : {0.0, std::numeric_limits<double>::infinity()}) {
+      for (const std::size_t m : {2, 3, 8, 65}) {
+        const mgard::DecompressedDataset<2, double> decompressed =
+            mgard::decompress(
+                mgard::compress_tiled(square, w.data(), s, tolerance, {m, m}));
+        double const *const v = decompressed.data();
+        for (std::size_t i = 0; i < w.size(); ++i) {
+          error.at(i) = w.at(i) - v[i];
+        }
+        mgard::shuffle(square, error.data(), shuffled.data());
+        tracker += mgard::norm(square, shuffled.data(), s) <= tolerance;
+      }
+    }
+    REQUIRE(tracker);
+  }
+
+  SECTION("errors of the tiles") {
+    std::uniform_real_distribution<double> node_spacing_distribution(0.5, 3);
+    const mgard::TensorMeshHierarchy<2, double> rectangle =
+        hierarchy_with_random_spacing(generator, node_spacing_distribution,
+                                      std::array<std::size_t, 2>{40, 33});
+    std::vector<double> w(rectangle.ndof());
+    std::generate(w.begin(), w.end(),
+                  [&]() -> double { return distribution(generator); });
+    const double tolerance = 0.1;
+    const mgard::TiledCompressedDataset<2, double> compressed =
+        mgard::compress_tiled(rectangle, w.data(), 0.0, tolerance, {8, 12});
+    TrialTracker tracker;
+    // The square tolerances of the tiles add up to less than the square
+    // tolerance, leaving room for the elements between the tiles.
+    double square_tolerance = 0;
+    for (std::size_t t = 0; t < compressed.ntiles(); ++t) {
+      const mgard::CompressedDataset<2, double> tile = compressed.tile(t);
+      square_tolerance += tile.tolerance * tile.tolerance;
+
+      const std::array<std::size_t, 2> lower = compressed.tile_lower_corner(t);
+      const std::array<std::size_t, 2> &shape = tile.hierarchy.shapes.back();
+      const mgard::DecompressedDataset<2, double> decompressed =
+          mgard::decompress(tile);
+      std::vector<double> error(tile.hierarchy.ndof());
+      for (std::size_t i = 0; i < shape.at(0); ++i) {
+        for (std::size_t j = 0; j < shape.at(1); ++j) {
+          error.at(i * shape.at(1) + j) =
+              w.at((lower.at(0) + i) * 33 + lower.at(1) + j) -
+              decompressed.data()[i * shape.at(1) + j];
+        }
+      }
+      std::vector<double> shuffled(error.size());
+      mgard::shuffle(tile.hierarchy, error.data(), shuffled.data());
+      tracker +=
+          mgard::norm(tile.hierarchy, shuffled.data(), 0.0) <= tile.tolerance;
+    }
+    tracker += square_tolerance < tolerance * tolerance;
+
+    const mgard::DecompressedDataset<2, double> decompressed =
+        mgard::decompress(compressed);
+    std::vector<double> error(rectangle.ndof());
+    for (std::size_t i = 0; i < w.size(); ++i) {
+      error.at(i) = w.at(i) - decompressed.data()[i];
+    }
+    std::vector<double> shuffled(error.size());
+    mgard::shuffle(rectangle, error.data(), shuffled.data());
+    tracker += mgard::norm(rectangle, shuffled.data(), 0.0) <= tolerance;
+    REQUIRE(tracker);
+
+    // The errors on the tiles don't bound the error of the whole function for
+    // other smoothness parameters.
+    for (const double s : {-0.5, 1.0}) {
+      REQUIRE_THROWS_AS(
+          mgard::compress_tiled(rectangle, w.data(), s, tolerance, {8, 12}),
+          std::invalid_argument);
+    }
+  }
+}
+
 namespace {
 
 template <std::size_t N, std::size_t M, typename Real>
@@ -243,8 +1051,9 @@ TEST_CASE("compressing on 'flat' meshes", "[mgard_api]") {
   TrialTracker tracker;
   for (const float s : smoothness_parameters) {
     for (const float tolerance : tolerances) {
+      std::copy(u, u + ndof, v);
       const mgard::CompressedDataset<2, float> expected =
-          mgard::compress(hierarchy, u, s, tolerance);
+          mgard::compress(hierarchy, v, s, tolerance);
 
       test_compression_on_flat_mesh<2, 3, float>(hierarchy, u, expected,
                                                  {31, 8, 1}, v, tracker);
@@ -308,8 +1117,9 @@ TEST_CASE("decompressing on 'flat' meshes", "[mgard_api]") {
   TrialTracker tracker;
   for (const double s : smoothness_parameters) {
     for (const double tolerance : tolerances) {
+      std::copy(u, u + ndof, v);
       const mgard::CompressedDataset<3, double> compressed =
-          mgard::compress(hierarchy, u, s, tolerance);
+          mgard::compress(hierarchy, v, s, tolerance);
       const mgard::DecompressedDataset<3, double> expected =
           mgard::decompress(compressed);
 
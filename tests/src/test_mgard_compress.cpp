@@ -0,0 +1,490 @@
+#include "catch2/catch_test_macros.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "mgard_compress.hpp"
+
+namespace {
+
+template <typename Int>
+void test_huffman_round_trip(const std::vector<Int> &quantized) {
+  const std::size_t n = quantized.size();
+  unsigned char *hit;
+  std::size_t hit_size;
+  unsigned char *miss;
+  std::size_t miss_size;
+  unsigned char *tree;
+  std::size_t tree_size;
+  mgard::huffman_encoding(quantized.data(), n, &hit, &hit_size, &miss,
+                          &miss_size, &tree, &tree_size);
+
+  std::vector<Int> decoded(n);
+  mgard::huffman_decoding(decoded.data(), n, hit, hit_size, miss, miss_size,
+                          tree, tree_size);
+  REQUIRE(decoded == quantized);
+
+  std::free(hit);
+  std::free(miss);
+  std::free(tree);
+}
+
+template <typename Int>
+void test_memory_huffman_round_trip(
+    const std::vector<Int> &quantized,
+    const mgard::LosslessCompressor compressor) {
+  std::vector<unsigned char> scratch;
+  std::size_t size;
+  unsigned char *const compressed =
+      mgard::compress_memory_huffman(quantized, scratch, size, compressor);
+
+  std::vector<Int> decompressed(quantized.size());
+  mgard::decompress_memory_huffman(compressed, size, decompressed.data(),
+                                   decompressed.size(), compressor);
+  REQUIRE(decompressed == quantized);
+
+  std::free(compressed);
+}
+
+//! Huffman pipelines available in this build.
+std::vector<mgard::LosslessCompressor> huffman_pipelines() {
+  std::vector<mgard::LosslessCompressor> compressors = {
+      mgard::LosslessCompressor::HuffmanZlib};
+#ifdef MGARD_ZSTD
+  compressors.push_back(mgard::LosslessCompressor::HuffmanZstd);
+#endif
+  return compressors;
+}
+
+//! Generate quantized coefficients in which the `k`th most common value occurs
+//! about half as often as the `k - 1`th. The codes of the rarest values are
+//! longer than a decoding table probe.
+template <typename Int>
+std::vector<Int> skewed_coefficients(std::default_random_engine &gen) {
+  std::vector<Int> quantized;
+  for (std::size_t k = 0; k <= 16; ++k) {
+    const Int value = static_cast<Int>(k % 2 ? k : -static_cast<Int>(k));
+    quantized.insert(quantized.end(), std::size_t(1) << (16 - k), value);
+  }
+  std::shuffle(quantized.begin(), quantized.end(), gen);
+  return quantized;
+}
+
+} // namespace
+
+TEST_CASE("Huffman coding round trip", "[mgard_compress]") {
+  std::default_random_engine gen(718);
+
+  SECTION("long codes") {
+    test_huffman_round_trip(skewed_coefficients<std::int16_t>(gen));
+    test_huffman_round_trip(skewed_coefficients<std::int32_t>(gen));
+    test_huffman_round_trip(skewed_coefficients<long int>(gen));
+  }
+
+  SECTION("outliers") {
+    std::uniform_int_distribution<std::int32_t> dis(-1000000, 1000000);
+    std::vector<std::int32_t> quantized(5000);
+    for (std::int32_t &q : quantized) {
+      q = dis(gen) / 1000;
+    }
+    for (std::size_t i = 0; i < quantized.size(); i += 97) {
+      quantized.at(i) = dis(gen) * 100;
+    }
+    test_huffman_round_trip(quantized);
+  }
+
+  SECTION("multiple chunks") {
+    std::geometric_distribution<std::int32_t> dis(0.2);
+    std::vector<std::int32_t> quantized(3 * (1 << 18) + 1000);
+    for (std::int32_t &q : quantized) {
+      q = dis(gen);
+    }
+    // Outliers in only some of the chunks.
+    for (std::size_t i = 1 << 18; i < 2 * (1 << 18); i += 1001) {
+      quantized.at(i) = -1000000;
+    }
+    quantized.back() = 1000000;
+    test_huffman_round_trip(quantized);
+  }
+
+  SECTION("long tail") {
+    // With frequencies following the Fibonacci sequence, the optimal codes of
+    // the rarest values would be longer than the limit.
+    std::vector<std::int16_t> quantized;
+    std::size_t a = 1;
+    std::size_t b = 1;
+    for (std::int16_t k = 0; k < 30; ++k) {
+      quantized.insert(quantized.end(), a, k % 2 ? k : -k);
+      const std::size_t c = a + b;
+      a = b;
+      b = c;
+    }
+    std::shuffle(quantized.begin(), quantized.end(), gen);
+    test_huffman_round_trip(quantized);
+  }
+
+  SECTION("large levels") {
+    std::vector<long int> quantized(1000, 3);
+    quantized.at(10) = 65535;
+    quantized.at(20) = -65536;
+    quantized.at(30) = 1L << 20;
+    test_huffman_round_trip(quantized);
+  }
+
+  SECTION("levels too large for 32-bit integers") {
+    std::vector<long int> quantized(1000, -2);
+    quantized.at(10) = 1L << 31;
+    quantized.at(20) = -(1L << 31) - 1;
+    quantized.at(30) = 1L << 40;
+    quantized.at(40) = -(1L << 52) + 7;
+    test_huffman_round_trip(quantized);
+  }
+
+  SECTION("single value") {
+    test_huffman_round_trip(std::vector<std::int16_t>(100, -3));
+    test_huffman_round_trip(std::vector<long int>(1, 0));
+  }
+
+  SECTION("empty") { test_huffman_round_trip(std::vector<std::int32_t>()); }
+}
+
+TEST_CASE("Huffman code transmission", "[mgard_compress]") {
+  const std::vector<std::int32_t> quantized = {0, 0, 0, 0, 1, 1, -1, 7};
+  unsigned char *hit;
+  std::size_t hit_size;
+  unsigned char *miss;
+  std::size_t miss_size;
+  unsigned char *tree;
+  std::size_t tree_size;
+  mgard::huffman_encoding(quantized.data(), quantized.size(), &hit, &hit_size,
+                          &miss, &miss_size, &tree, &tree_size);
+  // Size of the dictionary, number of codes of each length up to 24, then one
+  // symbol per value.
+  REQUIRE(tree_size == (1 + 24 + 4) * sizeof(std::uint32_t));
+  std::uint32_t dictionary_size;
+  std::memcpy(&dictionary_size, tree, sizeof(dictionary_size));
+  REQUIRE(dictionary_size == 16);
+  // Chunk table (two 64-bit offsets) followed by one chunk. The codes have
+  // lengths 1, 2, 3, and 3, so the chunk fits in a word.
+  REQUIRE(hit_size == 4 * 32 + 32);
+  REQUIRE(miss_size == 0);
+
+  // Code tables which are truncated or disagree with their symbols are
+  // rejected.
+  std::vector<std::int32_t> decoded(quantized.size());
+  for (const std::size_t size :
+       {std::size_t(0), 24 * sizeof(std::uint32_t), tree_size - 1,
+        tree_size - sizeof(std::uint32_t)}) {
+    REQUIRE_THROWS_AS(mgard::huffman_decoding(decoded.data(), decoded.size(),
+                                              hit, hit_size, miss, miss_size,
+                                              tree, size),
+                      std::invalid_argument);
+  }
+
+  std::free(hit);
+  std::free(miss);
+  std::free(tree);
+}
+
+TEST_CASE("Huffman compression round trip", "[mgard_compress]") {
+  std::default_random_engine gen(2049);
+  for (const mgard::LosslessCompressor compressor : huffman_pipelines()) {
+    test_memory_huffman_round_trip(skewed_coefficients<std::int16_t>(gen),
+                                   compressor);
+    test_memory_huffman_round_trip(skewed_coefficients<long int>(gen),
+                                   compressor);
+
+    std::uniform_int_distribution<long int> dis(-(1L << 40), 1L << 40);
+    std::vector<long int> quantized(5000);
+    for (long int &q : quantized) {
+      q = dis(gen);
+    }
+    test_memory_huffman_round_trip(quantized, compressor);
+  }
+
+  // The second stage is the one recorded, not the one built in.
+  const std::vector<std::int16_t> quantized(100, 3);
+  std::vector<unsigned char> scratch;
+  std::size_t size;
+  std::vector<std::int16_t> decompressed(quantized.size());
+#ifndef MGARD_ZSTD
+  REQUIRE_THROWS_AS(
+      mgard::compress_memory_huffman(quantized, scratch, size,
+                                     mgard::LosslessCompressor::HuffmanZstd),
+      std::invalid_argument);
+#endif
+  unsigned char *const compressed = mgard::compress_memory_huffman(
+      quantized, scratch, size, mgard::LosslessCompressor::HuffmanZlib);
+  REQUIRE_THROWS_AS(
+      mgard::decompress_memory_huffman(compressed, size, decompressed.data(),
+                                       decompressed.size(),
+                                       mgard::LosslessCompressor::Zlib),
+      std::invalid_argument);
+  std::free(compressed);
+}
+
+TEST_CASE("Huffman compression of streamed coefficients",
+          "[mgard_compress]") {
+  std::default_random_engine gen(3011);
+  std::geometric_distribution<std::int16_t> dis(0.2);
+  // More than one batch of chunks, with a partial chunk at the end.
+  std::vector<std::int16_t> quantized(17 * (1 << 18) + 101);
+  for (std::int16_t &q : quantized) {
+    q = dis(gen) - 3;
+  }
+  quantized.at(5) = 30000;
+
+  for (const mgard::LosslessCompressor compressor : huffman_pipelines()) {
+    std::vector<unsigned char> scratch;
+    std::size_t size;
+    unsigned char *const expected =
+        mgard::compress_memory_huffman(quantized, scratch, size, compressor, 1);
+
+    // The coefficients are produced in consecutive ranges, twice over.
+    std::vector<unsigned char> output = {7};
+    std::size_t next = 0;
+    std::size_t npasses = 0;
+    bool consecutive = true;
+    mgard::compress_stream_huffman<std::int16_t>(
+        quantized.size(),
+        [&](const std::size_t begin, const std::size_t end,
+            std::int16_t *const chunk) {
+          if (!begin) {
+            ++npasses;
+            next = 0;
+          }
+          consecutive = consecutive && begin == next && end > begin;
+          next = end;
+          std::copy(quantized.begin() + begin, quantized.begin() + end, chunk);
+        },
+        output, compressor, 1);
+    REQUIRE(consecutive);
+    REQUIRE(npasses == 2);
+    REQUIRE(next == quantized.size());
+    // The output is appended.
+    REQUIRE(output.size() == size + 1);
+    REQUIRE(output.front() == 7);
+    REQUIRE(std::equal(expected, expected + size, output.begin() + 1));
+
+    std::vector<std::int16_t> decompressed(quantized.size());
+    mgard::decompress_memory_huffman(output.data() + 1, size,
+                                     decompressed.data(), decompressed.size(),
+                                     compressor);
+    REQUIRE(decompressed == quantized);
+    std::free(expected);
+  }
+}
+
+TEST_CASE("Huffman decompression at positions", "[mgard_compress]") {
+  std::default_random_engine gen(3001);
+  std::geometric_distribution<std::int32_t> dis(0.1);
+  std::vector<std::int32_t> quantized(5 * (1 << 18) + 17);
+  for (std::int32_t &q : quantized) {
+    q = dis(gen) - 5;
+  }
+  for (std::size_t i = 3 * (1 << 18); i < quantized.size(); i += 333) {
+    quantized.at(i) = 1 << 20;
+  }
+  std::vector<unsigned char> scratch;
+  std::size_t size;
+  unsigned char *const compressed = mgard::compress_memory_huffman(
+      quantized, scratch, size, mgard::LosslessCompressor::HuffmanZlib);
+
+  // Positions in the second, fourth, and last chunks only.
+  std::vector<std::size_t> positions = {(1 << 18) + 5, 2 * (1 << 18) - 1};
+  for (std::size_t i = 3 * (1 << 18); i < 4 * (1 << 18); i += 4099) {
+    positions.push_back(i);
+  }
+  positions.push_back(quantized.size() - 1);
+  std::vector<std::int32_t> selected(positions.size());
+  mgard::decompress_memory_huffman_at(compressed, size, quantized.size(),
+                                      positions, selected.data(),
+                                      mgard::LosslessCompressor::HuffmanZlib);
+  for (std::size_t k = 0; k < positions.size(); ++k) {
+    REQUIRE(selected.at(k) == quantized.at(positions.at(k)));
+  }
+
+  REQUIRE_THROWS_AS(mgard::decompress_memory_huffman_at(
+                        compressed, size, quantized.size(),
+                        {quantized.size()}, selected.data(),
+                        mgard::LosslessCompressor::HuffmanZlib),
+                    std::out_of_range);
+  // Too short to hold even the sizes of the Huffman buffers.
+  REQUIRE_THROWS_AS(mgard::decompress_memory_huffman_at(
+                        compressed, 2 * sizeof(std::size_t), quantized.size(),
+                        positions, selected.data(),
+                        mgard::LosslessCompressor::HuffmanZlib),
+                    std::invalid_argument);
+
+  std::free(compressed);
+}
+
+namespace {
+
+void test_lz_round_trip(const std::vector<unsigned char> &data) {
+  std::vector<std::uint8_t> compressed;
+  mgard::compress_memory_lz(data.data(), data.size(), compressed);
+  std::vector<unsigned char> decompressed(data.size());
+  mgard::decompress_memory_lz(compressed.data(), compressed.size(),
+                              decompressed.data(), decompressed.size());
+  REQUIRE(decompressed == data);
+}
+
+} // namespace
+
+TEST_CASE("fast lossless codec", "[mgard_compress]") {
+  std::default_random_engine gen(160);
+
+  SECTION("round trips") {
+    test_lz_round_trip({});
+    test_lz_round_trip({7});
+    test_lz_round_trip({1, 2, 3, 4, 1, 2, 3, 4, 1, 2, 3, 4, 1, 2, 3});
+
+    // Long runs, overlapping their own matches, and long runs of literals.
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::vector<unsigned char> data;
+    data.insert(data.end(), 100000, 0);
+    for (std::size_t i = 0; i < 70000; ++i) {
+      data.push_back(byte(gen));
+    }
+    data.insert(data.end(), data.begin() + 100000, data.begin() + 101000);
+    for (std::size_t i = 0; i < 5000; ++i) {
+      data.push_back(i % 3);
+    }
+    test_lz_round_trip(data);
+  }
+
+  SECTION("compression") {
+    // Small quantized coefficients repeat a lot.
+    std::geometric_distribution<std::int16_t> dis(0.3);
+    std::vector<std::int16_t> quantized(100000);
+    for (std::int16_t &q : quantized) {
+      q = dis(gen);
+    }
+    std::vector<std::uint8_t> compressed;
+    mgard::compress_memory_lz(quantized.data(),
+                              quantized.size() * sizeof(std::int16_t),
+                              compressed);
+    REQUIRE(compressed.size() < quantized.size() * sizeof(std::int16_t));
+  }
+
+  SECTION("corrupt data") {
+    const std::vector<unsigned char> data(1000, 5);
+    std::vector<std::uint8_t> compressed;
+    mgard::compress_memory_lz(data.data(), data.size(), compressed);
+    std::vector<unsigned char> decompressed(data.size());
+    REQUIRE_THROWS_AS(mgard::decompress_memory_lz(compressed.data(),
+                                                  compressed.size() - 1,
+                                                  decompressed.data(),
+                                                  decompressed.size()),
+                      std::invalid_argument);
+    REQUIRE_THROWS_AS(mgard::decompress_memory_lz(compressed.data(),
+                                                  compressed.size(),
+                                                  decompressed.data(),
+                                                  decompressed.size() - 1),
+                      std::invalid_argument);
+  }
+
+  SECTION("end of block rules") {
+    // Blocks shorter than thirteen bytes are all literals.
+    for (std::size_t n = 0; n < 13; ++n) {
+      const std::vector<unsigned char> data(n, 4);
+      std::vector<std::uint8_t> compressed;
+      mgard::compress_memory_lz(data.data(), data.size(), compressed);
+      REQUIRE(compressed.size() == n + 1);
+      test_lz_round_trip(data);
+    }
+    // The last five bytes are literals even when they repeat.
+    const std::vector<unsigned char> data(1000, 4);
+    std::vector<std::uint8_t> compressed;
+    mgard::compress_memory_lz(data.data(), data.size(), compressed);
+    const std::vector<std::uint8_t> tail = {5 << 4, 4, 4, 4, 4, 4};
+    REQUIRE(std::equal(tail.begin(), tail.end(), compressed.end() - 6));
+
+    // Four literals and a match of four, ending the block.
+    const std::vector<std::uint8_t> late_match = {4 << 4, 1, 2, 3, 4, 4, 0, 0};
+    std::vector<unsigned char> decompressed(8);
+    REQUIRE_THROWS_AS(mgard::decompress_memory_lz(
+                          late_match.data(), late_match.size(),
+                          decompressed.data(), decompressed.size()),
+                      std::invalid_argument);
+  }
+}
+
+TEST_CASE("zlib compression levels", "[mgard_compress]") {
+  const std::vector<unsigned char> data(1000, 9);
+  for (const int level : {-1, 1, 9}) {
+    std::vector<std::uint8_t> compressed;
+    mgard::compress_memory_z(const_cast<unsigned char *>(data.data()),
+                             data.size(), compressed, level);
+    std::vector<unsigned char> decompressed(data.size());
+    mgard::decompress_memory_z_huffman(compressed.data(), compressed.size(),
+                                       decompressed.data(),
+                                       decompressed.size());
+    REQUIRE(decompressed == data);
+  }
+  for (const int level : {10, -5}) {
+    std::vector<std::uint8_t> compressed;
+    REQUIRE_THROWS_AS(
+        mgard::compress_memory_z(const_cast<unsigned char *>(data.data()),
+                                 data.size(), compressed, level),
+        std::invalid_argument);
+    std::size_t k = 0;
+    REQUIRE_THROWS_AS(mgard::compress_stream_z(
+                          [&]() -> std::pair<void const *, std::size_t> {
+                            return {data.data(), k++ ? 0 : data.size()};
+                          },
+                          compressed, level),
+                      std::invalid_argument);
+  }
+}
+
+TEST_CASE("lossless compressor registry", "[mgard_compress]") {
+  const mgard::LosslessCompressor id =
+      static_cast<mgard::LosslessCompressor>(101);
+  REQUIRE_THROWS_AS(mgard::lossless_backend(id), std::invalid_argument);
+
+  // A compressor storing the bytes in reverse order.
+  mgard::register_lossless_compressor(
+      id, {[](void const *const data, const std::size_t size, int,
+              std::vector<std::uint8_t> &output) {
+             unsigned char const *const p =
+                 static_cast<unsigned char const *>(data);
+             output.assign(p, p + size);
+             std::reverse(output.begin(), output.end());
+           },
+           [](void const *const src, const std::size_t size, void *const dst,
+              std::size_t) {
+             unsigned char const *const p =
+                 static_cast<unsigned char const *>(src);
+             std::reverse_copy(p, p + size, static_cast<unsigned char *>(dst));
+           }});
+  const mgard::LosslessBackend &backend = mgard::lossless_backend(id);
+  const std::vector<unsigned char> data = {1, 2, 3};
+  std::vector<std::uint8_t> compressed;
+  backend.compress(data.data(), data.size(), 0, compressed);
+  REQUIRE(compressed == std::vector<std::uint8_t>{3, 2, 1});
+  std::vector<unsigned char> decompressed(3);
+  backend.decompress(compressed.data(), 3, decompressed.data(), 3);
+  REQUIRE(decompressed == data);
+
+  const std::vector<mgard::LosslessCompressor> builtins = {
+      mgard::LosslessCompressor::None, mgard::LosslessCompressor::Zlib,
+      mgard::LosslessCompressor::HuffmanZlib, mgard::LosslessCompressor::Fast};
+  for (const mgard::LosslessCompressor compressor : builtins) {
+    const mgard::LosslessBackend &builtin = mgard::lossless_backend(compressor);
+    std::vector<std::uint8_t> output;
+    builtin.compress(data.data(), data.size(), 0, output);
+    std::vector<unsigned char> restored(data.size());
+    builtin.decompress(output.data(), output.size(), restored.data(),
+                       restored.size());
+    REQUIRE(restored == data);
+  }
+}
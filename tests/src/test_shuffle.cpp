@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "TensorMeshHierarchy.hpp"
+#include "TensorMeshHierarchyIteration.hpp"
 #include "shuffle.hpp"
 
 #include "testing_utilities.hpp"
@@ -142,3 +143,54 @@ TEST_CASE("shuffle inversion", "[shuffle]") {
     test_inversion<3, double>({8, 20, 13});
   }
 }
+
+namespace {
+
+template <std::size_t N, typename Real>
+void test_shuffle_addressing(const std::array<std::size_t, N> shape) {
+  const mgard::TensorMeshHierarchy<N, Real> hierarchy(shape);
+  const std::size_t ndof = hierarchy.ndof();
+  std::vector<Real> u_(ndof);
+  for (std::size_t i = 0; i < ndof; ++i) {
+    u_.at(i) = static_cast<Real>(i);
+  }
+  Real const *const u = u_.data();
+
+  std::vector<Real> v_(ndof);
+  Real *const v = v_.data();
+
+  mgard::shuffle(hierarchy, u, v);
+  TrialTracker tracker;
+  Real const *p = u;
+  for (const mgard::TensorNode<N> node :
+       mgard::UnshuffledTensorNodeRange<N, Real>(hierarchy, hierarchy.L)) {
+    tracker += hierarchy.at(v, node.multiindex) == *p++;
+  }
+  REQUIRE(tracker);
+}
+
+} // namespace
+
+TEST_CASE("shuffle addressing", "[shuffle]") {
+  SECTION("nondyadic") {
+    test_shuffle_addressing<1, float>({100});
+    test_shuffle_addressing<2, double>({19, 70});
+    test_shuffle_addressing<3, float>({23, 10, 6});
+  }
+
+  SECTION("long last dimension") {
+    test_shuffle_addressing<1, double>({5000});
+    test_shuffle_addressing<2, float>({3, 9000});
+  }
+
+  SECTION("short last dimension") {
+    test_shuffle_addressing<2, float>({65, 3});
+    test_shuffle_addressing<3, double>({17, 9, 2});
+  }
+
+  SECTION("flat dimensions") {
+    test_shuffle_addressing<2, double>({31, 1});
+    test_shuffle_addressing<3, float>({1, 14, 1});
+    test_shuffle_addressing<4, double>({5, 1, 6, 9});
+  }
+}